@@ -27,7 +27,7 @@
 
 #include "alignment.h"
 
-Alignment::Alignment() {}
+Alignment::Alignment() : l(0), m(0), key(0) {}
 Alignment::Alignment(PositionIndex _l, PositionIndex _m)
     : a(_m+1, 0),
       positionSum(_l+1, 0), f(_l+1, 0),
@@ -39,6 +39,7 @@ Alignment::~Alignment() {}
 
 void Alignment::Init() {
   f[0] = m;
+  key = 0;
   for (PositionIndex j = 1; j <= m; ++j) {
     if (j > 1) als_j[j].prev = j - 1;
     if (j < m) als_j[j].next = j + 1;
@@ -46,6 +47,20 @@ void Alignment::Init() {
   als_i[0] = 1;
 }
 
+void Alignment::assign(const Alignment& x) {
+  MASSERT(l == x.l && m == x.m);
+  for (PositionIndex j = 0; j <= m; ++j) {
+    a[j] = x.a[j];
+    als_j[j] = x.als_j[j];
+  }
+  for (PositionIndex i = 0; i <= l; ++i) {
+    positionSum[i] = x.positionSum[i];
+    f[i] = x.f[i];
+    als_i[i] = x.als_i[i];
+  }
+  key = x.key;
+}
+
 std::ostream&operator<<(std::ostream& out, const Alignment& a) {
   const int m = a.a.size() - 1;
   const int l = a.f.size() - 1;
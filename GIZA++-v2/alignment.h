@@ -27,6 +27,7 @@
 #ifndef GIZAPP_ALIGNMENT_H_
 #define GIZAPP_ALIGNMENT_H_
 
+#include <stdint.h>
 #include "util/vector.h"
 #include "defs.h"
 #include "util/assert.h"
@@ -42,6 +43,7 @@ class Alignment {
   Vector<PositionIndex> positionSum,f;
 
   PositionIndex l, m;
+  uint64_t key;
 
   // TODO: make sure this is needed actually.
   friend class transpair_model5;
@@ -56,6 +58,21 @@ class Alignment {
 
   void Init();
 
+  // copies x into this alignment's storage; x must have the same l and m
+  void assign(const Alignment& x);
+
+  // Zobrist hash of the links, kept up to date by set(). Equal alignments
+  // have equal hashes; unaligned words contribute nothing.
+  uint64_t hash() const { return key; }
+
+  static uint64_t linkHash(PositionIndex j, PositionIndex i) {
+    if (i == 0) return 0;
+    uint64_t x = ((uint64_t(j) << 32) | i) * 0x9e3779b97f4a7c15ULL;
+    x ^= x >> 31;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    return x ^ (x >> 29);
+  }
+
   PositionIndex get_l() const { return l; }
   PositionIndex get_m() const { return m; }
 
@@ -165,6 +182,7 @@ inline void Alignment::set(PositionIndex j, PositionIndex aj) {
   MASSERT(f[old_aj] > 0);
   MASSERT(j > 0);
   positionSum[old_aj] -= j;
+  key ^= linkHash(j, old_aj) ^ linkHash(j, aj);
 
   // ausfuegen
   PositionIndex prev = als_j[j].prev;
@@ -207,6 +225,8 @@ inline void Alignment::set(PositionIndex j, PositionIndex aj) {
 
 inline bool operator==(const Alignment& a, const Alignment& b) {
   MASSERT(a.a.size() == b.a.size());
+  if (a.hash() != b.hash())
+    return false;
   for (PositionIndex j = 1; j <= a.get_m(); j++) {
     if (a(j) != b(j))
       return false;
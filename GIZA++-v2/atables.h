@@ -42,8 +42,9 @@
 #include "util/vector.h"
 #include <utility>
 #include <fstream>
-#include "util/array4.h"
+#include "util/array2.h"
 #include "util/assert.h"
+#include "util/binary_file.h"
 #include "globals.h"
 
 extern bool CompactADTable;
@@ -67,8 +68,38 @@ extern short NoEmptyWord;
 
 template <class VALTYPE>
 class AModel {
+ private:
+  template <class T> friend class AModel;
+
+  // The tables of the single (l,m) pairs share one store. A table is only
+  // allocated when written, with one row per first and one column per second
+  // position of the written sentence lengths. When CompactADTable merges the
+  // tables of several lengths, a longer sentence moves its table to the end
+  // of the store; pack() drops the space left behind.
+  struct Table {
+    int at;
+    unsigned int n1, n2;
+    Table() : at(-1), n1(0), n2(0) {}
+  };
+  vector<VALTYPE> store;
+  Array2<Table> tables;
+
+  unsigned int lengthL(WordIndex l) const { return (CompactADTable&&is_distortion)?MaxSentLength:(l+1); }
+  unsigned int lengthM(WordIndex m) const { return (CompactADTable&&!is_distortion)?MaxSentLength:(m+1); }
+
+  // makes table t at least n1 x n2
+  void place(Table&t, unsigned int n1, unsigned int n2) {
+    n1=max(n1,t.n1);
+    n2=max(n2,t.n2);
+    const int at=store.size();
+    store.resize(at+n1*n2,VALTYPE(0.0));
+    for (unsigned int x=0;x<t.n1;++x)
+      for (unsigned int y=0;y<t.n2;++y)
+        store[at+x*n2+y]=store[t.at+x*t.n2+y];
+    t.at=at;t.n1=n1;t.n2=n2;
+  }
+
  public:
-  Array4<VALTYPE> a;
   bool is_distortion;
   WordIndex MaxSentLength;
   bool ignoreL, ignoreM;
@@ -76,7 +107,7 @@ class AModel {
   static float smooth_factor;
 
   explicit AModel(bool flag)
-      : a(MAX_SENTENCE_LENGTH + 1, 0.0),
+      : tables(MAX_SENTENCE_LENGTH + 1, MAX_SENTENCE_LENGTH + 1),
         is_distortion(flag),
         MaxSentLength(MAX_SENTENCE_LENGTH) { }
 
@@ -86,14 +117,30 @@ class AModel {
     MASSERT( (!is_distortion) || aj<=m);MASSERT( (!is_distortion) || j<=l);MASSERT( (!is_distortion) || aj!=0);
     MASSERT( is_distortion    || aj<=l);MASSERT( is_distortion    || j<=m);MASSERT( (is_distortion) || j!=0);
     MASSERT( l<MaxSentLength);MASSERT( m<MaxSentLength);
-    return a.get(aj, j, (CompactADTable&&is_distortion)?MaxSentLength:(l+1),(CompactADTable&&!is_distortion)?MaxSentLength:(m+1));
+    const Table&t=tables(lengthL(l),lengthM(m));
+    if (aj>=t.n1||j>=t.n2)
+      return VALTYPE(0.0);
+    return store[t.at+aj*t.n2+j];
   }
 
   VALTYPE&getRef(WordIndex aj, WordIndex j, WordIndex l, WordIndex m) {
     MASSERT( (!is_distortion) || aj<=m);MASSERT( (!is_distortion) || j<=l);
     MASSERT( is_distortion    || aj<=l);MASSERT( is_distortion    || j<=m);MASSERT( (is_distortion) || j!=0);
     MASSERT( l<MaxSentLength);MASSERT( m<MaxSentLength);
-    return a(aj, j, (CompactADTable&&is_distortion)?MaxSentLength:(l+1),(CompactADTable&&!is_distortion)?MaxSentLength:(m+1));
+    Table&t=tables(lengthL(l),lengthM(m));
+    if (aj>=t.n1||j>=t.n2)
+      place(t,max(aj+1,is_distortion?m+1:l+1),max(j+1,is_distortion?l+1:m+1));
+    return store[t.at+aj*t.n2+j];
+  }
+
+  // bytes allocated by the table
+  size_t memoryBytes() const {
+    return store.capacity()*sizeof(VALTYPE)+size_t(tables.getLen1())*tables.getLen2()*sizeof(Table);
+  }
+
+  // false if no value for sentence lengths l and m was set
+  bool used(WordIndex l, WordIndex m) const {
+    return tables(lengthL(l),lengthM(m)).at>=0;
   }
 
   void setValue(WordIndex aj, WordIndex j, WordIndex l, WordIndex m, VALTYPE val) {
@@ -126,6 +173,12 @@ class AModel {
           continue;
         unsigned int L = ((CompactADTable&&is_distortion)?MaxSentLength:(l+1))-1;
         unsigned int M = ((CompactADTable&&!is_distortion)?MaxSentLength:(m+1))-1;
+        if (!used(L, M))
+          continue;
+        const Table&t=tables(lengthL(L),lengthM(M));
+        typename AModel<COUNT>::Table&to=aTable.tables(lengthL(L),lengthM(M));
+        if (t.n1>to.n1||t.n2>to.n2)
+          aTable.place(to,t.n1,t.n2);
         if (is_distortion == 0) {
           for (j = 1; j <= M; j++) {
             total = 0.0;
@@ -162,6 +215,7 @@ class AModel {
       }
     }
     cout << "A/D table contains " << nParam << " parameters.\n";
+    aTable.pack();
   }
 
   // Reads the a table from a file.
@@ -175,7 +229,53 @@ class AModel {
   // them in that order when hashing the fifth value.
   // NAS, 7/11/99
   void readTable(const char *filename);
-  void clear() { a.clear(); }
+
+  // drops the space of moved tables and the spare capacity of the store
+  void pack() {
+    size_t n=0;
+    for (unsigned int l=0;l<tables.getLen1();++l)
+      for (unsigned int m=0;m<tables.getLen2();++m)
+        n+=tables(l,m).n1*tables(l,m).n2;
+    vector<VALTYPE> packed;
+    packed.reserve(n);
+    for (unsigned int l=0;l<tables.getLen1();++l)
+      for (unsigned int m=0;m<tables.getLen2();++m) {
+        Table&t=tables(l,m);
+        if (t.at<0)
+          continue;
+        const int at=packed.size();
+        packed.insert(packed.end(),store.begin()+t.at,store.begin()+t.at+t.n1*t.n2);
+        t.at=at;
+      }
+    store.swap(packed);
+  }
+
+  void clear() {
+    pack();
+    fill(store.begin(),store.end(),VALTYPE(0.0));
+  }
+
+  // the table in the binary format of the training checkpoints
+  void writeBinary(util::BinaryWriter&out) const {
+    out.Put(MaxSentLength);
+    out.PutRange(&tables(0,0),tables.getLen1()*tables.getLen2());
+    out.PutArray(store);
+  }
+
+  bool readBinary(util::BinaryReader&in) {
+    WordIndex msl=0;
+    if (!in.Get(msl)||msl!=MaxSentLength)
+      return false;
+    if (!in.GetRangeInto(&tables(0,0),tables.getLen1()*tables.getLen2())||!in.GetArray(store))
+      return false;
+    for (unsigned int l=0;l<tables.getLen1();++l)
+      for (unsigned int m=0;m<tables.getLen2();++m) {
+        const Table&t=tables(l,m);
+        if (t.at>=0&&size_t(t.at)+size_t(t.n1)*t.n2>store.size())
+          return false;
+      }
+    return true;
+  }
 };
 
 #endif  // GIZAPP_ATABLES_H_
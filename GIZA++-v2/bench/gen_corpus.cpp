@@ -0,0 +1,51 @@
+/*
+  This file is part of GIZA++.
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307,
+  USA.
+*/
+
+/*
+  gen-corpus: writes a synthetic parallel corpus (see synthetic_corpus.h)
+  in the input formats of GIZA++, e.g.
+
+    gen-corpus -out DIR -pairs 10000 -zipf 1.1
+    GIZA++ -S DIR/e.vcb -T DIR/f.vcb -C DIR/e_f.snt -CoocurrenceFile DIR/e_f.cooc
+*/
+
+#include <cstdlib>
+#include <iostream>
+#include "bench/synthetic_corpus.h"
+#include "globals.h"
+#include "parameter.h"
+#include "util/util.h"
+
+int main(int argc, char* argv[]) {
+  string out = ".";
+  getGlobalParSet().insert(new Parameter<string>("out", ParameterChangedFlag, "directory of the corpus files", out, kParLevOutput));
+  Usage = string(argv[0]) + " [-out DIR] [-pairs N] [-sourceVocab N] [-targetVocab N] [-length X] [-lengthStddev X] [-zipf X] [-classes N] [-seed N]\n";
+  // parseArguments lists all parameters on stdout
+  streambuf* stdoutBuffer = cout.rdbuf(cerr.rdbuf());
+  if (argc > 1)
+    parseArguments(argc, argv);
+  cout.rdbuf(stdoutBuffer);
+  const SyntheticCorpus corpus;
+  if (!corpus.write(out)) {
+    cerr << "ERROR: can not write the corpus to " << out << '\n';
+    exit(1);
+  }
+  cout << "Wrote " << corpus.pairs().size() << " sentence pairs (" << corpus.description() << ") to " << out << '\n';
+  return 0;
+}
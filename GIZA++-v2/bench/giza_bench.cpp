@@ -0,0 +1,461 @@
+/*
+  This file is part of GIZA++.
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307,
+  USA.
+*/
+
+/*
+  giza-bench: times the inner kernels of the training on a synthetic
+  corpus (see synthetic_corpus.h). The tables are trained first by two
+  Model 1, one HMM and one Model 3 iteration; the Model 4 distortion
+  tables by the Model 3 neighbourhoods. Every kernel then runs over all
+  sentence pairs until -seconds have passed, -repeats times; the fastest
+  run is reported, one line per kernel:
+
+    kernel unit ns/op ops/s
+
+  With -baseline FILE (a saved output of giza-bench) the ns/op of the
+  baseline and the change are added, and kernels more than -tolerance
+  percent slower are marked SLOWER. -kernels a,b,... runs only the named
+  kernels. The corpus options are those of gen-corpus.
+
+    make bench
+    ./bench/giza-bench > bench.txt
+    make bench BENCHFLAGS="-baseline bench.txt"
+*/
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include "bench/synthetic_corpus.h"
+#include "coll_counts.h"
+#include "d4tables.h"
+#include "forward_backward.h"
+#include "globals.h"
+#include "hmm.h"
+#include "ibm_model1.h"
+#include "ibm_model2.h"
+#include "ibm_model3.h"
+#include "move_swap_matrix.h"
+#include "parameter.h"
+#include "transpair_model3.h"
+#include "transpair_model4.h"
+#include "util/dictionary.h"
+#include "util/perplexity.h"
+#include "util/util.h"
+#include "vocab.h"
+
+// the templates of collectCountsOverNeighborhood
+#include "coll_counts.cpp"
+
+GLOBAL_PARAMETER(double,BenchSeconds,"seconds","minimum time of one measurement of a kernel",kParLevSpecial,0.5);
+GLOBAL_PARAMETER(int,BenchRepeats,"repeats","measurements of each kernel; the fastest is reported",kParLevSpecial,3);
+GLOBAL_PARAMETER(double,BenchTolerance,"tolerance","percent by which a kernel may be slower than the baseline before it is marked",kParLevSpecial,10.0);
+
+string BenchBaseline, BenchKernels;
+
+namespace {
+
+volatile double sink;
+
+class Kernel {
+ public:
+  Kernel(const char* name, const char* unit) : name_(name), unit_(unit) {}
+  virtual ~Kernel() {}
+
+  const char* name() const { return name_; }
+  const char* unit() const { return unit_; }
+
+  // untimed work before each run
+  virtual void prepare() {}
+
+  // one run over all sentence pairs; returns the number of operations
+  virtual unsigned long long run() = 0;
+
+ private:
+  const char* name_;
+  const char* unit_;
+};
+
+class TTableFind : public Kernel {
+ public:
+  TTableFind(const TModel<COUNT, PROB>& tTable, const Vector<SentencePair>& pairs)
+      : Kernel("ttable_find", "lookup"), tTable_(tTable), pairs_(pairs) {}
+
+  unsigned long long run() {
+    unsigned long long ops = 0;
+    double sum = 0;
+    for (unsigned int n = 0; n < pairs_.size(); ++n) {
+      const Vector<WordIndex>& es = pairs_[n].eSent;
+      const Vector<WordIndex>& fs = pairs_[n].fSent;
+      for (unsigned int j = 1; j < fs.size(); ++j)
+        for (unsigned int i = 0; i < es.size(); ++i) {
+          const LpPair<COUNT, PROB>* p = tTable_.find(es[i], fs[j]);
+          sum += p ? p->prob : 0;
+        }
+      ops += es.size() * (fs.size() - 1);
+    }
+    sink = sum;
+    return ops;
+  }
+
+ private:
+  const TModel<COUNT, PROB>& tTable_;
+  const Vector<SentencePair>& pairs_;
+};
+
+class MakeHMMNetwork : public Kernel {
+ public:
+  MakeHMMNetwork(const HMM& h, const Vector<SentencePair>& pairs)
+      : Kernel("make_hmm_network", "pair"), h_(h), pairs_(pairs) {}
+
+  unsigned long long run() {
+    double sum = 0;
+    for (unsigned int n = 0; n < pairs_.size(); ++n) {
+      HMMNetwork* net = h_.makeHMMNetwork(pairs_[n].eSent, pairs_[n].fSent, false);
+      sum += net->logFinalMultiply;
+      delete net;
+    }
+    sink = sum;
+    return pairs_.size();
+  }
+
+ private:
+  const HMM& h_;
+  const Vector<SentencePair>& pairs_;
+};
+
+class ForwardBackward : public Kernel {
+ public:
+  explicit ForwardBackward(const Vector<HMMNetwork*>& nets)
+      : Kernel("forward_backward", "pair"), nets_(nets) {}
+
+  unsigned long long run() {
+    double sum = 0;
+    Array<double> gamma;
+    for (unsigned int n = 0; n < nets_.size(); ++n) {
+      Array<Array2<double> > epsilon(max(1, int(nets_[n]->e.size())));
+      sum += ForwardBackwardTraining(*nets_[n], gamma, epsilon);
+    }
+    sink = sum;
+    return nets_.size();
+  }
+
+ private:
+  const Vector<HMMNetwork*>& nets_;
+};
+
+class RealViterbi : public Kernel {
+ public:
+  explicit RealViterbi(const Vector<HMMNetwork*>& nets)
+      : Kernel("hmm_viterbi", "pair"), nets_(nets) {}
+
+  unsigned long long run() {
+    double sum = 0;
+    Array<int> vit;
+    for (unsigned int n = 0; n < nets_.size(); ++n)
+      sum += HMMRealViterbi(*nets_[n], vit);
+    sink = sum;
+    return nets_.size();
+  }
+
+ private:
+  const Vector<HMMNetwork*>& nets_;
+};
+
+// the sentence pairs of a model with their starting alignments
+template<class TRANSPAIR>
+class HillClimbingInput {
+ public:
+  template<class A>
+  HillClimbingInput(IBMModel3& m3, A* dm, const Vector<SentencePair>& pairs)
+      : pairs_(pairs), ef_(pairs.size()), start_(pairs.size()) {
+    for (unsigned int n = 0; n < pairs_.size(); ++n) {
+      const Vector<WordIndex>& es = pairs_[n].eSent;
+      const Vector<WordIndex>& fs = pairs_[n].fSent;
+      ef_[n] = new TRANSPAIR(es, fs, m3.tTable, m3.aTable, m3.dTable, m3.nTable, m3.p1, m3.p0, dm);
+      start_[n] = new Alignment(PositionIndex(es.size() - 1), PositionIndex(fs.size() - 1));
+      m3.viterbi_model2(*ef_[n], *start_[n], int(n));
+    }
+  }
+
+  ~HillClimbingInput() {
+    for (unsigned int n = 0; n < ef_.size(); ++n) {
+      delete ef_[n];
+      delete start_[n];
+    }
+  }
+
+  unsigned int size() const { return (unsigned int)pairs_.size(); }
+  Vector<SentencePair>& pairs() { return pairs_; }
+  const TRANSPAIR& ef(unsigned int n) const { return *ef_[n]; }
+  const Alignment& start(unsigned int n) const { return *start_[n]; }
+
+ private:
+  Vector<SentencePair> pairs_;
+  Vector<TRANSPAIR*> ef_;
+  Vector<Alignment*> start_;
+};
+
+template<class TRANSPAIR>
+void deleteMatrices(Vector<MoveSwapMatrix<TRANSPAIR>*>& msc) {
+  for (unsigned int n = 0; n < msc.size(); ++n)
+    delete msc[n];
+  msc.clear();
+}
+
+template<class TRANSPAIR>
+class MoveSwapMatrixConstruction : public Kernel {
+ public:
+  MoveSwapMatrixConstruction(const char* name, const HillClimbingInput<TRANSPAIR>& in)
+      : Kernel(name, "pair"), in_(in) {}
+
+  unsigned long long run() {
+    double sum = 0;
+    for (unsigned int n = 0; n < in_.size(); ++n) {
+      MoveSwapMatrix<TRANSPAIR> msc(in_.ef(n), in_.start(n));
+      sum += msc.fert(0);
+    }
+    sink = sum;
+    return in_.size();
+  }
+
+ private:
+  const HillClimbingInput<TRANSPAIR>& in_;
+};
+
+template<class TRANSPAIR>
+class HillClimb : public Kernel {
+ public:
+  HillClimb(const char* name, const HillClimbingInput<TRANSPAIR>& in)
+      : Kernel(name, "pair"), in_(in) {}
+  ~HillClimb() { deleteMatrices(msc_); }
+
+  void prepare() {
+    deleteMatrices(msc_);
+    for (unsigned int n = 0; n < in_.size(); ++n)
+      msc_.push_back(new MoveSwapMatrix<TRANSPAIR>(in_.ef(n), in_.start(n)));
+  }
+
+  unsigned long long run() {
+    double sum = 0;
+    for (unsigned int n = 0; n < msc_.size(); ++n)
+      sum += hillClimb_std(*msc_[n]);
+    sink = sum;
+    return msc_.size();
+  }
+
+ private:
+  const HillClimbingInput<TRANSPAIR>& in_;
+  Vector<MoveSwapMatrix<TRANSPAIR>*> msc_;
+};
+
+// Collects the counts of the neighbourhoods of the hill climbed
+// alignments into the count tables of 'm3' and into 'd4m'.
+template<class TRANSPAIR>
+class NeighbourhoodCounts : public Kernel {
+ public:
+  NeighbourhoodCounts(const char* name, HillClimbingInput<TRANSPAIR>& in, IBMModel3& m3, d4model* d4m)
+      : Kernel(name, "pair"), in_(in), m3_(m3), d4m_(d4m), centers_(in.size()) {
+    for (unsigned int n = 0; n < in_.size(); ++n) {
+      MoveSwapMatrix<TRANSPAIR>* msc = new MoveSwapMatrix<TRANSPAIR>(in_.ef(n), in_.start(n));
+      centers_[n].push_back(make_pair(msc, hillClimb_std(*msc)));
+    }
+  }
+
+  ~NeighbourhoodCounts() {
+    for (unsigned int n = 0; n < centers_.size(); ++n)
+      delete centers_[n][0].first;
+  }
+
+  unsigned long long run() {
+    LogProb total = 0;
+    for (unsigned int n = 0; n < centers_.size(); ++n) {
+      SentencePair& s = in_.pairs()[n];
+      collectCountsOverNeighborhood(centers_[n], s.eSent, s.fSent, m3_.tTable, m3_.aCountTable,
+                                    m3_.dCountTable, m3_.nCountTable, m3_.p1_count, m3_.p0_count,
+                                    total, float(s.getCount()), true, d4m_);
+    }
+    sink = total;
+    return centers_.size();
+  }
+
+ private:
+  HillClimbingInput<TRANSPAIR>& in_;
+  IBMModel3& m3_;
+  d4model* d4m_;
+  Vector<Vector<pair<MoveSwapMatrix<TRANSPAIR>*, LogProb> > > centers_;
+};
+
+double seconds(std::chrono::steady_clock::time_point since) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - since).count();
+}
+
+// the fastest of -repeats measurements, in nanoseconds per operation
+double measure(Kernel& kernel) {
+  double best = 0;
+  for (int r = 0; r < max(1, int(BenchRepeats)); ++r) {
+    unsigned long long ops = 0;
+    double elapsed = 0;
+    do {
+      kernel.prepare();
+      const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      ops += kernel.run();
+      elapsed += seconds(start);
+    } while (elapsed < BenchSeconds);
+    const double nsPerOp = elapsed * 1e9 / double(max(ops, 1ULL));
+    if (r == 0 || nsPerOp < best)
+      best = nsPerOp;
+  }
+  return best;
+}
+
+// the ns/op of the kernels of a saved output
+map<string, double> readBaseline(const string& filename) {
+  map<string, double> baseline;
+  ifstream in(filename.c_str());
+  if (!in) {
+    cerr << "ERROR: can not read the baseline " << filename << '\n';
+    exit(1);
+  }
+  string line, name, unit;
+  double nsPerOp;
+  while (getline(in, line)) {
+    istringstream fields(line);
+    if (line.length() && line[0] != '#' && fields >> name >> unit >> nsPerOp)
+      baseline[name] = nsPerOp;
+  }
+  return baseline;
+}
+
+bool selected(const string& name) {
+  if (BenchKernels.empty())
+    return true;
+  const string list = "," + BenchKernels + ",";
+  return list.find("," + name + ",") != string::npos;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+  getGlobalParSet().insert(new Parameter<string>("baseline", ParameterChangedFlag, "saved output of giza-bench to compare with", BenchBaseline, kParLevInput));
+  getGlobalParSet().insert(new Parameter<string>("kernels", ParameterChangedFlag, "comma separated kernels to run (default: all)", BenchKernels, kParLevSpecial));
+  Usage = string(argv[0]) + " [-seconds X] [-repeats N] [-baseline FILE] [-kernels a,b,...] [corpus options of gen-corpus]\n";
+  // the training writes its messages to stdout; the results go to the
+  // real stdout at the end
+  ostream results(cout.rdbuf());
+  ofstream null("/dev/null");
+  cout.rdbuf(null.rdbuf());
+  initGlobals();
+  if (argc > 1)
+    parseArguments(argc, argv);
+  const map<string, double> baseline = BenchBaseline.length() ? readBaseline(BenchBaseline) : map<string, double>();
+
+  const SyntheticCorpus synthetic;
+  const string dir = makeScratchDirectory("giza-bench");
+  if (dir.empty() || !synthetic.write(dir)) {
+    cerr << "ERROR: can not write the corpus to " << dir << '\n';
+    exit(1);
+  }
+  g_source_vocab_filename = dir + "/e.vcb";
+  g_target_vocab_filename = dir + "/f.vcb";
+  CorpusFilename = dir + "/e_f.snt";
+  CoocurrenceFile = dir + "/e_f.cooc";
+  g_prefix = dir + "/bench";
+  NODUMPS = true;
+
+  VocabList eVcbList, fVcbList;
+  eVcbList.setName(g_source_vocab_filename.c_str());
+  fVcbList.setName(g_target_vocab_filename.c_str());
+  eVcbList.readVocabList();
+  fVcbList.readVocabList();
+  globeTrainVcbList = &eVcbList;
+  globfTrainVcbList = &fVcbList;
+  SentenceHandler corpus(CorpusFilename.c_str(), &eVcbList, &fVcbList);
+  g_lambda = double(fVcbList.totalVocab()) / (eVcbList.totalVocab() - corpus.getTotalNoPairs2());
+  Perplexity perp[4];
+  util::Dictionary dictionary;
+  TModel<COUNT, PROB> tTable(CoocurrenceFile);
+  IBMModel1 m1(CorpusFilename.c_str(), eVcbList, fVcbList, tTable, perp[0], corpus, &perp[1], 0, perp[2], &perp[3]);
+  AModel<PROB> aTable(false);
+  AModel<COUNT> aCountTable(false);
+  IBMModel2 m2(m1, aTable, aCountTable);
+  HMM h(m2);
+  IBMModel3 m3(m2);
+  m1.em_with_tricks(2, false, dictionary, false);
+  h.makeWordClasses(m1.Elist, m1.Flist, dir + "/e.vcb.classes", dir + "/f.vcb.classes");
+  h.initialize_table_uniformly(corpus);
+  h.em_with_tricks(1);
+  m3.setHMM(&h);
+  m3.viterbi(1, 0, 0, 0);
+
+  const Vector<SentencePair>& pairs = synthetic.pairs();
+  d4model d4m(MAX_SENTENCE_LENGTH);
+  d4m.makeWordClasses(m1.Elist, m1.Flist, dir + "/e.vcb.classes", dir + "/f.vcb.classes");
+  HillClimbingInput<transpair_model3> in3(m3, static_cast<void*>(0), pairs);
+  NeighbourhoodCounts<transpair_model3> counts3("neighbourhood_counts_3", in3, m3, &d4m);
+  counts3.run();
+  d4m.normalizeTable();
+  HillClimbingInput<transpair_model4> in4(m3, &d4m, pairs);
+  NeighbourhoodCounts<transpair_model4> counts4("neighbourhood_counts_4", in4, m3, &d4m);
+  removeScratchDirectory(dir);
+
+  Vector<HMMNetwork*> nets;
+  for (unsigned int n = 0; n < pairs.size(); ++n)
+    nets.push_back(h.makeHMMNetwork(pairs[n].eSent, pairs[n].fSent, false));
+  TTableFind find(tTable, pairs);
+  MakeHMMNetwork makeNetwork(h, pairs);
+  ForwardBackward forwardBackward(nets);
+  RealViterbi viterbi(nets);
+  MoveSwapMatrixConstruction<transpair_model3> construct3("move_swap_matrix_3", in3);
+  HillClimb<transpair_model3> climb3("hill_climb_3", in3);
+  MoveSwapMatrixConstruction<transpair_model4> construct4("move_swap_matrix_4", in4);
+  HillClimb<transpair_model4> climb4("hill_climb_4", in4);
+  Kernel* kernels[] = {&find, &makeNetwork, &forwardBackward, &viterbi, &construct3, &climb3,
+                       &counts3, &construct4, &climb4, &counts4};
+
+  results << "# giza-bench " << synthetic.description() << " seconds=" << BenchSeconds
+          << " repeats=" << BenchRepeats << '\n'
+          << "# kernel                 unit          ns/op          ops/s";
+  if (baseline.size())
+    results << "  baseline-ns/op   change";
+  results << '\n';
+  for (unsigned int k = 0; k < sizeof(kernels) / sizeof(kernels[0]); ++k) {
+    Kernel& kernel = *kernels[k];
+    if (!selected(kernel.name()))
+      continue;
+    const double nsPerOp = measure(kernel);
+    results << left << setw(24) << kernel.name() << ' ' << setw(8) << kernel.unit() << right
+            << fixed << setprecision(2) << setw(12) << nsPerOp << ' '
+            << setprecision(0) << setw(14) << 1e9 / nsPerOp;
+    const map<string, double>::const_iterator b = baseline.find(kernel.name());
+    if (b != baseline.end()) {
+      const double change = 100.0 * (nsPerOp - b->second) / b->second;
+      results << ' ' << setprecision(2) << setw(16) << b->second << ' ' << showpos
+              << setprecision(1) << setw(7) << change << '%' << noshowpos;
+      if (change > BenchTolerance)
+        results << " SLOWER";
+    }
+    results << endl;
+  }
+  for (unsigned int n = 0; n < nets.size(); ++n)
+    delete nets[n];
+  cout.rdbuf(results.rdbuf());
+  return 0;
+}
@@ -0,0 +1,330 @@
+/*
+  This file is part of GIZA++.
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307,
+  USA.
+*/
+
+/*
+  giza-regress: runs the GIZA++ binary (-giza, default ./GIZA++) with
+  -telemetry 1 on a synthetic corpus (see synthetic_corpus.h) through a
+  short schedule, -runs times, and compares the result with a reference
+  (-reference FILE):
+
+  - the training and Viterbi perplexities of every iteration have to be
+    within -perplexityTolerance (relative) of the reference;
+  - the pairs per second of every stage, of the fastest run, may be at
+    most -maxSlowdown percent lower, and the peak resident set size at
+    most -maxMemoryGrowth percent higher than in the reference.
+
+  The exit status is 1 if a check fails. -writeReference 1 writes the
+  result to the reference file instead. The stage lines of a reference
+  hold timings of one machine; without them only the perplexities are
+  checked. So bench/regress.ref keeps only the perplexities, and a
+  throughput reference is recorded locally before a change:
+
+    make regress REGRESSFLAGS="-writeReference 1 -reference /tmp/before.ref"
+    ... change and rebuild ...
+    make regress REGRESSFLAGS="-reference /tmp/before.ref"
+*/
+
+#include <sys/wait.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include "bench/synthetic_corpus.h"
+#include "globals.h"
+#include "parameter.h"
+#include "util/util.h"
+
+GLOBAL_PARAMETER(int,RegressRuns,"runs","training runs; the fastest of each stage counts",kParLevSpecial,3);
+GLOBAL_PARAMETER(double,RegressMaxSlowdown,"maxSlowdown","percent by which the pairs per second of a stage may drop",kParLevSpecial,20.0);
+GLOBAL_PARAMETER(double,RegressMaxMemoryGrowth,"maxMemoryGrowth","percent by which the peak resident set size of a stage may grow",kParLevSpecial,20.0);
+GLOBAL_PARAMETER(double,RegressPerplexityTolerance,"perplexityTolerance","relative deviation of a perplexity from the reference that is accepted",kParLevSpecial,1e-3);
+GLOBAL_PARAMETER(bool,RegressWriteReference,"writeReference","1: write the result to the reference file instead of comparing",kParLevSpecial,0);
+
+string RegressGiza = "./GIZA++", RegressReference = "bench/regress.ref";
+
+namespace {
+
+const char* const kSchedule = "-m1 2 -m2 0 -mh 2 -m3 1 -m4 1 -m5 0";
+
+struct Stage {
+  int iterations;
+  double seconds;
+  double pairs;
+  double peakRss;
+};
+
+struct Result {
+  string corpus, schedule;
+  // in the order of the training
+  vector<pair<string, Stage> > stages;
+  // "iteration model" -> training and Viterbi training perplexity
+  vector<pair<string, pair<double, double> > > perplexities;
+};
+
+// the index of a stage in r.stages, or -1
+int findStage(const Result& r, const string& name) {
+  for (unsigned int i = 0; i < r.stages.size(); ++i)
+    if (r.stages[i].first == name)
+      return int(i);
+  return -1;
+}
+
+// the number after "key": in a line of prefix.telemetry
+double jsonNumber(const string& line, const string& key) {
+  const string::size_type p = line.find("\"" + key + "\":");
+  return p == string::npos ? 0 : atof(line.c_str() + p + key.length() + 3);
+}
+
+string jsonString(const string& line, const string& key) {
+  const string::size_type p = line.find("\"" + key + "\":\"");
+  if (p == string::npos)
+    return "";
+  const string::size_type start = p + key.length() + 4;
+  return line.substr(start, line.find('"', start) - start);
+}
+
+bool readTelemetry(const string& filename, Result& r) {
+  ifstream in(filename.c_str());
+  string line;
+  while (getline(in, line)) {
+    const string name = jsonString(line, "stage");
+    if (findStage(r, name) < 0) {
+      const Stage empty = {0, 0, 0, 0};
+      r.stages.push_back(make_pair(name, empty));
+    }
+    Stage& s = r.stages[findStage(r, name)].second;
+    s.iterations++;
+    // "total":{"wall_seconds":...} is the first wall_seconds of a line
+    s.seconds += jsonNumber(line, "wall_seconds");
+    s.pairs += jsonNumber(line, "pairs");
+    s.peakRss = max(s.peakRss, jsonNumber(line, "peak_rss_bytes"));
+  }
+  return r.stages.size() > 0;
+}
+
+bool readPerplexities(const string& filename, Result& r) {
+  ifstream in(filename.c_str());
+  string line, model, testPP, testViterbiPP;
+  int trainSize, testSize, it;
+  double trainPP, trainViterbiPP;
+  while (getline(in, line)) {
+    istringstream fields(line);
+    if (line.length() && line[0] != '#' &&
+        fields >> trainSize >> testSize >> it >> model >> trainPP >> testPP >> trainViterbiPP) {
+      ostringstream key;
+      key << it << ' ' << model;
+      r.perplexities.push_back(make_pair(key.str(), make_pair(trainPP, trainViterbiPP)));
+    }
+  }
+  return r.perplexities.size() > 0;
+}
+
+// one training run in 'dir'
+bool train(const string& dir, Result& r) {
+  const string command = "'" + RegressGiza + "' -S " + dir + "/e.vcb -T " + dir + "/f.vcb -C " + dir +
+      "/e_f.snt -CoocurrenceFile " + dir + "/e_f.cooc -o " + dir + "/r " + kSchedule +
+      " -telemetry 1 > " + dir + "/r.out 2>&1";
+  const int status = system(command.c_str());
+  if (status == -1 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    cerr << "ERROR: " << RegressGiza << " failed; see " << dir << "/r.out\n";
+    return false;
+  }
+  if (!readTelemetry(dir + "/r.telemetry", r) || !readPerplexities(dir + "/r.perp", r)) {
+    cerr << "ERROR: " << RegressGiza << " wrote no telemetry or perplexities; is it built from this tree?\n";
+    return false;
+  }
+  return true;
+}
+
+void writeResult(ostream& out, const Result& r) {
+  out << setprecision(10);
+  out << "corpus " << r.corpus << '\n'
+      << "schedule " << r.schedule << '\n';
+  for (unsigned int i = 0; i < r.stages.size(); ++i) {
+    const Stage& s = r.stages[i].second;
+    out << "stage " << r.stages[i].first << ' ' << s.iterations << ' ' << s.seconds << ' '
+        << s.pairs << ' ' << s.peakRss << '\n';
+  }
+  for (unsigned int i = 0; i < r.perplexities.size(); ++i)
+    out << "perplexity " << r.perplexities[i].first << ' ' << r.perplexities[i].second.first
+        << ' ' << r.perplexities[i].second.second << '\n';
+}
+
+bool readResult(const string& filename, Result& r) {
+  ifstream in(filename.c_str());
+  if (!in)
+    return false;
+  string line, kind;
+  while (getline(in, line)) {
+    istringstream fields(line);
+    if (!(fields >> kind) || kind[0] == '#')
+      continue;
+    string rest;
+    getline(fields >> ws, rest);
+    istringstream values(rest);
+    if (kind == "corpus") {
+      r.corpus = rest;
+    } else if (kind == "schedule") {
+      r.schedule = rest;
+    } else if (kind == "stage") {
+      string name;
+      Stage s;
+      if (values >> name >> s.iterations >> s.seconds >> s.pairs >> s.peakRss)
+        r.stages.push_back(make_pair(name, s));
+    } else if (kind == "perplexity") {
+      string it, model;
+      double trainPP, trainViterbiPP;
+      if (values >> it >> model >> trainPP >> trainViterbiPP)
+        r.perplexities.push_back(make_pair(it + " " + model, make_pair(trainPP, trainViterbiPP)));
+    }
+  }
+  return true;
+}
+
+bool withinTolerance(double x, double reference) {
+  return fabs(x - reference) <= RegressPerplexityTolerance * fabs(reference);
+}
+
+// prints the comparison; false if a check fails
+bool compare(ostream& out, const Result& r, const Result& ref) {
+  bool ok = true;
+  if (ref.corpus != r.corpus || ref.schedule != r.schedule) {
+    out << "FAIL: the reference was made with a different corpus or schedule:\n  "
+        << ref.corpus << "\n  " << ref.schedule << '\n';
+    return false;
+  }
+  out << "# stage        iterations    seconds     pairs/s  peak-rss-MB";
+  if (ref.stages.size())
+    out << "  ref-pairs/s  change  ref-peak-MB  change";
+  out << '\n';
+  for (unsigned int i = 0; i < r.stages.size(); ++i) {
+    const Stage& s = r.stages[i].second;
+    const double pairsPerSecond = s.pairs / max(s.seconds, 1e-9);
+    out << left << setw(14) << r.stages[i].first << right << setw(11) << s.iterations
+        << fixed << setprecision(3) << setw(11) << s.seconds << setprecision(0) << setw(12)
+        << pairsPerSecond << setprecision(1) << setw(13) << s.peakRss / 1048576;
+    const int k = findStage(ref, r.stages[i].first);
+    if (k >= 0) {
+      const Stage* b = &ref.stages[k].second;
+      const double refPairsPerSecond = b->pairs / max(b->seconds, 1e-9);
+      const double speedChange = 100.0 * (pairsPerSecond - refPairsPerSecond) / refPairsPerSecond;
+      const double memoryChange = 100.0 * (s.peakRss - b->peakRss) / max(b->peakRss, 1.0);
+      out << setprecision(0) << setw(13) << refPairsPerSecond << showpos << setprecision(1)
+          << setw(7) << speedChange << '%' << noshowpos << setw(13) << b->peakRss / 1048576
+          << showpos << setw(7) << memoryChange << '%' << noshowpos;
+      if (speedChange < -RegressMaxSlowdown) {
+        out << " SLOWER";
+        ok = false;
+      }
+      if (memoryChange > RegressMaxMemoryGrowth) {
+        out << " LARGER";
+        ok = false;
+      }
+    } else if (ref.stages.size()) {
+      out << "  (not in the reference)";
+    }
+    out << '\n';
+  }
+  unsigned int matching = 0;
+  for (unsigned int i = 0; i < ref.perplexities.size(); ++i) {
+    unsigned int k = 0;
+    while (k < r.perplexities.size() && r.perplexities[k].first != ref.perplexities[i].first)
+      ++k;
+    if (k == r.perplexities.size()) {
+      out << "FAIL: no perplexity of iteration " << ref.perplexities[i].first << '\n';
+      ok = false;
+    } else if (!withinTolerance(r.perplexities[k].second.first, ref.perplexities[i].second.first) ||
+               !withinTolerance(r.perplexities[k].second.second, ref.perplexities[i].second.second)) {
+      out << "FAIL: perplexity of iteration " << ref.perplexities[i].first << " is "
+          << defaultfloat << setprecision(6) << r.perplexities[k].second.first << " (Viterbi "
+          << r.perplexities[k].second.second << "), reference "
+          << ref.perplexities[i].second.first << " (Viterbi " << ref.perplexities[i].second.second << ")\n";
+      ok = false;
+    } else {
+      ++matching;
+    }
+  }
+  out << matching << " of " << ref.perplexities.size() << " perplexities within the tolerance\n";
+  return ok && matching == r.perplexities.size();
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+  getGlobalParSet().insert(new Parameter<string>("giza", ParameterChangedFlag, "GIZA++ binary to run", RegressGiza, kParLevInput));
+  getGlobalParSet().insert(new Parameter<string>("reference", ParameterChangedFlag, "reference result to compare with or to write", RegressReference, kParLevInput));
+  Usage = string(argv[0]) + " [-giza BIN] [-reference FILE] [-writeReference 1] [-runs N] [-maxSlowdown %] [-maxMemoryGrowth %] [-perplexityTolerance X] [corpus options of gen-corpus]\n";
+  // parseArguments lists all parameters on stdout
+  streambuf* stdoutBuffer = cout.rdbuf(cerr.rdbuf());
+  if (argc > 1)
+    parseArguments(argc, argv);
+  cout.rdbuf(stdoutBuffer);
+  // GIZA++ names its default output after $USER
+  setenv("USER", "giza-regress", 0);
+
+  const SyntheticCorpus synthetic;
+  const string dir = makeScratchDirectory("giza-regress");
+  if (dir.empty() || !synthetic.write(dir)) {
+    cerr << "ERROR: can not write the corpus to " << dir << '\n';
+    exit(1);
+  }
+  Result result;
+  for (int run = 0; run < max(1, int(RegressRuns)); ++run) {
+    Result r;
+    if (!train(dir, r))
+      exit(1);
+    if (run == 0) {
+      result = r;
+      continue;
+    }
+    for (unsigned int i = 0; i < r.stages.size(); ++i) {
+      const int k = findStage(result, r.stages[i].first);
+      if (k >= 0 && r.stages[i].second.seconds < result.stages[k].second.seconds)
+        result.stages[k].second = r.stages[i].second;
+    }
+  }
+  removeScratchDirectory(dir);
+  result.corpus = synthetic.description();
+  result.schedule = kSchedule;
+
+  if (RegressWriteReference) {
+    ofstream out(RegressReference.c_str());
+    out << "# giza-regress reference\n";
+    writeResult(out, result);
+    if (!out) {
+      cerr << "ERROR: can not write " << RegressReference << '\n';
+      exit(1);
+    }
+    cout << "Wrote " << RegressReference << '\n';
+    return 0;
+  }
+  Result reference;
+  if (!readResult(RegressReference, reference)) {
+    cerr << "ERROR: can not read the reference " << RegressReference << '\n';
+    exit(1);
+  }
+  cout << "# giza-regress " << result.corpus << " schedule: " << result.schedule << '\n';
+  const bool ok = compare(cout, result, reference);
+  cout << (ok ? "PASS" : "FAIL") << endl;
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,203 @@
+/*
+  This file is part of GIZA++.
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307,
+  USA.
+*/
+
+#include "bench/synthetic_corpus.h"
+
+#include <dirent.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <set>
+#include <sstream>
+#include "globals.h"
+#include "parameter.h"
+
+GLOBAL_PARAMETER(int,CorpusPairs,"pairs","number of sentence pairs of the synthetic corpus",kParLevInput,2000);
+GLOBAL_PARAMETER(int,CorpusSourceVocab,"sourceVocab","source vocabulary size of the synthetic corpus",kParLevInput,5000);
+GLOBAL_PARAMETER(int,CorpusTargetVocab,"targetVocab","target vocabulary size of the synthetic corpus",kParLevInput,5000);
+GLOBAL_PARAMETER(double,CorpusLength,"length","mean source sentence length of the synthetic corpus",kParLevInput,20.0);
+GLOBAL_PARAMETER(double,CorpusLengthStddev,"lengthStddev","standard deviation of the source sentence lengths",kParLevInput,8.0);
+GLOBAL_PARAMETER(double,CorpusZipf,"zipf","exponent of the Zipf distribution of the words (0: uniform)",kParLevInput,1.0);
+GLOBAL_PARAMETER(int,CorpusClasses,"classes","number of word classes of the synthetic corpus",kParLevInput,50);
+GLOBAL_PARAMETER(int,CorpusSeed,"seed","random seed of the synthetic corpus",kParLevInput,1);
+
+namespace {
+
+// splitmix64; the C++ library distributions differ between platforms
+class Random {
+ public:
+  explicit Random(unsigned long long seed) : state_(seed) {}
+
+  unsigned long long next() {
+    unsigned long long z = (state_ += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+  }
+
+  // uniform in [0,1)
+  double uniform() { return double(next() >> 11) * (1.0 / 9007199254740992.0); }
+
+  bool chance(double p) { return uniform() < p; }
+
+  double normal() {
+    const double u = 1.0 - uniform(), v = uniform();
+    return sqrt(-2.0 * log(u)) * cos(6.283185307179586 * v);
+  }
+
+ private:
+  unsigned long long state_;
+};
+
+// ranks 1..n drawn with probability proportional to 1/rank^s
+class ZipfDistribution {
+ public:
+  ZipfDistribution(int n, double s) : cdf_(n) {
+    double sum = 0;
+    for (int r = 0; r < n; ++r)
+      cdf_[r] = (sum += pow(r + 1.0, -s));
+    for (int r = 0; r < n; ++r)
+      cdf_[r] /= sum;
+  }
+
+  int draw(Random& random) const {
+    const int r = int(lower_bound(cdf_.begin(), cdf_.end(), random.uniform()) - cdf_.begin());
+    return min(r, int(cdf_.size()) - 1) + 1;
+  }
+
+ private:
+  std::vector<double> cdf_;
+};
+
+const double kDropWord = 0.1;
+const double kInsertWord = 0.1;
+const double kSecondTranslation = 0.3;
+const double kSwapWords = 0.15;
+
+WordIndex wordOfRank(int rank) { return WordIndex(rank + 1); }
+
+// the rank of the k-th translation of the source word of rank r
+int translationRank(int r, int k) { return min(r + k, int(CorpusTargetVocab)); }
+
+bool writeVocab(const string& filename, const char* prefix, int size, const Vector<int>& freq) {
+  ofstream out(filename.c_str());
+  for (int r = 1; r <= size; ++r)
+    out << wordOfRank(r) << ' ' << prefix << r << ' ' << freq[wordOfRank(r)] << '\n';
+  return bool(out);
+}
+
+bool writeClasses(const string& filename, const char* prefix, int size) {
+  ofstream out(filename.c_str());
+  for (int r = 1; r <= size; ++r)
+    out << prefix << r << '\t' << 1 + (r - 1) % max(1, int(CorpusClasses)) << '\n';
+  return bool(out);
+}
+
+} // namespace
+
+SyntheticCorpus::SyntheticCorpus() {
+  const int maxLength = int(MAX_SENTENCE_LENGTH) - 1;
+  Random random((unsigned long long)CorpusSeed);
+  const ZipfDistribution source(CorpusSourceVocab, CorpusZipf);
+  const ZipfDistribution target(CorpusTargetVocab, CorpusZipf);
+  pairs_.resize(max(0, int(CorpusPairs)));
+  Vector<int> ranks;
+  for (unsigned int n = 0; n < pairs_.size(); ++n) {
+    SentencePair& s = pairs_[n];
+    s.sentenceNo = int(n) + 1;
+    s.noOcc = s.realCount = 1;
+    const int l = max(1, min(maxLength, int(floor(CorpusLength + CorpusLengthStddev * random.normal() + 0.5))));
+    s.eSent.assign(1, 0);
+    ranks.clear();
+    for (int i = 0; i < l; ++i) {
+      const int r = source.draw(random);
+      s.eSent.push_back(wordOfRank(r));
+      if (!random.chance(kDropWord))
+        ranks.push_back(translationRank(r, random.chance(kSecondTranslation)));
+      if (random.chance(kInsertWord))
+        ranks.push_back(target.draw(random));
+    }
+    if (ranks.empty())
+      ranks.push_back(target.draw(random));
+    for (unsigned int j = 1; j < ranks.size(); ++j)
+      if (random.chance(kSwapWords))
+        swap(ranks[j - 1], ranks[j]);
+    ranks.resize(min(int(ranks.size()), maxLength));
+    s.fSent.assign(1, 0);
+    for (unsigned int j = 0; j < ranks.size(); ++j)
+      s.fSent.push_back(wordOfRank(ranks[j]));
+  }
+}
+
+string SyntheticCorpus::description() const {
+  ostringstream out;
+  out << "pairs=" << CorpusPairs << " sourceVocab=" << CorpusSourceVocab
+      << " targetVocab=" << CorpusTargetVocab << " length=" << CorpusLength
+      << " lengthStddev=" << CorpusLengthStddev << " zipf=" << CorpusZipf
+      << " classes=" << CorpusClasses << " seed=" << CorpusSeed;
+  return out.str();
+}
+
+bool SyntheticCorpus::write(const string& dir) const {
+  Vector<int> efreq(CorpusSourceVocab + 2, 0), ffreq(CorpusTargetVocab + 2, 0);
+  Vector<std::set<WordIndex> > cooc(CorpusSourceVocab + 2);
+  ofstream snt((dir + "/e_f.snt").c_str());
+  for (unsigned int n = 0; n < pairs_.size(); ++n) {
+    const SentencePair& s = pairs_[n];
+    snt << s.noOcc << '\n';
+    for (unsigned int i = 1; i < s.eSent.size(); ++i)
+      snt << s.eSent[i] << (i + 1 < s.eSent.size() ? ' ' : '\n');
+    for (unsigned int j = 1; j < s.fSent.size(); ++j)
+      snt << s.fSent[j] << (j + 1 < s.fSent.size() ? ' ' : '\n');
+    for (unsigned int i = 1; i < s.eSent.size(); ++i)
+      efreq[s.eSent[i]]++;
+    for (unsigned int j = 1; j < s.fSent.size(); ++j) {
+      ffreq[s.fSent[j]]++;
+      for (unsigned int i = 0; i < s.eSent.size(); ++i)
+        cooc[s.eSent[i]].insert(s.fSent[j]);
+    }
+  }
+  ofstream coocFile((dir + "/e_f.cooc").c_str());
+  for (unsigned int e = 0; e < cooc.size(); ++e)
+    for (std::set<WordIndex>::const_iterator f = cooc[e].begin(); f != cooc[e].end(); ++f)
+      coocFile << e << ' ' << *f << '\n';
+  return snt && coocFile &&
+      writeVocab(dir + "/e.vcb", "e", CorpusSourceVocab, efreq) &&
+      writeVocab(dir + "/f.vcb", "f", CorpusTargetVocab, ffreq) &&
+      writeClasses(dir + "/e.vcb.classes", "e", CorpusSourceVocab) &&
+      writeClasses(dir + "/f.vcb.classes", "f", CorpusTargetVocab);
+}
+
+string makeScratchDirectory(const char* name) {
+  const char* tmp = getenv("TMPDIR");
+  string dir = string(tmp && *tmp ? tmp : "/tmp") + "/" + name + ".XXXXXX";
+  return mkdtemp(&dir[0]) ? dir : string();
+}
+
+void removeScratchDirectory(const string& dir) {
+  if (DIR* d = opendir(dir.c_str())) {
+    while (struct dirent* entry = readdir(d))
+      if (string(entry->d_name) != "." && string(entry->d_name) != "..")
+        unlink((dir + "/" + entry->d_name).c_str());
+    closedir(d);
+  }
+  rmdir(dir.c_str());
+}
@@ -0,0 +1,64 @@
+/*
+  This file is part of GIZA++.
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307,
+  USA.
+*/
+
+#ifndef GIZAPP_BENCH_SYNTHETIC_CORPUS_H_
+#define GIZAPP_BENCH_SYNTHETIC_CORPUS_H_
+
+#include <string>
+#include "sentence_handler.h"
+
+/*
+  A parallel corpus drawn from a fixed seed, for benchmarks and
+  regression runs. Source words are drawn by a Zipf distribution over
+  the ranks of the vocabulary (word id = rank + 1), sentence lengths by
+  a clipped normal distribution. Every source word has two translations
+  of about the same rank; the target sentence translates the source
+  sentence word by word, with dropped, inserted and swapped words. The
+  same options and seed give the same corpus on every platform.
+
+  The options are the parameters of gen-corpus and giza-bench (-pairs,
+  -sourceVocab, -targetVocab, -length, -lengthStddev, -zipf, -classes,
+  -seed).
+*/
+class SyntheticCorpus {
+ public:
+  // draws the corpus of the current parameters
+  SyntheticCorpus();
+
+  const Vector<SentencePair>& pairs() const { return pairs_; }
+
+  // the parameters the corpus was drawn with, as one line of name=value
+  std::string description() const;
+
+  // writes dir/e.vcb, dir/f.vcb, dir/e_f.snt, dir/e_f.cooc and the class
+  // files dir/e.vcb.classes and dir/f.vcb.classes; false if a file can
+  // not be written
+  bool write(const std::string& dir) const;
+
+ private:
+  Vector<SentencePair> pairs_;
+};
+
+// a new empty directory under $TMPDIR (or /tmp); empty on failure
+std::string makeScratchDirectory(const char* name);
+
+// removes a directory made by makeScratchDirectory and its files
+void removeScratchDirectory(const std::string& dir);
+
+#endif  // GIZAPP_BENCH_SYNTHETIC_CORPUS_H_
@@ -0,0 +1,215 @@
+/*
+  This file is part of GIZA++.
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307,
+  USA.
+*/
+
+#include "checkpoint.h"
+
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include "globals.h"
+#include "parameter.h"
+#include "ibm_model3.h"
+#include "hmm.h"
+#include "d5tables.h"
+#include "sentence_handler.h"
+#include "telemetry.h"
+#include "util/perplexity.h"
+
+GLOBAL_PARAMETER(bool,WriteCheckpoints,"checkpoint",
+                 "1: write the full training state to prefix.checkpoint after every iteration",kParLevOutput,0);
+GLOBAL_PARAMETER(bool,ResumeTraining,"resume",
+                 "1: continue after the last iteration in prefix.checkpoint (and keep writing checkpoints)",kParLevOutput,0);
+
+namespace {
+
+const uint64_t kCheckpointMagic = 0x54504b43415a4947ULL;  // "GIZACKPT"
+const uint32_t kCheckpointVersion = 2;
+
+TrainingCheckpoint* running = 0;
+
+const char* stageName(int stage) {
+  switch (stage) {
+    case kCheckpointModel1: return "Model1";
+    case kCheckpointModel2: return "Model2";
+    case kCheckpointHMM: return "HMM";
+    case kCheckpointModel345: return "Model345";
+    default: return "?";
+  }
+}
+
+} // namespace
+
+TrainingCheckpoint::TrainingCheckpoint(IBMModel3& m3, HMM& h, SentenceHandler* corpus,
+                                       Perplexity& trainPerp, Perplexity& testPerp,
+                                       Perplexity& trainViterbiPerp, Perplexity& testViterbiPerp,
+                                       const std::string& parameters)
+    : m3_(m3), h_(h), corpus_(corpus), parameters_(parameters),
+      filename_(g_prefix + ".checkpoint"), stage_(0), iteration_(0) {
+  perps_[0] = &trainPerp;
+  perps_[1] = &testPerp;
+  perps_[2] = &trainViterbiPerp;
+  perps_[3] = &testViterbiPerp;
+  running = this;
+}
+
+TrainingCheckpoint::~TrainingCheckpoint() {
+  if (running == this)
+    running = 0;
+}
+
+void TrainingCheckpoint::fail(const char* what) const {
+  cerr << "ERROR: checkpoint " << filename_ << ' ' << what << '\n';
+  exit(1);
+}
+
+bool TrainingCheckpoint::resume() {
+  if (!ResumeTraining)
+    return false;
+  if (!read()) {
+    cerr << "WARNING: no checkpoint " << filename_ << " to resume; training from the start.\n";
+    return false;
+  }
+  cout << "Resuming after " << stageName(stage_) << " iteration " << iteration_ << " of " << filename_ << '\n';
+  return true;
+}
+
+bool TrainingCheckpoint::read() {
+  if (!in_.Open(filename_))
+    return false;
+  uint64_t magic = 0;
+  uint32_t version = 0;
+  string parameters;
+  in_.Get(magic);
+  in_.Get(version);
+  if (magic != kCheckpointMagic || version != kCheckpointVersion)
+    fail("was not written by this version of GIZA++");
+  in_.GetString(parameters);
+  if (!in_.IsOK())
+    fail("is damaged");
+  if (parameters != parameters_) {
+    // name the first parameter that differs
+    istringstream was(parameters), now(parameters_);
+    string a, b;
+    while (getline(was, a) && getline(now, b) && a == b) {}
+    cerr << "ERROR: checkpoint " << filename_ << " was written with '" << a
+         << "', this run has '" << b << "'\n";
+    exit(1);
+  }
+  int stage = 0, it = 0;
+  in_.Get(stage);
+  in_.Get(it);
+  if (stage < kCheckpointModel1 || stage > kCheckpointModel345 || it < 1)
+    fail("is damaged");
+  if (!m3_.tTable.readBinary(in_) || !m3_.aTable.readBinary(in_) ||
+      !m3_.dTable.readBinary(in_) || !m3_.nTable.readBinary(in_))
+    fail("is damaged");
+  in_.Get(m3_.p0);
+  in_.Get(m3_.p1);
+  if (!h_.readBinary(in_) ||
+      !(corpus_ ? corpus_->readBinary(in_) : SentenceHandler::skipBinary(in_)))
+    fail("is damaged");
+  for (int i = 0; i < 4; ++i)
+    if (!perps_[i]->readBinary(in_))
+      fail("is damaged");
+  stage_ = stage;
+  iteration_ = it;
+  if (stage != kCheckpointModel345)
+    in_.Close();
+  return true;
+}
+
+bool TrainingCheckpoint::done(int stage, int it) const {
+  return stage < stage_ || (stage == stage_ && it <= iteration_);
+}
+
+void TrainingCheckpoint::write(int stage, int it, const d4model* d4m, const d5model* d5m) {
+  if ((!WriteCheckpoints && !ResumeTraining) || !corpus_)
+    return;
+  TelemetryPhaseTimer phase(kTelemetryDump);
+  util::BinaryWriter out(filename_);
+  out.Put(kCheckpointMagic);
+  out.Put(kCheckpointVersion);
+  out.PutString(parameters_);
+  out.Put(stage);
+  out.Put(it);
+  m3_.tTable.writeBinary(out);
+  m3_.aTable.writeBinary(out);
+  m3_.dTable.writeBinary(out);
+  m3_.nTable.writeBinary(out);
+  out.Put(m3_.p0);
+  out.Put(m3_.p1);
+  h_.writeBinary(out);
+  corpus_->writeBinary(out);
+  for (int i = 0; i < 4; ++i)
+    perps_[i]->writeBinary(out);
+  if (stage == kCheckpointModel345) {
+    d4m->writeBinary(out);
+    d5m->writeBinary(out);
+  }
+  if (out.Commit())
+    cout << "Wrote checkpoint of " << stageName(stage) << " iteration " << it << " to " << filename_ << '\n';
+  else
+    cerr << "WARNING: can not write checkpoint " << filename_ << '\n';
+}
+
+void TrainingCheckpoint::readDistortion(d4model& d4m, d5model& d5m) {
+  if (stage_ != kCheckpointModel345 || !in_.IsOK())
+    return;
+  if (!d4m.readBinary(in_) || !d5m.readBinary(in_))
+    fail("is damaged");
+  in_.Close();
+}
+
+string checkpointParameters() {
+  // how many threads or processes do the work, and what giza-align adds,
+  // does not change the tables
+  static const char* const kRunOnly[] = {
+    "threads", "model345threads", "alignthreads", "shards", "memorybudget", "alignmodel", "input"
+  };
+  const ParSet& pars = getGlobalParSet();
+  ostringstream out;
+  for (ParSet::const_iterator i = pars.begin(); i != pars.end(); ++i) {
+    // level -1 holds the long aliases of other parameters
+    if ((*i)->onlyCopy || (*i)->getLevel() == -1 || (*i)->getLevel() == kParLevOutput)
+      continue;
+    bool runOnly = false;
+    for (unsigned int k = 0; k < sizeof(kRunOnly) / sizeof(kRunOnly[0]); ++k)
+      runOnly = runOnly || *(*i) == kRunOnly[k];
+    if (runOnly)
+      continue;
+    out << (*i)->getString() << ' ';
+    (*i)->printValue(out);
+    out << '\n';
+  }
+  return out.str();
+}
+
+bool checkpointDone(int stage, int it) {
+  return running && running->done(stage, it);
+}
+
+void writeCheckpoint(int stage, int it, const d4model* d4m, const d5model* d5m) {
+  if (running)
+    running->write(stage, it, d4m, d5m);
+}
+
+void readCheckpointDistortion(d4model& d4m, d5model& d5m) {
+  if (running)
+    running->readDistortion(d4m, d5m);
+}
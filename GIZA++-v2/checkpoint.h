@@ -0,0 +1,100 @@
+/*
+  This file is part of GIZA++.
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307,
+  USA.
+*/
+
+#ifndef GIZAPP_CHECKPOINT_H_
+#define GIZAPP_CHECKPOINT_H_
+
+#include <string>
+#include "util/binary_file.h"
+
+class IBMModel3;
+class HMM;
+class Perplexity;
+class SentenceHandler;
+class d4model;
+class d5model;
+
+// stages of the training, in the order they run
+enum CheckpointStage {
+  kCheckpointModel1 = 1,
+  kCheckpointModel2,
+  kCheckpointHMM,
+  kCheckpointModel345
+};
+
+/*
+  The training state after an iteration: the t, a, d and n tables, p0/p1,
+  the HMM jump tables, the Model 4/5 distortion tables (in the Model 3/4/5
+  stage only), the perplexity history and the weights of a corpus with a
+  manual dictionary. With -checkpoint it is written to prefix.checkpoint
+  after every iteration, replacing the previous one only once complete;
+  -resume reads it back and the training loops skip the iterations it
+  contains.
+*/
+class TrainingCheckpoint {
+ public:
+  // 'parameters' describes the run; a checkpoint is only read by a run
+  // with the same description. Without a corpus its weights are skipped
+  // and no checkpoint is written.
+  TrainingCheckpoint(IBMModel3& m3, HMM& h, SentenceHandler* corpus,
+                     Perplexity& trainPerp, Perplexity& testPerp,
+                     Perplexity& trainViterbiPerp, Perplexity& testViterbiPerp,
+                     const std::string& parameters);
+  ~TrainingCheckpoint();
+
+  // with -resume, reads the checkpoint; false if there is none to resume
+  bool resume();
+
+  // reads the checkpoint; false if there is none
+  bool read();
+
+  // the stage of the checkpoint read
+  int stage() const { return stage_; }
+
+  // true if iteration 'it' of 'stage' is part of the resumed state
+  bool done(int stage, int it) const;
+
+  void write(int stage, int it, const d4model* d4m, const d5model* d5m);
+
+  // the Model 4/5 tables of a checkpoint of the Model 3/4/5 stage
+  void readDistortion(d4model& d4m, d5model& d5m);
+
+ private:
+  void fail(const char* what) const;
+
+  IBMModel3& m3_;
+  HMM& h_;
+  SentenceHandler* corpus_;
+  Perplexity* perps_[4];
+  std::string parameters_;
+  std::string filename_;
+  int stage_, iteration_;
+  util::BinaryReader in_;
+};
+
+// the parameters of the run that change the tables: all but the output
+// options and the numbers of threads and processes
+std::string checkpointParameters();
+
+// The same for the TrainingCheckpoint of the running training, if any.
+bool checkpointDone(int stage, int it);
+void writeCheckpoint(int stage, int it, const d4model* d4m = 0, const d5model* d5m = 0);
+void readCheckpointDistortion(d4model& d4m, d5model& d5m);
+
+#endif  // GIZAPP_CHECKPOINT_H_
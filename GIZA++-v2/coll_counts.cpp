@@ -43,7 +43,7 @@ int collectCountsOverNeighborhood(const MoveSwapMatrix<TRANSPAIR>&msc,
   const PositionIndex l=msc.get_l(),m=msc.get_m();
   Array2<LogProb,Vector<LogProb> > cmove(l+1,m+1),cswap(l+1,m+1);
   Vector<LogProb> negmove(m+1),negswap(m+1),plus1fert(l+1),minus1fert(l+1);
-  LogProb total_move,total_swap;
+  LogProb total_move=0,total_swap=0;
   if (msc.isCenterDeleted()==0) {
     total_move+=ascore;
     nAl++;
@@ -121,12 +121,12 @@ double collectCountsOverNeighborhoodForSophisticatedModels(const MoveSwapMatrix<
   return 0.0;
 }
 
-template <class TRANSPAIR>
-void _collectCountsOverNeighborhoodForSophisticatedModels(const MoveSwapMatrix<TRANSPAIR>&Mmsc,
-                                                          const Alignment&msc,
-                                                          const TRANSPAIR&ef,
-                                                          LogProb normalized_ascore,
-                                                          d4model* d4Table) {
+template <class TRANSPAIR,class D4TABLE>
+void collectD4CountsOfAlignment(const MoveSwapMatrix<TRANSPAIR>&Mmsc,
+                                const Alignment&msc,
+                                const TRANSPAIR&ef,
+                                LogProb normalized_ascore,
+                                D4TABLE* d4Table) {
   Mmsc.check();
   const PositionIndex m = msc.get_m(), l = msc.get_l();
   for (PositionIndex j=1;j<=m;++j) {
@@ -141,43 +141,67 @@ void _collectCountsOverNeighborhoodForSophisticatedModels(const MoveSwapMatrix<T
   }
 }
 
-template <class TRANSPAIR>
-void _collectCountsOverNeighborhoodForSophisticatedModels(const MoveSwapMatrix<TRANSPAIR>&Mmsc,
-                                                          const Alignment& msc,
-                                                          const TRANSPAIR& ef,
-                                                          LogProb normalized_ascore,
-                                                          d5model* d5Table) {
-  Mmsc.check();
-  _collectCountsOverNeighborhoodForSophisticatedModels(Mmsc,msc,ef,normalized_ascore,&d5Table->d4m);
-  Mmsc.check();
+// the Model 4 counts of the words of the given cepts only (see
+// transpair_model4::distortionOfCepts)
+template <class TRANSPAIR,class D4TABLE>
+void collectD4CountsOfCepts(const Alignment&msc,
+                            const TRANSPAIR&ef,
+                            const PositionIndex*cepts,int n,
+                            LogProb normalized_ascore,
+                            D4TABLE* d4Table) {
+  const PositionIndex m = msc.get_m(), l = msc.get_l();
+  for (int k=0;k<n;++k) {
+    const PositionIndex i=cepts[k];
+    if (i==0||i>l||msc.fert(i)==0||find(cepts,cepts+k,i)!=cepts+k)
+      continue;
+    PositionIndex j=msc.get_head(i);
+    int ep=msc.prev_cept(i);
+    d4Table->getCountRef_first(j,msc.get_center(ep),d4Table->ewordclasses.getClass(ef.get_es(ep)),d4Table->fwordclasses.getClass(ef.get_fs(j)),l,m)+=normalized_ascore;
+    for (j=msc.als_j[j].next;j;j=msc.als_j[j].next)
+      d4Table->getCountRef_bigger(j,msc.prev_in_cept(j),0,d4Table->fwordclasses.getClass(ef.get_fs(j)),l,m)+=normalized_ascore;
+  }
+}
+
+// the Model 5 counts of the cepts from..l
+template <class TRANSPAIR,class D5TABLE>
+void collectD5CountsOfCepts(const Alignment& msc,
+                            const TRANSPAIR& ef,
+                            PositionIndex from,
+                            LogProb normalized_ascore,
+                            D5TABLE* d5Table) {
   const PositionIndex m=msc.get_m(),l=msc.get_l();
   PositionIndex prev_cept=0;
   PositionIndex vac_all=m;
-  Vector<char> vac(m+1,0);
+  Vacancies vac(m);
+  for (PositionIndex i=1;i<from;i++)
+    if (msc.fert(i)) {
+      for (PositionIndex j=msc.als_i[i];j;j=msc.als_j[j].next) {
+        vac.fill(j);
+        vac_all--;
+      }
+      prev_cept=i;
+    }
 
-  for (PositionIndex i=1;i<=l;i++) {
+  for (PositionIndex i=from;i<=l;i++) {
     PositionIndex cur_j=msc.als_i[i];
     PositionIndex prev_j=0;
     PositionIndex k=0;
     if (cur_j) { // process first word of cept
       k++;
-      d5Table->getCountRef_first(vacancies(vac,cur_j),vacancies(vac,msc.get_center(prev_cept)),
+      d5Table->getCountRef_first(vac(cur_j),vac(msc.get_center(prev_cept)),
                                  d5Table->fwordclasses.getClass(ef.get_fs(cur_j)),l,m,vac_all-msc.fert(i)+k)+=normalized_ascore;
       vac_all--;
-      assert(vac[cur_j]==0);
-      vac[cur_j]=1;
-      Mmsc.check();
+      vac.fill(cur_j);
       prev_j=cur_j;
       cur_j=msc.als_j[cur_j].next;
     }
 
     while (cur_j) { // process following words of cept
       k++;
-      int vprev=vacancies(vac,prev_j);
-      d5Table->getCountRef_bigger(vacancies(vac,cur_j),vprev,d5Table->fwordclasses.getClass(ef.get_fs(cur_j)),l,m,vac_all-vprev/*war weg*/-msc.fert(i)+k)+=normalized_ascore;
+      int vprev=vac(prev_j);
+      d5Table->getCountRef_bigger(vac(cur_j),vprev,d5Table->fwordclasses.getClass(ef.get_fs(cur_j)),l,m,vac_all-vprev/*war weg*/-msc.fert(i)+k)+=normalized_ascore;
       vac_all--;
-      vac[cur_j]=1;
-      Mmsc.check();
+      vac.fill(cur_j);
       prev_j=cur_j;
       cur_j=msc.als_j[cur_j].next;
     }
@@ -189,16 +213,62 @@ void _collectCountsOverNeighborhoodForSophisticatedModels(const MoveSwapMatrix<T
   assert(vac_all==msc.fert(0));
 }
 
-extern int NumberOfAlignmentsInSophisticatedCountCollection;
+template <class TRANSPAIR,class D5TABLE>
+void collectD5CountsOfAlignment(const MoveSwapMatrix<TRANSPAIR>&Mmsc,
+                                const Alignment& msc,
+                                const TRANSPAIR& ef,
+                                LogProb normalized_ascore,
+                                D5TABLE* d5Table) {
+  Mmsc.check();
+  collectD4CountsOfAlignment(Mmsc,msc,ef,normalized_ascore,&d5Table->d4m);
+  collectD5CountsOfCepts(msc,ef,1,normalized_ascore,d5Table);
+  Mmsc.check();
+}
+
+template <class TRANSPAIR>
+void _collectCountsOverNeighborhoodForSophisticatedModels(const MoveSwapMatrix<TRANSPAIR>&Mmsc,const Alignment&msc,const TRANSPAIR&ef,
+                                                          LogProb normalized_ascore,DistortionCounts::D4* d4Table) {
+  collectD4CountsOfAlignment(Mmsc,msc,ef,normalized_ascore,d4Table);
+}
+
+template <class TRANSPAIR>
+void _collectCountsOverNeighborhoodForSophisticatedModels(const MoveSwapMatrix<TRANSPAIR>&Mmsc,const Alignment&msc,const TRANSPAIR&ef,
+                                                          LogProb normalized_ascore,DistortionCounts::D5* d5Table) {
+  collectD5CountsOfAlignment(Mmsc,msc,ef,normalized_ascore,d5Table);
+}
+
+// Counts of the cepts in which msc differs from a neighbour; cepts[0] and
+// cepts[1] are the two cepts the move or swap changes.
+template <class TRANSPAIR>
+void collectCountsOfChangedCepts(const Alignment&msc,const TRANSPAIR&ef,const PositionIndex*cepts,int n,
+                                 LogProb normalized_ascore,DistortionCounts::D4* d4Table) {
+  collectD4CountsOfCepts(msc,ef,cepts,n,normalized_ascore,d4Table);
+}
+
+template <class TRANSPAIR>
+void collectCountsOfChangedCepts(const Alignment&msc,const TRANSPAIR&ef,const PositionIndex*cepts,int n,
+                                 LogProb normalized_ascore,DistortionCounts::D5* d5Table) {
+  collectD4CountsOfCepts(msc,ef,cepts,n,normalized_ascore,&d5Table->d4m);
+  collectD5CountsOfCepts(msc,ef,firstChangedCept(cepts[0],cepts[1]),normalized_ascore,d5Table);
+}
+
+extern thread_local int NumberOfAlignmentsInSophisticatedCountCollection;
 
+// A neighbour differs from the center only in the counts of the cepts a
+// move or swap touches (and the ones after them for Model 5). Unless the
+// center is deleted, the whole neighbourhood therefore adds the counts of
+// the center with its total score, corrected by each neighbour's changed
+// cepts, instead of walking every neighbour in full. The counts go into a
+// DistortionCounts sink, which sums them in double precision.
 template<class TRANSPAIR,class MODEL>
 double collectCountsOverNeighborhoodForSophisticatedModels(const MoveSwapMatrix<TRANSPAIR>&msc,LogProb normalized_ascore, MODEL* d5Table) {
   const PositionIndex m=msc.get_m(),l=msc.get_l();
+  const TRANSPAIR&ef=msc.get_ef();
+  const bool changesOnly=!msc.isCenterDeleted();
   Alignment x(msc);
   double sum=0;
   msc.check();
-  if (!msc.isCenterDeleted()) {
-    _collectCountsOverNeighborhoodForSophisticatedModels<TRANSPAIR>(msc,x,msc.get_ef(),normalized_ascore,d5Table);
+  if (changesOnly) {
     NumberOfAlignmentsInSophisticatedCountCollection++;
     sum+=normalized_ascore;
   }
@@ -212,10 +282,18 @@ double collectCountsOverNeighborhoodForSophisticatedModels(const MoveSwapMatrix<
         msc.check();
         double c=msc.cmove(i,j)*normalized_ascore;
         if (c > COUNTINCREASE_CUTOFF_AL) {
+          PositionIndex cepts[6]={old,i,x.next_cept(old),x.next_cept(i),0,0};
           x.set(j,i);
-          _collectCountsOverNeighborhoodForSophisticatedModels<TRANSPAIR>(msc,x,msc.get_ef(),c,d5Table);
+          if (changesOnly) {
+            cepts[4]=x.next_cept(old);
+            cepts[5]=x.next_cept(i);
+            collectCountsOfChangedCepts(x,ef,cepts,6,c,d5Table);
+          } else
+            _collectCountsOverNeighborhoodForSophisticatedModels<TRANSPAIR>(msc,x,ef,c,d5Table);
           NumberOfAlignmentsInSophisticatedCountCollection++;
           x.set(j,old);
+          if (changesOnly)
+            collectCountsOfChangedCepts(x,ef,cepts,6,-c,d5Table);
           sum+=c;
         }
         msc.check();
@@ -231,9 +309,16 @@ double collectCountsOverNeighborhoodForSophisticatedModels(const MoveSwapMatrix<
 
         if (c > COUNTINCREASE_CUTOFF_AL) {
           int old1=msc(j1),old2=msc(j2);
+          // fertilities do not change, so neither do the following cepts
+          const PositionIndex cepts[4]={PositionIndex(old1),PositionIndex(old2),x.next_cept(old1),x.next_cept(old2)};
+          if (changesOnly)
+            collectCountsOfChangedCepts(x,ef,cepts,4,-c,d5Table);
           x.set(j1,old2);
           x.set(j2,old1);
-          _collectCountsOverNeighborhoodForSophisticatedModels<TRANSPAIR>(msc,x,msc.get_ef(),c,d5Table);
+          if (changesOnly)
+            collectCountsOfChangedCepts(x,ef,cepts,4,c,d5Table);
+          else
+            _collectCountsOverNeighborhoodForSophisticatedModels<TRANSPAIR>(msc,x,ef,c,d5Table);
           NumberOfAlignmentsInSophisticatedCountCollection++;
           x.set(j1,old1);
           x.set(j2,old2);
@@ -243,36 +328,62 @@ double collectCountsOverNeighborhoodForSophisticatedModels(const MoveSwapMatrix<
       }
     }
   }
+  if (changesOnly)
+    _collectCountsOverNeighborhoodForSophisticatedModels<TRANSPAIR>(msc,x,ef,sum,d5Table);
   msc.check();
   return sum;
 }
 
+inline void DistortionCounts::addTo(d4model* d4Table) const {
+  for (unsigned int n=0;n<index_.size();++n) {
+    const int* v=index_.key(n).v;
+    if (v[0]==kD4First)
+      d4Table->getCountRef_first(v[1],v[2],v[3],v[4],v[5],v[6])+=values_[n];
+    else
+      d4Table->getCountRef_bigger(v[1],v[2],v[3],v[4],v[5],v[6])+=values_[n];
+  }
+}
+
+inline void DistortionCounts::addTo(d5model* d5Table) const {
+  for (unsigned int n=0;n<index_.size();++n) {
+    const int* v=index_.key(n).v;
+    switch (v[0]) {
+      case kD4First:
+        d5Table->d4m.getCountRef_first(v[1],v[2],v[3],v[4],v[5],v[6])+=values_[n];
+        break;
+      case kD4Bigger:
+        d5Table->d4m.getCountRef_bigger(v[1],v[2],v[3],v[4],v[5],v[6])+=values_[n];
+        break;
+      case kD5First:
+        d5Table->getCountRef_first(v[1],v[2],v[4],v[5],v[6],v[7])+=values_[n];
+        break;
+      case kD5Bigger:
+        d5Table->getCountRef_bigger(v[1],v[2],v[4],v[5],v[6],v[7])+=values_[n];
+        break;
+    }
+  }
+}
+
 template <class TRANSPAIR, class MODEL>
-int collectCountsOverNeighborhood(const Vector<pair<MoveSwapMatrix<TRANSPAIR>*,LogProb> >& smsc,
-                                  Vector<WordIndex>& es,
-                                  Vector<WordIndex>& fs,
-                                  TModel<COUNT,PROB>& tTable,
-                                  AModel<COUNT>& aCountTable,
-                                  AModel<COUNT>& dCountTable,
-                                  nmodel<COUNT>& nCountTable,
-                                  double& p1count,
-                                  double& p0count,
-                                  LogProb& _total,
-                                  float count,
-                                  bool addCounts,
-                                  MODEL* d4Table) {
+int gatherCountsOverNeighborhood(const Vector<pair<MoveSwapMatrix<TRANSPAIR>*,LogProb> >& smsc,
+                                 PositionIndex l, PositionIndex m, float count,
+                                 bool addCounts, NeighborhoodCounts& counts,
+                                 MODEL* d4Table) {
   int nAl=0;
-  const PositionIndex l=es.size()-1,m=fs.size()-1;
-  Array2<LogProb,Vector<LogProb> > dtcount(l+1,m+1),ncount(l+1,g_max_fertility+1);
-  LogProb p0=0,p1=0,all_total=0;
+  counts.dtcount=Array2<LogProb,Vector<LogProb> >(l+1,m+1);
+  counts.ncount=Array2<LogProb,Vector<LogProb> >(l+1,g_max_fertility+1);
+  LogProb all_total=0;
 
   for (unsigned int i=0;i<smsc.size();++i) {
     LogProb this_total=0;
-    nAl+=collectCountsOverNeighborhood(*smsc[i].first,smsc[i].second,dtcount,ncount,p1,p0,this_total);
+    nAl+=collectCountsOverNeighborhood(*smsc[i].first,smsc[i].second,counts.dtcount,counts.ncount,counts.p1,counts.p0,this_total);
     all_total+=this_total;
   }
 
-  _total=all_total;
+  counts.total=all_total;
+  // the scores of very long sentences can underflow; such a pair adds no counts
+  if (!(all_total>0&&all_total<HUGE_VAL))
+    return nAl;
   all_total/=(double)count;
   double sum2=0;
 
@@ -286,25 +397,92 @@ int collectCountsOverNeighborhood(const Vector<pair<MoveSwapMatrix<TRANSPAIR>*,L
     if (!(fabs(count-sum2)<0.05))
       cerr << "WARNING: DIFFERENT SUMS: (" << count << ") (" << sum2 << ")\n";
   }
+  return nAl;
+}
 
-  if (addCounts) {
-    for (PositionIndex i=0;i<=l;i++) {
-      for (PositionIndex j=1;j<=m;j++) {
-        LogProb ijadd=dtcount(i,j)/all_total;
-        if (ijadd>COUNTINCREASE_CUTOFF_AL) {
-          tTable.incCount(es[i],fs[j],ijadd);
-          dCountTable.getRef(j,i,l,m)+=ijadd;
-          aCountTable.getRef(i,j,l,m)+=ijadd;
-        }
+template <class TRANSPAIR>
+int deferCountsOverNeighborhood(const Vector<pair<MoveSwapMatrix<TRANSPAIR>*,LogProb> >& smsc,
+                                PositionIndex l, PositionIndex m, float count,
+                                bool addCounts, NeighborhoodCounts& counts, void*) {
+  return gatherCountsOverNeighborhood(smsc,l,m,count,addCounts,counts,(void*)0);
+}
+
+template <class TRANSPAIR>
+int deferCountsOverNeighborhood(const Vector<pair<MoveSwapMatrix<TRANSPAIR>*,LogProb> >& smsc,
+                                PositionIndex l, PositionIndex m, float count,
+                                bool addCounts, NeighborhoodCounts& counts, d4model* d4Table) {
+  if (!d4Table)
+    return gatherCountsOverNeighborhood(smsc,l,m,count,addCounts,counts,(void*)0);
+  DistortionCounts::D4 sink(counts.distortion,d4Table->ewordclasses,d4Table->fwordclasses);
+  return gatherCountsOverNeighborhood(smsc,l,m,count,addCounts,counts,&sink);
+}
+
+template <class TRANSPAIR>
+int deferCountsOverNeighborhood(const Vector<pair<MoveSwapMatrix<TRANSPAIR>*,LogProb> >& smsc,
+                                PositionIndex l, PositionIndex m, float count,
+                                bool addCounts, NeighborhoodCounts& counts, d5model* d5Table) {
+  if (!d5Table)
+    return gatherCountsOverNeighborhood(smsc,l,m,count,addCounts,counts,(void*)0);
+  DistortionCounts::D5 sink(counts.distortion,d5Table->d4m.ewordclasses,d5Table->d4m.fwordclasses,
+                            d5Table->fwordclasses);
+  return gatherCountsOverNeighborhood(smsc,l,m,count,addCounts,counts,&sink);
+}
+
+inline void addNeighborhoodCounts(const NeighborhoodCounts& counts,
+                                  const Vector<WordIndex>& es,
+                                  const Vector<WordIndex>& fs,
+                                  float count,
+                                  TModel<COUNT,PROB>& tTable,
+                                  AModel<COUNT>& aCountTable,
+                                  AModel<COUNT>& dCountTable,
+                                  nmodel<COUNT>& nCountTable,
+                                  double& p1count,
+                                  double& p0count) {
+  const PositionIndex l=PositionIndex(es.size()-1),m=PositionIndex(fs.size()-1);
+  const LogProb all_total=counts.total/(double)count;
+  for (PositionIndex i=0;i<=l;i++) {
+    for (PositionIndex j=1;j<=m;j++) {
+      const LogProb ijadd=counts.dtcount(i,j)/all_total;
+      if (ijadd>COUNTINCREASE_CUTOFF_AL) {
+        tTable.incCount(es[i],fs[j],COUNT(ijadd));
+        COUNT& dcount=dCountTable.getRef(j,i,l,m);
+        dcount=COUNT(dcount+ijadd);
+        COUNT& acount=aCountTable.getRef(i,j,l,m);
+        acount=COUNT(acount+ijadd);
       }
+    }
 
-      if (i > 0) {
-        for (PositionIndex n=0;n<g_max_fertility;n++)
-          nCountTable.getRef(es[i],n) += ncount(i,n) / all_total;
+    if (i > 0) {
+      for (PositionIndex n=0;n<g_max_fertility;n++) {
+        COUNT& ncount=nCountTable.getRef(es[i],n);
+        ncount=COUNT(ncount+counts.ncount(i,n)/all_total);
       }
     }
-    p0count+=p0/all_total;
-    p1count+=p1/all_total;
   }
- return nAl;
+  p0count+=counts.p0/all_total;
+  p1count+=counts.p1/all_total;
+}
+
+template <class TRANSPAIR, class MODEL>
+int collectCountsOverNeighborhood(const Vector<pair<MoveSwapMatrix<TRANSPAIR>*,LogProb> >& smsc,
+                                  Vector<WordIndex>& es,
+                                  Vector<WordIndex>& fs,
+                                  TModel<COUNT,PROB>& tTable,
+                                  AModel<COUNT>& aCountTable,
+                                  AModel<COUNT>& dCountTable,
+                                  nmodel<COUNT>& nCountTable,
+                                  double& p1count,
+                                  double& p0count,
+                                  LogProb& _total,
+                                  float count,
+                                  bool addCounts,
+                                  MODEL* d4Table) {
+  NeighborhoodCounts counts;
+  int nAl=deferCountsOverNeighborhood(smsc,es.size()-1,fs.size()-1,count,addCounts,counts,d4Table);
+  _total=counts.total;
+  if (addCounts && counts.total>0 && counts.total<HUGE_VAL) {
+    addNeighborhoodCounts(counts,es,fs,count,tTable,aCountTable,dCountTable,nCountTable,p1count,p0count);
+    counts.distortion.addTo(d4Table);
+  }
+  return nAl;
 }
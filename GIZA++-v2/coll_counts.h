@@ -22,11 +22,16 @@
 #ifndef GIZAPP_COLL_COUNTS_H_
 #define GIZAPP_COLL_COUNTS_H_
 
+#include <stdint.h>
+#include <algorithm>
 #include <set>
 #include <ostream>
 #include <utility>
 
 #include "defs.h"
+#include "key_index.h"
+#include "util/array2.h"
+#include "util/binary_file.h"
 #include "util/vector.h"
 // #include "transpair_model3.h"
 // #include "transpair_model4.h"
@@ -37,6 +42,9 @@ template <class T> class MoveSwapMatrix;
 template <class T> class AModel;
 template <class T> class nmodel;
 template <class COUNT, class PROB> class TModel;
+class WordClasses;
+class d4model;
+class d5model;
 
 class OneMoveSwap {
  public:
@@ -78,6 +86,173 @@ bool makeOneMoveSwap(const Alignment& a,
                      const Alignment& b,
                      std::set<OneMoveSwap>& oms);
 
+// Model 4/5 distortion counts of one sentence pair, summed per table cell
+// and added to the d4model/d5model once the pair is done, so they can be
+// collected while other threads read those; D4 and D5 mirror their count
+// interface.
+class DistortionCounts {
+ public:
+  enum Table { kD4First, kD4Bigger, kD5First, kD5Bigger };
+
+  class D4 {
+   public:
+    D4(DistortionCounts& counts, const WordClasses& e, const WordClasses& f)
+        : ewordclasses(e), fwordclasses(f), counts_(counts) {}
+    const WordClasses& ewordclasses;
+    const WordClasses& fwordclasses;
+    double& getCountRef_first(WordIndex j,WordIndex j_cp,int E,int F,int l,int m) {
+      return counts_.cell(kD4First,j,j_cp,E,F,l,m,0);
+    }
+    double& getCountRef_bigger(WordIndex j,WordIndex j_prev,int E,int F,int l,int m) {
+      return counts_.cell(kD4Bigger,j,j_prev,E,F,l,m,0);
+    }
+   private:
+    DistortionCounts& counts_;
+  };
+
+  class D5 {
+   public:
+    D5(DistortionCounts& counts, const WordClasses& e4, const WordClasses& f4,
+       const WordClasses& f)
+        : d4m(counts,e4,f4), fwordclasses(f), counts_(counts) {}
+    D4 d4m;
+    const WordClasses& fwordclasses;
+    double& getCountRef_first(PositionIndex vacancies_j,PositionIndex vacancies_jp,int F,
+                             PositionIndex l,PositionIndex m,PositionIndex vacancies_total) {
+      return counts_.cell(kD5First,vacancies_j,vacancies_jp,0,F,l,m,vacancies_total);
+    }
+    double& getCountRef_bigger(PositionIndex vacancies_j,PositionIndex vacancies_jp,int F,
+                              PositionIndex l,PositionIndex m,PositionIndex vacancies_total) {
+      return counts_.cell(kD5Bigger,vacancies_j,vacancies_jp,0,F,l,m,vacancies_total);
+    }
+   private:
+    DistortionCounts& counts_;
+  };
+
+  DistortionCounts() {}
+
+  void addTo(void*) const {}
+  // defined in coll_counts.cpp, which is included where they are used
+  inline void addTo(d4model* d4Table) const;
+  inline void addTo(d5model* d5Table) const;
+
+  // the cells in the binary format of the -shards files
+  void writeBinary(util::BinaryWriter& out) const {
+    index_.writeBinary(out);
+    out.PutArray(values_);
+  }
+  bool readBinary(util::BinaryReader& in) {
+    return index_.readBinary(in) && in.GetArray(values_) && index_.size() == values_.size();
+  }
+
+ private:
+  struct Key {
+    int v[8];
+    bool operator==(const Key& k) const {
+      return std::equal(v,v+8,k.v);
+    }
+    friend uint64_t hashOf(const Key& k) {
+      uint64_t h=0;
+      for (int i=0;i<8;++i)
+        h=(h+unsigned(k.v[i]))*0x9e3779b97f4a7c15ULL;
+      return h;
+    }
+  };
+
+  double& cell(Table t,int a,int b,int E,int F,int l,int m,int total) {
+    const Key k={{t,a,b,E,F,l,m,total}};
+    int n=index_.find(k);
+    if (n<0) {
+      n=index_.add(k);
+      values_.push_back(0.0);
+    }
+    return values_[n];
+  }
+
+  // cells in the order they were first used
+  KeyIndex<Key> index_;
+  Vector<double> values_;
+};
+
+// Counts of one sentence pair over the neighbourhoods of its centers, before
+// they are added to the tables (see gatherCountsOverNeighborhood).
+class NeighborhoodCounts {
+ public:
+  NeighborhoodCounts() : p0(0), p1(0), total(0) {}
+  Array2<LogProb,Vector<LogProb> > dtcount,ncount;
+  LogProb p0,p1,total;
+  DistortionCounts distortion;
+
+  // in the binary format of the -shards files
+  void writeBinary(util::BinaryWriter& out) const {
+    putArray2(out, dtcount);
+    putArray2(out, ncount);
+    out.Put(p0);
+    out.Put(p1);
+    out.Put(total);
+    distortion.writeBinary(out);
+  }
+  bool readBinary(util::BinaryReader& in) {
+    return getArray2(in, dtcount) && getArray2(in, ncount) && in.Get(p0) && in.Get(p1) &&
+        in.Get(total) && distortion.readBinary(in);
+  }
+
+ private:
+  static void putArray2(util::BinaryWriter& out, const Array2<LogProb,Vector<LogProb> >& a) {
+    out.Put(a.getLen1());
+    out.PutRange(a.getLen1() && a.getLen2() ? &a(0, 0) : 0, size_t(a.getLen1()) * a.getLen2());
+  }
+  static bool getArray2(util::BinaryReader& in, Array2<LogProb,Vector<LogProb> >& a) {
+    unsigned int h1 = 0;
+    size_t n = 0;
+    if (!in.Get(h1))
+      return false;
+    const LogProb* p = in.GetRange<LogProb>(n);
+    if (!in.IsOK() || (h1 ? n % h1 : n))
+      return false;
+    a.resize(h1, h1 ? (unsigned int)(n / h1) : 0);
+    std::copy(p, p + n, a.begin());
+    return true;
+  }
+};
+
+// Collects the counts of a sentence pair into 'counts' without modifying any
+// table; 'counts.total' is the probability mass of the neighbourhood.
+// The model 4/5 counts go into 'd4Table', a DistortionCounts::D4 or ::D5
+// sink. Returns the number of alignments.
+template<class TRANSPAIR,class MODEL>
+int gatherCountsOverNeighborhood(const Vector<std::pair<MoveSwapMatrix<TRANSPAIR>*,LogProb> >&smsc,
+                                 PositionIndex l, PositionIndex m, float count,
+                                 bool addCounts, NeighborhoodCounts& counts,
+                                 MODEL* d4Table);
+
+// Like collectCountsOverNeighborhood, but leaves all counts, including the
+// model 4/5 counts meant for 'd4Table', in 'counts'. Safe to run while other
+// threads read the tables.
+template<class TRANSPAIR>
+int deferCountsOverNeighborhood(const Vector<std::pair<MoveSwapMatrix<TRANSPAIR>*,LogProb> >&smsc,
+                                PositionIndex l, PositionIndex m, float count,
+                                bool addCounts, NeighborhoodCounts& counts, void* d4Table);
+template<class TRANSPAIR>
+int deferCountsOverNeighborhood(const Vector<std::pair<MoveSwapMatrix<TRANSPAIR>*,LogProb> >&smsc,
+                                PositionIndex l, PositionIndex m, float count,
+                                bool addCounts, NeighborhoodCounts& counts, d4model* d4Table);
+template<class TRANSPAIR>
+int deferCountsOverNeighborhood(const Vector<std::pair<MoveSwapMatrix<TRANSPAIR>*,LogProb> >&smsc,
+                                PositionIndex l, PositionIndex m, float count,
+                                bool addCounts, NeighborhoodCounts& counts, d5model* d5Table);
+
+// Adds the t, a, d, n and p counts gathered by gatherCountsOverNeighborhood;
+// the model 4/5 counts are added by counts.distortion.addTo.
+inline void addNeighborhoodCounts(const NeighborhoodCounts& counts,
+                           const Vector<WordIndex>& es,
+                           const Vector<WordIndex>& fs,
+                           float count,
+                           TModel<COUNT,PROB>& tTable,
+                           AModel<COUNT>& aCountTable, AModel<COUNT>& dCountTable,
+                           nmodel<COUNT>& nCountTable, double& p1count,
+                           double& p0count);
+
 // TODO: Need refactoring. this function requires too arguments.
 template<class TRANSPAIR,class MODEL>
 int collectCountsOverNeighborhood(const Vector<std::pair<MoveSwapMatrix<TRANSPAIR>*,LogProb> >&smsc,
@@ -23,9 +23,12 @@
 #define GIZAPP_D4TABLES_H_
 
 #include <math.h>
+#include <stdint.h>
 #include "word_classes.h"
 #include "globals.h"
+#include "key_index.h"
 #include "util/assert.h"
+#include "util/binary_file.h"
 
 extern float d4modelsmooth_factor;
 
@@ -133,11 +136,115 @@ inline void tokenize(const string&in,Vector<string>&out) {
     out.push_back(s);
 }
 
+/*
+  Tables of (count, prob) pairs of a distortion model, stored back to back
+  in one vector and numbered through a KeyIndex over their packed keys
+  (see m4_tables and m5_tables).
+*/
+template<class KEY>
+class keyed_jump_tables {
+ public:
+  typedef pair<COUNT,PROB> Jump;
+
+  // number of the table of key k, -1 if there is none; table numbers stay
+  // valid when tables are added
+  int find(KEY k) const { return index.find(k); }
+
+  unsigned int size() const { return index.size(); }
+  KEY keyOf(int n) const { return index.key(n); }
+
+  // table numbers in the order of their keys
+  Vector<int> byKey() const { return index.byKey(); }
+
+  void clearCounts() {
+    for (unsigned int n=0;n<jumps.size();++n)
+      jumps[n].first=0.0;
+  }
+
+  // bytes used by the tables
+  size_t memoryBytes() const {
+    return index.memoryBytes()+jumps.size()*sizeof(Jump);
+  }
+
+ protected:
+  KeyIndex<KEY> index;  // number of each table
+  Vector<Jump> jumps;   // the tables
+};
+
+/*
+  Jump tables of one kind (head or non-head of a cept) of a d4model, keyed
+  by the dependencies switched on (l, m, F and E, 16 bits each; the others
+  are zero). Each table holds 2*msl+1 (count, prob) pairs, the jump j-j' at
+  position j-j'+msl.
+*/
+class m4_tables : public keyed_jump_tables<uint64_t> {
+ public:
+  // 'deps' uses the DEP_MODEL_l/m/F/E bits
+  m4_tables(int _deps, PositionIndex msl)
+      : deps(_deps), width(msl*2+1) {}
+
+  uint64_t key(int l, int m, int F, int E) const {
+    MASSERT(l<65536&&m<65536&&F>=0&&F<65536&&E>=0&&E<65536);
+    return (uint64_t((deps&DEP_MODEL_l)?l:0)<<48) | (uint64_t((deps&DEP_MODEL_m)?m:0)<<32)
+        | (uint64_t((deps&DEP_MODEL_F)?F:0)<<16) | uint64_t((deps&DEP_MODEL_E)?E:0);
+  }
+  int keyL(uint64_t k) const { return int(k>>48); }
+  int keyM(uint64_t k) const { return int((k>>32)&0xffff); }
+  int keyF(uint64_t k) const { return int((k>>16)&0xffff); }
+  int keyE(uint64_t k) const { return int(k&0xffff); }
+
+  // table of key k, created with zero counts and probabilities if needed
+  Jump* insert(uint64_t k) {
+    int n=index.find(k);
+    if (n<0) {
+      n=index.add(k);
+      for (int i=0;i<width;i++)
+        jumps.push_back(Jump(0.0,0.0));
+    }
+    return &jumps[n*width];
+  }
+
+  unsigned int jumpsPerTable() const { return width; }
+  const Jump* table(int n) const { return &jumps[n*width]; }
+
+  void writeBinary(util::BinaryWriter&out) const {
+    out.Put(deps);
+    out.Put(width);
+    index.writeBinary(out);
+    out.PutArray(jumps);
+  }
+
+  bool readBinary(util::BinaryReader&in) {
+    int d=0,w=0;
+    in.Get(d);
+    in.Get(w);
+    if (d!=deps||w!=width||!index.readBinary(in)||!in.GetArray(jumps))
+      return false;
+    return jumps.size()==size_t(index.size())*width;
+  }
+
+  // relative frequencies (uniform for tables without counts)
+  void normalize() {
+    for (unsigned int t=0;t<index.size();++t) {
+      Jump*d=&jumps[t*width];
+      double sum=0.0;
+      for (int i=0;i<width;i++)
+        sum+=d[i].first;
+      for (int i=0;i<width;i++)
+        d[i].second=sum?(d[i].first/sum):(1.0/width);
+    }
+  }
+
+ private:
+  int deps;
+  int width;
+};
+
 class d4model {
  public:
-  typedef Vector<pair<COUNT,PROB> > Vpff;
-  map<m4_key,Vpff,compare1 > D1;
-  map<m4_key,Vpff,compareb1> Db1;
+  typedef m4_tables::Jump Jump;
+  m4_tables D1;   // head of cept
+  m4_tables Db1;  // non-head of cept
   PositionIndex msl;
   WordClasses ewordclasses;
   WordClasses fwordclasses;
@@ -156,131 +263,97 @@ class d4model {
       fwordclasses.read(fstrm,m2);
     }
   }
+  // the same from lines "word class" in memory
+  template<class MAPPER>
+  void makeWordClasses(const MAPPER&m1,const MAPPER&m2,istream&estrm,istream&fstrm) {
+    ewordclasses.read(estrm,m1);
+    fwordclasses.read(fstrm,m2);
+  }
 
-  d4model(PositionIndex _msl) : D1(compare1(M4_Dependencies)),
-                                Db1(compareb1(M4_Dependencies)),
+  d4model(PositionIndex _msl) : D1(M4_Dependencies&15,_msl),
+                                Db1((M4_Dependencies>>4)&15,_msl),
                                 msl(_msl) { }
 
+  size_t memoryBytes() const { return D1.memoryBytes()+Db1.memoryBytes(); }
+
   COUNT& getCountRef_first(WordIndex j,WordIndex j_cp,int E,int F,int l,int m)  {
     assert(j>=1);
-    m4_key key(M4_Dependencies,l,m,F,E,j_cp,-1,-1);
-    map<m4_key,Vpff,compare1 >::iterator p=D1.find(key);
-    if (p==D1.end())
-      p = D1.insert(make_pair(key,Vpff(msl*2+1,pair<COUNT,PROB>(0.0,0.0)))).first;
-    assert(p!=D1.end());
-    return (p->second)[j-j_cp+msl].first;
+    return D1.insert(D1.key(l,m,F,E))[j-j_cp+msl].first;
   }
 
   COUNT& getCountRef_bigger(WordIndex j,WordIndex j_prev,int E,int F,int l,int m) {
     assert(j>=1);
     assert(j_prev>=1);
-    m4_key key(M4_Dependencies,l,m,F,E,j_prev,-1,-1);
-    map<m4_key,Vpff,compareb1 >::iterator p=Db1.find(key);
-    if (p==Db1.end())
-      p = Db1.insert(make_pair(key,Vpff(msl*2+1,pair<COUNT,PROB>(0.0,0.0)))).first;
-    assert(p!=Db1.end());
-    return (p->second)[j-j_prev+msl].first;
+    return Db1.insert(Db1.key(l,m,F,E))[j-j_prev+msl].first;
   }
 
-  map<m4_key,Vpff,compare1 >::const_iterator getProb_first_iterator(int E,int F,int l,int m) const {
-    return D1.find(m4_key(M4_Dependencies,l,m,F,E,0,-1,-1));
+  int getProb_first_iterator(int E,int F,int l,int m) const {
+    return D1.find(D1.key(l,m,F,E));
   }
 
-  PROB getProb_first_withiterator(WordIndex j,WordIndex j_cp,int m,const map<m4_key,Vpff,compare1 >::const_iterator& p) const {
+  PROB getProb_first_withiterator(WordIndex j,WordIndex j_cp,int m,int n) const {
     assert(j>=1);//assert(j_cp>=0);
     assert(j<=msl);assert(j_cp<=msl);
-    if (p==D1.end()) {
+    if (n<0) {
       return g_smooth_prob;
     } else {
-      MASSERT((p->second)[j-j_cp+msl].second<=1.0);
-      return max(g_smooth_prob,d4modelsmooth_factor/(2*m-1)+(1-d4modelsmooth_factor)*(p->second)[j-j_cp+msl].second);
+      const Jump*p=D1.table(n);
+      MASSERT(p[j-j_cp+msl].second<=1.0);
+      return max(g_smooth_prob,d4modelsmooth_factor/(2*m-1)+(1-d4modelsmooth_factor)*p[j-j_cp+msl].second);
     }
   }
 
   PROB getProb_first(WordIndex j,WordIndex j_cp,int E,int F,int l,int m) const {
-    assert(j>=1);//assert(j_cp>=0);
-    assert(j<=msl);assert(j_cp<=msl);
-    m4_key key(M4_Dependencies,l,m,F,E,j_cp,-1,-1);
-    map<m4_key,Vpff,compare1 >::const_iterator p=D1.find(key);
-
-    if (p==D1.end()) {
-      return g_smooth_prob;
-    } else {
-      MASSERT((p->second)[j-j_cp+msl].second<=1.0);
-      return max(g_smooth_prob,d4modelsmooth_factor/(2*m-1)+(1-d4modelsmooth_factor)*(p->second)[j-j_cp+msl].second);
-    }
+    return getProb_first_withiterator(j,j_cp,m,getProb_first_iterator(E,F,l,m));
   }
 
-  map<m4_key,Vpff,compareb1 >::const_iterator getProb_bigger_iterator(int E,int F,int l,int m) const {
-    return Db1.find(m4_key(M4_Dependencies,l,m,F,E,0,-1,-1));
+  int getProb_bigger_iterator(int E,int F,int l,int m) const {
+    return Db1.find(Db1.key(l,m,F,E));
   }
 
-  PROB getProb_bigger_withiterator(WordIndex j,WordIndex j_prev,int m,const map<m4_key,Vpff,compareb1 >::const_iterator&p) const {
+  PROB getProb_bigger_withiterator(WordIndex j,WordIndex j_prev,int m,int n) const {
     MASSERT(j>=1);MASSERT(j_prev>=1);
     MASSERT(j>j_prev);
     MASSERT(j<=msl);MASSERT(j_prev<=msl);
-    if (p==Db1.end()) {
+    if (n<0) {
       return g_smooth_prob;
     } else {
-      MASSERT((p->second)[j-j_prev+msl].second<=1.0);
-      return max(g_smooth_prob,d4modelsmooth_factor/(m-1)+(1-d4modelsmooth_factor)*(p->second)[j-j_prev+msl].second);
+      const Jump*p=Db1.table(n);
+      MASSERT(p[j-j_prev+msl].second<=1.0);
+      return max(g_smooth_prob,d4modelsmooth_factor/(m-1)+(1-d4modelsmooth_factor)*p[j-j_prev+msl].second);
     }
   }
 
   PROB getProb_bigger(WordIndex j,WordIndex j_prev,int E,int F,int l,int m) const {
-    MASSERT(j>=1);MASSERT(j_prev>=1);
-    MASSERT(j>j_prev);
-    MASSERT(j<=msl);MASSERT(j_prev<=msl);
-    m4_key key(M4_Dependencies,l,m,F,E,j_prev,-1,-1);
-    map<m4_key,Vpff,compareb1 >::const_iterator p=Db1.find(key);
-    if (p==Db1.end()) {
-      return g_smooth_prob;
-    } else {
-      MASSERT((p->second)[j-j_prev+msl].second<=1.0);
-      return max(g_smooth_prob, d4modelsmooth_factor/(m-1)+(1-d4modelsmooth_factor)*(p->second)[j-j_prev+msl].second);
-    }
+    return getProb_bigger_withiterator(j,j_prev,m,getProb_bigger_iterator(E,F,l,m));
   }
 
   void normalizeTable() {
-    int nParams=0;
-    for (map<m4_key,Vpff,compare1 >::iterator i=D1.begin();i!=D1.end();++i) {
-      Vpff&d1=i->second;
-      double sum=0.0;
-      for (PositionIndex i=0;i<d1.size();i++)
-        sum+=d1[i].first;
-
-      for (PositionIndex i=0;i<d1.size();i++) {
-        d1[i].second=sum?(d1[i].first/sum):(1.0/d1.size());
-        nParams++;
-      }
-    }
+    D1.normalize();
+    Db1.normalize();
+    cout << "D4 table contains " << (D1.size()+Db1.size())*D1.jumpsPerTable() << " parameters.\n";
+  }
 
-    for (map<m4_key,Vpff,compareb1 >::iterator i=Db1.begin();i!=Db1.end();++i) {
-      Vpff&db1=i->second;
-      double sum=0.0;
-      for (PositionIndex i=0;i<db1.size();i++)
-        sum+=db1[i].first;
-      for (PositionIndex i=0;i<db1.size();i++) {
-        db1[i].second=sum?(db1[i].first/sum):(1.0/db1.size());
-        nParams++;
-      }
-    }
+  void clear() {
+    D1.clearCounts();
+    Db1.clearCounts();
+  }
 
-    cout << "D4 table contains " << nParams << " parameters.\n";
+  // the tables in the binary format of the training checkpoints
+  void writeBinary(util::BinaryWriter&out) const {
+    D1.writeBinary(out);
+    Db1.writeBinary(out);
   }
 
-  void clear() {
-    for (map<m4_key,Vpff,compare1 >::iterator i=D1.begin();i!=D1.end();++i) {
-      Vpff&d1=i->second;
-      for (PositionIndex i=0;i<d1.size();i++)
-        d1[i].first=0.0;
-    }
+  bool readBinary(util::BinaryReader&in) {
+    return D1.readBinary(in)&&Db1.readBinary(in);
+  }
 
-    for (map<m4_key,Vpff,compareb1 >::iterator i=Db1.begin();i!=Db1.end();++i) {
-      Vpff&db1=i->second;
-      for (PositionIndex i=0;i<db1.size();i++)
-        db1[i].first=0.0;
-    }
+  // the key of table n of D1 (b=0) or Db1 (b=1), for printing
+  m4_key keyOf(bool b, int n) const {
+    const m4_tables&t=b?Db1:D1;
+    const uint64_t k=t.keyOf(n);
+    return m4_key(M4_Dependencies,t.keyL(k),t.keyM(k),t.keyF(k),t.keyE(k),0,-1,-1);
   }
 
   void printProbTable(const char*fname1,const char*fname2) {
@@ -288,17 +361,18 @@ class d4model {
     double ssum=0.0;
     out << "# Translation tables for Model 4 .\n";
     out << "# Table for head of cept.\n";
-    for (map<m4_key,Vpff,compare1>::const_iterator i = D1.begin();
-        i != D1.end();++i) {
-      const Vpff&d1=i->second;
+    const Vector<int> order1=D1.byKey(), orderb1=Db1.byKey();
+    const unsigned int width=D1.jumpsPerTable();
+    for (unsigned int n=0;n<order1.size();++n) {
+      const Jump*d1=D1.table(order1[n]);
       double sum=0.0;
-      for (PositionIndex ii=0;ii<d1.size();ii++)
+      for (PositionIndex ii=0;ii<width;ii++)
         sum += d1[ii].first;
 
       if (sum) {
-        print1(out,i->first,ewordclasses,fwordclasses);
+        print1(out,keyOf(0,order1[n]),ewordclasses,fwordclasses);
         out << "SUM: " << sum << ' '<< '\n';
-        for (unsigned ii=0;ii<d1.size();ii++) {
+        for (unsigned ii=0;ii<width;ii++) {
           if (d1[ii].first)
             out << (int)(ii)-(int)(msl) << ' ' << d1[ii].first << '\n';
         }
@@ -308,16 +382,15 @@ class d4model {
     }
 
     out << "# Table for non-head of cept.\n";
-    for (map<m4_key,Vpff,compareb1 >::const_iterator i=Db1.begin();
-        i!=Db1.end();++i) {
-      const Vpff&db1=i->second;
+    for (unsigned int n=0;n<orderb1.size();++n) {
+      const Jump*db1=Db1.table(orderb1[n]);
       double sum=0.0;
-      for (PositionIndex ii=0;ii<db1.size();++ii)
+      for (PositionIndex ii=0;ii<width;++ii)
         sum+=db1[ii].first;
       if (sum) {
-        printb1(out,i->first,ewordclasses,fwordclasses);
+        printb1(out,keyOf(1,orderb1[n]),ewordclasses,fwordclasses);
         out << "SUM: " << sum << ' '<<'\n';
-        for (unsigned ii=0;ii<db1.size();ii++) {
+        for (unsigned ii=0;ii<width;ii++) {
           if (db1[ii].first) {
             out << (int)(ii)-(int)(msl) << ' ' << db1[ii].first << '\n';
           }
@@ -331,25 +404,24 @@ class d4model {
     if (M4_Dependencies == 76) {
       ofstream out2(fname2);
 
-      for (map<m4_key,Vpff,compare1 >::const_iterator i=D1.begin();
-          i != D1.end(); ++i) {
-        const Vpff&d1=i->second;
-        for (unsigned ii=0;ii<d1.size();ii++) {
+      for (unsigned int n=0;n<order1.size();++n) {
+        const Jump*d1=D1.table(order1[n]);
+        const m4_key k=keyOf(0,order1[n]);
+        for (unsigned ii=0;ii<width;ii++) {
           if (d1[ii].first) {
-            out2 << ewordclasses.classString(i->first.E) << ' '
-                 << fwordclasses.classString(i->first.F) << ' '
+            out2 << ewordclasses.classString(k.E) << ' '
+                 << fwordclasses.classString(k.F) << ' '
                  << (int)(ii)-(int)(msl) << ' ' << d1[ii].second << '\n';
           }
         }
       }
 
-      for (map<m4_key,Vpff,compareb1 >::const_iterator i=Db1.begin();
-          i != Db1.end();++i) {
-        const Vpff& db1 = i->second;
-
-        for (unsigned ii=0;ii<db1.size();ii++) {
+      for (unsigned int n=0;n<orderb1.size();++n) {
+        const Jump*db1=Db1.table(orderb1[n]);
+        const m4_key k=keyOf(1,orderb1[n]);
+        for (unsigned ii=0;ii<width;ii++) {
           if (db1[ii].first) {
-            out2 << -1 << ' ' << fwordclasses.classString(i->first.F) << ' '
+            out2 << -1 << ' ' << fwordclasses.classString(k.F) << ' '
                  << (int)(ii)-(int)(msl) << ' ' << db1[ii].second << '\n';
           }
         }
@@ -413,9 +485,7 @@ class d4model {
         getline(file,line);
         istringstream twonumbers(line);
         if (twonumbers >> value >> count) {
-          if (D1.count(k)==0)
-            D1.insert(make_pair(k,Vpff(msl*2+1,pair<COUNT,PROB>(0.0,0.0))));
-          D1[k][value+msl]=make_pair(count,count/sum);
+          D1.insert(D1.key(k.l,k.m,k.F,k.E))[value+msl]=make_pair(count,count/sum);
         }
 
       } while (line.length());
@@ -479,9 +549,7 @@ class d4model {
         getline(file,line);
         istringstream twonumbers(line);
         if (twonumbers >> value >> count) {
-          if (Db1.count(k) == 0)
-            Db1.insert(make_pair(k,Vpff(msl*2+1,pair<COUNT,PROB>(0.0,0.0))));
-          Db1[k][value+msl]=make_pair(count,count/sum);
+          Db1.insert(Db1.key(k.l,k.m,k.F,k.E))[value+msl]=make_pair(count,count/sum);
         }
 
       } while (file&&line.length());
@@ -30,11 +30,90 @@ extern float d5modelsmooth_factor;
 
 #define UNSEENPROB (1.0/vacancies_total)
 
+/*
+  Vacancy tables of one kind (head or non-head of a cept) of a d5model,
+  stored like the m4_tables of a d4model. The key holds l, m and F as far
+  as 'deps' switches them on, the vacancies v1 left of the previous center
+  (head tables only, -1 otherwise) and the number v2 of vacancies the word
+  can go to; the packed keys sort like m4_keys under compare1/compareb1. A
+  table holds v2+1 (count, prob) pairs.
+*/
+class m5_tables : public keyed_jump_tables<uint64_t> {
+ public:
+  // 'deps' uses the DEP_MODEL_l/m/F bits
+  m5_tables(int _deps) : deps(_deps) {}
+
+  uint64_t key(int l, int m, int F, int v1, int v2) const {
+    MASSERT(l<4096&&m<4096&&F>=0&&F<65536&&v1>=-1&&v1<4095&&v2>0&&v2<4096);
+    return (uint64_t((deps&DEP_MODEL_l)?l:0)<<52) | (uint64_t((deps&DEP_MODEL_m)?m:0)<<40)
+        | (uint64_t((deps&DEP_MODEL_F)?F:0)<<24) | (uint64_t(v1+1)<<12) | uint64_t(v2);
+  }
+  int keyL(uint64_t k) const { return int(k>>52); }
+  int keyM(uint64_t k) const { return int((k>>40)&0xfff); }
+  int keyF(uint64_t k) const { return int((k>>24)&0xffff); }
+  int keyV1(uint64_t k) const { return int((k>>12)&0xfff)-1; }
+  int keyV2(uint64_t k) const { return int(k&0xfff); }
+
+  // table of key k, created with zero counts and uniform probabilities if needed
+  Jump* insert(uint64_t k) {
+    int n=index.find(k);
+    if (n<0) {
+      const int v2=keyV2(k);
+      n=index.add(k);
+      starts.push_back(jumps.size());
+      for (int i=0;i<=v2;i++)
+        jumps.push_back(Jump(0.0,1.0/v2));
+    }
+    return &jumps[starts[n]];
+  }
+
+  unsigned int parameters() const { return jumps.size(); }
+
+  // bytes used by the tables
+  size_t memoryBytes() const {
+    return keyed_jump_tables<uint64_t>::memoryBytes()+starts.size()*sizeof(unsigned int);
+  }
+  unsigned int jumpsOf(int n) const { return keyV2(keyOf(n))+1; }
+  Jump* table(int n) { return &jumps[starts[n]]; }
+  const Jump* table(int n) const { return &jumps[starts[n]]; }
+
+  void writeBinary(util::BinaryWriter&out) const {
+    out.Put(deps);
+    index.writeBinary(out);
+    out.PutArray(starts);
+    out.PutArray(jumps);
+  }
+
+  bool readBinary(util::BinaryReader&in) {
+    int d=0;
+    in.Get(d);
+    if (d!=deps||!index.readBinary(in)||!in.GetArray(starts)||!in.GetArray(jumps))
+      return false;
+    if (starts.size()!=index.size())
+      return false;
+    for (unsigned int n=0;n<index.size();++n)
+      if (size_t(starts[n])+jumpsOf(n)>jumps.size())
+        return false;
+    return true;
+  }
+
+ private:
+  int deps;
+  Vector<unsigned int> starts; // first pair of each table in jumps
+};
+
 class d5model {
  private:
-  typedef Vector < pair < COUNT,PROB > >Vpff;
-  map< m4_key,Vpff,compare1 > D1;
-  map< m4_key,Vpff,compareb1 > Db1;
+  typedef m5_tables::Jump Jump;
+  m5_tables D1;   // head of cept
+  m5_tables Db1;  // non-head of cept
+
+  // the key of table n of D1 (b=0) or Db1 (b=1), for printing
+  m4_key keyOf(bool b, int n) const {
+    const m5_tables&t=b?Db1:D1;
+    const uint64_t k=t.keyOf(n);
+    return m4_key(M5_Dependencies,t.keyL(k),t.keyM(k),t.keyF(k),0,0,t.keyV1(k),t.keyV2(k));
+  }
 
  public:
   d4model& d4m;
@@ -52,11 +131,20 @@ class d5model {
     else
       fwordclasses.read(fstrm,m2);
   }
+  // the same from lines "word class" in memory
+  template<class MAPPER>
+  void makeWordClasses(const MAPPER&m1,const MAPPER&m2,istream&estrm,istream&fstrm) {
+    ewordclasses.read(estrm,m1);
+    fwordclasses.read(fstrm,m2);
+  }
 
-  d5model(d4model&_d4m) : D1(compare1(M5_Dependencies)),
-                          Db1(compareb1(M5_Dependencies)),
+  d5model(d4model&_d4m) : D1(M5_Dependencies&15),
+                          Db1((M5_Dependencies>>4)&15),
                           d4m(_d4m) { }
 
+  // bytes of the Model 5 tables, without those of d4m
+  size_t memoryBytes() const { return D1.memoryBytes()+Db1.memoryBytes(); }
+
   COUNT &getCountRef_first(PositionIndex vacancies_j,
                            PositionIndex vacancies_jp,
                            int F,
@@ -68,13 +156,7 @@ class d5model {
     //MASSERT(vacancies_jp<=vacancies_total);
     MASSERT(vacancies_j <=vacancies_total);
     MASSERT(vacancies_total<=m);
-    m4_key key(M5_Dependencies,l,m,F,0,0,vacancies_jp,vacancies_total);
-    map<m4_key,Vpff,compare1 >::iterator p=D1.find(key);
-    if (p == D1.end()) {
-      p = D1.insert(make_pair(key,Vpff(vacancies_total+1,make_pair(0,UNSEENPROB)))).first; // !!! constrain length
-    }
-    MASSERT(p!=D1.end());
-    return (p->second)[vacancies_j].first;
+    return D1.insert(D1.key(l,m,F,vacancies_jp,vacancies_total))[vacancies_j].first;
   }
 
   COUNT &getCountRef_bigger(PositionIndex vacancies_j,
@@ -85,12 +167,7 @@ class d5model {
     MASSERT(vacancies_total>0);
     MASSERT (vacancies_jp <= vacancies_j);
     MASSERT (vacancies_j-vacancies_jp <= vacancies_total);
-    m4_key key(M5_Dependencies,l,m,F,0,0,-1,vacancies_total);
-    map<m4_key,Vpff,compareb1 >::iterator p=Db1.find(key);
-    if (p==Db1.end())
-      p=Db1.insert(make_pair(key,Vpff(vacancies_total+1,make_pair(0,UNSEENPROB)))).first; // !!! constrain length
-    MASSERT(p!=Db1.end());
-    return (p->second)[vacancies_j - vacancies_jp].first;
+    return Db1.insert(Db1.key(l,m,F,-1,vacancies_total))[vacancies_j - vacancies_jp].first;
   }
 
   PROB getProb_first(PositionIndex vacancies_j, PositionIndex vacancies_jp,
@@ -101,12 +178,11 @@ class d5model {
     //MASSERT(vacancies_jp<=vacancies_total);
     MASSERT(vacancies_j <=vacancies_total);
     MASSERT(vacancies_total<=m);
-    m4_key key(M5_Dependencies,l,m,F,0,0,vacancies_jp,vacancies_total);
-    map<m4_key,Vpff,compare1 >::const_iterator p=D1.find(key);
-    if (p==D1.end())
+    const int n=D1.find(D1.key(l,m,F,vacancies_jp,vacancies_total));
+    if (n<0)
       return UNSEENPROB;
     else
-      return max(g_smooth_prob,d5modelsmooth_factor/(vacancies_total)+(1-d5modelsmooth_factor)*(p->second)[vacancies_j].second);
+      return max(g_smooth_prob,d5modelsmooth_factor/(vacancies_total)+(1-d5modelsmooth_factor)*D1.table(n)[vacancies_j].second);
   }
 
   PROB getProb_bigger(PositionIndex vacancies_j, PositionIndex vacancies_jp,
@@ -116,54 +192,51 @@ class d5model {
     MASSERT(vacancies_total>0);
     MASSERT(vacancies_jp <= vacancies_j);
     MASSERT(vacancies_j-vacancies_jp <= vacancies_total);
-    m4_key key(M5_Dependencies,l,m,F,0,0,-1,vacancies_total);
-    map<m4_key,Vpff,compareb1 >::const_iterator p=Db1.find(key);
-    if (p==Db1.end())
+    const int n=Db1.find(Db1.key(l,m,F,-1,vacancies_total));
+    if (n<0)
       return UNSEENPROB;
     else
-      return max(g_smooth_prob, d5modelsmooth_factor/(vacancies_total)+(1-d5modelsmooth_factor)*(p->second)[vacancies_j - vacancies_jp].second);
+      return max(g_smooth_prob, d5modelsmooth_factor/(vacancies_total)+(1-d5modelsmooth_factor)*Db1.table(n)[vacancies_j - vacancies_jp].second);
   }
 
   void normalizeTable() {
-    int nParams=0;
-    for (map<m4_key,Vpff,compare1 >::iterator i=D1.begin();
-        i != D1.end(); ++i) {
-      Vpff&d1=i->second;
+    for (unsigned int n=0;n<D1.size();++n) {
+      Jump*d1=D1.table(n);
+      const unsigned int w=D1.jumpsOf(n);
       COUNT sum=0.0;
-      for (PositionIndex i=0;i<d1.size();i++)
+      for (PositionIndex i=0;i<w;i++)
         sum+=d1[i].first+d5modelsmooth_countoffset;
-      for (PositionIndex i=0;i<d1.size();i++) {
-        d1[i].second=sum?((d1[i].first+d5modelsmooth_countoffset)/sum):(1.0/d1.size());
-        nParams++;
-      }
+      for (PositionIndex i=0;i<w;i++)
+        d1[i].second=sum?((d1[i].first+d5modelsmooth_countoffset)/sum):(1.0/w);
     }
 
-    for (map<m4_key,Vpff,compareb1 >::iterator i=Db1.begin();i!=Db1.end();++i) {
-      Vpff&db1=i->second;
+    for (unsigned int n=0;n<Db1.size();++n) {
+      Jump*db1=Db1.table(n);
+      const unsigned int w=Db1.jumpsOf(n);
       double sum=0.0;
-      for (PositionIndex i=0;i<db1.size();i++)
+      for (PositionIndex i=0;i<w;i++)
         sum+=db1[i].first+d5modelsmooth_countoffset;
-      for (PositionIndex i=0;i<db1.size();i++) {
-        db1[i].second = sum ? ((db1[i].first+d5modelsmooth_countoffset)/sum) : (1.0/db1.size());
-        nParams++;
-      }
+      for (PositionIndex i=0;i<w;i++)
+        db1[i].second = sum ? ((db1[i].first+d5modelsmooth_countoffset)/sum) : (1.0/w);
     }
-    cout << "D5 table contains " << nParams << " parameters.\n";
+    cout << "D5 table contains " << D1.parameters()+Db1.parameters() << " parameters.\n";
   }
 
   friend ostream&operator<<(ostream&out, d5model&d5m) {
     out << "# Translation tables for Model 5 .\n";
     out << "# Table for head of cept.\n";
-    for (map<m4_key,Vpff,compare1 >::const_iterator i=d5m.D1.begin();
-        i != d5m.D1.end();++i) {
-      const Vpff&d1=i->second;
+    const Vector<int> order1=d5m.D1.byKey(), orderb1=d5m.Db1.byKey();
+    for (unsigned int n=0;n<order1.size();++n) {
+      const Jump*d1=d5m.D1.table(order1[n]);
+      const unsigned int w=d5m.D1.jumpsOf(order1[n]);
       COUNT sum=0.0;
-      for (PositionIndex ii=0;ii<d1.size();ii++)
+      for (PositionIndex ii=0;ii<w;ii++)
         sum+=d1[ii].first;
 
       if (sum) {
-        for (unsigned ii=0;ii<d1.size();ii++) {
-          print1_m5(out,i->first,d5m.ewordclasses,d5m.fwordclasses);
+        const m4_key k=d5m.keyOf(0,order1[n]);
+        for (unsigned ii=0;ii<w;ii++) {
+          print1_m5(out,k,d5m.ewordclasses,d5m.fwordclasses);
           out << (int)(ii) << ' ' << d1[ii].second  << ' ' << d1[ii].first << '\n';
         }
         out << endl;
@@ -172,14 +245,15 @@ class d5model {
 
     out << "# Table for non-head of cept.\n";
 
-    for (map<m4_key,Vpff,compareb1 >::const_iterator i=d5m.Db1.begin();
-        i != d5m.Db1.end(); ++i) {
-      const Vpff&db1=i->second;
+    for (unsigned int n=0;n<orderb1.size();++n) {
+      const Jump*db1=d5m.Db1.table(orderb1[n]);
+      const unsigned int w=d5m.Db1.jumpsOf(orderb1[n]);
       double sum=0.0;
-      for (PositionIndex ii=0;ii<db1.size();++ii)sum+=db1[ii].first;
+      for (PositionIndex ii=0;ii<w;++ii)sum+=db1[ii].first;
       if (sum) {
-        for (unsigned ii=0;ii<db1.size();ii++) {
-          printb1_m5(out,i->first,d5m.fwordclasses);
+        const m4_key k=d5m.keyOf(1,orderb1[n]);
+        for (unsigned ii=0;ii<w;ii++) {
+          printb1_m5(out,k,d5m.fwordclasses);
           out << (int)(ii) << ' ' << db1[ii].second << ' ' << db1[ii].first << '\n';
         }
         out << endl;
@@ -214,19 +288,18 @@ class d5model {
   }
 
   void clear() {
-    for (map<m4_key,Vpff,compare1 >::iterator i=D1.begin();
-         i!=D1.end();++i) {
-      Vpff&d1=i->second;
-      for (PositionIndex i=0;i<d1.size();i++)
-        d1[i].first=0.0;
-    }
+    D1.clearCounts();
+    Db1.clearCounts();
+  }
 
-    for (map<m4_key,Vpff,compareb1 >::iterator i=Db1.begin();
-        i!=Db1.end();++i) {
-      Vpff&db1=i->second;
-      for (PositionIndex i=0;i<db1.size();i++)
-        db1[i].first=0.0;
-    }
+  // the tables in the binary format of the training checkpoints (without d4m)
+  void writeBinary(util::BinaryWriter&out) const {
+    D1.writeBinary(out);
+    Db1.writeBinary(out);
+  }
+
+  bool readBinary(util::BinaryReader&in) {
+    return D1.readBinary(in)&&Db1.readBinary(in);
   }
 };
 
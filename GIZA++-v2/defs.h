@@ -36,7 +36,8 @@ const int kTransfer = 0;
 const int kTransferSimple = 1;
 const int kMaxWeight = 457979;
 const int kTrainBufSize = 50000;
-const unsigned int kMaxAllowedSentenceLength = 101;
+const unsigned int kDefaultMaxSentenceLength = 101;
+const unsigned int kMaxAllowedSentenceLength = 1001;
 const float kEPS = 0.000001;
 
 // TODO: we might want to consider enum type.
@@ -52,6 +53,6 @@ const int kParLevInput   = 8;
 extern WordIndex g_max_fertility;
 
 // Lambda that is used to scale cross_entropy factor
-extern double g_lambda;
+extern thread_local double g_lambda;
 
 #endif  // GIZAPP_DEFS_H_
@@ -0,0 +1,139 @@
+/*
+  This file is part of GIZA++.
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307,
+  USA.
+*/
+
+#include "estep_shards.h"
+
+#include <sys/wait.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include "globals.h"
+#include "parameter.h"
+#include "telemetry.h"
+
+GLOBAL_PARAMETER(int,Shards,"shards",
+                 "number of worker processes of the Model 1, HMM and Model 3/4/5 E-steps (0 or 1: none); "
+                 "they exchange their counts through the files prefix.shard*",kParLevSpecial,0);
+
+EStepShards::EStepShards(const char* model, int nPairs, bool sharded)
+    : model_(model), nPairs_(nPairs), nShards_(sharded && Shards > 1 ? Shards : 1),
+      shard_(-1), reading_(-1), out_(0), lookups_(0) {
+  if (nShards_ == 1)
+    return;
+  // the workers only write their files
+  cout.flush();
+  cerr.flush();
+  for (int k = 0; k < nShards_; ++k) {
+    const pid_t pid = fork();
+    if (pid < 0) {
+      fail("can not start a worker process");
+    } else if (pid == 0) {
+      shard_ = k;
+      pids_.clear();
+      lookups_ = g_ttable_lookups;
+      out_ = new util::BinaryWriter(filename(k));
+      if (!out_->IsOK())
+        fail("can not write " + filename(k));
+      return;
+    }
+    pids_.push_back(pid);
+  }
+}
+
+EStepShards::~EStepShards() {
+  delete out_;
+}
+
+int EStepShards::first(int shard) const {
+  return int((long long)(nPairs_) * shard / nShards_);
+}
+
+std::string EStepShards::filename(int shard) const {
+  ostringstream name;
+  name << g_prefix << ".shard" << shard;
+  return name.str();
+}
+
+util::BinaryWriter& EStepShards::out(int n) {
+  out_->Put<int>(n);
+  return *out_;
+}
+
+util::BinaryReader& EStepShards::results(int n) {
+  // pairs past the count of the corpus belong to the last shard
+  while (reading_ < nShards_ - 1 && (reading_ < 0 || n >= first(reading_ + 1)))
+    nextShard();
+  int written = -1;
+  if (!in_.Get(written) || written != n) {
+    ostringstream what;
+    what << "pair " << n << " is missing in " << filename(reading_);
+    fail(what.str());
+  }
+  return in_;
+}
+
+void EStepShards::nextShard() {
+  if (reading_ >= 0)
+    closeShard();
+  ++reading_;
+  int status = 0;
+  if (waitpid(pids_[reading_], &status, 0) != pids_[reading_] || !WIFEXITED(status) || WEXITSTATUS(status))
+    fail("the worker of " + filename(reading_) + " failed");
+  if (!in_.Open(filename(reading_)))
+    fail("can not read " + filename(reading_));
+}
+
+void EStepShards::closeShard() {
+  // the totals of the worker after its results
+  unsigned long long lookups = 0;
+  int end = 0;
+  if (!in_.Get(end) || end != -1 || !in_.Get(lookups))
+    fail("unexpected results in " + filename(reading_));
+  g_ttable_lookups += lookups;
+  in_.Close();
+  remove(filename(reading_).c_str());
+}
+
+void EStepShards::finish() {
+  if (working()) {
+    out_->Put<int>(-1);
+    out_->Put<unsigned long long>(g_ttable_lookups - lookups_);
+    const bool ok = out_->Commit();
+    if (!ok)
+      cerr << "ERROR: can not write " << filename(shard_) << '\n';
+    cout.flush();
+    cerr.flush();
+    _exit(ok ? 0 : 1);
+  }
+  if (reducing()) {
+    while (reading_ < nShards_ - 1)
+      nextShard();
+    closeShard();
+    pids_.clear();
+  }
+}
+
+void EStepShards::fail(const std::string& what) const {
+  cerr << "ERROR: " << model_ << " E-step: " << what << '\n';
+  if (working())
+    _exit(1);
+  exit(1);
+}
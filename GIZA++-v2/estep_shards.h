@@ -0,0 +1,94 @@
+/*
+  This file is part of GIZA++.
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307,
+  USA.
+*/
+
+#ifndef GIZAPP_ESTEP_SHARDS_H_
+#define GIZAPP_ESTEP_SHARDS_H_
+
+#include <sys/types.h>
+#include <string>
+#include <vector>
+#include "util/binary_file.h"
+
+/*
+  With -shards N the E-steps of Model 1, the HMM and Model 3/4/5 on the
+  training corpus run in N worker processes. The workers are forked when
+  an E-step starts, so they have the tables of the last M-step, and each
+  aligns a contiguous range of the sentence pairs. A worker writes the
+  counts and scores of its pairs to prefix.shard<k>; the training process
+  reads the files in corpus order and adds the counts to the tables the
+  same way it adds the counts of a pair it aligned itself, so the tables
+  are the same bit for bit as without -shards. It then normalizes them
+  for the workers of the next E-step.
+
+  The loop over the pairs of an E-step looks like
+
+    EStepShards shards("Model1", corpus.getTotalNoPairs1(), !test);
+    for (int n = 0; corpus.getNextSentence(sent); ++n) {
+      if (!shards.mine(n))
+        continue;
+      result of pair n: computed, or read from shards.results(n)
+      in a worker: written to shards.out(n), otherwise added to the tables
+    }
+    shards.finish();
+*/
+class EStepShards {
+ public:
+  // forks the workers if -shards is over 1 and 'sharded' is set
+  EStepShards(const char* model, int nPairs, bool sharded = true);
+  ~EStepShards();
+
+  // in a worker process
+  bool working() const { return shard_ >= 0; }
+  // in the training process while workers align the pairs
+  bool reducing() const { return !pids_.empty(); }
+
+  // false for the pairs (from 0, in corpus order) of other workers
+  bool mine(int n) const {
+    return shard_ < 0 || (n >= first(shard_) && n < first(shard_ + 1));
+  }
+
+  // in a worker, the file for the result of pair n
+  util::BinaryWriter& out(int n);
+  // in the training process, the result of pair n; the results of the
+  // pairs are read in the order they were written
+  util::BinaryReader& results(int n);
+
+  // a worker writes its file and exits; the training process waits for
+  // the workers it has not read yet
+  void finish();
+
+ private:
+  int first(int shard) const;
+  std::string filename(int shard) const;
+  // the training process reads the next file
+  void nextShard();
+  void closeShard();
+  void fail(const std::string& what) const;
+
+  std::string model_;
+  int nPairs_, nShards_;
+  int shard_;  // of this worker, -1 in the training process
+  std::vector<pid_t> pids_;
+  int reading_;  // the shard read by the training process
+  util::BinaryWriter* out_;
+  util::BinaryReader in_;
+  unsigned long long lookups_;  // t table lookups when the worker started
+};
+
+#endif  // GIZAPP_ESTEP_SHARDS_H_
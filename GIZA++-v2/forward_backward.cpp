@@ -22,16 +22,45 @@
 #ifndef NO_TRAINING
 
 #include "forward_backward.h"
+
+#include <cmath>
+#include <numeric>
 #include "globals.h"
 #include "hmm_tables.h"
 #include "util/assert.h"
 #include "util/math.h"
 
-double ForwardBackwardTraining(const HMMNetwork&net,Array<double>&g,Array<Array2<double> >&E) {
+// Divides a column by its sum (or maximum) and returns the logarithm of the
+// factor; columns that are zero everywhere are left alone.
+static double ScaleToSum(double* col,int I) {
+  double c=0;
+  for (int i=0;i<I;i++)
+    c+=col[i];
+  if (c<=0)
+    return 0.0;
+  for (int i=0;i<I;i++)
+    col[i]/=c;
+  return log(c);
+}
+
+static double ScaleToMax(double* col,int I) {
+  const double c= *max_element(col,col+I);
+  if (c<=0)
+    return 0.0;
+  for (int i=0;i<I;i++)
+    col[i]/=c;
+  return log(c);
+}
+
+// Every column of beta but the last is scaled to sum one; logScale[j] is the
+// logarithm of the product of the factors removed from the columns j..J-1.
+static void BackwardPass(const HMMNetwork&net,Array<double>&beta,Array<double>&logScale) {
   const int I=net.size1(),J=net.size2(),N=I*J;
-  Array<double> alpha(N,0),beta(N,0),sum(J);
   for (int i=0;i<I;i++)
     beta[N-I+i]=net.getBetainit(i);
+  logScale.resize(J);
+  if (J)
+    logScale[J-1]=0.0;
 
   double * cur_beta=conv<double>(beta.begin())+N-I-1;
   for (int j=J-2;j>=0;--j) {
@@ -47,13 +76,43 @@ double ForwardBackwardTraining(const HMMNetwork&net,Array<double>&g,Array<Array2
         (*cur_beta)+=(*next_beta++)*(*alprob++)*(*next_node);
       }
     }
+    logScale[j]=logScale[j+1]+ScaleToSum(conv<double>(beta.begin())+j*I,I);
   }
+}
 
-  for (int i=0;i<I;i++)
+static void NormalizeGamma(const HMMNetwork&net,Array<double>&g) {
+  const int I=net.size1();
+  double* ge=conv<double>(g.end());
+  for (double* gp=conv<double>(g.begin());gp!=ge;gp+=I)
+    normalize_if_possible(gp,gp+I);
+}
+
+// Compares the probability of the network seen by the forward pass with the
+// one of the backward pass.
+static void CheckProb(const HMMNetwork&net,double logProbForward,double logProb) {
+  const int I=net.size1();
+  if (!(util::mfabs(logProbForward-logProb)<1e-3*I))
+    cout << "ERROR2: " << logProbForward << " " << logProb << " " << net << endl;
+}
+
+// With scaled alpha and beta, the transitions into position j are weighted
+// so that those of every position sum up to 1/(J-1), as if alpha and beta
+// were not scaled and all transitions were normalized at once.
+double ForwardBackwardTraining(const HMMNetwork&net,Array<double>&g,Array<Array2<double> >&E) {
+  const int I=net.size1(),J=net.size2(),N=I*J;
+  Array<double> alpha(N,0),beta(N,0),logBetaScale;
+  BackwardPass(net,beta,logBetaScale);
+
+  double bsum=0;
+  for (int i=0;i<I;i++) {
     alpha[i]=net.getAlphainit(i)*net.nodeProb(i,0);
+    bsum+=beta[i]*alpha[i];
+  }
+  const double logProb=log(bsum)+(J?logBetaScale[0]:0.0);
+  double logAlphaScale=ScaleToSum(conv<double>(alpha.begin()),I);
 
   double* cur_alpha=conv<double>(alpha.begin())+I;
-  cur_beta=conv<double>(beta.begin())+I;
+  double* cur_beta=conv<double>(beta.begin())+I;
 
   for (int j=1;j<J;j++) {
     Array2<double>&e=E[ (E.size()==1)?0:(j-1) ];
@@ -62,70 +121,78 @@ double ForwardBackwardTraining(const HMMNetwork&net,Array<double>&g,Array<Array2
       e.resize(I,I);
       fill(e.begin(),e.end(),0.0);
     }
+    const double weight=(bsum>0)?exp(logAlphaScale+logBetaScale[j]-logProb)/(J-1):0.0;
 
     for (int ti=0;ti<I;++ti,++cur_alpha,++cur_beta) {
       const double * prev_alpha=conv<double>(alpha.begin())+I*(j-1);
       double *cur_e= &e(ti,0);
       double this_node=net.nodeProb(ti,j);
+      const double this_beta=(*cur_beta)*weight;
       const double* alprob= &net.outProb(j-1,0,ti);
       for (int pi=0;pi<I;++pi,++prev_alpha,(alprob+=I)) {
         MASSERT(prev_alpha<cur_alpha&& &net.outProb(j-1,pi,ti)==alprob);
         MASSERT(&e(ti,pi)==cur_e);
         const double alpha_increment= *prev_alpha*(*alprob)*this_node;
         (*cur_alpha)+=alpha_increment;
-        (*cur_e++)+=alpha_increment*(*cur_beta);
+        (*cur_e++)+=alpha_increment*this_beta;
       }
     }
+    logAlphaScale+=ScaleToSum(cur_alpha-I,I);
   }
 
   g.resize(N);
   transform(alpha.begin(),alpha.end(),beta.begin(),g.begin(),multiplies<double>());
-  double bsum=0,esum=0,esum2;
+  if (bsum>0&&J)
+    CheckProb(net,logAlphaScale+log(accumulate(g.end()-I,g.end(),0.0)),logProb);
+  NormalizeGamma(net,g);
+  return logProb;
+}
 
-  for (int i=0;i<I;i++)
-    bsum+=beta[i]*net.nodeProb(i,0)*net.getAlphainit(i);
+// Hands the transitions of every position to 'E' as soon as they are known,
+// so only a single I x I matrix is needed.
+double ForwardBackwardTraining(const HMMNetwork&net,Array<double>&g,HMMTransitionCounts&E) {
+  const int I=net.size1(),J=net.size2(),N=I*J;
+  Array<double> alpha(N,0),beta(N,0),logBetaScale;
+  BackwardPass(net,beta,logBetaScale);
 
-  for (unsigned int j=0;j<(unsigned int)E.size();j++) {
-    Array2<double>&e=E[j];
-    const double *epe=e.end();
-    for (const double*ep=e.begin();ep!=epe;++ep)
-      esum+=*ep;
+  double bsum=0;
+  for (int i=0;i<I;i++) {
+    alpha[i]=net.getAlphainit(i)*net.nodeProb(i,0);
+    bsum+=beta[i]*alpha[i];
   }
+  const double logProb=log(bsum)+(J?logBetaScale[0]:0.0);
+  double logAlphaScale=ScaleToSum(conv<double>(alpha.begin()),I);
 
-  if (J>1)
-    esum2=esum/(J-1);
-  else
-    esum2=0.0;
-
-  if (!(esum2==0.0||util::mfabs(esum2-bsum)/bsum<1e-3*I))
-    cout << "ERROR2: " << esum2 <<" " <<bsum << " " << esum << net << endl;
-
-  double * sumptr=conv<double>(sum.begin());
-  double* ge=conv<double>(g.end());
+  Array2<double> e(I,I);
+  double* cur_alpha=conv<double>(alpha.begin())+I;
+  double* cur_beta=conv<double>(beta.begin())+I;
 
-  for (double* gp=conv<double>(g.begin());gp!=ge;gp+=I) {
-    *sumptr++=normalize_if_possible(gp,gp+I);
-    if (bsum && !(util::mfabs((*(sumptr-1)-bsum)/bsum)<1e-3*I)) {
-      cout << "ERROR: " << *(sumptr-1) << " " << bsum << " "
-           << util::mfabs((*(sumptr-1)-bsum)/bsum) << ' '
-           << I << ' ' << J << endl;
+  for (int j=1;j<J;j++) {
+    fill(e.begin(),e.end(),0.0);
+    const double weight=(bsum>0)?exp(logAlphaScale+logBetaScale[j]-logProb)/(J-1):0.0;
+    for (int ti=0;ti<I;++ti,++cur_alpha,++cur_beta) {
+      const double * prev_alpha=conv<double>(alpha.begin())+I*(j-1);
+      double *cur_e= &e(ti,0);
+      double this_node=net.nodeProb(ti,j);
+      const double this_beta=(*cur_beta)*weight;
+      const double* alprob= &net.outProb(j-1,0,ti);
+      for (int pi=0;pi<I;++pi,++prev_alpha,(alprob+=I)) {
+        const double alpha_increment= *prev_alpha*(*alprob)*this_node;
+        (*cur_alpha)+=alpha_increment;
+        (*cur_e++)+=alpha_increment*this_beta;
+      }
     }
+    logAlphaScale+=ScaleToSum(cur_alpha-I,I);
+    if (bsum>0)
+      E.add(j-1,e);
   }
 
-  for (unsigned int j=0;j<(unsigned int)E.size();j++) {
-    Array2<double>&e=E[j];
-    double* epe=e.end();
-    if (esum)
-      for (double*ep=e.begin();ep!=epe;++ep)
-        *ep/=esum;
-    else
-      for (double*ep=e.begin();ep!=epe;++ep)
-        *ep/=1.0/(max(I*I,I*I*(J-1)));
-  }
-  if (sum.size())
-    return sum[0];
-  else
-    return 1.0;
+  g.resize(N);
+  transform(alpha.begin(),alpha.end(),beta.begin(),g.begin(),multiplies<double>());
+  if (bsum>0&&J)
+    CheckProb(net,logAlphaScale+log(accumulate(g.end()-I,g.end(),0.0)),logProb);
+  NormalizeGamma(net,g);
+  return logProb;
 }
 
 void HMMViterbi(const HMMNetwork&net,Array<int>&vit) {
@@ -149,19 +216,20 @@ void HMMViterbi(const HMMNetwork&net,Array<double>&g,Array<int>&vit) {
   }
 }
 
-double HMMRealViterbi(const HMMNetwork&net,Array<int>&vitar,int pegi,int pegj,bool verbose) {
+double HMMLogViterbi(const HMMNetwork&net,Array<int>&vitar,int pegi,int pegj,bool verbose) {
   const int I=net.size1(),J=net.size2(),N=I*J;
   Array<double> alpha(N,-1);
   Array<double*> bp(N,(double*)0);
   vitar.resize(J);
   if (J==0)
-    return 1.0;
+    return 0.0;
   for (int i=0;i<I;i++) {
     alpha[i]=net.getAlphainit(i)*net.nodeProb(i,0);
     if (i>I/2)
       alpha[i]=0; // only first empty word can be chosen
     bp[i]=0;
   }
+  double logScale=ScaleToMax(conv<double>(alpha.begin()),I);
 
   double *cur_alpha=conv<double>(alpha.begin())+I;
   double **cur_bp=conv<double*>(bp.begin())+I;
@@ -185,6 +253,7 @@ double HMMRealViterbi(const HMMNetwork&net,Array<int>&vitar,int pegi,int pegj,bo
         }
       }
     }
+    logScale+=ScaleToMax(cur_alpha-I,I);
   }
 
   for (int i=0;i<I;i++)
@@ -197,7 +266,7 @@ double HMMRealViterbi(const HMMNetwork&net,Array<int>&vitar,int pegi,int pegj,bo
   int j=J-1;
   cur_alpha=conv<double>(alpha.begin())+j*I;
   vitar[J-1]=max_element(cur_alpha,cur_alpha+I)-cur_alpha;
-  double ret= *max_element(cur_alpha,cur_alpha+I);
+  double ret=log(*max_element(cur_alpha,cur_alpha+I))+logScale;
   while (bp[vitar[j]+j*I]) {
     cur_alpha-=I;
     vitar[j-1]=bp[vitar[j]+j*I]-cur_alpha;
@@ -217,6 +286,10 @@ double HMMRealViterbi(const HMMNetwork&net,Array<int>&vitar,int pegi,int pegj,bo
   return ret;
 }
 
+double HMMRealViterbi(const HMMNetwork&net,Array<int>&vitar,int pegi,int pegj,bool verbose) {
+  return exp(HMMLogViterbi(net,vitar,pegi,pegj,verbose));
+}
+
 double MaximumTraining(const HMMNetwork&net,Array<double>&g,Array<Array2<double> >&E) {
   Array<int> vitar;
   double ret=HMMRealViterbi(net,vitar);
@@ -250,4 +323,90 @@ double MaximumTraining(const HMMNetwork&net,Array<double>&g,Array<Array2<double>
   return ret;
 }
 
+HMMPeggedViterbi::HMMPeggedViterbi(const HMMNetwork&net)
+    : I(net.size1()),J(net.size2()),delta(I*J,-1),psi(I*J,-1),logDelta(J,0.0),logPsi(J,0.0),
+      prev(I*J,-1),next(I*J,-1) {
+  if (J==0)
+    return;
+  for (int i=0;i<I;i++) {
+    delta[i]=net.getAlphainit(i)*net.nodeProb(i,0);
+    if (i>I/2)
+      delta[i]=0; // only first empty word can be chosen
+  }
+  logDelta[0]=ScaleToMax(conv<double>(delta.begin()),I);
+  for (int j=1;j<J;j++) {
+    for (int ti=0;ti<I;++ti) {
+      double& cur=delta[j*I+ti];
+      const double this_node=net.nodeProb(ti,j);
+      const double *alprob= &net.outProb(j-1,0,ti);
+      for (int pi=0;pi<I;++pi,(alprob+=I)) {
+        const double increment=delta[(j-1)*I+pi]*(*alprob)*this_node;
+        if (increment>cur) {
+          cur=increment;
+          prev[j*I+ti]=pi;
+        }
+      }
+    }
+    logDelta[j]=logDelta[j-1]+ScaleToMax(conv<double>(delta.begin())+j*I,I);
+  }
+  for (int i=0;i<I;i++)
+    psi[(J-1)*I+i]=net.getBetainit(i);
+  for (int j=J-2;j>=0;--j) {
+    for (int ti=0;ti<I;++ti) {
+      double& cur=psi[j*I+ti];
+      const double *alprob= &net.outProb(j,ti,0);
+      for (int ni=0;ni<I;++ni,++alprob) {
+        const double increment=(*alprob)*net.nodeProb(ni,j+1)*psi[(j+1)*I+ni];
+        if (increment>cur) {
+          cur=increment;
+          next[j*I+ti]=ni;
+        }
+      }
+    }
+    logPsi[j]=logPsi[j+1]+ScaleToMax(conv<double>(psi.begin())+j*I,I);
+  }
+}
+
+int HMMPeggedViterbi::bestNode(int pegi,int pegj) const {
+  const bool pegged=(pegj!=-1);
+  if (!pegged)
+    pegj=J-1;
+  int best=-1;
+  double bestScore=-1;
+  for (int ti=0;ti<I;ti++)
+    if (!pegged||pegi==ti||(pegi==-1&&ti>=I/2)) {
+      const double s=delta[pegj*I+ti]*psi[pegj*I+ti];
+      if (s>bestScore) {
+        bestScore=s;
+        best=ti;
+      }
+    }
+  MASSERT(best>=0);
+  return best;
+}
+
+double HMMPeggedViterbi::score(int pegi,int pegj) const {
+  if (J==0)
+    return 1.0;
+  const int ti=bestNode(pegi,pegj);
+  if (pegj==-1)
+    pegj=J-1;
+  return delta[pegj*I+ti]*psi[pegj*I+ti]*exp(logDelta[pegj]+logPsi[pegj]);
+}
+
+double HMMPeggedViterbi::path(int pegi,int pegj,Array<int>&vit) const {
+  vit.resize(J);
+  if (J==0)
+    return 1.0;
+  const int ti=bestNode(pegi,pegj);
+  if (pegj==-1)
+    pegj=J-1;
+  vit[pegj]=ti;
+  for (int j=pegj;j>0;--j)
+    vit[j-1]=prev[j*I+vit[j]];
+  for (int j=pegj;j<J-1;++j)
+    vit[j+1]=next[j*I+vit[j]];
+  return delta[pegj*I+ti]*psi[pegj*I+ti]*exp(logDelta[pegj]+logPsi[pegj]);
+}
+
 #endif  // NO_TRAINING
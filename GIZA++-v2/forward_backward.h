@@ -27,6 +27,22 @@
 #include "util/array.h"
 #include "util/array2.h"
 
+// Computes the I x I transition matrix of French position j on demand.
+// Used instead of storing one matrix per position in HMMNetwork::e.
+class HMMTransitionSource {
+ public:
+  virtual ~HMMTransitionSource() {}
+  virtual void fill(int j, Array2<double>& e) const = 0;
+};
+
+// Receives the normalized expected transition counts of French position j,
+// one position at a time.
+class HMMTransitionCounts {
+ public:
+  virtual ~HMMTransitionCounts() {}
+  virtual void add(int j, const Array2<double>& e) = 0;
+};
+
 class HMMNetwork {
  public:
   int as,bs;
@@ -36,11 +52,15 @@ class HMMNetwork {
   Array<double> betainit;
   int ab;
   double finalMultiply;
+  double logFinalMultiply;
 
-  HMMNetwork(int I,int J)
-      : as(I),bs(J),n(as,bs), e(0),alphainit(as,1.0/as),betainit(as,1.0),ab(as*bs),finalMultiply(1.0)
+  HMMNetwork(int I,int J,const HMMTransitionSource* s=0)
+      : as(I),bs(J),n(as,bs), e(0),alphainit(as,1.0/as),betainit(as,1.0),ab(as*bs),finalMultiply(1.0),
+        logFinalMultiply(0.0),source(s),cachedJ(-1)
   { }
 
+  ~HMMNetwork() { delete source; }
+
   double getAlphainit(int i) const { return alphainit[i]; }
   double getBetainit(int i) const { return betainit[i]; }
 
@@ -49,25 +69,74 @@ class HMMNetwork {
 
   inline const double& nodeProb(int i, int j) const { return n(i,j); }
 
+  inline const Array2<double>& transitions(int j) const {
+    if (source == 0)
+      return e[min(int(e.size())-1,j)];
+    if (j != cachedJ) {
+      source->fill(j,cache);
+      cachedJ=j;
+    }
+    return cache;
+  }
+
   inline const double& outProb(int j, int i1, int i2) const {
-    return e[min(int(e.size())-1,j)](i1,i2);
+    return transitions(j)(i1,i2);
   }
 
+  bool isStreaming() const { return source != 0; }
+
   friend ostream&operator<<(ostream&out,const HMMNetwork&x) {
     return out <<"N: \n" << x.n << endl
                << "E: \n" << x.e << "A:\n"
                << x.alphainit << "B:\n" << x.betainit << endl;
   }
+
+ private:
+  const HMMTransitionSource* source;
+  mutable Array2<double> cache;
+  mutable int cachedJ;
+
+  HMMNetwork(const HMMNetwork&);
+  HMMNetwork& operator=(const HMMNetwork&);
 };
 
+// Both versions scale alpha and beta column by column, so long sentences do
+// not underflow, and return the logarithm of the probability of the network.
 double ForwardBackwardTraining(const HMMNetwork&mc, Array<double>&gamma, Array<Array2<double> >&epsilon);
 
+// Same as above, but hands the expected transition counts of each position
+// to 'epsilon' as soon as they are known instead of keeping all of them.
+double ForwardBackwardTraining(const HMMNetwork&mc, Array<double>&gamma, HMMTransitionCounts&epsilon);
+
 void HMMViterbi(const HMMNetwork&mc, Array<int>&vit);
 
+// Returns the logarithm of the probability of the Viterbi path.
+double HMMLogViterbi(const HMMNetwork&net, Array<int>&vit, int pegi=-1, int pegj=-1, bool verbose=0);
+
 double HMMRealViterbi(const HMMNetwork&net, Array<int>&vit, int pegi=-1, int pegj=-1, bool verbose=0);
 
 double MaximumTraining(const HMMNetwork&net, Array<double>&g, Array<Array2<double> >&e);
 
+// Scores of the best paths through every node of an HMMNetwork, obtained by
+// one forward and one backward max-product pass. score(pegi,pegj) is what
+// HMMRealViterbi(net,vit,pegi,pegj) returns; path() also traces back the
+// corresponding alignment.
+class HMMPeggedViterbi {
+ public:
+  explicit HMMPeggedViterbi(const HMMNetwork& net);
+
+  double score(int pegi, int pegj) const;
+  double path(int pegi, int pegj, Array<int>& vit) const;
+
+ private:
+  int bestNode(int pegi, int pegj) const;
+
+  int I, J;
+  Array<double> delta, psi;
+  Array<double> logDelta, logPsi;  // scaling factors of the columns
+  Array<int> prev, next;
+};
+
 void HMMViterbi(const HMMNetwork&net, Array<double>&g, Array<int>&vit);
 
 #endif  // NO_TRAINING
@@ -0,0 +1,506 @@
+/*
+  This file is part of GIZA++.
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307,
+  USA.
+*/
+
+#include "giza.h"
+
+#include <algorithm>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include "sentence_handler.h"
+#include "ibm_model1.h"
+#include "ibm_model2.h"
+#include "ibm_model3.h"
+#include "hmm.h"
+#include "d4tables.h"
+#include "d5tables.h"
+#include "transpair_model4.h"
+#include "transpair_model5.h"
+#include "parameter.h"
+#include "util/dictionary.h"
+#include "util/perplexity.h"
+
+namespace giza {
+
+namespace {
+
+// the globals of the models are shared by all trainings, which run one
+// after the other (see giza.h)
+std::mutex trainingMutex;
+
+// the values of the global parameters, restored by the destructor
+class GlobalsSnapshot {
+ public:
+  GlobalsSnapshot()
+      : prefix_(g_prefix), lambda_(g_lambda),
+        elist_(globeTrainVcbList), flist_(globfTrainVcbList) {
+    const ParSet& pars = getGlobalParSet();
+    for (ParSet::const_iterator i = pars.begin(); i != pars.end(); ++i) {
+      ostringstream value;
+      value.precision(17);
+      (*i)->printValue(value);
+      values_.push_back(make_pair(&**i, value.str()));
+    }
+  }
+
+  ~GlobalsSnapshot() {
+    for (size_t i = 0; i < values_.size(); ++i)
+      values_[i].first->setParameter(values_[i].second, 0);
+    g_prefix = prefix_;
+    g_lambda = lambda_;
+    globeTrainVcbList = elist_;
+    globfTrainVcbList = flist_;
+  }
+
+ private:
+  vector<pair<_Parameter*, string> > values_;
+  string prefix_;
+  double lambda_;
+  VocabList *elist_, *flist_;
+};
+
+class NullBuffer : public std::streambuf {
+ protected:
+  int overflow(int c) { return traits_type::not_eof(c); }
+};
+
+// sends standard output to nowhere while it exists
+class QuietOutput {
+ public:
+  explicit QuietOutput(bool quiet) : saved_(quiet ? cout.rdbuf(&null_) : 0) {}
+  ~QuietOutput() {
+    if (saved_)
+      cout.rdbuf(saved_);
+  }
+
+ private:
+  NullBuffer null_;
+  std::streambuf* saved_;
+};
+
+void setGlobal(const string& name, int value) {
+  ostringstream s;
+  s << value;
+  makeSetCommand(name, s.str(), getGlobalParSet(), 0);
+}
+
+// the lines "word class" of a .classes file for the words with a class
+string classLines(const map<string, string>& classes, const vector<string>& words) {
+  string lines;
+  for (size_t w = 1; w < words.size(); ++w) {
+    map<string, string>::const_iterator c = classes.find(words[w]);
+    if (c != classes.end())
+      lines += words[w] + ' ' + c->second + '\n';
+  }
+  return lines;
+}
+
+} // namespace
+
+Corpus::Corpus() {
+  sourceWords_.push_back("NULL");
+  targetWords_.push_back("NULL");
+}
+
+WordIndex Corpus::id(const string& word, vector<string>& words, map<string, WordIndex>& ids) {
+  map<string, WordIndex>::const_iterator i = ids.find(word);
+  if (i != ids.end())
+    return i->second;
+  words.push_back(word);
+  return ids[word] = WordIndex(words.size() - 1);
+}
+
+bool Corpus::add(const vector<string>& source, const vector<string>& target, double count) {
+  if (source.empty() || target.empty() || !(count > 0))
+    return false;
+  pairs_.push_back(Pair());
+  Pair& p = pairs_.back();
+  p.count = count;
+  for (size_t i = 0; i < source.size(); ++i)
+    p.source.push_back(id(source[i], sourceWords_, sourceIds_));
+  for (size_t j = 0; j < target.size(); ++j)
+    p.target.push_back(id(target[j], targetWords_, targetIds_));
+  return true;
+}
+
+void Corpus::setSourceClass(const string& word, const string& wordClass) {
+  sourceClasses_[word] = wordClass;
+}
+
+void Corpus::setTargetClass(const string& word, const string& wordClass) {
+  targetClasses_[word] = wordClass;
+}
+
+TrainingOptions::TrainingOptions()
+    : model1(5), model2(0), hmm(5), model3(5), model4(5), model5(0), quiet(false),
+      symmetrize(false), symmetrizeFinalAnd(false) {}
+
+// the sentence pairs as read from a corpus file, truncated to -ml words,
+// and the word pairs of the .cooc files of one or both directions
+struct Training::Data {
+  Data(const Corpus& corpus, bool bothDirections);
+
+  Vector<SentencePair> pairs;
+  vector<vector<WordIndex> > cooc[2];  // target words by source word, and reversed
+};
+
+namespace {
+
+// adds the word pairs of a sentence pair to cooc; the lists are kept
+// short by sorting them when they have grown
+void addCooccurrences(vector<vector<WordIndex> >& cooc, vector<size_t>& sorted,
+                      const Vector<WordIndex>& es, const Vector<WordIndex>& fs) {
+  for (size_t i = 0; i < es.size(); ++i) {
+    vector<WordIndex>& f = cooc[es[i]];
+    f.insert(f.end(), fs.begin() + 1, fs.end());
+    if (f.size() > 2 * sorted[es[i]] + 64) {
+      sort(f.begin(), f.end());
+      f.erase(unique(f.begin(), f.end()), f.end());
+      sorted[es[i]] = f.size();
+    }
+  }
+}
+
+void sortCooccurrences(vector<vector<WordIndex> >& cooc) {
+  for (size_t e = 0; e < cooc.size(); ++e) {
+    sort(cooc[e].begin(), cooc[e].end());
+    cooc[e].erase(unique(cooc[e].begin(), cooc[e].end()), cooc[e].end());
+  }
+}
+
+// sets the parameters of the options
+void applyOptions(const TrainingOptions& options) {
+  setGlobal("m1", options.model1);
+  setGlobal("m2", options.model2);
+  setGlobal("mh", options.hmm);
+  setGlobal("m3", options.model3);
+  setGlobal("m4", options.model4);
+  setGlobal("m5", options.model5);
+  for (size_t i = 0; i < options.parameters.size(); ++i)
+    makeSetCommand(options.parameters[i].first, options.parameters[i].second, getGlobalParSet(), 0);
+  if (options.prefix.empty()) {
+    setGlobal("NODUMPS", 1);
+    setGlobal("telemetry", 0);
+  }
+  setGlobal("checkpoint", 0);
+  setGlobal("resume", 0);
+}
+
+// grow-diag-final (Koehn et al. 2003) of the links of both directions:
+// the links of both, grown by the neighbouring links of either direction
+// that align an unaligned word, then the final steps of the forward and
+// of the backward links that align an unaligned word. With 'finalAnd'
+// (grow-diag-final-and) the final steps only add links of two unaligned
+// words.
+Links growDiagFinal(unsigned int l, unsigned int m, const PairAlignment& forward,
+                    const PairAlignment& backward, bool finalAnd) {
+  enum { kForward = 1, kBackward = 2, kTaken = 4 };
+  vector<char> links((l + 1) * (m + 1), 0);
+  for (unsigned int j = 1; j < forward.links.size(); ++j)
+    if (forward.links[j])
+      links[forward.links[j] * (m + 1) + j] |= kForward;
+  for (unsigned int i = 1; i < backward.links.size(); ++i)
+    if (backward.links[i])
+      links[i * (m + 1) + backward.links[i]] |= kBackward;
+  vector<char> sourceAligned(l + 1, 0), targetAligned(m + 1, 0);
+  Links result;
+  for (unsigned int i = 1; i <= l; ++i)
+    for (unsigned int j = 1; j <= m; ++j)
+      if (links[i * (m + 1) + j] == (kForward | kBackward)) {
+        links[i * (m + 1) + j] |= kTaken;
+        sourceAligned[i] = targetAligned[j] = 1;
+        result.push_back(make_pair(i, j));
+      }
+  static const int kNeighbours[8][2] = {
+    {-1, 0}, {0, -1}, {1, 0}, {0, 1}, {-1, -1}, {-1, 1}, {1, -1}, {1, 1}
+  };
+  for (bool added = true; added;) {
+    added = false;
+    for (size_t k = 0; k < result.size(); ++k)
+      for (int n = 0; n < 8; ++n) {
+        const int i = int(result[k].first) + kNeighbours[n][0];
+        const int j = int(result[k].second) + kNeighbours[n][1];
+        if (i < 1 || j < 1 || i > int(l) || j > int(m) || !links[i * (m + 1) + j] ||
+            (links[i * (m + 1) + j] & kTaken))
+          continue;
+        if (!sourceAligned[i] || !targetAligned[j]) {
+          links[i * (m + 1) + j] |= kTaken;
+          sourceAligned[i] = targetAligned[j] = 1;
+          result.push_back(make_pair(unsigned(i), unsigned(j)));
+          added = true;
+        }
+      }
+  }
+  static const char kDirections[2] = { kForward, kBackward };
+  for (int d = 0; d < 2; ++d)
+    for (unsigned int i = 1; i <= l; ++i)
+      for (unsigned int j = 1; j <= m; ++j) {
+        char& link = links[i * (m + 1) + j];
+        if (!(link & kDirections[d]) || (link & kTaken))
+          continue;
+        if (finalAnd ? (!sourceAligned[i] && !targetAligned[j]) : (!sourceAligned[i] || !targetAligned[j])) {
+          link |= kTaken;
+          sourceAligned[i] = targetAligned[j] = 1;
+          result.push_back(make_pair(i, j));
+        }
+      }
+  sort(result.begin(), result.end());
+  return result;
+}
+
+} // namespace
+
+Training::Data::Data(const Corpus& corpus, bool bothDirections) : pairs(corpus.pairs_.size()) {
+  cooc[0].resize(corpus.sourceWords_.size());
+  if (bothDirections)
+    cooc[1].resize(corpus.targetWords_.size());
+  vector<size_t> sorted[2] = { vector<size_t>(cooc[0].size(), 0), vector<size_t>(cooc[1].size(), 0) };
+  int truncated = 0;
+  for (size_t n = 0; n < pairs.size(); ++n) {
+    const Corpus::Pair& p = corpus.pairs_[n];
+    SentencePair& s = pairs[n];
+    s.sentenceNo = int(n) + 1;
+    s.noOcc = s.realCount = float(p.count);
+    s.eSent.assign(1, 0);
+    s.eSent.insert(s.eSent.end(), p.source.begin(),
+                   p.source.begin() + min(p.source.size(), size_t(MAX_SENTENCE_LENGTH) - 1));
+    s.fSent.assign(1, 0);
+    s.fSent.insert(s.fSent.end(), p.target.begin(),
+                   p.target.begin() + min(p.target.size(), size_t(MAX_SENTENCE_LENGTH) - 1));
+    truncated += s.eSent.size() <= p.source.size() || s.fSent.size() <= p.target.size();
+    addCooccurrences(cooc[0], sorted[0], s.eSent, s.fSent);
+    if (bothDirections)
+      addCooccurrences(cooc[1], sorted[1], s.fSent, s.eSent);
+  }
+  if (truncated)
+    cerr << "WARNING: " << truncated << " sentence pairs are truncated to " << MAX_SENTENCE_LENGTH - 1 << " words.\n";
+  sortCooccurrences(cooc[0]);
+  sortCooccurrences(cooc[1]);
+}
+
+// the objects of StartTraining in giza_main.cpp, in the order they depend
+// on each other
+struct Training::State {
+  State() : aTable(false), aCountTable(false) {}
+
+  void train(const Corpus& corpus, Data& data, bool reversed);
+  void align(vector<PairAlignment>& alignments);
+
+  VocabList elist, flist;
+  map<string, WordIndex> sourceIds, targetIds;
+  std::unique_ptr<SentenceHandler> corpus;
+  std::unique_ptr<TModel<COUNT, PROB> > tTable;
+  Perplexity perp[4];
+  std::unique_ptr<IBMModel1> m1;
+  AModel<PROB> aTable;
+  AModel<COUNT> aCountTable;
+  std::unique_ptr<IBMModel2> m2;
+  std::unique_ptr<HMM> h;
+  std::unique_ptr<IBMModel3> m3;
+  std::unique_ptr<d4model> d4m;
+  std::unique_ptr<d5model> d5m;
+};
+
+void Training::State::train(const Corpus& source, Data& data, bool reversed) {
+  const vector<string>& ewords = reversed ? source.targetWords_ : source.sourceWords_;
+  const vector<string>& fwords = reversed ? source.sourceWords_ : source.targetWords_;
+  for (size_t w = 1; w < ewords.size(); ++w)
+    elist.addWord(ewords[w]);
+  for (size_t w = 1; w < fwords.size(); ++w)
+    flist.addWord(fwords[w]);
+  globeTrainVcbList = &elist;
+  globfTrainVcbList = &flist;
+  sourceIds = reversed ? source.targetIds_ : source.sourceIds_;
+  targetIds = reversed ? source.sourceIds_ : source.targetIds_;
+
+  corpus.reset(new SentenceHandler(data.pairs, &elist, &flist, reversed));
+  g_lambda = double(flist.totalVocab()) / (elist.totalVocab() - corpus->getTotalNoPairs2());
+  tTable.reset(new TModel<COUNT, PROB>(data.cooc[reversed]));
+  vector<vector<WordIndex> >().swap(data.cooc[reversed]);
+
+  m1.reset(new IBMModel1("", elist, flist, *tTable, perp[0], *corpus, &perp[1], 0, perp[2], &perp[3]));
+  m2.reset(new IBMModel2(*m1, aTable, aCountTable));
+  h.reset(new HMM(*m2));
+  m3.reset(new IBMModel3(*m2));
+  d4m.reset(new d4model(MAX_SENTENCE_LENGTH));
+  d5m.reset(new d5model(*d4m));
+  const string eclasses = classLines(reversed ? source.targetClasses_ : source.sourceClasses_, ewords);
+  const string fclasses = classLines(reversed ? source.sourceClasses_ : source.targetClasses_, fwords);
+  {
+    istringstream estrm(eclasses), fstrm(fclasses);
+    d4m->makeWordClasses(elist, flist, estrm, fstrm);
+  }
+  {
+    istringstream estrm(eclasses), fstrm(fclasses);
+    d5m->makeWordClasses(elist, flist, estrm, fstrm);
+  }
+
+  // the schedule of StartTraining
+  if (Model1_Iterations > 0) {
+    util::Dictionary dictionary;
+    m1->em_with_tricks(Model1_Iterations, false, dictionary, false);
+  }
+  if (Model2_Iterations > 0) {
+    m2->initialize_table_uniformly(*corpus);
+    m2->em_with_tricks(Model2_Iterations);
+  }
+  if (HMM_Iterations > 0) {
+    istringstream estrm(eclasses), fstrm(fclasses);
+    h->makeWordClasses(elist, flist, estrm, fstrm);
+    h->initialize_table_uniformly(*corpus);
+    h->em_with_tricks(HMM_Iterations);
+  }
+  if (Transfer2to3 || HMM_Iterations == 0) {
+    if (Transfer == kTransferSimple)
+      m3->transferSimple(*corpus, Transfer_Dump_Freq==1&&!NODUMPS, perp[0], perp[2]);
+    else
+      m3->transfer(*corpus, Transfer_Dump_Freq==1&&!NODUMPS, perp[0], perp[2]);
+  }
+  if (HMM_Iterations > 0)
+    m3->setHMM(h.get());
+  if (Model3_Iterations > 0 || Model4_Iterations > 0 || Model5_Iterations || Model6_Iterations)
+    m3->viterbi(Model3_Iterations, Model4_Iterations, Model5_Iterations, Model6_Iterations, *d4m, *d5m);
+}
+
+// the alignments of the last model, as giza-align computes them
+void Training::State::align(vector<PairAlignment>& alignments) {
+  const bool model345 = Model3_Iterations > 0 || Model4_Iterations > 0 || Model5_Iterations > 0;
+  if (!model345 && HMM_Iterations <= 0)
+    return;
+  alignments.reserve(corpus->getTotalNoPairs1());
+  SentencePair sent;
+  corpus->rewind();
+  while (corpus->getNextSentence(sent)) {
+    const Vector<WordIndex>& es = sent.eSent;
+    const Vector<WordIndex>& fs = sent.fSent;
+    Alignment al(PositionIndex(es.size() - 1), PositionIndex(fs.size() - 1));
+    LogProb score;
+    if (!model345)
+      score = m3->align_pair<TransPairModelHMM>(es, fs, static_cast<const HMM*>(h.get()), al);
+    else if (Model5_Iterations > 0)
+      score = m3->align_pair<transpair_model5>(es, fs, d5m.get(), al);
+    else if (Model4_Iterations > 0)
+      score = m3->align_pair<transpair_model4>(es, fs, d4m.get(), al);
+    else
+      score = m3->align_pair<transpair_model3>(es, fs, static_cast<void*>(0), al);
+    alignments.push_back(PairAlignment());
+    const Vector<PositionIndex>& links = al.getAlignment();
+    alignments.back().links.assign(links.begin(), links.end());
+    alignments.back().score = double(score);
+  }
+  corpus->rewind();
+}
+
+Training::Training() {}
+
+Training::Training(const Corpus& corpus, const TrainingOptions& options) {
+  if (!corpus.size()) {
+    cerr << "ERROR: training on an empty corpus\n";
+    exit(1);
+  }
+  std::lock_guard<std::mutex> lock(trainingMutex);
+  GlobalsSnapshot globals;
+  QuietOutput quiet(options.quiet);
+  applyOptions(options);
+  g_prefix = options.prefix;
+  data_.reset(new Data(corpus, false));
+  train(corpus, *data_, false);
+}
+
+Training::~Training() {}
+
+void Training::train(const Corpus& corpus, Data& data, bool reversed) {
+  state_.reset(new State);
+  state_->train(corpus, data, reversed);
+  state_->align(alignments_);
+}
+
+double Training::probability(const string& source, const string& target) const {
+  map<string, WordIndex>::const_iterator e = state_->sourceIds.find(source);
+  map<string, WordIndex>::const_iterator f = state_->targetIds.find(target);
+  if (e == state_->sourceIds.end() || f == state_->targetIds.end())
+    return 0;
+  return state_->tTable->getProb(e->second, f->second);
+}
+
+const vector<PairAlignment>& Training::alignments() const { return alignments_; }
+
+double Training::trainPerplexity() const { return state_->perp[0].perplexity(); }
+
+const VocabList& Training::sourceVocab() const { return state_->elist; }
+const VocabList& Training::targetVocab() const { return state_->flist; }
+const TModel<COUNT, PROB>& Training::tTable() const { return *state_->tTable; }
+const AModel<PROB>& Training::aTable() const { return state_->aTable; }
+const AModel<PROB>& Training::dTable() const { return state_->m3->dTable; }
+const nmodel<PROB>& Training::nTable() const { return state_->m3->nTable; }
+double Training::p0() const { return state_->m3->p0; }
+const HMM& Training::hmm() const { return *state_->h; }
+const d4model& Training::model4() const { return *state_->d4m; }
+const d5model& Training::model5() const { return *state_->d5m; }
+
+BidirectionalTraining::BidirectionalTraining(const Corpus& corpus, const TrainingOptions& options) {
+  if (!corpus.size()) {
+    cerr << "ERROR: training on an empty corpus\n";
+    exit(1);
+  }
+  std::lock_guard<std::mutex> lock(trainingMutex);
+  GlobalsSnapshot globals;
+  QuietOutput quiet(options.quiet);
+  applyOptions(options);
+  setGlobal("telemetry", 0);
+  data_.reset(new Training::Data(corpus, true));
+  const string prefix = options.prefix;
+  Training::Data* data = data_.get();
+  Training* backwardTraining = &backward_;
+  std::thread backward([&corpus, &prefix, data, backwardTraining]() {
+    g_prefix = prefix.empty() ? prefix : prefix + ".t2s";
+    backwardTraining->train(corpus, *data, true);
+  });
+  g_prefix = prefix.empty() ? prefix : prefix + ".s2t";
+  forward_.train(corpus, *data, false);
+  backward.join();
+  g_prefix = prefix;
+
+  if (!options.symmetrize || forward_.alignments().empty())
+    return;
+  const vector<PairAlignment>& f = forward_.alignments();
+  const vector<PairAlignment>& b = backward_.alignments();
+  symmetrized_.reserve(f.size());
+  for (size_t n = 0; n < f.size(); ++n) {
+    const SentencePair& s = data_->pairs[n];
+    symmetrized_.push_back(growDiagFinal(s.eSent.size() - 1, s.fSent.size() - 1, f[n], b[n],
+                                         options.symmetrizeFinalAnd));
+  }
+  if (prefix.empty())
+    return;
+  const string filename = prefix + (options.symmetrizeFinalAnd ? ".grow-diag-final-and" : ".grow-diag-final");
+  ofstream out(filename.c_str());
+  for (size_t n = 0; n < symmetrized_.size(); ++n) {
+    for (size_t k = 0; k < symmetrized_[n].size(); ++k)
+      out << (k ? " " : "") << symmetrized_[n][k].first - 1 << '-' << symmetrized_[n][k].second - 1;
+    out << '\n';
+  }
+  if (!out)
+    cerr << "WARNING: can not write " << filename << '\n';
+}
+
+BidirectionalTraining::~BidirectionalTraining() {}
+
+} // namespace giza
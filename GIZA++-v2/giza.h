@@ -0,0 +1,215 @@
+/*
+  This file is part of GIZA++.
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307,
+  USA.
+*/
+
+#ifndef GIZAPP_GIZA_H_
+#define GIZAPP_GIZA_H_
+
+/*
+  Training from memory with libgizapp.a, without the .vcb, .snt and .cooc
+  files of GIZA++:
+
+    giza::Corpus corpus;
+    corpus.add(source_words, target_words);
+    ...
+    giza::TrainingOptions options;
+    options.model4 = 3;
+    giza::Training training(corpus, options);
+    double p = training.probability("house", "Haus");
+    const giza::PairAlignment& a = training.alignments()[0];
+
+  Only one training runs at a time in a process. The models read their
+  parameters from the global GIZA++ parameters (p0, -ml, the smoothing
+  ...), which a training sets from its options and restores when it is
+  done, so the constructors of Training and BidirectionalTraining hold
+  one lock: a training constructed on another thread waits until the
+  running one is done, and a program that needs two corpora trained at
+  once must run two processes. The trained objects are only read
+  afterwards and may be used from any thread.
+  giza::BidirectionalTraining trains both directions of one corpus at the
+  same time, with the same options.
+*/
+
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include "defs.h"
+#include "ttables.h"
+#include "atables.h"
+#include "ntables.h"
+#include "vocab.h"
+
+class d4model;
+class d5model;
+class HMM;
+
+namespace giza {
+
+// sentence pairs of words in memory; the words get ids in the order they
+// first occur, after the empty word NULL with id 0
+class Corpus {
+ public:
+  Corpus();
+
+  // adds a pair that occurs 'count' times; false (and nothing added) if a
+  // sentence is empty or the count is not positive
+  bool add(const std::vector<std::string>& source, const std::vector<std::string>& target,
+           double count = 1.0);
+
+  // the word classes of Model 4, 5 and the HMM (the .classes files of
+  // GIZA++); words without a class are in class 0
+  void setSourceClass(const std::string& word, const std::string& wordClass);
+  void setTargetClass(const std::string& word, const std::string& wordClass);
+
+  size_t size() const { return pairs_.size(); }
+  // the words by id
+  const std::vector<std::string>& sourceWords() const { return sourceWords_; }
+  const std::vector<std::string>& targetWords() const { return targetWords_; }
+
+ private:
+  friend class Training;
+
+  struct Pair {
+    std::vector<WordIndex> source, target;
+    double count;
+  };
+
+  static WordIndex id(const std::string& word, std::vector<std::string>& words,
+                      std::map<std::string, WordIndex>& ids);
+
+  std::vector<Pair> pairs_;
+  std::vector<std::string> sourceWords_, targetWords_;
+  std::map<std::string, WordIndex> sourceIds_, targetIds_;
+  std::map<std::string, std::string> sourceClasses_, targetClasses_;
+};
+
+// the schedule and parameters of a training
+struct TrainingOptions {
+  TrainingOptions();
+
+  // iterations of the models, as -m1, -m2, -mh, -m3, -m4 and -m5
+  int model1, model2, hmm, model3, model4, model5;
+  // any other GIZA++ parameter by name and value, e.g. ("p0", "0.98")
+  std::vector<std::pair<std::string, std::string> > parameters;
+  // prefix of the files GIZA++ writes (-o); empty: no files are written
+  std::string prefix;
+  // no messages on standard output
+  bool quiet;
+  // BidirectionalTraining: grow-diag-final alignments of both directions
+  bool symmetrize;
+  // grow-diag-final-and instead of grow-diag-final
+  bool symmetrizeFinalAnd;
+};
+
+// the alignment of a sentence pair: source position (0 for NULL) of each
+// target position 1..m; index 0 is not used
+struct PairAlignment {
+  std::vector<unsigned int> links;
+  double score;  // the probability of the alignment and the target sentence
+};
+
+// trains the models of the options on a corpus when it is constructed
+class Training {
+ public:
+  Training(const Corpus& corpus, const TrainingOptions& options);
+  ~Training();
+
+  // t(target | source) of the trained models; 0 for unknown words
+  double probability(const std::string& source, const std::string& target) const;
+
+  // the Viterbi alignments of the pairs of the corpus, in order, with the
+  // last model trained of the HMM and Model 3, 4 and 5; empty if none of
+  // them is trained. The pairs are shortened as in training (-ml and the
+  // fertility limit).
+  const std::vector<PairAlignment>& alignments() const;
+
+  // the perplexity of the corpus in the last iteration
+  double trainPerplexity() const;
+
+  // the trained tables, with the word ids of sourceVocab() and
+  // targetVocab(), which are the ids of the corpus
+  const VocabList& sourceVocab() const;
+  const VocabList& targetVocab() const;
+  const TModel<COUNT, PROB>& tTable() const;
+  const AModel<PROB>& aTable() const;
+  const AModel<PROB>& dTable() const;
+  const nmodel<PROB>& nTable() const;
+  double p0() const;
+  const HMM& hmm() const;
+  const d4model& model4() const;
+  const d5model& model5() const;
+
+ private:
+  friend class BidirectionalTraining;
+  struct Data;
+  struct State;
+
+  Training();
+  Training(const Training&);
+  Training& operator=(const Training&);
+
+  // trains with the parameters set; 'reversed' trains target to source
+  void train(const Corpus& corpus, Data& data, bool reversed);
+
+  std::unique_ptr<Data> data_;
+  std::unique_ptr<State> state_;
+  std::vector<PairAlignment> alignments_;
+};
+
+// the source and target positions (from 1) of the links of a pair
+typedef std::vector<std::pair<unsigned int, unsigned int> > Links;
+
+/*
+  Trains source to target and target to source at the same time, in two
+  threads, on one copy of the sentence pairs and with the word pairs of
+  both directions collected in one pass. The E-steps of both threads share
+  the threads of -threads (see sentence_scheduler.h).
+  With a prefix, the files of the directions are prefix.s2t.* and
+  prefix.t2s.*, and the symmetrized alignments are written to
+  prefix.grow-diag-final (or prefix.grow-diag-final-and) as lines
+  "i-j ..." of positions from 0; there is no -telemetry. The hill climbing
+  statistics of Model 3/4/5 are kept per E-step, so the directions do not
+  mix them.
+*/
+class BidirectionalTraining {
+ public:
+  BidirectionalTraining(const Corpus& corpus, const TrainingOptions& options);
+  ~BidirectionalTraining();
+
+  const Training& sourceToTarget() const { return forward_; }
+  // with the target words as sources
+  const Training& targetToSource() const { return backward_; }
+
+  // with options.symmetrize, the grow-diag-final (-and) alignments of the
+  // pairs of the corpus, from the alignments of both directions
+  const std::vector<Links>& symmetrized() const { return symmetrized_; }
+
+ private:
+  BidirectionalTraining(const BidirectionalTraining&);
+  BidirectionalTraining& operator=(const BidirectionalTraining&);
+
+  std::unique_ptr<Training::Data> data_;
+  Training forward_, backward_;
+  std::vector<Links> symmetrized_;
+};
+
+} // namespace giza
+
+#endif  // GIZAPP_GIZA_H_
@@ -0,0 +1,277 @@
+/*
+  This file is part of GIZA++.
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307,
+  USA.
+*/
+
+
+/*
+  giza-align: aligns sentence pairs with the tables of a finished training
+  and without training. It is started with the .gizacfg file the training
+  wrote, so that it uses the same vocabulary and class files and model
+  parameters, and reads the tables from the checkpoint the training wrote
+  with -checkpoint 1. The sentence pairs are read in the corpus format
+  (count, source and target line of word ids) and written in the format
+  of the A3 files; a pair with words that are not in the vocabulary gets
+  the alignment of all its target words to NULL and the score 0.
+
+  The checkpoint holds the tables after the last M-step, while the
+  training writes A3.final in the last E-step, with the tables of the
+  iteration before. The alignments are also found without pegging
+  (see IBMModel3::align_pair), even if the training used -pegging 1.
+*/
+
+#include <chrono>
+#include <thread>
+#include "sentence_handler.h"
+#include "sentence_scheduler.h"
+#include "ttables.h"
+#include "ibm_model1.h"
+#include "ibm_model2.h"
+#include "ibm_model3.h"
+#include "hmm.h"
+#include "vocab.h"
+#include "util/perplexity.h"
+#include "util/util.h"
+#include "parameter.h"
+#include "d4tables.h"
+#include "d5tables.h"
+#include "transpair_model4.h"
+#include "transpair_model5.h"
+#include "checkpoint.h"
+
+GLOBAL_PARAMETER(int,AlignThreads,"alignThreads","number of threads aligning sentence pairs (0: one per processor)",kParLevSpecial,0);
+
+string AlignModel, AlignInput, AlignOutput;
+
+extern short CompactAlignmentFormat;
+
+namespace {
+
+struct AlignedPair {
+  SentencePair sent;
+  bool usable;
+  Vector<PositionIndex> alignment;
+  LogProb score;
+};
+
+// false if the pair has words that are not in the vocabulary; shortens it
+// like the training does
+bool usablePair(SentencePair& s, const VocabList& elist, const VocabList& flist) {
+  for (WordIndex i = 1; i < s.eSent.size(); i++)
+    if (s.eSent[i] >= elist.uniqTokens()) {
+      cerr << "WARNING: source word " << s.eSent[i] << " of sentence pair " << s.sentenceNo
+           << " is not in the vocabulary list; the pair is aligned to NULL.\n";
+      return false;
+    }
+  for (WordIndex j = 1; j < s.fSent.size(); j++)
+    if (s.fSent[j] >= flist.uniqTokens()) {
+      cerr << "WARNING: target word " << s.fSent[j] << " of sentence pair " << s.sentenceNo
+           << " is not in the vocabulary list; the pair is aligned to NULL.\n";
+      return false;
+    }
+  if ((s.fSent.size() - 1) > (g_max_fertility - 1) * (s.eSent.size() - 1)) {
+    cerr << "WARNING: sentence pair " << s.sentenceNo << " exceeds the fertility limit and is shortened.\n";
+    s.eSent.resize(min(s.eSent.size(), s.fSent.size()));
+    s.fSent.resize(min(s.eSent.size(), s.fSent.size()));
+  }
+  return s.eSent.size() > 1 && s.fSent.size() > 1;
+}
+
+template<class MODEL_TYPE, class A>
+void alignPair(IBMModel3& m3, A* dm, AlignedPair& p) {
+  const PositionIndex l = PositionIndex(p.sent.eSent.size() - 1), m = PositionIndex(p.sent.fSent.size() - 1);
+  if (!p.usable) {
+    p.alignment = Vector<PositionIndex>(int(m) + 1, 0);
+    p.score = 0;
+    return;
+  }
+  Alignment al(l, m);
+  p.score = m3.align_pair<MODEL_TYPE>(p.sent.eSent, p.sent.fSent, dm, al);
+  p.alignment = al.getAlignment();
+}
+
+// the word of id w in the A3 format; words outside the vocabulary by id
+string wordOf(const VocabList& list, WordIndex w) {
+  if (w < list.uniqTokens())
+    return list.getVocabList()[w].word;
+  ostringstream id;
+  id << w;
+  return id.str();
+}
+
+// printAlignToFile for pairs with words outside the vocabulary
+void printAlignment(const AlignedPair& p, const VocabList& elist, const VocabList& flist, ostream& out) {
+  if (p.usable) {
+    printAlignToFile(p.sent.eSent, p.sent.fSent, elist.getVocabList(), flist.getVocabList(), out,
+                     p.alignment, p.sent.sentenceNo, p.score);
+    return;
+  }
+  const Vector<WordIndex>& es = p.sent.eSent;
+  const Vector<WordIndex>& fs = p.sent.fSent;
+  if (CompactAlignmentFormat) {
+    out << '\n';
+    return;
+  }
+  out << "# Sentence pair (" << p.sent.sentenceNo << ") source length " << es.size() - 1
+      << " target length " << fs.size() - 1 << " alignment score : " << p.score << '\n';
+  for (WordIndex j = 1; j < fs.size(); j++)
+    out << wordOf(flist, fs[j]) << ' ';
+  out << "\nNULL ({ ";
+  for (WordIndex j = 1; j < fs.size(); j++)
+    out << j << ' ';
+  out << "}) ";
+  for (WordIndex i = 1; i < es.size(); i++)
+    out << wordOf(elist, es[i]) << " ({ }) ";
+  out << '\n';
+}
+
+// aligns all pairs of 'pairs' on the threads of a SentenceScheduler and
+// returns their number
+template<class MODEL_TYPE, class A>
+int alignPairs(IBMModel3& m3, A* dm, SentenceHandler& pairs, ostream& out, int nThreads,
+               SentenceScheduler::Model cost) {
+  SentenceScheduler scheduler(cost, nThreads);
+  Vector<AlignedPair> window;
+  AlignedPair p;
+  int aligned = 0;
+  for (bool more = 1; more;) {
+    window.clear();
+    while (!scheduler.full() && (more = pairs.readNextSentence(p.sent))) {
+      p.usable = usablePair(p.sent, m3.Elist, m3.Flist);
+      window.push_back(p);
+      scheduler.add(PositionIndex(p.sent.eSent.size() - 1), PositionIndex(p.sent.fSent.size() - 1));
+    }
+    scheduler.run([&](unsigned int k) { alignPair<MODEL_TYPE>(m3, dm, window[k]); });
+    for (unsigned int k = 0; k < window.size(); ++k)
+      printAlignment(window[k], m3.Elist, m3.Flist, out);
+    out.flush();
+    aligned += int(window.size());
+  }
+  return aligned;
+}
+
+// the model named by -alignModel, or the last one trained
+string alignmentModel() {
+  if (AlignModel.length())
+    return AlignModel;
+  if (Model5_Iterations > 0)
+    return "5";
+  if (Model4_Iterations > 0)
+    return "4";
+  if (Model3_Iterations > 0)
+    return "3";
+  return "hmm";
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+  getGlobalParSet().insert(new Parameter<string>("alignModel", ParameterChangedFlag, "model of the alignments: hmm, 3, 4 or 5 (default: the last model trained)", AlignModel, kParLevSpecial));
+  getGlobalParSet().insert(new Parameter<string>("input", ParameterChangedFlag, "sentence pairs to align, in the corpus format (default: standard input)", AlignInput, kParLevInput));
+  getGlobalParSet().insert(new Parameter<string>("output", ParameterChangedFlag, "file of the alignments (default: standard output)", AlignOutput, kParLevOutput));
+  Usage = string(argv[0]) + " <prefix.gizacfg> [options]\n";
+  if (argc < 2) {
+    printHelp();
+    exit(1);
+  }
+  // the messages of the training code go to stderr; stdout carries the
+  // alignments
+  streambuf* stdoutBuffer = cout.rdbuf(cerr.rdbuf());
+  initGlobals();
+  parseArguments(argc, argv);
+
+  const string model = alignmentModel();
+  if (model != "hmm" && model != "3" && model != "4" && model != "5") {
+    cerr << "ERROR: unknown alignment model " << model << '\n';
+    exit(1);
+  }
+  if ((model == "hmm" && HMM_Iterations <= 0) || (model == "3" && Model3_Iterations <= 0) ||
+      (model == "4" && Model4_Iterations <= 0) || (model == "5" && Model5_Iterations <= 0)) {
+    cerr << "ERROR: model " << model << " was not trained\n";
+    exit(1);
+  }
+
+  VocabList eVcbList, fVcbList;
+  eVcbList.setName(g_source_vocab_filename.c_str());
+  fVcbList.setName(g_target_vocab_filename.c_str());
+  eVcbList.readVocabList();
+  fVcbList.readVocabList();
+  globeTrainVcbList = &eVcbList;
+  globfTrainVcbList = &fVcbList;
+
+  const string input = (AlignInput.length() && AlignInput != "-") ? AlignInput : string("/dev/stdin");
+  SentenceHandler pairs(input.c_str());
+  Perplexity perp[4];
+  TModel<COUNT, PROB> tTable;
+  IBMModel1 m1(input.c_str(), eVcbList, fVcbList, tTable, perp[0], pairs, &perp[1], 0, perp[2], &perp[3]);
+  AModel<PROB> aTable(false);
+  AModel<COUNT> aCountTable(false);
+  IBMModel2 m2(m1, aTable, aCountTable);
+  HMM h(m2);
+  IBMModel3 m3(m2);
+  TrainingCheckpoint checkpoint(m3, h, 0, perp[0], perp[1], perp[2], perp[3], checkpointParameters());
+  if (!checkpoint.read()) {
+    cerr << "ERROR: can not read the tables " << g_prefix << ".checkpoint; they are written by training with -checkpoint 1\n";
+    exit(1);
+  }
+  if (model != "hmm" && checkpoint.stage() != kCheckpointModel345) {
+    cerr << "ERROR: " << g_prefix << ".checkpoint does not contain the Model " << model << " tables\n";
+    exit(1);
+  }
+  if (HMM_Iterations > 0) {
+    h.makeWordClasses(m1.Elist, m1.Flist, g_source_vocab_filename + ".classes", g_target_vocab_filename + ".classes");
+    m3.setHMM(&h);
+  }
+  d4model d4m(MAX_SENTENCE_LENGTH);
+  d4m.makeWordClasses(m1.Elist, m1.Flist, g_source_vocab_filename + ".classes", g_target_vocab_filename + ".classes");
+  d5model d5m(d4m);
+  d5m.makeWordClasses(m1.Elist, m1.Flist, g_source_vocab_filename + ".classes", g_target_vocab_filename + ".classes");
+  checkpoint.readDistortion(d4m, d5m);
+
+  ofstream outputFile;
+  if (AlignOutput.length() && AlignOutput != "-") {
+    outputFile.open(AlignOutput.c_str());
+    if (!outputFile) {
+      cerr << "ERROR: Cannot write to " << AlignOutput << '\n';
+      exit(1);
+    }
+  }
+  ostream standardOutput(stdoutBuffer);
+  ostream& out = outputFile.is_open() ? static_cast<ostream&>(outputFile) : standardOutput;
+  const int nThreads = AlignThreads > 0 ? int(AlignThreads) : max(1, int(std::thread::hardware_concurrency()));
+
+  if (Peg && model != "hmm")
+    cerr << "WARNING: the training used pegging; giza-align aligns without it\n";
+  cerr << "Aligning with model " << model << " and " << nThreads << " threads\n";
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  int aligned;
+  if (model == "hmm")
+    aligned = alignPairs<TransPairModelHMM>(m3, static_cast<const HMM*>(&h), pairs, out, nThreads,
+                                            SentenceScheduler::kHMM);
+  else if (model == "3")
+    aligned = alignPairs<transpair_model3>(m3, static_cast<void*>(0), pairs, out, nThreads,
+                                           SentenceScheduler::kModel345);
+  else if (model == "4")
+    aligned = alignPairs<transpair_model4>(m3, &d4m, pairs, out, nThreads, SentenceScheduler::kModel345);
+  else
+    aligned = alignPairs<transpair_model5>(m3, &d5m, pairs, out, nThreads, SentenceScheduler::kModel345);
+  const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  cerr << "Aligned " << aligned << " sentence pairs in " << seconds << " seconds ("
+       << aligned / max(seconds, 1e-9) << " pairs per second)\n";
+  cout.rdbuf(stdoutBuffer);
+  return 0;
+}
@@ -26,7 +26,6 @@
 #include "ibm_model2.h"
 #include "ibm_model3.h"
 #include "hmm.h"
-#include "port/file_spec.h"
 #include "defs.h"
 #include "vocab.h"
 #include "util/perplexity.h"
@@ -38,61 +37,7 @@
 #include "d5tables.h"
 #include "transpair_model4.h"
 #include "transpair_model5.h"
-
-#define ITER_M2 0
-#define ITER_MH 5
-
-GLOBAL_PARAMETER3(int,Model1_Iterations,"Model1_Iterations","NO. ITERATIONS MODEL 1","m1","number of iterations for Model 1",kParLevIter,5);
-GLOBAL_PARAMETER3(int,Model2_Iterations,"Model2_Iterations","NO. ITERATIONS MODEL 2","m2","number of iterations for Model 2",kParLevIter,ITER_M2);
-GLOBAL_PARAMETER3(int,HMM_Iterations,"HMM_Iterations","mh","number of iterations for HMM alignment model","mh",              kParLevIter,ITER_MH);
-GLOBAL_PARAMETER3(int,Model3_Iterations,"Model3_Iterations","NO. ITERATIONS MODEL 3","m3","number of iterations for Model 3",kParLevIter,5);
-GLOBAL_PARAMETER3(int,Model4_Iterations,"Model4_Iterations","NO. ITERATIONS MODEL 4","m4","number of iterations for Model 4",kParLevIter,5);
-GLOBAL_PARAMETER3(int,Model5_Iterations,"Model5_Iterations","NO. ITERATIONS MODEL 5","m5","number of iterations for Model 5",kParLevIter,0);
-GLOBAL_PARAMETER3(int,Model6_Iterations,"Model6_Iterations","NO. ITERATIONS MODEL 6","m6","number of iterations for Model 6",kParLevIter,0);
-
-
-GLOBAL_PARAMETER(float, g_smooth_prob,"probSmooth","probability smoothing (floor) value ",kParLevOptheur,1e-7);
-GLOBAL_PARAMETER(float, MINCOUNTINCREASE,"minCountIncrease","minimal count increase",kParLevOptheur,1e-7);
-
-GLOBAL_PARAMETER2(int,Transfer_Dump_Freq,"TRANSFER DUMP FREQUENCY","t2to3","output: dump of transfer from Model 2 to 3",kParLevOutput,0);
-GLOBAL_PARAMETER2(bool, g_is_verbose, "verbose","v","0: not verbose; 1: verbose", kParLevOutput, 0);
-GLOBAL_PARAMETER(bool, g_enable_logging, "log","0: no logfile; 1: logfile", kParLevOutput, 0);
-
-
-GLOBAL_PARAMETER(double,P0,"p0","fixed value for parameter p_0 in IBM-3/4 (if negative then it is determined in training)",kParLevEM,-1.0);
-GLOBAL_PARAMETER(double,M5P0,"m5p0","fixed value for parameter p_0 in IBM-5 (if negative then it is determined in training)",kParLevEM,-1.0);
-GLOBAL_PARAMETER3(bool,Peg,"pegging","p","DO PEGGING? (Y/N)","0: no pegging; 1: do pegging",kParLevEM,0);
-
-GLOBAL_PARAMETER(short,OldADBACKOFF,"adbackoff","",-1,0);
-GLOBAL_PARAMETER2(unsigned int,MAX_SENTENCE_LENGTH,"ml","MAX SENTENCE LENGTH","maximum sentence length",0,kMaxAllowedSentenceLength);
-
-
-GLOBAL_PARAMETER(short, DeficientDistortionForEmptyWord,"DeficientDistortionForEmptyWord","0: IBM-3/IBM-4 as described in (Brown et al. 1993); 1: distortion model of empty word is deficient; 2: distoriton model of empty word is deficient (differently); setting this parameter also helps to avoid that during IBM-3 and IBM-4 training too many words are aligned with the empty word",kParLevModels,0);
-short OutputInAachenFormat=0;
-bool Transfer = kTransfer;
-bool Transfer2to3=0;
-short NoEmptyWord=0;
-bool FEWDUMPS=0;
-GLOBAL_PARAMETER(bool,ONLYALDUMPS,"ONLYALDUMPS","1: do not write any files",kParLevOutput,0);
-GLOBAL_PARAMETER(short,CompactAlignmentFormat,"CompactAlignmentFormat","0: detailled alignment format, 1: compact alignment format ",kParLevOutput,0);
-GLOBAL_PARAMETER2(bool,NODUMPS,"NODUMPS","NO FILE DUMPS? (Y/N)","1: do not write any files",kParLevOutput,0);
-
-GLOBAL_PARAMETER(WordIndex,g_max_fertility,"g_max_fertility","maximal fertility for fertility models",kParLevEM,10);
-
-Vector<map< pair<int,int>,char > > ReferenceAlignment;
-
-
-bool useDict = false;
-string CoocurrenceFile;
-string g_log_filename;
-string g_prefix;
-string g_output_path;
-string g_source_vocab_filename;
-string g_target_vocab_filename;
-
-string Usage, CorpusFilename,
-  TestCorpusFilename, t_Filename, a_Filename, p0_Filename, d_Filename,
-  n_Filename, dictionary_Filename;
+#include "checkpoint.h"
 
 const string str2Num(int n) {
   string number = "";
@@ -103,12 +48,9 @@ const string str2Num(int n) {
 }
 
 
-double g_lambda = 1.09;
 SentenceHandler *testCorpus=0,*corpus=0;
 Perplexity trainPerp, testPerp, trainViterbiPerp, testViterbiPerp;
 
-string ReadTablePrefix;
-
 
 const char*stripPath(const char*fullpath)
     // strip the path info from the file name
@@ -346,13 +288,6 @@ void ReadAlignment(const string&x,Vector<map< pair<int,int>,char > >&a) {
   cout << "Read: " << a.size() << " sentences in reference alignment." << '\n';
 }
 
-void initGlobals() {
-  NODUMPS = false;
-  g_prefix = port::GetFileSpec();
-  g_log_filename = g_prefix + ".log";
-  MAX_SENTENCE_LENGTH = kMaxAllowedSentenceLength;
-}
-
 void convert(const map< pair<int,int>,char >&reference,Alignment&x) {
   int l=x.get_l();
   int m=x.get_m();
@@ -374,9 +309,6 @@ void convert(const map< pair<int,int>,char >&reference,Alignment&x) {
   }
 }
 
-VocabList *globeTrainVcbList;
-VocabList *globfTrainVcbList;
-
 double StartTraining(int& result) {
   double errors=0.0;
   VocabList eTrainVcbList, fTrainVcbList;
@@ -429,7 +361,7 @@ double StartTraining(int& result) {
   util::Dictionary *dictionary;
   useDict = !dictionary_Filename.empty();
   if (useDict) dictionary = new util::Dictionary(dictionary_Filename.c_str());
-  else dictionary = new util::Dictionary("");
+  else dictionary = new util::Dictionary();
   int minIter=0;
 #ifdef BINARY_SEARCH_FOR_TTABLE
   if (CoocurrenceFile.length()==0) {
@@ -450,6 +382,8 @@ double StartTraining(int& result) {
   IBMModel2 m2(m1,aTable,aCountTable);
   HMM h(m2);
   IBMModel3 m3(m2);
+  TrainingCheckpoint checkpoint(m3, h, corpus, trainPerp, testPerp, trainViterbiPerp, testViterbiPerp,
+                                checkpointParameters());
 
   if (ReadTablePrefix.length()) {
     string number = "final";
@@ -505,10 +439,11 @@ double StartTraining(int& result) {
       cout << "No corpus exists.\n";
     }
   } else {
+    checkpoint.resume();
     // initialize model1
     bool seedModel1 = false;
     if (Model1_Iterations > 0) {
-      if (t_Filename != "NONE" && t_Filename != "") {
+      if (t_Filename != "NONE" && t_Filename != "" && !checkpointDone(kCheckpointModel1, 1)) {
         seedModel1 = true;
         m1.load_table(t_Filename.c_str());
       }
@@ -518,7 +453,8 @@ double StartTraining(int& result) {
 
     {
       if (Model2_Iterations > 0) {
-        m2.initialize_table_uniformly(*corpus);
+        if (!checkpointDone(kCheckpointModel2, 1))
+          m2.initialize_table_uniformly(*corpus);
         minIter=m2.em_with_tricks(Model2_Iterations);
         errors=m2.errorsAL();
       }
@@ -530,7 +466,7 @@ double StartTraining(int& result) {
         errors=h.errorsAL();
       }
 
-      if (Transfer2to3||HMM_Iterations==0) {
+      if ((Transfer2to3||HMM_Iterations==0) && !checkpointDone(kCheckpointModel345, 1)) {
         if (HMM_Iterations>0)
           cout << "WARNING: transfor is not needed, as results are overwritten bei transfer from HMM.\n";
         string test_alignfile = g_prefix +".tst.A2to3";
@@ -562,27 +498,6 @@ double StartTraining(int& result) {
 }
 
 int main(int argc, char* argv[]) {
-#ifdef BINARY_SEARCH_FOR_TTABLE
-  getGlobalParSet().insert(new Parameter<string>("CoocurrenceFile",ParameterChangedFlag,"",CoocurrenceFile,kParLevSpecial));
-#endif
-  getGlobalParSet().insert(new Parameter<string>("ReadTablePrefix",ParameterChangedFlag,"optimized",ReadTablePrefix,-1));
-  getGlobalParSet().insert(new Parameter<string>("S", ParameterChangedFlag, "source vocabulary file name", g_source_vocab_filename, kParLevInput));
-  getGlobalParSet().insert(new Parameter<string>("SOURCE VOCABULARY FILE", ParameterChangedFlag,"source vocabulary file name", g_source_vocab_filename, -1));
-  getGlobalParSet().insert(new Parameter<string>("T", ParameterChangedFlag, "target vocabulary file name", g_target_vocab_filename, kParLevInput));
-  getGlobalParSet().insert(new Parameter<string>("TARGET VOCABULARY FILE", ParameterChangedFlag, "target vocabulary file name", g_target_vocab_filename, -1));
-  getGlobalParSet().insert(new Parameter<string>("C",ParameterChangedFlag,"training corpus file name",CorpusFilename,kParLevInput));
-  getGlobalParSet().insert(new Parameter<string>("CORPUS FILE",ParameterChangedFlag,"training corpus file name",CorpusFilename,-1));
-  getGlobalParSet().insert(new Parameter<string>("TC",ParameterChangedFlag,"test corpus file name",TestCorpusFilename,kParLevInput));
-  getGlobalParSet().insert(new Parameter<string>("TEST CORPUS FILE",ParameterChangedFlag,"test corpus file name",TestCorpusFilename,-1));
-  getGlobalParSet().insert(new Parameter<string>("d",ParameterChangedFlag,"dictionary file name",dictionary_Filename,kParLevInput));
-  getGlobalParSet().insert(new Parameter<string>("DICTIONARY",ParameterChangedFlag,"dictionary file name",dictionary_Filename,-1));
-  getGlobalParSet().insert(new Parameter<string>("l",ParameterChangedFlag,"log file name",g_log_filename,kParLevOutput));
-  getGlobalParSet().insert(new Parameter<string>("LOG FILE",ParameterChangedFlag,"log file name",g_log_filename,-1));
-
-  getGlobalParSet().insert(new Parameter<string>("o",ParameterChangedFlag,"output file prefix",g_prefix,kParLevOutput));
-  getGlobalParSet().insert(new Parameter<string>("OUTPUT FILE PREFIX",ParameterChangedFlag,"output file prefix",g_prefix,-1));
-  getGlobalParSet().insert(new Parameter<string>("OUTPUT PATH", ParameterChangedFlag, "output path", g_output_path, kParLevOutput));
-
   time_t st1, fn;
   st1 = time(NULL);                    // starting time
 
@@ -0,0 +1,121 @@
+/*
+  EGYPT Toolkit for Statistical Machine Translation
+
+  Written by Yaser Al-Onaizan, Jan Curin, Michael Jahr, Kevin Knight, John Lafferty, Dan Melamed, David Purdy, Franz Och, Noah Smith, and David Yarowsky.
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307,
+  USA.
+*/
+
+/*
+  The parameters and global variables shared by GIZA++ and giza-align.
+*/
+
+#include "globals.h"
+
+#include "parameter.h"
+#include "port/file_spec.h"
+
+#define ITER_M2 0
+#define ITER_MH 5
+
+GLOBAL_PARAMETER3(int,Model1_Iterations,"Model1_Iterations","NO. ITERATIONS MODEL 1","m1","number of iterations for Model 1",kParLevIter,5);
+GLOBAL_PARAMETER3(int,Model2_Iterations,"Model2_Iterations","NO. ITERATIONS MODEL 2","m2","number of iterations for Model 2",kParLevIter,ITER_M2);
+GLOBAL_PARAMETER3(int,HMM_Iterations,"HMM_Iterations","mh","number of iterations for HMM alignment model","mh",              kParLevIter,ITER_MH);
+GLOBAL_PARAMETER3(int,Model3_Iterations,"Model3_Iterations","NO. ITERATIONS MODEL 3","m3","number of iterations for Model 3",kParLevIter,5);
+GLOBAL_PARAMETER3(int,Model4_Iterations,"Model4_Iterations","NO. ITERATIONS MODEL 4","m4","number of iterations for Model 4",kParLevIter,5);
+GLOBAL_PARAMETER3(int,Model5_Iterations,"Model5_Iterations","NO. ITERATIONS MODEL 5","m5","number of iterations for Model 5",kParLevIter,0);
+GLOBAL_PARAMETER3(int,Model6_Iterations,"Model6_Iterations","NO. ITERATIONS MODEL 6","m6","number of iterations for Model 6",kParLevIter,0);
+
+
+GLOBAL_PARAMETER(float, g_smooth_prob,"probSmooth","probability smoothing (floor) value ",kParLevOptheur,1e-7);
+GLOBAL_PARAMETER(float, MINCOUNTINCREASE,"minCountIncrease","minimal count increase",kParLevOptheur,1e-7);
+
+GLOBAL_PARAMETER2(int,Transfer_Dump_Freq,"TRANSFER DUMP FREQUENCY","t2to3","output: dump of transfer from Model 2 to 3",kParLevOutput,0);
+GLOBAL_PARAMETER2(bool, g_is_verbose, "verbose","v","0: not verbose; 1: verbose", kParLevOutput, 0);
+GLOBAL_PARAMETER(bool, g_enable_logging, "log","0: no logfile; 1: logfile", kParLevOutput, 0);
+
+
+GLOBAL_PARAMETER(double,P0,"p0","fixed value for parameter p_0 in IBM-3/4 (if negative then it is determined in training)",kParLevEM,-1.0);
+GLOBAL_PARAMETER(double,M5P0,"m5p0","fixed value for parameter p_0 in IBM-5 (if negative then it is determined in training)",kParLevEM,-1.0);
+GLOBAL_PARAMETER3(bool,Peg,"pegging","p","DO PEGGING? (Y/N)","0: no pegging; 1: do pegging",kParLevEM,0);
+
+GLOBAL_PARAMETER(short,OldADBACKOFF,"adbackoff","",-1,0);
+GLOBAL_PARAMETER2(unsigned int,MAX_SENTENCE_LENGTH,"ml","MAX SENTENCE LENGTH","maximum sentence length",0,kDefaultMaxSentenceLength);
+
+
+GLOBAL_PARAMETER(short, DeficientDistortionForEmptyWord,"DeficientDistortionForEmptyWord","0: IBM-3/IBM-4 as described in (Brown et al. 1993); 1: distortion model of empty word is deficient; 2: distoriton model of empty word is deficient (differently); setting this parameter also helps to avoid that during IBM-3 and IBM-4 training too many words are aligned with the empty word",kParLevModels,0);
+short OutputInAachenFormat=0;
+bool Transfer = kTransfer;
+bool Transfer2to3=0;
+short NoEmptyWord=0;
+bool FEWDUMPS=0;
+GLOBAL_PARAMETER(bool,ONLYALDUMPS,"ONLYALDUMPS","1: do not write any files",kParLevOutput,0);
+GLOBAL_PARAMETER(short,CompactAlignmentFormat,"CompactAlignmentFormat","0: detailled alignment format, 1: compact alignment format ",kParLevOutput,0);
+GLOBAL_PARAMETER2(bool,NODUMPS,"NODUMPS","NO FILE DUMPS? (Y/N)","1: do not write any files",kParLevOutput,0);
+
+GLOBAL_PARAMETER(WordIndex,g_max_fertility,"g_max_fertility","maximal fertility for fertility models",kParLevEM,10);
+
+Vector<map< pair<int,int>,char > > ReferenceAlignment;
+
+
+bool useDict = false;
+string CoocurrenceFile;
+string g_log_filename;
+thread_local string g_prefix;
+string g_output_path;
+string g_source_vocab_filename;
+string g_target_vocab_filename;
+
+string Usage, CorpusFilename,
+  TestCorpusFilename, t_Filename, a_Filename, p0_Filename, d_Filename,
+  n_Filename, dictionary_Filename;
+
+thread_local double g_lambda = 1.09;
+
+string ReadTablePrefix;
+
+thread_local VocabList *globeTrainVcbList;
+thread_local VocabList *globfTrainVcbList;
+
+// registers the file name parameters and sets the defaults that depend on
+// the time of the run
+void initGlobals() {
+#ifdef BINARY_SEARCH_FOR_TTABLE
+  getGlobalParSet().insert(new Parameter<string>("CoocurrenceFile",ParameterChangedFlag,"",CoocurrenceFile,kParLevSpecial));
+#endif
+  getGlobalParSet().insert(new Parameter<string>("ReadTablePrefix",ParameterChangedFlag,"optimized",ReadTablePrefix,-1));
+  getGlobalParSet().insert(new Parameter<string>("S", ParameterChangedFlag, "source vocabulary file name", g_source_vocab_filename, kParLevInput));
+  getGlobalParSet().insert(new Parameter<string>("SOURCE VOCABULARY FILE", ParameterChangedFlag,"source vocabulary file name", g_source_vocab_filename, -1));
+  getGlobalParSet().insert(new Parameter<string>("T", ParameterChangedFlag, "target vocabulary file name", g_target_vocab_filename, kParLevInput));
+  getGlobalParSet().insert(new Parameter<string>("TARGET VOCABULARY FILE", ParameterChangedFlag, "target vocabulary file name", g_target_vocab_filename, -1));
+  getGlobalParSet().insert(new Parameter<string>("C",ParameterChangedFlag,"training corpus file name",CorpusFilename,kParLevInput));
+  getGlobalParSet().insert(new Parameter<string>("CORPUS FILE",ParameterChangedFlag,"training corpus file name",CorpusFilename,-1));
+  getGlobalParSet().insert(new Parameter<string>("TC",ParameterChangedFlag,"test corpus file name",TestCorpusFilename,kParLevInput));
+  getGlobalParSet().insert(new Parameter<string>("TEST CORPUS FILE",ParameterChangedFlag,"test corpus file name",TestCorpusFilename,-1));
+  getGlobalParSet().insert(new Parameter<string>("d",ParameterChangedFlag,"dictionary file name",dictionary_Filename,kParLevInput));
+  getGlobalParSet().insert(new Parameter<string>("DICTIONARY",ParameterChangedFlag,"dictionary file name",dictionary_Filename,-1));
+  getGlobalParSet().insert(new Parameter<string>("l",ParameterChangedFlag,"log file name",g_log_filename,kParLevOutput));
+  getGlobalParSet().insert(new Parameter<string>("LOG FILE",ParameterChangedFlag,"log file name",g_log_filename,-1));
+
+  getGlobalParSet().insert(new Parameter<string>("o",ParameterChangedFlag,"output file prefix",g_prefix,kParLevOutput));
+  getGlobalParSet().insert(new Parameter<string>("OUTPUT FILE PREFIX",ParameterChangedFlag,"output file prefix",g_prefix,-1));
+  getGlobalParSet().insert(new Parameter<string>("OUTPUT PATH", ParameterChangedFlag, "output path", g_output_path, kParLevOutput));
+
+  NODUMPS = false;
+  g_prefix = port::GetFileSpec();
+  g_log_filename = g_prefix + ".log";
+  MAX_SENTENCE_LENGTH = kDefaultMaxSentenceLength;
+}
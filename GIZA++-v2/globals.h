@@ -38,15 +38,24 @@ extern bool g_enable_logging;
 extern bool Peg, Transfer, Transfer2to3, useDict;
 
 extern std::string g_log_filename;
-extern std::string g_prefix;
+// per thread, for the two trainings of giza::BidirectionalTraining
+extern thread_local std::string g_prefix;
 extern std::string g_output_path;
 
+extern std::string CoocurrenceFile;
+extern std::string ReadTablePrefix;
+
 extern std::string g_source_vocab_filename;
 extern std::string g_target_vocab_filename;
 
 extern string CorpusFilename, TestCorpusFilename,
   t_Filename, a_Filename, p0_Filename, d_Filename, n_Filename, dictionary_Filename;
 
+extern int Model1_Iterations, Model2_Iterations, HMM_Iterations,
+  Model3_Iterations, Model4_Iterations, Model5_Iterations, Model6_Iterations;
+extern int Transfer_Dump_Freq;
+extern short OldADBACKOFF;
+
 extern double M5P0,P0;
 extern bool NODUMPS, FEWDUMPS;
 extern string Usage;
@@ -74,11 +83,14 @@ extern short OutputInAachenFormat;
 
 class VocabList;
 
-extern VocabList *globeTrainVcbList, *globfTrainVcbList;
+extern thread_local VocabList *globeTrainVcbList, *globfTrainVcbList;
 
 extern short g_prediction_in_alignments;
 extern short SmoothHMM;
 
 extern Vector<map< pair<int,int>,char > > ReferenceAlignment;
 
+// defined in globals.cpp; call before parseArguments()
+void initGlobals();
+
 #endif  // GIZAPP_GLOBALS_H_
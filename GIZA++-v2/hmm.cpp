@@ -20,12 +20,20 @@
 */
 
 #include "hmm.h"
+
+#include <numeric>
+#include <sstream>
 #include "globals.h"
 #include "util/util.h"
 #include "forward_backward.h"
 #include "parameter.h"
 #include "util/perplexity.h"
 #include "sentence_handler.h"
+#include "checkpoint.h"
+#include "estep_shards.h"
+#include "memory_usage.h"
+#include "sentence_scheduler.h"
+#include "telemetry.h"
 
 #define CLASSIFY(i,empty,ianf) bool empty=(i>=l); unsigned int ianf=(i%l);
 #define CLASSIFY2(i,ianf) unsigned int ianf=(i%l);
@@ -47,11 +55,167 @@ GLOBAL_PARAMETER(short,SmoothHMM,"emSmoothHMM",
                  "f-b-trn: smooth HMM model &1: modified counts; &2:perform smoothing with -emAlSmooth",kParLevSpecial,2);
 GLOBAL_PARAMETER(double,HMMAlignmentModelSmoothFactor,"emAlSmooth",
                  "f-b-trn: smoothing factor for HMM alignment model (can be ignored by -emSmoothHMM)",kParLevSmooth,0.2);
+GLOBAL_PARAMETER(short,HMMStreamTransitions,"emStreamTransitions",
+                 "f-b-trn: with -emAlignmentDependencies &8 or &16, compute the transition matrix of each French position on demand "
+                 "instead of keeping one per position (less memory, more time)",kParLevSpecial,0);
+GLOBAL_PARAMETER(float,HMMPosteriorThreshold,"emPosteriorThreshold",
+                 "f-b-trn: do not collect posteriors below this fraction of the posterior mass of their French position "
+                 "(0: collect all)",kParLevOptheur,0.0);
+
+namespace {
+
+class HMMTransitionRows : public HMMTransitionSource {
+ public:
+  HMMTransitionRows(const HMM& h, const Vector<WordIndex>& es,
+                    const Vector<WordIndex>& fs, bool doInit)
+      : hmm_(h), es_(es), fs_(fs), do_init_(doInit) {}
+
+  void fill(int j, Array2<double>& e) const {
+    hmm_.makeTransitions(es_,fs_,do_init_,j,e);
+  }
+
+ private:
+  const HMM& hmm_;
+  const Vector<WordIndex>& es_;
+  const Vector<WordIndex>& fs_;
+  bool do_init_;
+};
+
+// the counts and scores of a sentence pair in an HMM E-step
+struct HMMPair {
+  Array<double> gamma;
+  Vector<Array2<double> > jumps;  // of the French positions, l x l; empty: none
+  Vector<WordIndex> viterbi_alignment;
+  double cross_entropy, viterbi_log_score, logFinalMultiply;
+  double p0c, np0c;
+  // of the transition counts, see -emPosteriorThreshold
+  long long seenPosteriors, skippedPosteriors;
+  double skippedPosteriorMass;
+  // the -v output of the pair, printed in corpus order
+  std::string verbose;
+
+  void write(util::BinaryWriter& out) const {
+    out.PutArray(gamma);
+    out.Put<uint64_t>(jumps.size());
+    for (unsigned int j = 0; j < jumps.size(); ++j) {
+      out.Put(jumps[j].getLen1());
+      out.PutRange(jumps[j].getLen1() ? &jumps[j](0, 0) : 0, size_t(jumps[j].getLen1()) * jumps[j].getLen2());
+    }
+    out.PutArray(viterbi_alignment);
+    out.Put(cross_entropy);
+    out.Put(viterbi_log_score);
+    out.Put(logFinalMultiply);
+    out.Put(p0c);
+    out.Put(np0c);
+    out.Put(seenPosteriors);
+    out.Put(skippedPosteriors);
+    out.Put(skippedPosteriorMass);
+    out.PutString(verbose);
+  }
+
+  bool read(util::BinaryReader& in) {
+    uint64_t n = 0;
+    if (!in.GetArray(gamma) || !in.Get(n) || n > gamma.size())
+      return false;
+    jumps.resize(n);
+    for (unsigned int j = 0; j < jumps.size(); ++j) {
+      unsigned int l = 0;
+      if (!in.Get(l))
+        return false;
+      jumps[j].resize(l, l);
+      if (!in.GetRangeInto(jumps[j].begin(), size_t(l) * l))
+        return false;
+    }
+    return in.GetArray(viterbi_alignment) && in.Get(cross_entropy) && in.Get(viterbi_log_score) &&
+        in.Get(logFinalMultiply) && in.Get(p0c) && in.Get(np0c) && in.Get(seenPosteriors) &&
+        in.Get(skippedPosteriors) && in.Get(skippedPosteriorMass) && in.GetString(verbose);
+  }
+};
+
+// The jumps between the source positions of French position j of a pair
+// with l source words from its expected transition counts 'e', in l x l
+// 'jumps'; the transitions to the empty word go to pair.p0c.
+void transitionJumps(unsigned int l, const Array2<double>& e, HMMPair& pair, Array2<double>& jumps) {
+  unsigned int I=2*l;
+  const double *ep=&e(0,0);
+  double cutoff=0.0;
+  if (HMMPosteriorThreshold>0)
+    cutoff=HMMPosteriorThreshold*accumulate(ep,ep+I*I,0.0);
+  //for (i=0;i<I;i++)
+  //  normalize_if_possible_with_increment(ep+i,ep+i+I*I,I);
+  //    for (i=0;i<I*I;++i)
+  //  ep[i] *= I;
+  //if (DependencyOfJ)
+  //  if (J-1)
+  //    for (i=0;i<I*I;++i)
+  //      ep[i] /= (J-1);
+  double mult=1.0;
+  mult*=l;
+  //if (DependencyOfJ && J-1)
+  //  mult/=(J-1);
+  // jumps(i_befreal,ireal); the empty word continues from i_befreal as well
+  jumps.resize(l,l);
+  fill(jumps.begin(),jumps.end(),0.0);
+  for (unsigned int i=0;i<I;i++)
+  {
+    for (unsigned int i_bef=0;i_bef<I;i_bef++,ep++)
+    {
+      CLASSIFY(i,i_empty,ireal);
+      CLASSIFY2(i_bef,i_befreal);
+      pair.seenPosteriors++;
+      if (*ep<cutoff && *ep)
+      {
+        pair.skippedPosteriors++;
+        pair.skippedPosteriorMass+=*ep * mult;
+        continue;
+      }
+      if (i_empty)
+        pair.p0c+=*ep * mult;
+      else
+      {
+        jumps(i_befreal,ireal)+=*ep * mult;
+        pair.np0c+=*ep * mult;
+      }
+      MASSERT( &e(i,i_bef)== ep);
+    }
+  }
+}
+
+class HMMTransitionCountCollector : public HMMTransitionCounts {
+ public:
+  HMMTransitionCountCollector(HMMPair& pair, unsigned int l, bool active)
+      : pair_(pair), l_(l), active_(active) {}
+
+  void add(int j, const Array2<double>& e) {
+    if (!active_ || e.getLen1()==0)
+      return;
+    if (pair_.jumps.size()<=unsigned(j))
+      pair_.jumps.resize(j+1);
+    transitionJumps(l_,e,pair_,pair_.jumps[j]);
+  }
+
+ private:
+  HMMPair& pair_;
+  unsigned int l_;
+  bool active_;
+};
+
+// a sentence pair of a window of the scheduler and its result
+struct HMMItem {
+  SentencePair sent;
+  int pair_no;
+  HMMPair result;
+};
+
+} // namespace
 
 HMM::HMM(IBMModel2& m)
     : IBMModel2(m),
       counts(GLOBALProbabilityForEmpty, ewordclasses, fwordclasses),
-      probs(GLOBALProbabilityForEmpty, ewordclasses, fwordclasses) {}
+      probs(GLOBALProbabilityForEmpty, ewordclasses, fwordclasses),
+      seenPosteriors(0),
+      skippedPosteriors(0),
+      skippedPosteriorMass(0.0) {}
 
 HMM::~HMM() { }
 
@@ -71,6 +235,8 @@ int HMM::em_with_tricks(int noIterations) {
   cout << "\n==========================================================\n";
   cout << modelName << " Training Started at: " << ctime(&st);
   for (int it=1; it <= noIterations; it++) {
+    if (checkpointDone(kCheckpointHMM, it))
+      continue;
     pair_no = 0;
     it_st = time(NULL);
     cout << endl << "-----------\n" << modelName << ": Iteration " << it << '\n';
@@ -85,22 +251,33 @@ int HMM::em_with_tricks(int noIterations) {
     afileh = g_prefix + ".h" + shortModelName + "." + number;
     alignfile = g_prefix + ".A" + shortModelName + "." + number;
     test_alignfile = g_prefix + ".tst.A" + shortModelName + "." + number;
+    IterationTelemetry telemetry(modelName, it);
     counts=HMMTables<int,WordClasses>(GLOBALProbabilityForEmpty,ewordclasses,fwordclasses);
     aCountTable.clear();
     initAL();
-    em_loop(perp, sHandler1,  dump_files , alignfile.c_str(), trainViterbiPerp, false,it==1,it);
+    {
+      TelemetryPhaseTimer phase(kTelemetryEStep);
+      em_loop(perp, sHandler1,  dump_files , alignfile.c_str(), trainViterbiPerp, false,it==1,it);
+    }
     if (errorsAL()<minErrors)
     {
       minErrors=errorsAL();
       minIter=it;
     }
-    if (testPerp && testHandler)
+    if (testPerp && testHandler) {
+      TelemetryPhaseTimer phase(kTelemetryEStep);
       em_loop(*testPerp, *testHandler, dump_files, test_alignfile.c_str(), *testViterbiPerp,  true,it==1,it);
-    if (dump_files&&OutputInAachenFormat==1)
+    }
+    if (dump_files&&OutputInAachenFormat==1) {
+      TelemetryPhaseTimer phase(kTelemetryDump);
       tTable.printCountTable(tfile.c_str(),Elist.getVocabList(),Flist.getVocabList(),1);
-    tTable.normalizeTable(Elist, Flist);
-    aCountTable.normalize(aTable);
-    probs=counts;
+    }
+    {
+      TelemetryPhaseTimer phase(kTelemetryNormalize);
+      tTable.normalizeTable(Elist, Flist);
+      aCountTable.normalize(aTable);
+      probs=counts;
+    }
     cout << modelName << ": ("<<it<<") TRAIN CROSS-ENTROPY " << perp.cross_entropy()
          << " PERPLEXITY " << perp.perplexity() << '\n';
     if (testPerp && testHandler)
@@ -114,6 +291,7 @@ int HMM::em_with_tricks(int noIterations) {
            << " PERPLEXITY " << testViterbiPerp->perplexity()
            << '\n';
     if (dump_files) {
+      TelemetryPhaseTimer phase(kTelemetryDump);
       if (OutputInAachenFormat==0)
         tTable.printProbTable(tfile.c_str(),Elist.getVocabList(),Flist.getVocabList(),OutputInAachenFormat);
       ofstream afilestream(afileh.c_str());
@@ -123,9 +301,18 @@ int HMM::em_with_tricks(int noIterations) {
     it_fn = time(NULL);
     cout << "\n" << modelName << " Iteration: " << it<< " took: " <<
         difftime(it_fn, it_st) << " seconds\n";
+    MemoryUsage memory;
+    memoryUsage(memory);
+    enforceMemoryBudget(memory);
+    writeCheckpoint(kCheckpointHMM, it);
+    memory.record(telemetry);
+    telemetry.finish();
   } // end of iterations
   fn = time(NULL);
   cout << endl << "Entire " << modelName << " Training took: " << difftime(fn, st) << " seconds\n";
+  MemoryUsage memory;
+  memoryUsage(memory);
+  memory.print(cout, modelName);
   //cout << "tTable contains " << tTable.getHash().bucket_count()
   //     << " buckets and  " << tTable.getHash().size() << " entries.";
   cout << "==========================================================\n";
@@ -150,6 +337,12 @@ int HMM::em_with_tricks(int noIterations) {
   return sum;
   }*/
 
+void HMM::memoryUsage(MemoryUsage& usage) const {
+  IBMModel2::memoryUsage(usage);
+  usage.add("hmm_jumps", probs.memoryBytes());
+  usage.add("hmm_counts", counts.memoryBytes());
+}
+
 void HMM::load_table(const char* filename) {
   cout << "Hmm: loading a table not implemented.\n";
   // TODO: is this correct?
@@ -160,7 +353,7 @@ void HMM::load_table(const char* filename) {
 
 HMMNetwork* HMM::makeHMMNetwork(const Vector<WordIndex>& es,
                                 const Vector<WordIndex>&fs,
-                                bool doInit) const {
+                                bool doInit,bool streamTransitions) const {
   unsigned int i,j;
   unsigned int l = es.size() - 1;
   unsigned int m = fs.size() - 1;
@@ -168,7 +361,7 @@ HMMNetwork* HMM::makeHMMNetwork(const Vector<WordIndex>& es,
   int IJ=I*J;
   bool DependencyOfJ=(CompareAlDeps&(16|8))||(g_prediction_in_alignments==2);
   bool DependencyOfPrevAJ=(CompareAlDeps&(2|4))||(g_prediction_in_alignments==0);
-  HMMNetwork *net = new HMMNetwork(I,J);
+  HMMNetwork *net = new HMMNetwork(I,J,streamTransitions?new HMMTransitionRows(*this,es,fs,doInit):0);
   fill(net->alphainit.begin(),net->alphainit.end(),0.0);
   fill(net->betainit.begin(),net->betainit.end(),0.0);
   for (j=1;j<=m;j++)
@@ -179,41 +372,18 @@ HMMNetwork* HMM::makeHMMNetwork(const Vector<WordIndex>& es,
     emptyContribution=tTable.getProb(es[0],fs[j]);
     for (i=1;i<=l;i++)
       net->n(i+l-1,j-1)=emptyContribution;
-    net->finalMultiply*=max(normalize_if_possible_with_increment(&net->n(0,j-1),&net->n(0,j-1)+IJ,J),double(1e-12));
+    const double columnSum=max(normalize_if_possible_with_increment(&net->n(0,j-1),&net->n(0,j-1)+IJ,J),double(1e-12));
+    net->finalMultiply*=columnSum;
+    net->logFinalMultiply+=log(columnSum);
   }
-  if (DependencyOfJ)
-    net->e.resize(m-1);
-  else
-    net->e.resize(J>1);
-  for (j=0;j<net->e.size();j++)
+  if (!streamTransitions)
   {
-    int frenchClass=fwordclasses.getClass(fs[1+min(int(m)-1,int(j)+1)]);
-    net->e[j].resize(I,I,0);
-    for (unsigned int i1=0;i1<I;++i1) {
-      Array<double> al(l);
-      CLASSIFY2(i1,i1real);
-      for (unsigned int i2=0;i2<l;i2++)
-        al[i2]=probs.getAlProb(i1real,i2,l,m,ewordclasses.getClass(es[1+i1real]),frenchClass
-                               ,j+1);
-      normalize_if_possible(conv<double>(al.begin()),conv<double>(al.end()));
-      if (SmoothHMM&2)
-        smooth_standard(conv<double>(al.begin()),conv<double>(al.end()),HMMAlignmentModelSmoothFactor);
-      for (unsigned int i2=0;i2<I;i2++) {
-        CLASSIFY(i2,empty_i2,i2real);
-        net->e[j](i1,i2)      = al[i2real];
-
-        if (empty_i2)
-          if (i1real!=i2real)
-          {
-            net->e[j](i1,i2)=0;
-          }
-          else
-          {
-            net->e[j](i1,i2)=doInit?al[0]:(probs.getProbabilityForEmpty()); // make first HMM iteration like IBM-1
-          }
-      }
-      normalize_if_possible(&net->e[j](i1,0),&net->e[j](i1,0)+I);
-    }
+    if (DependencyOfJ)
+      net->e.resize(m-1);
+    else
+      net->e.resize(J>1);
+    for (j=0;j<net->e.size();j++)
+      makeTransitions(es,fs,doInit,j,net->e[j]);
   }
   if (doInit)
   {
@@ -245,152 +415,264 @@ HMMNetwork* HMM::makeHMMNetwork(const Vector<WordIndex>& es,
   transform(net->betainit.begin(),net->betainit.end(),net->betainit.begin(),bind1st(multiplies<double>(),2*l));
   return net;
 }
+
+double HMM::viterbiAlignment(const Vector<WordIndex>& es, const Vector<WordIndex>& fs,
+                             Vector<WordIndex>& alignment) const {
+  const WordIndex l = WordIndex(es.size() - 1), m = WordIndex(fs.size() - 1);
+  HMMNetwork *net = makeHMMNetwork(es, fs, false);
+  Array<int> vit;
+  const double viterbi_log_score = HMMLogViterbi(*net, vit);
+  delete net;
+  alignment.resize(fs.size());
+  for (WordIndex j = 1; j <= m; j++) {
+    alignment[j] = vit[j-1] + 1;
+    if (alignment[j] > l)
+      alignment[j] = 0;
+  }
+  return exp(viterbi_log_score);
+}
+
+void HMM::makeTransitions(const Vector<WordIndex>& es,
+                          const Vector<WordIndex>& fs,
+                          bool doInit, int j, Array2<double>& e) const {
+  unsigned int l = (unsigned int)(es.size() - 1);
+  unsigned int m = (unsigned int)(fs.size() - 1);
+  unsigned int I=2*l;
+  int frenchClass=fwordclasses.getClass(fs[1+min(int(m)-1,int(j)+1)]);
+  e.resize(I,I);
+  Array<double> al(l);
+  for (unsigned int i1real=0;i1real<l;++i1real) {
+    for (unsigned int i2=0;i2<l;i2++)
+      al[i2]=probs.getAlProb(i1real,i2,l,m,ewordclasses.getClass(es[1+i1real]),frenchClass
+                             ,j+1);
+    normalize_if_possible(conv<double>(al.begin()),conv<double>(al.end()));
+    if (SmoothHMM&2)
+      smooth_standard(conv<double>(al.begin()),conv<double>(al.end()),HMMAlignmentModelSmoothFactor);
+    for (unsigned int i2=0;i2<I;i2++) {
+      CLASSIFY(i2,empty_i2,i2real);
+      e(i1real,i2)      = al[i2real];
+
+      if (empty_i2)
+        if (i1real!=i2real)
+        {
+          e(i1real,i2)=0;
+        }
+        else
+        {
+          e(i1real,i2)=doInit?al[0]:(probs.getProbabilityForEmpty()); // make first HMM iteration like IBM-1
+        }
+    }
+    normalize_if_possible(&e(i1real,0),&e(i1real,0)+I);
+    // the empty word i1real+l continues from the same source position
+    copy(&e(i1real,0),&e(i1real,0)+I,&e(i1real+l,0));
+  }
+}
+
+void HMM::addJumpCounts(const Vector<WordIndex>& es,
+                        const Vector<WordIndex>& fs,
+                        int jj, const Array2<double>& jumps) {
+  unsigned int l = (unsigned int)(es.size() - 1);
+  unsigned int m = (unsigned int)(fs.size() - 1);
+  if (jumps.getLen1()==0)
+    return;
+  int frenchClass=fwordclasses.getClass(fs[1+min(int(m)-1,int(jj)+1)]);
+  for (unsigned int i_befreal=0;i_befreal<l;i_befreal++)
+    counts.addAlCounts(i_befreal,l,m,ewordclasses.getClass(es[1+i_befreal]),
+                       frenchClass,jj+1,&jumps(i_befreal,0));
+}
+
 extern float MINCOUNTINCREASE;
 
 void HMM::em_loop(Perplexity& perp, SentenceHandler& sHandler1,
                   bool dump_alignment, const char* alignfile, Perplexity& viterbi_perp,
                   bool test,bool doInit,int) {
-  WordIndex i, j, l, m;
-  double cross_entropy;
-  int pair_no=0;
+  WordIndex i, l, m;
   perp.clear();
   viterbi_perp.clear();
+  seenPosteriors=skippedPosteriors=0;
+  skippedPosteriorMass=0.0;
   ofstream of2;
   // for each sentence pair in the corpus
   if (dump_alignment||FEWDUMPS)
     of2.open(alignfile);
-  SentencePair sent;
-  sHandler1.rewind();
-  while (sHandler1.getNextSentence(sent)) {
-    const Vector<WordIndex>& es = sent.get_eSent();
-    const Vector<WordIndex>& fs = sent.get_fSent();
-    const float so  = sent.getCount();
-    l = es.size() - 1;
-    m = fs.size() - 1;
-    cross_entropy = log(1.0);
-    Vector<WordIndex> viterbi_alignment(fs.size());
-
-    unsigned int I=2*l,J=m;
-    bool DependencyOfJ=(CompareAlDeps&(16|8))||(g_prediction_in_alignments==2);
-    bool DependencyOfPrevAJ=(CompareAlDeps&(2|4))||(g_prediction_in_alignments==0);
-    HMMNetwork *net= makeHMMNetwork(es,fs,doInit);
-    Array<double> gamma;
-    Array<Array2<double> > epsilon(DependencyOfJ?(m-1):1);
-    double trainProb;
-    trainProb=ForwardBackwardTraining(*net,gamma,epsilon);
-    if (!test)
+  bool DependencyOfJ=(CompareAlDeps&(16|8))||(g_prediction_in_alignments==2);
+  bool DependencyOfPrevAJ=(CompareAlDeps&(2|4))||(g_prediction_in_alignments==0);
+  EStepShards shards("HMM", sHandler1.getTotalNoPairs1(), !test);
+  SentenceScheduler scheduler(SentenceScheduler::kHMM, (shards.working() || shards.reducing()) ? 1 : Threads);
+  // the posteriors, transition counts and scores of a pair; the tables
+  // are only read
+  auto compute = [&](HMMItem& item) {
+    HMMPair& result = item.result;
+    const Vector<WordIndex>& es = item.sent.get_eSent();
+    const Vector<WordIndex>& fs = item.sent.get_fSent();
+    const WordIndex l = WordIndex(es.size() - 1);
+    const WordIndex m = WordIndex(fs.size() - 1);
+    Array<double>& gamma=result.gamma;
+    Vector<WordIndex>& viterbi_alignment=result.viterbi_alignment;
+    result.jumps.clear();
+    result.p0c=result.np0c=0.0;
+    result.seenPosteriors=result.skippedPosteriors=0;
+    result.skippedPosteriorMass=0.0;
+    viterbi_alignment.assign(fs.size(),0);
+    HMMNetwork *net= makeHMMNetwork(es,fs,doInit,DependencyOfJ&&HMMStreamTransitions);
+    HMMTransitionCountCollector epsilonCounts(result,l,!test);
+    double trainLogProb;
+    if (net->isStreaming())
+      trainLogProb=ForwardBackwardTraining(*net,gamma,epsilonCounts);
+    else
     {
-      double *gp=conv<double>(gamma.begin());
-      for (unsigned int i2=0;i2<J;i2++)for (unsigned int i1=0;i1<I;++i1,++gp)
-                                        if (*gp>MINCOUNTINCREASE)
-                                        {
-                                          COUNT add= *gp*so;
-                                          if (i1>=l)
-                                          {
-                                            tTable.incCount(es[0],fs[1+i2],add);
-                                            aCountTable.getRef(0,i2+1,l,m)+=add;
-                                          }
-                                          else
-                                          {
-                                            tTable.incCount(es[1+i1],fs[1+i2],add);
-                                            aCountTable.getRef(1+i1,1+i2,l,m)+=add;
-                                          }
-                                        }
-      double p0c=0.0,np0c=0.0;
+      Array<Array2<double> > epsilon(DependencyOfJ?(m-1):1);
+      trainLogProb=ForwardBackwardTraining(*net,gamma,epsilon);
       for (unsigned int jj=0;jj<epsilon.size();jj++)
-      {
-        int frenchClass=fwordclasses.getClass(fs[1+min(int(m)-1,int(jj)+1)]);
-        double *ep=epsilon[jj].begin();
-        if (ep)
-        {
-          //for (i=0;i<I;i++)
-          //  normalize_if_possible_with_increment(ep+i,ep+i+I*I,I);
-          //    for (i=0;i<I*I;++i)
-          //  ep[i] *= I;
-          //if (DependencyOfJ)
-          //  if (J-1)
-          //    for (i=0;i<I*I;++i)
-          //      ep[i] /= (J-1);
-          double mult=1.0;
-          mult*=l;
-          //if (DependencyOfJ && J-1)
-          //  mult/=(J-1);
-          for (i=0;i<I;i++)
-          {
-            for (unsigned int i_bef=0;i_bef<I;i_bef++,ep++)
-            {
-              CLASSIFY(i,i_empty,ireal);
-              CLASSIFY2(i_bef,i_befreal);
-              if (i_empty)
-                p0c+=*ep * mult;
-              else
-              {
-                counts.addAlCount(i_befreal,ireal,l,m,ewordclasses.getClass(es[1+i_befreal]),
-                                  frenchClass ,jj+1,*ep * mult,0.0);
-                np0c+=*ep * mult;
-              }
-              MASSERT( &epsilon[jj](i,i_bef)== ep);
-            }
-          }
-        }
-      }
-      double *gp1=conv<double>(gamma.begin()),*gp2=conv<double>(gamma.end())-I;
-      Array<double>&ai=counts.doGetAlphaInit(I);
-      Array<double>&bi=counts.doGetBetaInit(I);
-      int firstFrenchClass=(fs.size()>1)?(fwordclasses.getClass(fs[1+0])):0;
-      for (i=0;i<I;i++,gp1++,gp2++)
-      {
-        CLASSIFY(i,i_empty,ireal);
-        ai[i]+= *gp1;
-        bi[i]+= *gp2;
-        if (DependencyOfPrevAJ==0)
-        {
-          if (i_empty)
-            p0c+=*gp1;
-          else
-          {
-            counts.addAlCount(-1,ireal,l,m,0,firstFrenchClass,0,*gp1,0.0);
-            np0c+=*gp1;
-          }
-        }
-      }
-      if (g_is_verbose)
-        cout << "l: " << l << "m: " << m << " p0c: " << p0c << " np0c: " << np0c << endl;
+        epsilonCounts.add(jj,epsilon[jj]);
     }
-    cross_entropy+=log(max(trainProb,1e-100))+log(max(net->finalMultiply,1e-100));
+    // the reported probability and the product of the column factors are
+    // at least 1e-100 each, as before the scaling; a sentence pair without
+    // any possible alignment counts as 1e-100
+    const double logFloor=log(1e-100);
+    if (!(trainLogProb>logFloor))
+      trainLogProb=logFloor;
+    result.logFinalMultiply=max(net->logFinalMultiply,logFloor);
+    result.cross_entropy=trainLogProb+result.logFinalMultiply;
     Array<int>vit;
-    double viterbi_score=1.0;
+    double& viterbi_log_score=result.viterbi_log_score;
+    viterbi_log_score=0.0;
     if ((g_hmm_training_special_flags&1))
       HMMViterbi(*net,gamma,vit);
     else
-      viterbi_score=HMMRealViterbi(*net,vit);
-    for (j=1;j<=m;j++)
+      viterbi_log_score=HMMLogViterbi(*net,vit);
+    for (WordIndex j=1;j<=m;j++)
     {
       viterbi_alignment[j]=vit[j-1]+1;
       if (viterbi_alignment[j]>l)
         viterbi_alignment[j]=0;
     }
-    sHandler1.setProbOfSentence(sent,cross_entropy);
-    perp.addFactor(cross_entropy, so, l, m,1);
-    viterbi_perp.addFactor(log(viterbi_score)+log(max(net->finalMultiply,1e-100)), so, l, m,1);
 
+    result.verbose.clear();
     if (g_is_verbose) {
-      cout << "Viterbi-perp: " << log(viterbi_score) << ' '
-           << log(max(net->finalMultiply,1e-100)) << ' '
-           << viterbi_score << ' ' << net->finalMultiply
-           << ' ' << *net << "gamma: " << gamma << endl;
+      ostringstream out;
+      out << "Viterbi-perp: " << viterbi_log_score << ' '
+          << net->logFinalMultiply << ' '
+          << exp(viterbi_log_score) << ' ' << net->finalMultiply
+          << ' ' << *net << "gamma: " << gamma << '\n';
+      result.verbose=out.str();
     }
 
     // TODO: Use more safe resource management like RAII.
     delete net;
     net = 0;
+  };
+  Vector<HMMItem> window;
+  sHandler1.rewind();
+  int pair_no=0;
+  for (bool more=true; more;) {
+    while (!scheduler.full()) {
+      if (scheduler.size()==window.size())
+        window.resize(window.size()+1);
+      HMMItem& item=window[scheduler.size()];
+      if (!(more=sHandler1.getNextSentence(item.sent)))
+        break;
+      item.pair_no=pair_no++;
+      if (shards.mine(item.pair_no))
+        scheduler.add((unsigned int)(item.sent.get_eSent().size()-1),(unsigned int)(item.sent.get_fSent().size()-1));
+    }
+    const unsigned int n=scheduler.size();
+    if (shards.reducing())
+      scheduler.run([&](unsigned int k) {
+          HMMItem& item=window[k];
+          const WordIndex l=WordIndex(item.sent.get_eSent().size()-1),m=WordIndex(item.sent.get_fSent().size()-1);
+          if (!item.result.read(shards.results(item.pair_no)) || item.result.gamma.size()!=2*l*m ||
+              item.result.viterbi_alignment.size()!=m+1) {
+            cerr << "ERROR: bad HMM results of sentence pair " << item.sent.getSentenceNo() << '\n';
+            exit(1);
+          }
+        });
+    else
+      scheduler.run([&](unsigned int k) { compute(window[k]); });
+    for (unsigned int b=0; b<n; ++b) {
+      SentencePair& sent=window[b].sent;
+      HMMPair& result=window[b].result;
+      const Vector<WordIndex>& es = sent.get_eSent();
+      const Vector<WordIndex>& fs = sent.get_fSent();
+      const float so  = float(sent.getCount());
+      l = WordIndex(es.size() - 1);
+      m = WordIndex(fs.size() - 1);
+      unsigned int I=2*l,J=m;
+      Array<double>& gamma=result.gamma;
+      Vector<WordIndex>& viterbi_alignment=result.viterbi_alignment;
+      if (shards.working()) {
+        result.write(shards.out(window[b].pair_no));
+        continue;
+      }
+      cout << result.verbose;
+      if (!test)
+      {
+        seenPosteriors+=result.seenPosteriors;
+        skippedPosteriors+=result.skippedPosteriors;
+        skippedPosteriorMass+=result.skippedPosteriorMass;
+        for (unsigned int jj=0;jj<result.jumps.size();jj++)
+          addJumpCounts(es,fs,jj,result.jumps[jj]);
+        double *gp=conv<double>(gamma.begin());
+        seenPosteriors+=I*J;
+        for (unsigned int i2=0;i2<J;i2++)for (unsigned int i1=0;i1<I;++i1,++gp)
+                                          if (*gp>MINCOUNTINCREASE&&*gp<HMMPosteriorThreshold)
+                                          {
+                                            skippedPosteriors++;
+                                            skippedPosteriorMass+= *gp*so;
+                                          }
+                                          else if (*gp>MINCOUNTINCREASE)
+                                          {
+                                            COUNT add=COUNT(*gp*so);
+                                            if (i1>=l)
+                                            {
+                                              tTable.incCount(es[0],fs[1+i2],add);
+                                              aCountTable.getRef(0,i2+1,l,m)+=add;
+                                            }
+                                            else
+                                            {
+                                              tTable.incCount(es[1+i1],fs[1+i2],add);
+                                              aCountTable.getRef(1+i1,1+i2,l,m)+=add;
+                                            }
+                                          }
+        double &p0c=result.p0c,&np0c=result.np0c;
+        double *gp1=conv<double>(gamma.begin()),*gp2=conv<double>(gamma.end())-I;
+        Array<double>&ai=counts.doGetAlphaInit(I);
+        Array<double>&bi=counts.doGetBetaInit(I);
+        int firstFrenchClass=(fs.size()>1)?(fwordclasses.getClass(fs[1+0])):0;
+        for (i=0;i<I;i++,gp1++,gp2++)
+        {
+          CLASSIFY(i,i_empty,ireal);
+          ai[i]+= *gp1;
+          bi[i]+= *gp2;
+          if (DependencyOfPrevAJ==0)
+          {
+            if (i_empty)
+              p0c+=*gp1;
+            else
+            {
+              counts.addAlCount(-1,ireal,l,m,0,firstFrenchClass,0,*gp1,0.0);
+              np0c+=*gp1;
+            }
+          }
+        }
+        if (g_is_verbose)
+          cout << "l: " << l << "m: " << m << " p0c: " << p0c << " np0c: " << np0c << endl;
+      }
+      const double viterbi_score=exp(result.viterbi_log_score);
+      sHandler1.setProbOfSentence(sent,result.cross_entropy);
+      perp.addFactor(result.cross_entropy, so, l, m,1);
+      viterbi_perp.addFactor(result.viterbi_log_score+result.logFinalMultiply, so, l, m,1);
 
-    if (dump_alignment||(FEWDUMPS&&sent.getSentenceNo()<1000))
-      printAlignToFile(es, fs, Elist.getVocabList(), Flist.getVocabList(), of2, viterbi_alignment, sent.getSentenceNo(), viterbi_score);
-    addAL(viterbi_alignment,sent.getSentenceNo(),l);
-    pair_no++;
+      if (dump_alignment||(FEWDUMPS&&sent.getSentenceNo()<1000))
+        printAlignToFile(es, fs, Elist.getVocabList(), Flist.getVocabList(), of2, viterbi_alignment, sent.getSentenceNo(), viterbi_score);
+      addAL(viterbi_alignment,sent.getSentenceNo(),l);
+    }
   } /* of while */
+  shards.finish();
   sHandler1.rewind();
+  if (HMMPosteriorThreshold>0&&!test)
+    cout << "Hmm: skipped " << skippedPosteriors << " of " << seenPosteriors << " posteriors below -emPosteriorThreshold "
+         << HMMPosteriorThreshold << " (counts: " << skippedPosteriorMass << ")\n";
   perp.record("HMM");
   viterbi_perp.record("HMM");
   errorReportAL(cout,"HMM");
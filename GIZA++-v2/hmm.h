@@ -25,6 +25,7 @@
 #include <iostream>
 #include <string>
 #include "util/vector.h"
+#include "util/array2.h"
 #include "defs.h"
 #include "ibm_model2.h"
 #include "word_classes.h"
@@ -40,6 +41,9 @@ class HMM : public IBMModel2 {
   WordClasses ewordclasses;
   WordClasses fwordclasses;
   HMMTables<int,WordClasses> counts, probs;
+  // posteriors seen and skipped by -emPosteriorThreshold in one em_loop
+  long long seenPosteriors, skippedPosteriors;
+  double skippedPosteriorMass;
 
  public:
   HMM(IBMModel2& m2);
@@ -48,6 +52,13 @@ class HMM : public IBMModel2 {
   template<class Mapper>
   void makeWordClasses(const Mapper& m1, const Mapper& m2,
                        const std::string& efile, const std::string& ffile);
+  // the same from lines "word class" in memory
+  template<class Mapper>
+  void makeWordClasses(const Mapper& m1, const Mapper& m2,
+                       std::istream& estrm, std::istream& fstrm) {
+    ewordclasses.read(estrm,m1);
+    fwordclasses.read(fstrm,m2);
+  }
 
   void initialize_table_uniformly(SentenceHandler& handler);
 
@@ -56,12 +67,34 @@ class HMM : public IBMModel2 {
   // WARNING: Do not call this function. Not implemented yet.
   void load_table(const char* filename);
 
+  // the jump tables in the binary format of the training checkpoints
+  void writeBinary(util::BinaryWriter& out) const { probs.writeBinary(out); }
+  bool readBinary(util::BinaryReader& in) { return probs.readBinary(in); }
+
   void em_loop(Perplexity& perp, SentenceHandler& sHandler1, bool dump_files,
                const char* alignfile, Perplexity&, bool test,bool doInit,int iter);
 
+  void memoryUsage(MemoryUsage& usage) const;
+
   HMMNetwork *makeHMMNetwork(const Vector<WordIndex>& es,
                              const Vector<WordIndex>&fs,
-                             bool doInit) const;
+                             bool doInit,bool streamTransitions=false) const;
+
+  // The Viterbi alignment of a sentence pair as em_loop prints it, with
+  // positions of the empty word mapped to 0; returns its score.
+  double viterbiAlignment(const Vector<WordIndex>& es, const Vector<WordIndex>& fs,
+                          Vector<WordIndex>& alignment) const;
+
+  // Transition matrix between French positions j and j+1 of a sentence pair.
+  void makeTransitions(const Vector<WordIndex>& es,
+                       const Vector<WordIndex>& fs,
+                       bool doInit, int j, Array2<double>& e) const;
+
+  // Adds the jumps between the source positions of French position j
+  // of a sentence pair, from its expected transition counts, to 'counts'.
+  void addJumpCounts(const Vector<WordIndex>& es,
+                     const Vector<WordIndex>& fs,
+                     int j, const Array2<double>& jumps);
   friend class IBMModel3;
 };
 
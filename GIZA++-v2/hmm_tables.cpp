@@ -53,30 +53,105 @@ void HMMTables<CLS,MAPPERCLASSTOSTRING>::writeJumps(ostream&out) const {
 template<class CLS,class MAPPERCLASSTOSTRING>
 void HMMTables<CLS,MAPPERCLASSTOSTRING>::readJumps(istream&) { }
 
+namespace {
+
+template<class KEY>
+void writeJumpTables(util::BinaryWriter&out,const std::map<KEY,FlexArray<double> >&tables) {
+  out.Put<uint64_t>(tables.size());
+  for (typename std::map<KEY,FlexArray<double> >::const_iterator i=tables.begin();i!=tables.end();++i) {
+    out.Put(i->first);
+    out.Put(i->second.low());
+    out.Put(i->second.high());
+    out.PutRange(&i->second[i->second.low()],i->second.high()-i->second.low()+1);
+  }
+}
+
+template<class KEY>
+bool readJumpTables(util::BinaryReader&in,std::map<KEY,FlexArray<double> >&tables) {
+  uint64_t n=0;
+  in.Get(n);
+  tables.clear();
+  for (uint64_t i=0;i<n&&in.IsOK();++i) {
+    KEY key(0);
+    int low=0,high=-1;
+    in.Get(key);
+    in.Get(low);
+    in.Get(high);
+    if (high<low)
+      return false;
+    FlexArray<double>&x=tables.insert(make_pair(key,FlexArray<double>(low,high,0.0))).first->second;
+    in.GetRangeInto(&x[low],high-low+1);
+  }
+  return in.IsOK();
+}
+
+void writeInitTables(util::BinaryWriter&out,const hash_map<int,Array<double> >&tables) {
+  out.Put<uint64_t>(tables.size());
+  for (hash_map<int,Array<double> >::const_iterator i=tables.begin();i!=tables.end();++i) {
+    out.Put(i->first);
+    out.PutArray(i->second);
+  }
+}
+
+bool readInitTables(util::BinaryReader&in,hash_map<int,Array<double> >&tables) {
+  uint64_t n=0;
+  in.Get(n);
+  tables.clear();
+  for (uint64_t i=0;i<n&&in.IsOK();++i) {
+    int I=0;
+    in.Get(I);
+    in.GetArray(tables[I]);
+  }
+  return in.IsOK();
+}
+
+} // namespace
+
 template<class CLS,class MAPPERCLASSTOSTRING>
-double HMMTables<CLS,MAPPERCLASSTOSTRING>::getAlProb(int istrich,int k,int sentLength,int J,CLS w1,CLS w2,int j,int iter) const {
-  MASSERT(k<sentLength&&k>=0);
-  MASSERT(istrich<sentLength&&istrich>=-1);
+void HMMTables<CLS,MAPPERCLASSTOSTRING>::writeBinary(util::BinaryWriter&out) const {
+  out.Put(probabilityForEmpty);
+  writeInitTables(out,init_alpha);
+  writeInitTables(out,init_beta);
+  writeJumpTables(out,alProb);
+  writeJumpTables(out,alProbPredicted);
+}
+
+template<class CLS,class MAPPERCLASSTOSTRING>
+bool HMMTables<CLS,MAPPERCLASSTOSTRING>::readBinary(util::BinaryReader&in) {
+  in.Get(probabilityForEmpty);
+  return readInitTables(in,init_alpha)&&readInitTables(in,init_beta)
+      &&readJumpTables(in,alProb)&&readJumpTables(in,alProbPredicted);
+}
+
+template<class CLS,class MAPPERCLASSTOSTRING>
+int HMMTables<CLS,MAPPERCLASSTOSTRING>::jumpPosition(int istrich,int k,int sentLength,int J,int j) const {
   int pos=istrich-k;
-  switch(g_prediction_in_alignments) {
+  switch (g_prediction_in_alignments) {
     case 0:
-      pos = istrich-k;
+      pos=istrich-k;
       break;
     case 1:
-      pos = k;
+      pos=k;
       break;
     case 2:
-      pos = (k*J-j*sentLength);
+      pos=(k*J-j*sentLength);
       if (pos > 0)
-        pos += J / 2;
+        pos+=J/2;
       else
-        pos -= J/2;
-
+        pos-=J/2;
       pos /= J;
       break;
     default:
       abort();
   }
+  return pos;
+}
+
+template<class CLS,class MAPPERCLASSTOSTRING>
+double HMMTables<CLS,MAPPERCLASSTOSTRING>::getAlProb(int istrich,int k,int sentLength,int J,CLS w1,CLS w2,int j,int iter) const {
+  MASSERT(k<sentLength&&k>=0);
+  MASSERT(istrich<sentLength&&istrich>=-1);
+  const int pos=jumpPosition(istrich,k,sentLength,J,j);
 
   typename map<AlDeps<CLS>,FlexArray<double> >::const_iterator p=alProb.find(AlDeps<CLS>(sentLength,istrich,j,w1,w2));
   if (p!=alProb.end()) {
@@ -90,25 +165,7 @@ double HMMTables<CLS,MAPPERCLASSTOSTRING>::getAlProb(int istrich,int k,int sentL
 
 template<class CLS,class MAPPERCLASSTOSTRING>
 void HMMTables<CLS,MAPPERCLASSTOSTRING>::addAlCount(int istrich,int k,int sentLength,int J,CLS w1,CLS w2,int j,double value,double valuePredicted) {
-  int pos=istrich-k;
-  switch (g_prediction_in_alignments) {
-    case 0:
-      pos=istrich-k;
-      break;
-    case 1:
-      pos=k;
-      break;
-    case 2:
-      pos=(k*J-j*sentLength);
-      if (pos > 0)
-        pos+=J/2;
-      else
-        pos-=J/2;
-      pos /= J;
-      break;
-    default:
-      abort();
-  }
+  const int pos=jumpPosition(istrich,k,sentLength,J,j);
 
   AlDeps<CLS> deps(AlDeps<CLS>(sentLength,istrich,j,w1,w2));
 
@@ -135,6 +192,21 @@ void HMMTables<CLS,MAPPERCLASSTOSTRING>::addAlCount(int istrich,int k,int sentLe
   }
 }
 
+template<class CLS,class MAPPERCLASSTOSTRING>
+void HMMTables<CLS,MAPPERCLASSTOSTRING>::addAlCounts(int istrich,int sentLength,int J,CLS w1,CLS w2,int j,const double* values) {
+  AlDeps<CLS> deps(AlDeps<CLS>(sentLength,istrich,j,w1,w2));
+  typename map<AlDeps<CLS>,FlexArray<double> >::iterator p=alProb.find(deps);
+  if (p==alProb.end()) {
+    if ((CompareAlDeps&1)==0)
+      p=alProb.insert(make_pair(deps,FlexArray<double> (-MAX_SENTENCE_LENGTH,MAX_SENTENCE_LENGTH,0.0))).first;
+    else
+      p=alProb.insert(make_pair(deps,FlexArray<double> (-sentLength,sentLength,0.0))).first;
+  }
+  for (int k=0;k<sentLength;k++)
+    if (values[k])
+      p->second[jumpPosition(istrich,k,sentLength,J,j)]+=values[k];
+}
+
 template<class CLS,class MAPPERCLASSTOSTRING>
 Array<double>&HMMTables<CLS,MAPPERCLASSTOSTRING>::doGetAlphaInit(int I) {
   if (!init_alpha.count(I))
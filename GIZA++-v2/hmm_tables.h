@@ -22,8 +22,11 @@
 #ifndef GIZAPP_HMM_TABLES_H_
 #define GIZAPP_HMM_TABLES_H_
 
+#include <stdint.h>
+
 #include <iostream>
 #include <map>
+#include "util/binary_file.h"
 #include "util/flex_array.h"
 
 template<class T>
@@ -41,51 +44,49 @@ T normalize_if_possible(T* a, T* b) {
 
 extern short CompareAlDeps;
 
+template<class CLS> class Hash_AlDeps;
+
+// Key of one jump distribution. The fields that CompareAlDeps does not
+// select are zeroed on construction, and the rest are packed into two words
+// in the order (sentence length, previous class | previous position, French
+// position, French class), so comparing keys needs no mask tests.
 template<class CLS>
 class AlDeps {
  public:
-  int englishSentenceLength;
-  CLS classPrevious;
-  int previous;
-  int j;
-  CLS Cj;
-  AlDeps(int l,int p=0,int _j=0,CLS s1=0,CLS _Cj=0)
-      : englishSentenceLength(l),
-        classPrevious(s1),
-        previous(p),
-        j(_j),Cj(_Cj) { }
-  ~AlDeps() {}
+  AlDeps(int l,int p=0,int _j=0,CLS s1=0,CLS _Cj=0) {
+    // previous position can be -1 (the initial state)
+    hi=(uint64_t((CompareAlDeps&1)?l:0)<<32)
+        | uint32_t((CompareAlDeps&2)?s1:0);
+    lo=(uint64_t(uint16_t((CompareAlDeps&4)?p+1:0))<<48)
+        | (uint64_t(uint16_t((CompareAlDeps&8)?_j:0))<<32)
+        | uint32_t((CompareAlDeps&16)?_Cj:0);
+  }
+
+  int englishSentenceLength() const { return int(hi>>32); }
+  CLS classPrevious() const { return CLS(uint32_t(hi)); }
+  int previous() const { return int(lo>>48)-1; }
+  int j() const { return int((lo>>32)&0xffff); }
+  CLS Cj() const { return CLS(uint32_t(lo)); }
 
   friend bool operator<(const AlDeps&x,const AlDeps&y) {
-    if ((CompareAlDeps&1) && x.englishSentenceLength<y.englishSentenceLength) return 1;
-    if ((CompareAlDeps&1) && y.englishSentenceLength<x.englishSentenceLength) return 0;
-    if ((CompareAlDeps&2) && x.classPrevious<y.classPrevious) return 1;
-    if ((CompareAlDeps&2) && y.classPrevious<x.classPrevious) return 0;
-    if ((CompareAlDeps&4) && x.previous<y.previous) return 1;
-    if ((CompareAlDeps&4) && y.previous<x.previous) return 0;
-    if ((CompareAlDeps&8) && x.j<y.j) return 1;
-    if ((CompareAlDeps&8) && y.j<x.j) return 0;
-    if ((CompareAlDeps&16) && x.Cj<y.Cj) return 1;
-    if ((CompareAlDeps&16) && y.Cj<x.Cj) return 0;
-    return 0;
+    return x.hi<y.hi || (x.hi==y.hi && x.lo<y.lo);
   }
 
   friend bool operator==(const AlDeps&x,const AlDeps&y) {
-    return !( x<y || y<x);
+    return x.hi==y.hi && x.lo==y.lo;
   }
+
+ private:
+  uint64_t hi,lo;
+  friend class Hash_AlDeps<CLS>;
 };
 
 template<class CLS>
 class Hash_AlDeps {
  public:
   unsigned int operator()(const AlDeps<CLS>&x) const {
-    unsigned int hash=0;
-    if ((CompareAlDeps&1)) { hash=hash+x.englishSentenceLength;hash*=31; }
-    if ((CompareAlDeps&2)) { hash=hash+x.classPrevious;hash*=31; }
-    if ((CompareAlDeps&4)) { hash=hash+x.previous;hash*=31; }
-    if ((CompareAlDeps&8)) { hash=hash+x.j;hash*=31; }
-    if ((CompareAlDeps&16)) { hash=hash+x.Cj;hash*=31; }
-    return hash;
+    const uint64_t h=(x.hi*0x9e3779b97f4a7c15ULL)^x.lo;
+    return (unsigned int)(h^(h>>32));
   }
 };
 
@@ -104,6 +105,8 @@ class HMMTables {
   const MAPPERCLASSTOSTRING*mapper1;
   const MAPPERCLASSTOSTRING*mapper2;
 
+  int jumpPosition(int i,int k,int sentLength,int J,int j) const;
+
  public:
   HMMTables(double _probForEmpty,
             const MAPPERCLASSTOSTRING& m1,
@@ -119,7 +122,16 @@ class HMMTables {
   void addAlCount(int i,int k,int sentLength, int J, CLS w1,CLS w2, int j,
                   double value,double valuePredicted);
 
+  // Same as addAlCount(i,k,...,values[k],0.0) for all k<sentLength, with a
+  // single lookup of the distribution of i.
+  void addAlCounts(int i,int sentLength, int J, CLS w1,CLS w2, int j,
+                   const double* values);
+
   virtual void readJumps(istream&);
+
+  // the tables in the binary format of the training checkpoints
+  void writeBinary(util::BinaryWriter&out) const;
+  bool readBinary(util::BinaryReader&in);
   virtual bool getAlphaInit(int I,Array<double>&x) const;
   virtual bool getBetaInit(int I,Array<double>&x) const;
 
@@ -128,6 +140,21 @@ class HMMTables {
 
   virtual double getProbabilityForEmpty() const { return probabilityForEmpty; }
 
+  // bytes of the jump distributions, estimated for the nodes of the maps
+  size_t memoryBytes() const {
+    const size_t node=sizeof(std::pair<AlDeps<CLS>,FlexArray<double> >)+4*sizeof(void*);
+    size_t bytes=(alProb.size()+alProbPredicted.size())*node;
+    for (typename std::map<AlDeps<CLS>,FlexArray<double> >::const_iterator i=alProb.begin();i!=alProb.end();++i)
+      bytes+=(i->second.high()-i->second.low()+1)*sizeof(double);
+    for (typename std::map<AlDeps<CLS>,FlexArray<double> >::const_iterator i=alProbPredicted.begin();i!=alProbPredicted.end();++i)
+      bytes+=(i->second.high()-i->second.low()+1)*sizeof(double);
+    for (typename hash_map<int,Array<double> >::const_iterator i=init_alpha.begin();i!=init_alpha.end();++i)
+      bytes+=sizeof(*i)+2*sizeof(void*)+i->second.size()*sizeof(double);
+    for (typename hash_map<int,Array<double> >::const_iterator i=init_beta.begin();i!=init_beta.end();++i)
+      bytes+=sizeof(*i)+2*sizeof(void*)+i->second.size()*sizeof(double);
+    return bytes;
+  }
+
   void performGISIteration(const HMMTables<CLS,MAPPERCLASSTOSTRING>*old);
 };
 
@@ -166,15 +193,15 @@ inline void printAlDeps(std::ostream& out, const AlDeps<CLS>&x,
                         const MAPPERCLASSTOSTRING& mapper1,
                         const MAPPERCLASSTOSTRING& mapper2) {
   if ((CompareAlDeps&1))
-    out << "sentenceLength: " << x.englishSentenceLength<< ' ';
+    out << "sentenceLength: " << x.englishSentenceLength()<< ' ';
   if ((CompareAlDeps&2))
-    out << "previousClass: " << mapper1.classString(x.classPrevious) << ' ';
+    out << "previousClass: " << mapper1.classString(x.classPrevious()) << ' ';
   if ((CompareAlDeps&4))
-    out << "previousPosition: " << x.previous << ' ';
+    out << "previousPosition: " << x.previous() << ' ';
   if ((CompareAlDeps&8))
-    out << "FrenchPosition: " << x.j << ' ';
+    out << "FrenchPosition: " << x.j() << ' ';
   if ((CompareAlDeps&16))
-    out << "FrenchClass: " << mapper2.classString(x.Cj) << ' ';
+    out << "FrenchClass: " << mapper2.classString(x.Cj()) << ' ';
 }
 
 #endif  // GIZAPP_HMM_TABLES_H_
@@ -26,6 +26,11 @@
 #include "parameter.h"
 #include "sentence_handler.h"
 #include "ttables.h"
+#include "checkpoint.h"
+#include "estep_shards.h"
+#include "memory_usage.h"
+#include "sentence_scheduler.h"
+#include "telemetry.h"
 
 extern short NoEmptyWord;
 extern int VerboseSentence;
@@ -81,6 +86,8 @@ int IBMModel1::em_with_tricks(int noIterations, /*Perplexity& perp, SentenceHand
   cout << "==========================================================\n";
   cout << modelName << " Training Started at: "<< ctime(&st) << "\n";
   for (int it = 1; it <= noIterations; it++) {
+    if (checkpointDone(kCheckpointModel1, it))
+      continue;
     pair_no = 0;
     it_st = time(NULL);
     cout <<  "-----------\n" << modelName << ": Iteration " << it << '\n';
@@ -93,20 +100,28 @@ int IBMModel1::em_with_tricks(int noIterations, /*Perplexity& perp, SentenceHand
     tfile = g_prefix + ".t" + shortModelName + "." + number;
     alignfile = g_prefix + ".A" + shortModelName + "." + number;
     test_alignfile = g_prefix +".tst.A" + shortModelName + "." + number;
+    IterationTelemetry telemetry(modelName, it);
     initAL();
-    em_loop(it,perp, sHandler1, seedModel1, dump_files, alignfile.c_str(), dictionary, useDict, trainViterbiPerp);
-    if (testPerp && testHandler) // calculate test perplexity
-      em_loop(it,*testPerp, *testHandler, seedModel1, dump_files, test_alignfile.c_str(), dictionary, useDict, *testViterbiPerp, true);
+    {
+      TelemetryPhaseTimer phase(kTelemetryEStep);
+      em_loop(it,perp, sHandler1, seedModel1, dump_files, alignfile.c_str(), dictionary, useDict, trainViterbiPerp);
+      if (testPerp && testHandler) // calculate test perplexity
+        em_loop(it,*testPerp, *testHandler, seedModel1, dump_files, test_alignfile.c_str(), dictionary, useDict, *testViterbiPerp, true);
+    }
     if (errorsAL()<minErrors)
     {
       minErrors=errorsAL();
       minIter=it;
     }
     if (dump_files) {
+      TelemetryPhaseTimer phase(kTelemetryDump);
       if (OutputInAachenFormat==1)
         tTable.printCountTable(tfile.c_str(),Elist.getVocabList(),Flist.getVocabList(),1);
     }
-    tTable.normalizeTable(Elist, Flist);
+    {
+      TelemetryPhaseTimer phase(kTelemetryNormalize);
+      tTable.normalizeTable(Elist, Flist);
+    }
     cout << modelName << ": ("<<it<<") TRAIN CROSS-ENTROPY " << perp.cross_entropy()
          << " PERPLEXITY " << perp.perplexity() << '\n';
     if (testPerp && testHandler)
@@ -120,14 +135,24 @@ int IBMModel1::em_with_tricks(int noIterations, /*Perplexity& perp, SentenceHand
            << " PERPLEXITY " << (*testViterbiPerp).perplexity()
            << '\n';
     if (dump_files) {
+      TelemetryPhaseTimer phase(kTelemetryDump);
       if (OutputInAachenFormat==0)
         tTable.printProbTable(tfile.c_str(),Elist.getVocabList(),Flist.getVocabList(),OutputInAachenFormat);
     }
     it_fn = time(NULL);
     cout << "Model 1 Iteration: " << it<< " took: " << difftime(it_fn, it_st) << " seconds\n";
+    MemoryUsage memory;
+    memoryUsage(memory);
+    enforceMemoryBudget(memory);
+    writeCheckpoint(kCheckpointModel1, it);
+    memory.record(telemetry);
+    telemetry.finish();
   }
   fn = time(NULL);
   cout <<  "Entire " << modelName << " Training took: " << difftime(fn, st) << " seconds\n";
+  MemoryUsage memory;
+  memoryUsage(memory);
+  memory.print(cout, modelName);
   return minIter;
 }
 
@@ -138,12 +163,44 @@ void IBMModel1::load_table(const char* tname) {
 
 
 extern float MINCOUNTINCREASE;
+
+namespace {
+
+// the counts and scores of a sentence pair in a Model 1 E-step
+struct Model1Pair {
+  Vector<COUNT> counts;  // of (es[i], fs[j]) at (j-1)*(l+1)+i, 0 for none
+  Vector<LpPair<COUNT,PROB>*> entries;  // their t table entries, if looked up
+  Vector<WordIndex> viterbi_alignment;
+  double cross_entropy, viterbi_score, viterbi_log_score;
+
+  void write(util::BinaryWriter& out) const {
+    out.PutArray(counts);
+    out.PutArray(viterbi_alignment);
+    out.Put(cross_entropy);
+    out.Put(viterbi_score);
+    out.Put(viterbi_log_score);
+  }
+
+  bool read(util::BinaryReader& in) {
+    entries.clear();
+    return in.GetArray(counts) && in.GetArray(viterbi_alignment) && in.Get(cross_entropy) &&
+        in.Get(viterbi_score) && in.Get(viterbi_log_score);
+  }
+};
+
+// a sentence pair of a window of the scheduler and its result
+struct Model1Item {
+  SentencePair sent;
+  int pair_no;
+  Model1Pair result;
+};
+
+} // namespace
+
 void IBMModel1::em_loop(int it,Perplexity& perp, SentenceHandler& sHandler1, bool seedModel1,
                      bool dump_alignment, const char* alignfile, util::Dictionary& dict, bool useDict, Perplexity& viterbi_perp, bool test)
 {
   WordIndex i, j, l, m;
-  double cross_entropy;
-  int pair_no=0;
   perp.clear();
   viterbi_perp.clear();
   ofstream of2;
@@ -151,17 +208,31 @@ void IBMModel1::em_loop(int it,Perplexity& perp, SentenceHandler& sHandler1, boo
   if (dump_alignment||FEWDUMPS)
     of2.open(alignfile);
   PROB uniform = 1.0/noFrenchWords;
-  SentencePair sent;
-  sHandler1.rewind();
-  while (sHandler1.getNextSentence(sent)) {
-    Vector<WordIndex>& es = sent.eSent;
-    Vector<WordIndex>& fs = sent.fSent;
-    const float so  = sent.getCount();
-    l = es.size() - 1;
-    m = fs.size() - 1;
+  EStepShards shards("Model1", sHandler1.getTotalNoPairs1(), !test);
+  // the dictionary keeps its last lookup, so the first iteration with a
+  // dictionary is sequential
+  SentenceScheduler scheduler(SentenceScheduler::kModel1,
+                              (shards.working() || shards.reducing() || (it == 1 && useDict)) ? 1 : Threads);
+  // the counts and scores of a pair; the tables are only read
+  auto compute = [&](Model1Item& item) {
+    WordIndex i, j;
+    Model1Pair& result = item.result;
+    const Vector<WordIndex>& es = item.sent.eSent;
+    const Vector<WordIndex>& fs = item.sent.fSent;
+    const float so  = float(item.sent.getCount());
+    const WordIndex l = WordIndex(es.size() - 1);
+    const WordIndex m = WordIndex(fs.size() - 1);
+    Vector<COUNT>& counts = result.counts;
+    Vector<WordIndex>& viterbi_alignment = result.viterbi_alignment;
+    counts.assign((l + 1) * m, 0);
+    result.entries.assign((l + 1) * m, 0);
+    viterbi_alignment.assign(fs.size(), 0);
+    double& cross_entropy = result.cross_entropy;
     cross_entropy = log(1.0);
-    Vector<WordIndex> viterbi_alignment(fs.size());
-    double viterbi_score = 1;
+    double& viterbi_score = result.viterbi_score;
+    double& viterbi_log_score = result.viterbi_log_score;
+    viterbi_score = 1;
+    viterbi_log_score = 0;
 
     bool eindict[l + 1];
     bool findict[m + 1];
@@ -182,18 +253,19 @@ void IBMModel1::em_loop(int it,Perplexity& perp, SentenceHandler& sHandler1, boo
 
     for (j=1; j <= m; j++) {
       // entries  that map fs to all possible ei in this sentence.
-      Vector<LpPair<COUNT,PROB> *> sPtrCache(es.size(),0); // cache pointers to table
+      LpPair<COUNT,PROB> **sPtrCache=&result.entries[(j - 1) * (l + 1)]; // cache pointers to table
       LpPair<COUNT,PROB> **sPtrCachePtr;
+      COUNT *jcounts=&counts[(j - 1) * (l + 1)];
 
       PROB denom = 0.0;
       WordIndex best_i = 0; // i for which fj is best maped to ei
       PROB word_best_score = 0;  // score for the best mapping of fj
       if (it == 1 && !seedModel1) {
-        denom = uniform  * es.size();
+        denom = uniform  * PROB(es.size());
         word_best_score = uniform;
       }
       else
-        for ((i=0),(sPtrCachePtr=&sPtrCache[0]); i <= l; i++,sPtrCachePtr++) {
+        for ((i=0),(sPtrCachePtr=sPtrCache); i <= l; i++,sPtrCachePtr++) {
           PROB e(0.0);
           (*sPtrCachePtr) = tTable.getPtr(es[i], fs[j]);
           if ((*sPtrCachePtr) != 0 && (*((*sPtrCachePtr))).prob > g_smooth_prob)
@@ -206,6 +278,7 @@ void IBMModel1::em_loop(int it,Perplexity& perp, SentenceHandler& sHandler1, boo
           } }
       viterbi_alignment[j] = best_i;
       viterbi_score *= word_best_score; /// denom;
+      viterbi_log_score += log(word_best_score);
       if (denom == 0) {
         if (test)
           cerr << "WARNING: denom is zero (TEST)\n";
@@ -224,7 +297,7 @@ void IBMModel1::em_loop(int it,Perplexity& perp, SentenceHandler& sHandler1, boo
              fs[j] does not occur in the dictionary with any es[y]
           */
           if (it == 1 && useDict) {
-            for ((i=0),(sPtrCachePtr=&sPtrCache[0]); i <= l; i++,sPtrCachePtr++) {
+            for ((i=0),(sPtrCachePtr=sPtrCache); i <= l; i++,sPtrCachePtr++) {
               if (indict[j][i] || (!findict[j] && !eindict[i])) {
                 PROB e(0.0);
                 if (it == 1 && !seedModel1)
@@ -234,16 +307,13 @@ void IBMModel1::em_loop(int it,Perplexity& perp, SentenceHandler& sHandler1, boo
                 else e = g_smooth_prob;
                 COUNT x=e*val;
                 if (it==1||x>MINCOUNTINCREASE)
-                  if ((*sPtrCachePtr) != 0)
-                    (*((*sPtrCachePtr))).count += x;
-                  else
-                    tTable.incCount(es[i], fs[j], x);
+                  jcounts[i] = x;
               } /* end of if */
             } /* end of for i */
           } /* end of it == 1 */
           // Old code:
           else{
-            for ((i=0),(sPtrCachePtr=&sPtrCache[0]); i <= l; i++,sPtrCachePtr++) {
+            for ((i=0),(sPtrCachePtr=sPtrCache); i <= l; i++,sPtrCachePtr++) {
               //for (i=0; i <= l; i++) {
               PROB e(0.0);
               if (it == 1 && !seedModel1)
@@ -255,34 +325,118 @@ void IBMModel1::em_loop(int it,Perplexity& perp, SentenceHandler& sHandler1, boo
               //if (!(i==0))
               //cout << "COUNT(e): " << e << " " << MINCOUNTINCREASE << endl;
               COUNT x=e*val;
-              if (pair_no==VerboseSentence)
+              if (item.pair_no==VerboseSentence)
                 cout << i << "(" << evlist[es[i]].word << ")," << j << "(" << fvlist[fs[j]].word << ")=" << x << endl;
               if (it==1||x>MINCOUNTINCREASE)
                 if (NoEmptyWord==0 || i!=0)
-                  if ((*sPtrCachePtr) != 0)
-                    (*((*sPtrCachePtr))).count += x;
-                  else
-                    tTable.incCount(es[i], fs[j], x);
+                  jcounts[i] = x;
             } /* end of for i */
           } // end of else
         } // end of if (denom > 0)
       }// if (!test)
     } // end of for (j);
-    sHandler1.setProbOfSentence(sent,cross_entropy);
-    //cerr << sent << "CE: " << cross_entropy << " " << so << endl;
-    perp.addFactor(cross_entropy-m*log(l+1.0), so, l, m,1);
-    viterbi_perp.addFactor(log(viterbi_score)-m*log(l+1.0), so, l, m,1);
-    if (dump_alignment||(FEWDUMPS&&sent.sentenceNo<1000))
-      printAlignToFile(es, fs, evlist, fvlist, of2, viterbi_alignment, sent.sentenceNo, viterbi_score);
-    addAL(viterbi_alignment,sent.sentenceNo,l);
-    pair_no++;
+  };
+  Vector<Model1Item> window;
+  sHandler1.rewind();
+  int pair_no = 0;
+  for (bool more = true; more;) {
+    while (!scheduler.full()) {
+      if (scheduler.size() == window.size())
+        window.resize(window.size() + 1);
+      Model1Item& item = window[scheduler.size()];
+      if (!(more = sHandler1.getNextSentence(item.sent)))
+        break;
+      item.pair_no = pair_no++;
+      if (shards.mine(item.pair_no))
+        scheduler.add((unsigned int)(item.sent.eSent.size() - 1), (unsigned int)(item.sent.fSent.size() - 1));
+    }
+    const unsigned int n = scheduler.size();
+    if (shards.reducing())
+      scheduler.run([&](unsigned int k) {
+          Model1Item& item = window[k];
+          const WordIndex l = WordIndex(item.sent.eSent.size() - 1), m = WordIndex(item.sent.fSent.size() - 1);
+          if (!item.result.read(shards.results(item.pair_no)) || item.result.counts.size() != (l + 1) * m ||
+              item.result.viterbi_alignment.size() != m + 1) {
+            cerr << "ERROR: bad Model 1 results of sentence pair " << item.sent.sentenceNo << '\n';
+            exit(1);
+          }
+        });
+    else
+      scheduler.run([&](unsigned int k) { compute(window[k]); });
+    for (unsigned int b = 0; b < n; ++b) {
+      SentencePair& sent = window[b].sent;
+      Model1Pair& result = window[b].result;
+      Vector<WordIndex>& es = sent.eSent;
+      Vector<WordIndex>& fs = sent.fSent;
+      const float so  = float(sent.getCount());
+      l = WordIndex(es.size() - 1);
+      m = WordIndex(fs.size() - 1);
+      Vector<COUNT>& counts = result.counts;
+      Vector<WordIndex>& viterbi_alignment = result.viterbi_alignment;
+      if (shards.working()) {
+        result.write(shards.out(window[b].pair_no));
+        continue;
+      }
+      // the counts in the order they were computed
+      for (j=1; j <= m; j++)
+        for (i=0; i <= l; i++) {
+          const unsigned int k = (j - 1) * (l + 1) + i;
+          if (counts[k]) {
+            if (k < result.entries.size() && result.entries[k])
+              result.entries[k]->count += counts[k];
+            else
+              tTable.incCount(es[i], fs[j], counts[k]);
+          }
+        }
+      sHandler1.setProbOfSentence(sent,result.cross_entropy);
+      //cerr << sent << "CE: " << cross_entropy << " " << so << endl;
+      perp.addFactor(result.cross_entropy-m*log(l+1.0), so, l, m,1);
+      viterbi_perp.addFactor(result.viterbi_log_score-m*log(l+1.0), so, l, m,1);
+      if (dump_alignment||(FEWDUMPS&&sent.sentenceNo<1000))
+        printAlignToFile(es, fs, evlist, fvlist, of2, viterbi_alignment, sent.sentenceNo, result.viterbi_score);
+      addAL(viterbi_alignment,sent.sentenceNo,l);
+    }
   } /* of while */
+  shards.finish();
   sHandler1.rewind();
   perp.record("Model1");
   viterbi_perp.record("Model1");
   errorReportAL(cout, "IBM-1");
 }
 
+void IBMModel1::memoryUsage(MemoryUsage& usage) const {
+  usage.add("t", tTable.memoryBytes());
+  usage.add("corpus", sHandler1.memoryBytes());
+  if (testHandler)
+    usage.add("test_corpus", testHandler->memoryBytes());
+}
+
+extern float PROB_CUTOFF;
+// the t table is pruned below PROB_CUTOFF, 10*PROB_CUTOFF, ... up to
+// 10^(kPruneSteps-1)*PROB_CUTOFF
+const int kPruneSteps = 5;
+
+void IBMModel1::enforceMemoryBudget(MemoryUsage& usage) {
+  if (!usage.overBudget())
+    return;
+  compactTables(usage);
+  if (usage.overBudget() && !sHandler1.streaming && sHandler1.stream()) {
+    cout << "Over the memory budget: reading the corpus from disk in every iteration\n";
+    usage.set("corpus", sHandler1.memoryBytes());
+    if (testHandler && testHandler->stream())
+      usage.set("test_corpus", testHandler->memoryBytes());
+  }
+  PROB threshold = PROB_CUTOFF;
+  for (int step = 0; step < kPruneSteps && usage.overBudget(); ++step, threshold *= 10) {
+    const size_t removed = tTable.prune(threshold);
+    usage.set("t", tTable.memoryBytes());
+    if (removed)
+      cout << "Over the memory budget: removed " << removed << " t table entries below " << threshold << '\n';
+  }
+  if (usage.overBudget())
+    cerr << "WARNING: the tables and the corpus take " << usage.total() / 1048576 << " MB, more than -memoryBudget\n";
+}
+
 void IBMModel1::errorReportAL(ostream& out, const string& m) const {
   if (ALeventsMissing+ALeventsToomuch)
     out << "alignmentErrors (" << m << "): "
@@ -27,6 +27,7 @@
 #include "util/vector.h"
 #include "vocab.h"
 
+class MemoryUsage;
 class Perplexity;
 class SentenceHandler;
 
@@ -167,6 +168,18 @@ class IBMModel1 : public ReportInfo {
 
   void errorReportAL(ostream& out, const string& m) const;
 
+  // Adds the bytes of the tables and of the corpus in memory to 'usage'.
+  virtual void memoryUsage(MemoryUsage& usage) const;
+
+  // With -memoryBudget, frees memory while 'usage' is over the budget:
+  // compacts the tables, then reads the corpus from the file in every
+  // iteration, then prunes the t table at rising thresholds.
+  void enforceMemoryBudget(MemoryUsage& usage);
+
+ protected:
+  // drops the unused space of the tables and updates 'usage'
+  virtual void compactTables(MemoryUsage&) { }
+
  private:
   void em_loop(int it, Perplexity& perp,
                SentenceHandler& sHandler1,
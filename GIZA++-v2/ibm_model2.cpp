@@ -26,6 +26,10 @@
 #include "parameter.h"
 #include "sentence_handler.h"
 #include "util/perplexity.h"
+#include "checkpoint.h"
+#include "memory_usage.h"
+#include "sentence_scheduler.h"
+#include "telemetry.h"
 
 extern short NoEmptyWord;
 
@@ -72,6 +76,8 @@ int IBMModel2::em_with_tricks(int noIterations)
   cout << "\n==========================================================\n";
   cout << modelName << " Training Started at: " << ctime(&st) << " iter: " << noIterations << "\n";
   for (int it=1; it <= noIterations; it++) {
+    if (checkpointDone(kCheckpointModel2, it))
+      continue;
     pair_no = 0;
     it_st = time(NULL);
     cout << endl << "-----------\n" << modelName << ": Iteration " << it << '\n';
@@ -85,19 +91,30 @@ int IBMModel2::em_with_tricks(int noIterations)
     afile = g_prefix + ".a" + shortModelName + "." + number;
     alignfile = g_prefix + ".A" + shortModelName + "." + number;
     test_alignfile = g_prefix + ".tst.A" + shortModelName + "." + number;
+    IterationTelemetry telemetry(modelName, it);
     aCountTable.clear();
     initAL();
-    em_loop(perp, sHandler1, dump_files, alignfile.c_str(), trainViterbiPerp, false);
+    {
+      TelemetryPhaseTimer phase(kTelemetryEStep);
+      em_loop(perp, sHandler1, dump_files, alignfile.c_str(), trainViterbiPerp, false);
+    }
     if (errorsAL()<minErrors) {
       minErrors=errorsAL();
       minIter=it;
     }
-    if (testPerp && testHandler)
+    if (testPerp && testHandler) {
+      TelemetryPhaseTimer phase(kTelemetryEStep);
       em_loop(*testPerp, *testHandler, dump_files, test_alignfile.c_str(), *testViterbiPerp, true);
-    if (dump_files&&OutputInAachenFormat==1)
+    }
+    if (dump_files&&OutputInAachenFormat==1) {
+      TelemetryPhaseTimer phase(kTelemetryDump);
       tTable.printCountTable(tfile.c_str(),Elist.getVocabList(),Flist.getVocabList(),1);
-    tTable.normalizeTable(Elist, Flist);
-    aCountTable.normalize(aTable);
+    }
+    {
+      TelemetryPhaseTimer phase(kTelemetryNormalize);
+      tTable.normalizeTable(Elist, Flist);
+      aCountTable.normalize(aTable);
+    }
     cout << modelName << ": ("<<it<<") TRAIN CROSS-ENTROPY " << perp.cross_entropy()
          << " PERPLEXITY " << perp.perplexity() << '\n';
     if (testPerp && testHandler)
@@ -111,28 +128,65 @@ int IBMModel2::em_with_tricks(int noIterations)
            << " PERPLEXITY " << testViterbiPerp->perplexity()
            << '\n';
     if (dump_files) {
+      TelemetryPhaseTimer phase(kTelemetryDump);
       if (OutputInAachenFormat==0)
         tTable.printProbTable(tfile.c_str(),Elist.getVocabList(),Flist.getVocabList(),OutputInAachenFormat);
       aCountTable.printTable(afile.c_str());
     }
     it_fn = time(NULL);
     cout << modelName << " Iteration: " << it<< " took: " << difftime(it_fn, it_st) << " seconds\n";
+    MemoryUsage memory;
+    memoryUsage(memory);
+    enforceMemoryBudget(memory);
+    writeCheckpoint(kCheckpointModel2, it);
+    memory.record(telemetry);
+    telemetry.finish();
   } // end of iterations
   aCountTable.clear();
   fn = time(NULL);
   cout << endl << "Entire " << modelName << " Training took: " << difftime(fn, st) << " seconds\n";
+  MemoryUsage memory;
+  memoryUsage(memory);
+  memory.print(cout, modelName);
   //  cout << "tTable contains " << tTable.getHash().bucket_count()
   //     << " buckets and  " << tTable.getHash().size() << " entries.";
   cout << "==========================================================\n";
   return minIter;
 }
 
+void IBMModel2::memoryUsage(MemoryUsage& usage) const {
+  IBMModel1::memoryUsage(usage);
+  usage.add("a", aTable.memoryBytes());
+  usage.add("a_counts", aCountTable.memoryBytes());
+}
+
+void IBMModel2::compactTables(MemoryUsage& usage) {
+  aTable.pack();
+  aCountTable.pack();
+  usage.set("a", aTable.memoryBytes());
+  usage.set("a_counts", aCountTable.memoryBytes());
+}
+
 void IBMModel2::load_table(const char* aname) {
   cout << "Model2: loading a table \n";
   aTable.readTable(aname);
 }
 
 
+namespace {
+
+// a sentence pair of a Model 2 E-step and its counts and scores
+struct Model2Item {
+  SentencePair sent;
+  Vector<COUNT> counts;  // of (es[i], fs[j]) at (j-1)*(l+1)+i
+  Vector<char> counted;  // of the French positions j with counts
+  Vector<LpPair<COUNT,PROB>*> entries;  // their t table entries
+  Vector<WordIndex> viterbi_alignment;
+  double cross_entropy, viterbi_score, viterbi_log_score;
+};
+
+} // namespace
+
 void IBMModel2::em_loop(Perplexity& perp, SentenceHandler& sHandler1,
                      bool dump_alignment, const char* alignfile, Perplexity& viterbi_perp,
                      bool test)
@@ -140,31 +194,36 @@ void IBMModel2::em_loop(Perplexity& perp, SentenceHandler& sHandler1,
   MASSERT(aTable.is_distortion==0);
   MASSERT(aCountTable.is_distortion==0);
   WordIndex i, j, l, m;
-  double cross_entropy;
-  int pair_no=0;
   perp.clear();
   viterbi_perp.clear();
   ofstream of2;
   // for each sentence pair in the corpus
   if (dump_alignment||FEWDUMPS)
     of2.open(alignfile);
-  SentencePair sent;
-
-  vector<double> ferts(evlist.size());
-
-  sHandler1.rewind();
-  while (sHandler1.getNextSentence(sent)) {
-    Vector<WordIndex>& es = sent.eSent;
-    Vector<WordIndex>& fs = sent.fSent;
-    const float so  = sent.getCount();
-    l = es.size() - 1;
-    m = fs.size() - 1;
+  SentenceScheduler scheduler(SentenceScheduler::kModel1, Threads);
+  // the counts and scores of a pair; the tables are only read
+  auto compute = [&](Model2Item& item) {
+    WordIndex i, j;
+    const Vector<WordIndex>& es = item.sent.eSent;
+    const Vector<WordIndex>& fs = item.sent.fSent;
+    const float so  = float(item.sent.getCount());
+    const WordIndex l = WordIndex(es.size() - 1);
+    const WordIndex m = WordIndex(fs.size() - 1);
+    item.counts.assign((l + 1) * m, 0);
+    item.counted.assign(m + 1, 0);
+    item.entries.resize((l + 1) * m);
+    double& cross_entropy = item.cross_entropy;
     cross_entropy = log(1.0);
-    Vector<WordIndex> viterbi_alignment(fs.size());
-    double viterbi_score = 1;
+    Vector<WordIndex>& viterbi_alignment = item.viterbi_alignment;
+    viterbi_alignment.assign(fs.size(), 0);
+    double& viterbi_score = item.viterbi_score;
+    double& viterbi_log_score = item.viterbi_log_score;
+    viterbi_score = 1;
+    viterbi_log_score = 0;
     for (j=1; j <= m; j++) {
-      Vector<LpPair<COUNT,PROB> *> sPtrCache(es.size(),0); // cache pointers to table
+      LpPair<COUNT,PROB> **sPtrCache = &item.entries[(j - 1) * (l + 1)]; // cache pointers to table
       // entries  that map fs to all possible ei in this sentence.
+      COUNT *jcounts = &item.counts[(j - 1) * (l + 1)];
       PROB denom = 0.0;
       PROB e = 0.0, word_best_score = 0;
       WordIndex best_i = 0; // i for which fj is best maped to ei
@@ -182,6 +241,7 @@ void IBMModel2::em_loop(Perplexity& perp, SentenceHandler& sHandler1,
       }
       viterbi_alignment[j] = best_i;
       viterbi_score *= word_best_score; ///denom;
+      viterbi_log_score += log(word_best_score);
       cross_entropy += log(denom);
       if (denom == 0) {
         if (test)
@@ -192,6 +252,7 @@ void IBMModel2::em_loop(Perplexity& perp, SentenceHandler& sHandler1,
       if (!test) {
         if (denom > 0) {
           COUNT val = COUNT(so) / (COUNT) double(denom);
+          item.counted[j] = 1;
           for (i=0; i <= l; i++) {
             PROB e(0.0);
             if (sPtrCache[i] != 0 &&  (*(sPtrCache[i])).prob > g_smooth_prob)
@@ -199,24 +260,55 @@ void IBMModel2::em_loop(Perplexity& perp, SentenceHandler& sHandler1,
             else
               e = g_smooth_prob;
             e *= aTable.getValue(i,j, l, m);
-            COUNT temp = COUNT(e) * val;
-            if (NoEmptyWord==0 || i!=0)
-              if (sPtrCache[i] != 0)
-                (*(sPtrCache[i])).count += temp;
-              else
-                tTable.incCount(es[i], fs[j], temp);
-            aCountTable.getRef(i,j, l, m)+= temp;
+            jcounts[i] = COUNT(e) * val;
           } /* end of for i */
         } // end of if (denom > 0)
       }// if (!test)
     } // end of for (j);
-    sHandler1.setProbOfSentence(sent,cross_entropy);
-    perp.addFactor(cross_entropy, so, l, m,1);
-    viterbi_perp.addFactor(log(viterbi_score), so, l, m,1);
-    if (dump_alignment||(FEWDUMPS&&sent.sentenceNo<1000))
-      printAlignToFile(es, fs, Elist.getVocabList(), Flist.getVocabList(), of2, viterbi_alignment, sent.sentenceNo, viterbi_score);
-    addAL(viterbi_alignment,sent.sentenceNo,l);
-    pair_no++;
+  };
+  Vector<Model2Item> window;
+  sHandler1.rewind();
+  for (bool more = true; more;) {
+    while (!scheduler.full()) {
+      if (scheduler.size() == window.size())
+        window.resize(window.size() + 1);
+      Model2Item& item = window[scheduler.size()];
+      if (!(more = sHandler1.getNextSentence(item.sent)))
+        break;
+      scheduler.add((unsigned int)(item.sent.eSent.size() - 1), (unsigned int)(item.sent.fSent.size() - 1));
+    }
+    const unsigned int n = scheduler.size();
+    scheduler.run([&](unsigned int k) { compute(window[k]); });
+    for (unsigned int b = 0; b < n; ++b) {
+      Model2Item& item = window[b];
+      SentencePair& sent = item.sent;
+      Vector<WordIndex>& es = sent.eSent;
+      Vector<WordIndex>& fs = sent.fSent;
+      const float so  = float(sent.getCount());
+      l = WordIndex(es.size() - 1);
+      m = WordIndex(fs.size() - 1);
+      // the counts in the order they were computed
+      for (j=1; j <= m; j++)
+        if (item.counted[j])
+          for (i=0; i <= l; i++) {
+            const unsigned int k = (j - 1) * (l + 1) + i;
+            const COUNT temp = item.counts[k];
+            if (NoEmptyWord==0 || i!=0) {
+              if (item.entries[k] != 0)
+                (*(item.entries[k])).count += temp;
+              else
+                tTable.incCount(es[i], fs[j], temp);
+            }
+            aCountTable.getRef(i,j, l, m)+= temp;
+          }
+      sHandler1.setProbOfSentence(sent,item.cross_entropy);
+      perp.addFactor(item.cross_entropy, so, l, m,1);
+      viterbi_perp.addFactor(item.viterbi_log_score, so, l, m,1);
+      if (dump_alignment||(FEWDUMPS&&sent.sentenceNo<1000))
+        printAlignToFile(es, fs, Elist.getVocabList(), Flist.getVocabList(), of2, item.viterbi_alignment, sent.sentenceNo,
+                         item.viterbi_score);
+      addAL(item.viterbi_alignment,sent.sentenceNo,l);
+    }
   } /* of while */
   sHandler1.rewind();
   perp.record("Model2");
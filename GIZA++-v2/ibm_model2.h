@@ -58,6 +58,11 @@ class IBMModel2 : public IBMModel1 {
                const char* alignfile,
                Perplexity&, bool test);
 
+  void memoryUsage(MemoryUsage& usage) const;
+
+ protected:
+  void compactTables(MemoryUsage& usage);
+
  private:
   friend class IBMModel3;
 };
@@ -27,92 +27,29 @@
 #include "util/perplexity.h"
 #include "sentence_handler.h"
 
-namespace {
-
-const int kMaxFertility = 10;
-
-} // namespace
-
-double get_sum_of_partitions(int n, int source_pos,
-                             double alpha[kMaxFertility][kMaxAllowedSentenceLength]) {
-  int done, init;
-  double sum = 0, prod;
-  int s, w, u, v;
-  WordIndex k, k1, i;
-  WordIndex num_parts = 0;
-  int total_partitions_considered = 0;
-
-  int part[kMaxFertility], mult[kMaxFertility];
-
-  done = false;
-  init = true;
-  for (i = 0; i < kMaxFertility; i++) {
-    part[i] = mult[i] = 0;
-  }
-
-  //printf("Entering get sum of partitions\n");
-  while (! done) {
-    total_partitions_considered++;
-    if (init) {
-      part[1] = n;
-      mult[1] = 1;
-      num_parts = 1;
-      init = false;
-    }
-    else {
-      if ((part[num_parts] > 1) || (num_parts > 1)) {
-        if (part[num_parts] == 1) {
-          s = part[num_parts-1] + mult[num_parts];
-          k = num_parts - 1;
-        } else {
-          s = part[num_parts];
-          k = num_parts;
-        }
-        w = part[k] - 1;
-        u = s / w;
-        v = s % w;
-        mult[k] -= 1;
-        if (mult[k] == 0)
-          k1 = k;
-        else
-          k1 = k + 1;
-
-        mult[k1] = u;
-        part[k1] = w;
-        if (v == 0) {
-          num_parts = k1;
-        } else {
-          mult[k1+1] = 1;
-          part[k1+1] = v;
-          num_parts = k1 + 1;
-        }
-      } else { /* of if num_parts > 1 || part[num_parts] > 1 */
-        done = true;
-      }
-    }
-    /* of else of if (init) */
-    if (!done) {
-      prod = 1.0;
-      if (n != 0) {
-        for (i = 1; i <= num_parts; i++) {
-          prod *= std::pow(alpha[part[i]][source_pos], mult[i]) / factorial(mult[i]);
-        }
-      }
-      sum += prod;
-    }
-  } /* of while */
-  if (sum < 0) sum = 0;
-  return(sum);
+// The fertility counts of a source word sum, over the partitions of n, the
+// products of alpha(k)^mult/mult! with alpha(k) = (-1)^(k+1)/k sum_j x_j^k,
+// x_j = p_j/(1-p_j). These are the coefficients of exp(sum_k alpha(k) z^k) =
+// prod_j (1 + x_j z), so for all n < max_n at once they are the elementary
+// symmetric sums of the x_j, which have no cancelling terms.
+void get_sums_of_partitions(const Vector<double>& x, int max_n,
+                            Vector<double>& sums) {
+  sums = Vector<double>(max_n, 0.0);
+  if (max_n == 0)
+    return;
+  sums[0] = 1.0;
+  for (unsigned int j = 0; j < x.size(); j++)
+    for (int n = min(int(j)+1, max_n-1); n > 0; n--)
+      sums[n] += x[j] * sums[n-1];
 }
 
 void IBMModel3::estimate_t_a_d(SentenceHandler& sHandler1, Perplexity& perp, Perplexity& trainVPerp,
                             bool simple, bool dump_files,bool updateT) {
   string tfile, nfile, dfile, p0file, afile, alignfile;
   WordIndex i, j, l, m, max_fertility_here, k;
-  PROB val, temp_mult[kMaxAllowedSentenceLength][kMaxAllowedSentenceLength];
+  PROB val;
+  Array2<PROB> temp_mult;
   double cross_entropy;
-  double beta, sum,
-      alpha[kMaxFertility][kMaxAllowedSentenceLength];
   double total, temp, r;
 
   dCountTable.clear();
@@ -138,8 +75,10 @@ void IBMModel3::estimate_t_a_d(SentenceHandler& sHandler1, Perplexity& perp, Per
     Vector<WordIndex> viterbi_alignment(fs.size());
     l = es.size() - 1;
     m = fs.size() - 1;
+    temp_mult.resize(l+1, m+1);
     cross_entropy = log(1.0);
     double viterbi_score = 1;
+    double viterbi_log_score = 0;
     PROB word_best_score;  // score for the best mapping of fj
     for (j = 1; j <= m; j++) {
       word_best_score = 0;  // score for the best mapping of fj
@@ -149,30 +88,32 @@ void IBMModel3::estimate_t_a_d(SentenceHandler& sHandler1, Perplexity& perp, Per
       for (i = 0; i <= l; i++) {
         sPtrCache[i] = tTable.getPtr(es[i], fs[j]);
         if (sPtrCache[i] != 0 &&  (*(sPtrCache[i])).prob > g_smooth_prob) // if valid pointer
-          temp_mult[i][j]= (*(sPtrCache[i])).prob * aTable.getValue(i, j, l, m);
+          temp_mult(i, j)= (*(sPtrCache[i])).prob * aTable.getValue(i, j, l, m);
         else
-          temp_mult[i][j] = g_smooth_prob *  aTable.getValue(i, j, l, m);
-        total += temp_mult[i][j];
-        if (temp_mult[i][j] > word_best_score) {
-          word_best_score = temp_mult[i][j];
+          temp_mult(i, j) = g_smooth_prob *  aTable.getValue(i, j, l, m);
+        total += temp_mult(i, j);
+        if (temp_mult(i, j) > word_best_score) {
+          word_best_score = temp_mult(i, j);
           best_i = i;
         }
       } // end of for (i)
       viterbi_alignment[j] = best_i;
       viterbi_score *= word_best_score; /// total;
+      viterbi_log_score += log(word_best_score);
       cross_entropy += log(total);
-      if (total == 0) {
+      if (total <= 0) {
         cerr << "WARNING: total is zero (TRAIN)\n";
         viterbi_score = 0;
+        viterbi_log_score = log(0.0);
       }
       if (total > 0) {
         for (i = 0; i <= l; i++) {
-          temp_mult[i][j] /= total;
-          if (temp_mult[i][j] == 1) // smooth to prevent underflow
-            temp_mult[i][j] = 0.99;
-          else  if (temp_mult[i][j] == 0)
-            temp_mult[i][j] = g_smooth_prob;
-          val = temp_mult[i][j] * PROB(count);
+          temp_mult(i, j) /= total;
+          if (temp_mult(i, j) >= 1) // smooth to prevent underflow
+            temp_mult(i, j) = 0.99;
+          else  if (temp_mult(i, j) <= 0)
+            temp_mult(i, j) = g_smooth_prob;
+          val = temp_mult(i, j) * PROB(count);
           if (val > g_smooth_prob) {
             if (updateT)
             {
@@ -193,32 +134,25 @@ void IBMModel3::estimate_t_a_d(SentenceHandler& sHandler1, Perplexity& perp, Per
     addAL(viterbi_alignment,sent.sentenceNo,l);
     if (!simple) {
       max_fertility_here = min(WordIndex(m+1), g_max_fertility);
-      for (i = 1; i <= l; i++) {
-        for (k = 1; k < max_fertility_here; k++) {
-          beta = 0;
-          alpha[k][i] = 0;
-          for (j = 1; j <= m; j++) {
-            temp =  temp_mult[i][j];
-            if (temp > 0.95) temp = 0.95; // smooth to prevent under/over flow
-            else if (temp < 0.05) temp = 0.05;
-            beta += pow(temp/(1.0-temp), (double) k);
-          }
-          alpha[k][i] = beta * pow((double) -1, (double) (k+1)) / (double) k;
-        }
-      }
+      Vector<double> x(m), sums;
       for (i = 1; i <= l; i++) {
         r = 1;
-        for (j = 1; j <= m; j++)
-          r *= (1 - temp_mult[i][j]);
+        for (j = 1; j <= m; j++) {
+          r *= (1 - temp_mult(i, j));
+          temp =  temp_mult(i, j);
+          if (temp > 0.95) temp = 0.95; // smooth to prevent under/over flow
+          else if (temp < 0.05) temp = 0.05;
+          x[j-1] = temp/(1.0-temp);
+        }
+        get_sums_of_partitions(x, max_fertility_here, sums);
         for (k = 0; k <  max_fertility_here; k++) {
-          sum = get_sum_of_partitions(k, i, alpha);
-          temp = r * sum * count;
+          temp = r * sums[k] * count;
           nCountTable.getRef(es[i], k)+=temp;
         } // end of for (k ..)
       } // end of for (i == ..)
     } // end of  if (!simple)
     perp.addFactor(cross_entropy, count, l, m,1);
-    trainVPerp.addFactor(log(viterbi_score), count, l, m,1);
+    trainVPerp.addFactor(viterbi_log_score, count, l, m,1);
   } // end of while
   sHandler1.rewind();
   cerr << "Normalizing t, a, d, n count tables now ... ";
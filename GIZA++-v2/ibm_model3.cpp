@@ -34,6 +34,9 @@
 #include "transpair_model_hmm.h"
 #include "parameter.h"
 #include "hmm.h"
+#include "checkpoint.h"
+#include "memory_usage.h"
+#include "telemetry.h"
 
 #define TRICKY_IBM3_TRAINING
 
@@ -55,6 +58,26 @@ IBMModel3::~IBMModel3() {
   nCountTable.clear();
 }
 
+void IBMModel3::memoryUsage(MemoryUsage& usage) const {
+  IBMModel2::memoryUsage(usage);
+  usage.add("d", dTable.memoryBytes());
+  usage.add("d_counts", dCountTable.memoryBytes());
+  usage.add("n", nTable.memoryBytes());
+  usage.add("n_counts", nCountTable.memoryBytes());
+  if (h) {
+    usage.add("hmm_jumps", h->probs.memoryBytes());
+    usage.add("hmm_counts", h->counts.memoryBytes());
+  }
+}
+
+void IBMModel3::compactTables(MemoryUsage& usage) {
+  IBMModel2::compactTables(usage);
+  dTable.pack();
+  dCountTable.pack();
+  usage.set("d", dTable.memoryBytes());
+  usage.set("d_counts", dCountTable.memoryBytes());
+}
+
 void IBMModel3::load_tables(const char *nfile, const char *dfile, const char *p0file) {
   cout << "Model3: loading n, d, p0 tables \n";
 
@@ -258,11 +281,18 @@ extern short DoViterbiTraining;
 
 int IBMModel3::viterbi(int noIterationsModel3, int noIterationsModel4,int noIterationsModel5,int noIterationsModel6)
 {
-  double minErrors=1.0;int minIter=0;
   d4model d4m(MAX_SENTENCE_LENGTH);
   d4m.makeWordClasses(Elist,Flist, g_source_vocab_filename + ".classes", g_target_vocab_filename + ".classes");
   d5model d5m(d4m);
   d5m.makeWordClasses(Elist,Flist, g_source_vocab_filename + ".classes", g_target_vocab_filename + ".classes");
+  return viterbi(noIterationsModel3,noIterationsModel4,noIterationsModel5,noIterationsModel6,d4m,d5m);
+}
+
+int IBMModel3::viterbi(int noIterationsModel3, int noIterationsModel4,int noIterationsModel5,int noIterationsModel6,
+                       d4model& d4m, d5model& d5m)
+{
+  double minErrors=1.0;int minIter=0;
+  readCheckpointDistortion(d4m,d5m);
   time_t it_st, st, it_fn, fn;
   bool dump_files = false;
   string tfile, tfile_actual, dfile, afile, nfile, nfile_actual, p0file, alignfile, number, test_alignfile, d4file,d5file,zeroFertFile;
@@ -285,6 +315,8 @@ int IBMModel3::viterbi(int noIterationsModel3, int noIterationsModel4,int noIter
   }
   cout << "\n "<<trainingString<<" Training Started at: "<< ctime(&st) << '\n';
   for (unsigned int it=1; it < trainingString.length(); it++) {
+    if (checkpointDone(kCheckpointModel345,it))
+      continue;
     bool final=0;
     if (it==trainingString.length()-1)
       final=1;
@@ -325,6 +357,7 @@ int IBMModel3::viterbi(int noIterationsModel3, int noIterationsModel4,int noIter
       test_alignfile = g_prefix + ".tst.A3." + number;
       p0file = g_prefix + ".p0_3." + number;
     }
+    IterationTelemetry telemetry(modelName, it);
     // clear count tables
     //    tCountTable.clear();
     dCountTable.clear();
@@ -340,6 +373,7 @@ int IBMModel3::viterbi(int noIterationsModel3, int noIterationsModel4,int noIter
 #define TEST_ARGS  *testPerp, *testViterbiPerp, *testHandler, dump_files, test_alignfile.c_str(),false, modelName,final
 
 
+    TelemetryPhaseTimer eStep(kTelemetryEStep);
     switch (toModel) {
       case '3':
         switch (fromModel) {
@@ -378,9 +412,14 @@ int IBMModel3::viterbi(int noIterationsModel3, int noIterationsModel4,int noIter
             default: abort();
           }
 
-          d4m.normalizeTable();
-          if (dump_files)
+          {
+            TelemetryPhaseTimer phase(kTelemetryNormalize);
+            d4m.normalizeTable();
+          }
+          if (dump_files) {
+            TelemetryPhaseTimer phase(kTelemetryDump);
             d4m.printProbTable(d4file.c_str(),d4file2.c_str());
+          }
         }
         break;
 
@@ -409,12 +448,21 @@ int IBMModel3::viterbi(int noIterationsModel3, int noIterationsModel4,int noIter
               break;
             default: abort();
           }
-          d5m.d4m.normalizeTable();
-          if (dump_files)
+          {
+            TelemetryPhaseTimer phase(kTelemetryNormalize);
+            d5m.d4m.normalizeTable();
+          }
+          if (dump_files) {
+            TelemetryPhaseTimer phase(kTelemetryDump);
             d5m.d4m.printProbTable(d4file.c_str(),d4file2.c_str());
-          d5m.normalizeTable();
+          }
+          {
+            TelemetryPhaseTimer phase(kTelemetryNormalize);
+            d5m.normalizeTable();
+          }
           if (dump_files)
           {
+            TelemetryPhaseTimer phase(kTelemetryDump);
             ofstream d5output(d5file.c_str());
             d5output << d5m;
           }
@@ -423,6 +471,7 @@ int IBMModel3::viterbi(int noIterationsModel3, int noIterationsModel4,int noIter
       default:
         abort();
     }
+    eStep.stop();
 
 #else
     viterbi_loop(perp, trainViterbiPerp, sHandler1, dump_files,
@@ -438,12 +487,17 @@ int IBMModel3::viterbi(int noIterationsModel3, int noIterationsModel4,int noIter
     }
 
     // now normalize count tables
-    if (dump_files&&OutputInAachenFormat==1)
+    if (dump_files&&OutputInAachenFormat==1) {
+      TelemetryPhaseTimer phase(kTelemetryDump);
       tTable.printCountTable(tfile.c_str(),Elist.getVocabList(),Flist.getVocabList(),1);
-    tTable.normalizeTable(Elist, Flist);
-    aCountTable.normalize(aTable);
-    dCountTable.normalize(dTable);
-    nCountTable.normalize(nTable,&Elist.getVocabList());
+    }
+    {
+      TelemetryPhaseTimer phase(kTelemetryNormalize);
+      tTable.normalizeTable(Elist, Flist);
+      aCountTable.normalize(aTable);
+      dCountTable.normalize(dTable);
+      nCountTable.normalize(nTable,&Elist.getVocabList());
+    }
 
     //    cout << "tTable contains " <<
     //      tTable.getHash().bucket_count() << " buckets and "<<
@@ -480,6 +534,7 @@ int IBMModel3::viterbi(int noIterationsModel3, int noIterationsModel4,int noIter
            << " PERPLEXITY " << (*testViterbiPerp).perplexity() << " Sum: " << (*testViterbiPerp).getSum() <<
           " wc: " << (*testViterbiPerp).word_count() << '\n';
     if (dump_files) {
+      TelemetryPhaseTimer phase(kTelemetryDump);
       if (OutputInAachenFormat==0)
         tTable.printProbTable(tfile.c_str(),Elist.getVocabList(),Flist.getVocabList(),OutputInAachenFormat);
       aTable.printTable(afile.c_str());
@@ -493,6 +548,16 @@ int IBMModel3::viterbi(int noIterationsModel3, int noIterationsModel4,int noIter
     it_fn = time(NULL);
     cout << "\n" << modelName << " Viterbi Iteration : "<<it<<  " took: " <<
         difftime(it_fn, it_st) << " seconds\n";
+    MemoryUsage memory;
+    memoryUsage(memory);
+    memory.add("d4", d4m.memoryBytes());
+    memory.add("d5", d5m.memoryBytes());
+    enforceMemoryBudget(memory);
+    writeCheckpoint(kCheckpointModel345,it,&d4m,&d5m);
+    memory.record(telemetry);
+    telemetry.finish();
+    if (final || trainingString[it+1]!=toModel)
+      memory.print(cout, modelName);
   } /* of iterations */
   fn = time(NULL);
   cout << trainingString <<" Training Finished at: " << ctime(&fn) << "\n";
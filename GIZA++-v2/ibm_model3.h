@@ -34,6 +34,15 @@ class SentenceHandler;
 class transpair_model2;
 class transpair_model3;
 class TransPairModelHMM;
+class d4model;
+class d5model;
+template<class MODEL_TYPE> class ViterbiSentence;
+template<class TRANSPAIR> class MoveSwapMatrix;
+
+// Climbs from 'msc' to the locally best alignment by moves and swaps,
+// keeping the link of target position 'j_peg'; returns its probability.
+template<class TRANSPAIR>
+LogProb hillClimb_std(MoveSwapMatrix<TRANSPAIR>& msc, int i_peg = -1, int j_peg = -1);
 
 class IBMModel3 : public IBMModel2 {
   // TODO: should be private.
@@ -73,6 +82,37 @@ class IBMModel3 : public IBMModel2 {
 
   void em(int, SentenceHandler&);
   int viterbi(int, int, int,int);
+  // the same with Model 4 and 5 tables of the caller, which hold the
+  // trained tables afterwards
+  int viterbi(int, int, int, int, d4model& d4m, d5model& d5m);
+
+  // The alignment of one sentence pair that the training would print
+  // without pegging: hill climbing with MODEL_TYPE from the HMM (or Model 2)
+  // Viterbi alignment, or for TransPairModelHMM the HMM Viterbi alignment
+  // itself. With -pegging 1 the training searches more alignments and may
+  // print a better one. No counts are collected; 'best' has to be l x m.
+  template<class MODEL_TYPE, class A>
+  LogProb align_pair(const Vector<WordIndex>& es, const Vector<WordIndex>& fs,
+                     A* dm, Alignment& best);
+
+  // The alignment the hill climbing starts from: the HMM (or Model 2)
+  // Viterbi alignment within the fertility limits of Model 3.
+  LogProb viterbi_model2(const transpair_model3&ef,
+                         Alignment&output,
+                         int pair_no,
+                         int i_peg = -1,
+                         int j_peg = -1) const;
+
+  LogProb viterbi_model2(const TransPairModelHMM&ef,
+                         Alignment& output,
+                         int pair_no,
+                         int i_peg = -1,
+                         int j_peg = -1) const;
+
+  void memoryUsage(MemoryUsage& usage) const;
+
+ protected:
+  void compactTables(MemoryUsage& usage);
 
  private:
   LogProb prob_of_special(Vector<WordIndex>&,
@@ -116,23 +156,11 @@ class IBMModel3 : public IBMModel2 {
                                    const Vector<WordIndex>&,
                                    LogProb , float count);
 
-  LogProb viterbi_model2(const transpair_model3&ef,
-                         Alignment&output,
-                         int pair_no,
-                         int i_peg = -1,
-                         int j_peg = -1) const;
-
   LogProb _viterbi_model2(const transpair_model2&ef,
                           Alignment&output,
                           int i_peg = -1,
                           int j_peg = -1) const;
 
-  LogProb viterbi_model2(const TransPairModelHMM&ef,
-                         Alignment& output,
-                         int pair_no,
-                         int i_peg = -1,
-                         int j_peg = -1) const;
-
   void estimate_t_a_d(SentenceHandler& sHandler1,
                       Perplexity& perp1,
                       Perplexity& perp2,
@@ -148,6 +176,14 @@ class IBMModel3 : public IBMModel2 {
                     bool,
                     string model);
 
+  // Finds the alignment centers of one sentence pair and collects their
+  // counts, into the tables or (deferCounts) into s.counts.
+  template<class MODEL_TYPE, class A,class B>
+  void viterbi_sentence_with_tricks(ViterbiSentence<MODEL_TYPE>& s,
+                                    bool collect_counts,
+                                    bool deferCounts,
+                                    A* d4m,
+                                    B* d5m);
   template<class MODEL_TYPE, class A,class B>
   void viterbi_loop_with_tricks(Perplexity&,
                                 Perplexity&,
@@ -161,4 +197,9 @@ class IBMModel3 : public IBMModel2 {
                                 B* d5m);
 };
 
+template<>
+LogProb IBMModel3::align_pair<TransPairModelHMM, const HMM>(const Vector<WordIndex>& es,
+                                                           const Vector<WordIndex>& fs,
+                                                           const HMM* dm, Alignment& best);
+
 #endif  // GIZAPP_IBM_MODEL3_H_
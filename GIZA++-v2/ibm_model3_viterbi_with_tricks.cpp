@@ -21,6 +21,7 @@
 
 #include "ibm_model3.h"
 
+#include <atomic>
 #include <cassert>
 #include "port/stl_helper.h"
 
@@ -36,6 +37,10 @@
 #include "transpair_model_hmm.h"
 #include "parameter.h"
 #include "coll_counts.h"
+#include "estep_shards.h"
+#include "move_swap_matrix.h"
+#include "sentence_scheduler.h"
+#include "telemetry.h"
 
 
 GLOBAL_PARAMETER(float,PrintN,"nbestalignments","for printing the n best alignments",kParLevOutput,0);
@@ -48,14 +53,16 @@ GLOBAL_PARAMETER(int,VerboseSentence,"VerboseSentence","number of sentence for w
 GLOBAL_PARAMETER(double,PEGGED_CUTOFF,"PEGGED_CUTOFF","relative cutoff probability for alignment-centers in pegging",kParLevOptheur,3e-2);
 GLOBAL_PARAMETER2(float, COUNTINCREASE_CUTOFF_AL,"COUNTINCREASE CUTOFF AL","countCutoffAl","Counts increment cutoff threshold for alignments in training of fertility models",kParLevOptheur,1e-5);
 
-int SentNr;
+thread_local int SentNr;
 bool UseLinkCache=1;    /// optimization for pegging
-int NumberOfAlignmentsInSophisticatedCountCollection;
+// the alignments and hill climbing steps of the pair being aligned on this
+// thread; viterbi_sentence_with_tricks keeps them with the pair
+thread_local int NumberOfAlignmentsInSophisticatedCountCollection=0;
 
 extern bool ONLYALDUMPS;
 
-int PrintHillClimbWarning=0;
-int PrintZeroScoreWarning=0;
+std::atomic<int> PrintHillClimbWarning(0);
+std::atomic<int> PrintZeroScoreWarning(0);
 
 
 LogProb IBMModel3::viterbi_model2(const TransPairModelHMM&ef, Alignment&output, int
@@ -95,7 +102,10 @@ LogProb IBMModel3::viterbi_model2(const TransPairModelHMM&ef, Alignment&output,
     }
   }
 #else
-  ret=HMMRealViterbi(*ef.GetHMMNetwork(),vit,i_peg-1,j_peg-1)*ef.GetHMMNetwork()->finalMultiply;
+  if (j_peg==-1)
+    ret=HMMRealViterbi(*ef.GetHMMNetwork(),vit,i_peg-1,j_peg-1)*ef.GetHMMNetwork()->finalMultiply;
+  else
+    ret=ef.GetPeggedViterbi().path(i_peg-1,j_peg-1,vit)*ef.GetHMMNetwork()->finalMultiply;
   for (int j=1;j<=m;j++)
   {
     if (vit[j-1]+1>l)
@@ -211,7 +221,7 @@ LogProb IBMModel3::viterbi_model2(const transpair_model3&ef, Alignment&output, i
   return _viterbi_model2(ef,output,i_peg,j_peg);
 }
 
-int HillClimbingSteps=0;
+thread_local int HillClimbingSteps=0;
 
 template<class TRANSPAIR>
 LogProb greedyClimb_WithIBM3Scoring(MoveSwapMatrix<TRANSPAIR>&msc2,int j_peg=-1)
@@ -302,52 +312,28 @@ LogProb greedyClimb(MoveSwapMatrix<TRANSPAIR>&msc2, int j_peg = -1)
 }
 
 template<class TRANSPAIR>
-LogProb hillClimb_std(MoveSwapMatrix<TRANSPAIR>&msc2, int= -1,int j_peg = -1)
+LogProb hillClimb_std(MoveSwapMatrix<TRANSPAIR>&msc2, int,int j_peg)
 {
   if (msc2.isLazy())
     return greedyClimb_WithIBM3Scoring(msc2,j_peg);
   if (LogHillClimb>1)
     cout << msc2 << '\n';
-  PositionIndex l = msc2.get_l(), m=msc2.get_m();
   int changes=0;
-  int best_change_type=-1, best_change_v1=-1, best_change_v2=-1;
+  int best_change_type=-1;
+  WordIndex best_change_v1=0, best_change_v2=0;
+  MoveSwapTree<TRANSPAIR> tree(msc2,j_peg);
   do
   {
     HillClimbingSteps++;
-    LogProb best_change_so_far = 1.00001;
-    best_change_type=0;
-    for (PositionIndex j = 1; j <= m; j++)if (int(j) != j_peg)
-                                            {
-                                              WordIndex aj=msc2(j);
-                                              for (PositionIndex j1 = j + 1; j1 <= m; j1++)if ((aj != msc2(j1)) && (int(j1) != j_peg))
-                                                                                            {
-                                                                                              LogProb change = msc2.cswap(j, j1);
-                                                                                              if (change > best_change_so_far)
-                                                                                              {
-                                                                                                best_change_so_far = change;
-                                                                                                best_change_type=1;
-                                                                                                best_change_v1=j;
-                                                                                                best_change_v2=j1;
-                                                                                                if (LogHillClimb)
-                                                                                                  cerr << "CLIMB: " << best_change_type << " " << best_change_v1 << " " << best_change_v2 << " " << best_change_so_far << msc2 << '\n';
-                                                                                                MASSERT(msc2.get_ef().isSubOptimal()==1);
-                                                                                              }
-                                                                                            }
-                                              for (PositionIndex i = 0; i <= l; i++)if (i != aj &&(i != 0 || (m >= 2 * (msc2.fert(0)+1))) && msc2.fert(i)+1<g_max_fertility)
-                                                                                      {
-                                                                                        LogProb change = msc2.cmove(i, j);
-                                                                                        if (change > best_change_so_far)
-                                                                                        {
-                                                                                          best_change_so_far = change;
-                                                                                          best_change_type=2;
-                                                                                          best_change_v1=j;
-                                                                                          best_change_v2=i;
-                                                                                          if (LogHillClimb)
-                                                                                            cerr << "CLIMB: " << best_change_type << " " << best_change_v1 << " " << best_change_v2 << " " << best_change_so_far << msc2 << '\n';
-                                                                                          MASSERT(msc2.get_ef().isSubOptimal()==1);
-                                                                                        }
-                                                                                      }
-                                            }
+    LogProb best_change_so_far = tree.best(best_change_type,best_change_v1,best_change_v2);
+    if (best_change_so_far > 1.00001)
+    {
+      if (LogHillClimb)
+        cerr << "CLIMB: " << best_change_type << " " << best_change_v1 << " " << best_change_v2 << " " << best_change_so_far << msc2 << '\n';
+      MASSERT(msc2.get_ef().isSubOptimal()==1);
+    }
+    else
+      best_change_type=0;
     if (best_change_type==1)
     {
       msc2.doSwap(best_change_v1, best_change_v2);
@@ -417,6 +403,279 @@ class Als
 
 inline bool operator<(const Als&x,const Als&y) { return x.v>y.v; }
 
+// The centers found so far for a sentence pair, looked up by the Zobrist hash
+// of their alignment in a sorted flat vector (hits are verified).
+class AlignmentKeys
+{
+  typedef pair<uint64_t,const Alignment*> Key;
+  vector<Key> keys;
+  static bool byHash(const Key&x,const Key&y) { return x.first<y.first; }
+ public:
+  bool contains(const Alignment&a) const
+  {
+    const Key k(a.hash(),&a);
+    for (vector<Key>::const_iterator p=lower_bound(keys.begin(),keys.end(),k,byHash);p!=keys.end()&&p->first==k.first;++p)
+      if (*p->second==a)
+        return 1;
+    return 0;
+  }
+  void insert(const Alignment&a)
+  {
+    const Key k(a.hash(),&a);
+    keys.insert(upper_bound(keys.begin(),keys.end(),k,byHash),k);
+  }
+  int size() const { return keys.size(); }
+};
+
+// One sentence pair of viterbi_loop_with_tricks: its model, the centers found
+// by hill climbing and pegging, and (with several threads or -shards) its
+// counts until they are added to the tables. The training process of
+// -shards reads the results of a worker instead of the centers.
+template<class MODEL_TYPE>
+class ViterbiSentence
+{
+ public:
+  SentencePair sent;
+  int pair_no,index;
+  MODEL_TYPE *ef;
+  Vector<pair<MoveSwapMatrix<MODEL_TYPE>*,LogProb> > setOfGoodCenters;
+  int bestAlignment,nHillClimbed,nAlignment,alTotal,hillClimbingSteps,neighbourhood;
+  bool betterByPegging,zeroScore;
+  LogProb align_total_count;
+  double seconds;
+  NeighborhoodCounts counts;
+  ViterbiSentence(const SentencePair&_sent,int _pair_no,int _index)
+      : sent(_sent),pair_no(_pair_no),index(_index),ef(0),bestAlignment(0),nHillClimbed(1),nAlignment(1),alTotal(0),
+        hillClimbingSteps(0),neighbourhood(0),
+        betterByPegging(0),zeroScore(0),align_total_count(0),seconds(0),readCenters(0),readScore(0) {}
+  ~ViterbiSentence()
+  {
+    for (unsigned int i=0;i<setOfGoodCenters.size();i++)
+      delete setOfGoodCenters[i].first;
+    delete ef;
+  }
+  // the best center, its score and the number of centers
+  const Alignment& best() const
+  { return setOfGoodCenters.size()?*setOfGoodCenters[bestAlignment].first:readBest; }
+  LogProb bestScore() const
+  { return setOfGoodCenters.size()?setOfGoodCenters[bestAlignment].second:readScore; }
+  int centers() const
+  { return setOfGoodCenters.size()?int(setOfGoodCenters.size()):readCenters; }
+  void write(util::BinaryWriter&out) const
+  {
+    out.Put(nHillClimbed);
+    out.Put(nAlignment);
+    out.Put(alTotal);
+    out.Put(hillClimbingSteps);
+    out.Put(neighbourhood);
+    out.Put(betterByPegging);
+    out.Put(zeroScore);
+    out.Put(align_total_count);
+    out.Put(seconds);
+    out.Put(centers());
+    out.PutArray(best().getAlignment());
+    out.Put(bestScore());
+    counts.writeBinary(out);
+  }
+  bool read(util::BinaryReader&in)
+  {
+    const PositionIndex l=sent.eSent.size()-1,m=sent.fSent.size()-1;
+    Vector<PositionIndex> a;
+    if (!(in.Get(nHillClimbed)&&in.Get(nAlignment)&&in.Get(alTotal)&&in.Get(hillClimbingSteps)&&
+          in.Get(neighbourhood)&&in.Get(betterByPegging)&&
+          in.Get(zeroScore)&&in.Get(align_total_count)&&in.Get(seconds)&&in.Get(readCenters)&&
+          in.GetArray(a)&&in.Get(readScore)&&counts.readBinary(in))||a.size()!=m+1)
+      return 0;
+    readBest=Alignment(l,m);
+    for (PositionIndex j=1;j<=m;j++)
+    {
+      if (a[j]>l)
+        return 0;
+      readBest.set(j,a[j]);
+    }
+    return 1;
+  }
+ private:
+  int readCenters;
+  Alignment readBest;
+  LogProb readScore;
+};
+
+GLOBAL_PARAMETER(int,Model345Threads,"model345threads","number of threads aligning sentence pairs in Model 3/4/5 training "
+                 "if more than -threads (-log forces 1)",kParLevSpecial,1);
+
+template<class MODEL_TYPE, class ADDITIONAL_MODEL_DATA_IN,class ADDITIONAL_MODEL_DATA_OUT>
+void IBMModel3::viterbi_sentence_with_tricks(ViterbiSentence<MODEL_TYPE>& s,
+                                             bool collect_counts, bool deferCounts,
+                                             ADDITIONAL_MODEL_DATA_IN*dm_in,
+                                             ADDITIONAL_MODEL_DATA_OUT*dm_out)
+{
+  time_t sent_s = time(NULL);
+  HillClimbingSteps=0;
+  NumberOfAlignmentsInSophisticatedCountCollection=0;
+  const int pair_no=s.pair_no;
+  Vector<WordIndex>& es = s.sent.eSent;
+  Vector<WordIndex>& fs = s.sent.fSent;
+  const float count  = float(s.sent.getCount());
+  const PositionIndex l = PositionIndex(es.size() - 1), m = PositionIndex(fs.size() - 1);
+  if (g_enable_logging) {
+    util::Logging::GetLogger() << "Processing sentence pair:\n\t";
+    printSentencePair(es, fs, util::Logging::GetLogger());
+    for (PositionIndex i = 0; i <= l; i++)
+      util::Logging::GetLogger() << Elist.getVocabList()[es[i]].word << " ";
+    util::Logging::GetLogger() << "\n\t";
+    for (PositionIndex j = 1; j <= m; j++)
+      util::Logging::GetLogger() << Flist.getVocabList()[fs[j]].word << " ";
+    util::Logging::GetLogger() << "\n";
+  }
+
+  Alignment viterbi2alignment(l,m);
+  s.ef=new MODEL_TYPE(es,fs,tTable,aTable,dTable,nTable,p1,p0,dm_in);
+  MODEL_TYPE& ef=*s.ef;
+  viterbi_model2(ef,viterbi2alignment,pair_no-1);
+  Vector<pair<MoveSwapMatrix<MODEL_TYPE>*,LogProb> >&setOfGoodCenters=s.setOfGoodCenters;
+  setOfGoodCenters.resize(1);
+  AlignmentKeys alignments;
+  MoveSwapMatrix<MODEL_TYPE> *best = (setOfGoodCenters[0].first  = new MoveSwapMatrix<MODEL_TYPE>(ef, viterbi2alignment));
+  MoveSwapMatrix<MODEL_TYPE> _viterbi(*best), *viterbi=&_viterbi; // please, don't delete this line (FJO)
+  if (g_enable_logging)
+    util::Logging::GetLogger() << "VITERBI: " << Alignment(_viterbi);
+  if (ef.isSubOptimal())
+    setOfGoodCenters[0].second = hillClimb_std(*best);
+  else
+  {
+    setOfGoodCenters[0].second = best->get_ef().prob_of_target_and_alignment_given_source(*best);
+    if (!(setOfGoodCenters[0].second>0))
+    {
+      cerr << "PROBLEM: alignment is 0.\n";
+      best->get_ef().prob_of_target_and_alignment_given_source(*best,1);
+    }
+  }
+  int& bestAlignment=s.bestAlignment;
+
+
+  for (unsigned int i=0;i<setOfGoodCenters.size();++i)
+    setOfGoodCenters[i].first->check();
+  alignments.insert(*best);
+  if (setOfGoodCenters[bestAlignment].second <= 0) {
+    s.zeroScore=1;
+    s.hillClimbingSteps=HillClimbingSteps;
+    return;
+  }
+  int& nHillClimbed=s.nHillClimbed;
+  int& nAlignment=s.nAlignment;
+  if (Peg)
+  {
+    const MoveSwapMatrix<MODEL_TYPE> *useMatrix=viterbi;  // it is faster using 'best', ... (FJO)
+    MoveSwapMatrix<MODEL_TYPE> *spare=0;  // a rejected candidate, reused for the next one
+    Array2<short, vector<short> > linkCache(l+1, m+1, false);
+    if (UseLinkCache)for (unsigned int j=1;j<=m;j++)linkCache((*useMatrix)(j), j)=1;
+    for (PositionIndex j=1;j<=m;j++)for (PositionIndex i=0;i<=l;i++)
+                                   {
+                                     nAlignment++;
+                                     if (i!=(*useMatrix)(j) && (UseLinkCache==0||linkCache(i,j)==0) &&
+                                         ef.get_t(i,j)>ef.get_t((*useMatrix)(j),j)*PEGGED_CUTOFF &&
+                                         (i != 0 || (m >= 2 * (useMatrix->fert(0)+1))))
+                                     {
+                                       MoveSwapMatrix<MODEL_TYPE> *BESTPEGGED=0;
+                                       LogProb peggedAlignmentScore;
+                                       nHillClimbed++;
+                                       if (ef.isSubOptimal())
+                                       {
+                                         if (spare)
+                                         {
+                                           BESTPEGGED=spare;
+                                           spare=0;
+                                           BESTPEGGED->assign(*useMatrix);
+                                         }
+                                         else
+                                           BESTPEGGED = new MoveSwapMatrix<MODEL_TYPE>(*useMatrix);
+                                         BESTPEGGED->doMove(i, j);
+                                         peggedAlignmentScore= hillClimb_std(*BESTPEGGED, i,j);
+                                       }
+                                       else
+                                       {
+                                         Alignment pegAlignment(l,m);
+                                         peggedAlignmentScore=viterbi_model2(ef,pegAlignment,pair_no-1,i,j);
+                                         BESTPEGGED = new MoveSwapMatrix<MODEL_TYPE>(ef,pegAlignment);
+                                         MASSERT( pegAlignment(j)==i);
+                                       }
+                                       if (UseLinkCache)
+                                         for (unsigned int j=1;j<=m;j++)
+                                           linkCache((*BESTPEGGED)(j), j)=1;
+                                       if (peggedAlignmentScore>setOfGoodCenters[bestAlignment].second*(LogProb)PEGGED_CUTOFF && !alignments.contains(*BESTPEGGED))
+                                       {
+                                         if (extendCenterList(setOfGoodCenters,BESTPEGGED,peggedAlignmentScore))
+                                         {
+                                           alignments.insert(*BESTPEGGED);
+                                           if (peggedAlignmentScore>1.00001*setOfGoodCenters[bestAlignment].second)
+                                           {
+                                             if (LogPeg)
+                                             {
+                                               cerr << "found better alignment by pegging " << pair_no << " " << peggedAlignmentScore/setOfGoodCenters[bestAlignment].second << '\n';
+                                               cerr << "NEW BEST: " << Alignment(*BESTPEGGED);
+                                               cerr << "OLD     : " << Alignment(*setOfGoodCenters[bestAlignment].first);
+                                             }
+                                             s.betterByPegging=1;
+                                             bestAlignment=alignments.size()-1;
+                                           }
+                                         }
+                                         assert( differences(*BESTPEGGED, *best)!=0);
+                                         BESTPEGGED=0;       }
+                                       else if (spare==0)
+                                         spare=BESTPEGGED;
+                                       else
+                                         delete BESTPEGGED;
+                                     }
+                                   }
+    delete spare;
+  } // end of if (Peg)
+  for (unsigned int i=0;i<setOfGoodCenters.size();++i)
+    setOfGoodCenters[i].first->check();
+  if (LogPeg>1)
+    cout << "PEGGED: " << setOfGoodCenters.size() << " HILLCLIMBED:" << nHillClimbed << " TOTAL:" << nAlignment << " alignments." << '\n';
+  if (deferCounts)
+  {
+    s.alTotal=deferCountsOverNeighborhood(setOfGoodCenters, l, m, count, collect_counts, s.counts, dm_out);
+    s.align_total_count=s.counts.total;
+  }
+  else
+    s.alTotal=collectCountsOverNeighborhood(setOfGoodCenters,es, fs, tTable, aCountTable,
+                                            dCountTable, nCountTable, p1_count, p0_count,
+                                            s.align_total_count, count, collect_counts, dm_out);
+  s.hillClimbingSteps=HillClimbingSteps;
+  s.neighbourhood=NumberOfAlignmentsInSophisticatedCountCollection;
+  s.seconds=difftime(time(NULL), sent_s);
+}
+
+template<class MODEL_TYPE, class A>
+LogProb IBMModel3::align_pair(const Vector<WordIndex>& es, const Vector<WordIndex>& fs,
+                              A* dm, Alignment& best)
+{
+  MODEL_TYPE ef(es,fs,tTable,aTable,dTable,nTable,p1,p0,dm);
+  viterbi_model2(ef,best,0);
+  if (!ef.isSubOptimal())
+    return ef.prob_of_target_and_alignment_given_source(best);
+  MoveSwapMatrix<MODEL_TYPE> msc(ef,best);
+  LogProb score=hillClimb_std(msc);
+  best.assign(msc);
+  return score;
+}
+
+// the HMM training prints the HMM Viterbi alignment without the
+// fertility limits of Model 3
+template<>
+LogProb IBMModel3::align_pair<TransPairModelHMM, const HMM>(const Vector<WordIndex>& es,
+                                                           const Vector<WordIndex>& fs,
+                                                           const HMM* dm, Alignment& best)
+{
+  Vector<WordIndex> vit;
+  const LogProb score = dm->viterbiAlignment(es, fs, vit);
+  for (PositionIndex j = 1; j < fs.size(); j++)
+    best.set(j, vit[j]);
+  return score;
+}
+
 template<class MODEL_TYPE, class ADDITIONAL_MODEL_DATA_IN,class ADDITIONAL_MODEL_DATA_OUT>
 void IBMModel3::viterbi_loop_with_tricks(Perplexity& perp, Perplexity& viterbiPerp, SentenceHandler& sHandler1,
                                       bool dump_files, const char* alignfile,
@@ -431,11 +690,9 @@ void IBMModel3::viterbi_loop_with_tricks(Perplexity& perp, Perplexity& viterbiPe
     writeNBestErrorsFile= new ofstream(x.c_str());
   }
   ofstream *of3=0;
-  PositionIndex i, j, l, m;
+  PositionIndex l, m;
   ofstream of2;
   int pair_no;
-  HillClimbingSteps=0;
-  NumberOfAlignmentsInSophisticatedCountCollection=0;
   if (dump_files||FEWDUMPS||(final&&(ONLYALDUMPS)))
     of2.open(alignfile);
   if (dump_files&&PrintN&&final)
@@ -443,233 +700,202 @@ void IBMModel3::viterbi_loop_with_tricks(Perplexity& perp, Perplexity& viterbiPe
     string x=alignfile+string("NBEST");
     of3= new ofstream(x.c_str());
   }
+  // With several threads the sentence pairs of a window of the scheduler
+  // are aligned in parallel while the tables are only read; their counts,
+  // dumps and statistics are then added in corpus order. The n best
+  // alignments and the log need all centers of a pair, so they are not
+  // split over -shards.
+  EStepShards shards(model.c_str(),sHandler1.getTotalNoPairs1(),
+                     collect_counts&&!of3&&!writeNBestErrorsFile&&!g_enable_logging);
+  const int nThreads=(g_enable_logging||shards.working())?1:max(1,max(int(Threads),int(Model345Threads)));
+  const bool deferCounts=nThreads>1||shards.working()||shards.reducing();
+  SentenceScheduler scheduler(SentenceScheduler::kModel345,shards.reducing()?1:nThreads);
   pair_no = 0; // sentence pair number
   // for each sentence pair in the corpus
   perp.clear(); // clears cross_entrop & perplexity
   viterbiPerp.clear(); // clears cross_entrop & perplexity
   SentencePair sent;
-  int NCenter=0,NHillClimbed=0,NAlignment=0,NTotal=0,NBetterByPegging=0;
-  while (sHandler1.getNextSentence(sent)) {
-    if (sent.eSent.size()==1||sent.fSent.size()==1)
-      continue;
-    SentNr=sent.sentenceNo;
-    Vector<WordIndex>& es = sent.eSent;
-    Vector<WordIndex>& fs = sent.fSent;
-    const float count  = sent.getCount();
-    if ((sent.sentenceNo % 10000) == 0)
-      cerr <<sent.sentenceNo << '\n';
-    time_t sent_s = time(NULL);
-    pair_no++;
-    l = es.size() - 1;
-    m = fs.size() - 1;
-    if (g_enable_logging) {
-      util::Logging::GetLogger() << "Processing sentence pair:\n\t";
-      printSentencePair(es, fs, util::Logging::GetLogger());
-      for (i = 0; i <= l; i++)
-        util::Logging::GetLogger() << Elist.getVocabList()[es[i]].word << " ";
-      util::Logging::GetLogger() << "\n\t";
-      for (j = 1; j <= m; j++)
-        util::Logging::GetLogger() << Flist.getVocabList()[fs[j]].word << " ";
-      util::Logging::GetLogger() << "\n";
+  int NCenter=0,NHillClimbed=0,NAlignment=0,NTotal=0,NBetterByPegging=0,NSteps=0,NNeighbourhood=0;
+  Vector<ViterbiSentence<MODEL_TYPE>*> batch;
+  int index=0;  // of the pair in the corpus, with the empty ones
+  for (bool more=1;more;)
+  {
+    batch.clear();
+    while (!scheduler.full() && (more=sHandler1.getNextSentence(sent)))
+    {
+      if (sent.eSent.size()==1||sent.fSent.size()==1)
+      {
+        index++;
+        continue;
+      }
+      SentNr=sent.sentenceNo;
+      if ((sent.sentenceNo % 10000) == 0 && !shards.working())
+        cerr <<sent.sentenceNo << '\n';
+      pair_no++;
+      if (shards.mine(index))
+      {
+        batch.push_back(new ViterbiSentence<MODEL_TYPE>(sent,pair_no,index));
+        scheduler.add(sent.eSent.size()-1,sent.fSent.size()-1);
+      }
+      index++;
     }
-
-    LogProb align_total_count=0;
-    Alignment viterbi2alignment(l,m);
-    MODEL_TYPE ef(es,fs,tTable,aTable,dTable,nTable,p1,p0,dm_in);
-    viterbi_model2(ef,viterbi2alignment,pair_no-1);
-    Vector<pair<MoveSwapMatrix<MODEL_TYPE>*,LogProb> >setOfGoodCenters(1);
-    set<Alignment> alignments;
-    MoveSwapMatrix<MODEL_TYPE> *best = (setOfGoodCenters[0].first  = new MoveSwapMatrix<MODEL_TYPE>(ef, viterbi2alignment));
-    MoveSwapMatrix<MODEL_TYPE> _viterbi(*best), *viterbi=&_viterbi; // please, don't delete this line (FJO)
-    if (g_enable_logging)
-      util::Logging::GetLogger() << "VITERBI: " << Alignment(_viterbi);
-    if (ef.isSubOptimal())
-      setOfGoodCenters[0].second = hillClimb_std(*best);
+    if (shards.reducing())
+      scheduler.run([&](unsigned int k) {
+          if (!batch[k]->read(shards.results(batch[k]->index)))
+          {
+            cerr << "ERROR: bad " << model << " results of sentence pair " << batch[k]->sent.sentenceNo << '\n';
+            exit(1);
+          }
+        });
     else
+      scheduler.run([&](unsigned int k) {
+          viterbi_sentence_with_tricks(*batch[k],collect_counts,deferCounts,dm_in,dm_out);
+        });
+    if (shards.working())
     {
-      setOfGoodCenters[0].second = best->get_ef().prob_of_target_and_alignment_given_source(*best);
-      if (setOfGoodCenters[0].second==0)
+      for (unsigned int b=0;b<batch.size();++b)
       {
-        cerr << "PROBLEM: alignment is 0.\n";
-        best->get_ef().prob_of_target_and_alignment_given_source(*best,1);
+        batch[b]->write(shards.out(batch[b]->index));
+        delete batch[b];
       }
+      continue;
     }
-    int bestAlignment=0;
 
-
-    for (unsigned int i=0;i<setOfGoodCenters.size();++i)
-      setOfGoodCenters[i].first->check();
-    alignments.insert(*best);
-    if (setOfGoodCenters[bestAlignment].second <= 0) {
-      if (PrintZeroScoreWarning++<100)
-      {
-        cerr << "WARNING: Hill Climbing yielded a zero score viterbi alignment for the following pair:\n";
-        cerr << Alignment(*setOfGoodCenters[bestAlignment].first);
-        printSentencePair(es, fs, cerr);
-        if (g_enable_logging) {
-          util::Logging::GetLogger() << "WARNING: Hill Climbing yielded a zero score viterbi alignment for the following pair:\n";
-          printSentencePair(es, fs, util::Logging::GetLogger());
+    for (unsigned int b=0;b<batch.size();++b)
+    {
+      ViterbiSentence<MODEL_TYPE>& s=*batch[b];
+      Vector<WordIndex>& es = s.sent.eSent;
+      Vector<WordIndex>& fs = s.sent.fSent;
+      const float count  = float(s.sent.getCount());
+      l = PositionIndex(es.size() - 1);
+      m = PositionIndex(fs.size() - 1);
+      pair_no=s.pair_no;
+      Vector<pair<MoveSwapMatrix<MODEL_TYPE>*,LogProb> >&setOfGoodCenters=s.setOfGoodCenters;
+      const int bestAlignment=s.bestAlignment;
+      const Alignment& best=s.best();
+      const LogProb bestScore=s.bestScore();
+      LogProb align_total_count=s.align_total_count;
+      NSteps+=s.hillClimbingSteps;
+      NNeighbourhood+=s.neighbourhood;
+      if (s.zeroScore) {
+        if (PrintZeroScoreWarning++<100)
+        {
+          cerr << "WARNING: Hill Climbing yielded a zero score viterbi alignment for the following pair:\n";
+          cerr << Alignment(best);
+          printSentencePair(es, fs, cerr);
+          if (g_enable_logging) {
+            util::Logging::GetLogger() << "WARNING: Hill Climbing yielded a zero score viterbi alignment for the following pair:\n";
+            printSentencePair(es, fs, util::Logging::GetLogger());
+          }
+        }
+        else if (PrintZeroScoreWarning==100)
+        {
+          cerr << "ERROR: too many zero score warnings => no additional one will be printed\n";
         }
+        continue;
       }
-      else if (PrintZeroScoreWarning==100)
+      NBetterByPegging+=s.betterByPegging;
+      const int alTotal=s.alTotal;
+      if (LogPeg>1)
       {
-        cerr << "ERROR: too many zero score warnings => no additional one will be printed\n";
+        cout << "ALL: " << alTotal << " from " << pow(float(l+1),float(m)) << '\n';
+        MASSERT(alTotal<=pow(double(l+1),double(m)));
       }
-      setOfGoodCenters[bestAlignment].second=1e-300;
-      continue;
-    }
-    int nHillClimbed=1,nAlignment=1;
-    bool flagBetterByPegging=0;
-    if (Peg)
-    {
-      const MoveSwapMatrix<MODEL_TYPE> *useMatrix=viterbi;  // it is faster using 'best', ... (FJO)
-      Array2<short, vector<short> > linkCache(l+1, m+1, false);
-      if (UseLinkCache)for (unsigned int j=1;j<=m;j++)linkCache((*useMatrix)(j), j)=1;
-      for (PositionIndex j=1;j<=m;j++)for (PositionIndex i=0;i<=l;i++)
-                                     {
-                                       nAlignment++;
-                                       if (i!=(*useMatrix)(j) && (UseLinkCache==0||linkCache(i,j)==0) &&
-                                           ef.get_t(i,j)>ef.get_t((*useMatrix)(j),j)*PEGGED_CUTOFF &&
-                                           (i != 0 || (m >= 2 * (useMatrix->fert(0)+1))))
-                                       {
-                                         MoveSwapMatrix<MODEL_TYPE> *BESTPEGGED=0;
-                                         LogProb peggedAlignmentScore;
-                                         nHillClimbed++;
-                                         if (ef.isSubOptimal())
-                                         {
-                                           BESTPEGGED = new MoveSwapMatrix<MODEL_TYPE>(*useMatrix);
-                                           BESTPEGGED->doMove(i, j);
-                                           peggedAlignmentScore= hillClimb_std(*BESTPEGGED, i,j);
-                                         }
-                                         else
-                                         {
-                                           Alignment pegAlignment(l,m);
-                                           peggedAlignmentScore=viterbi_model2(ef,pegAlignment,pair_no-1,i,j);
-                                           BESTPEGGED = new MoveSwapMatrix<MODEL_TYPE>(ef,pegAlignment);
-                                           MASSERT( pegAlignment(j)==i);
-                                         }
-                                         if (UseLinkCache)
-                                           for (unsigned int j=1;j<=m;j++)
-                                             linkCache((*BESTPEGGED)(j), j)=1;
-                                         if (peggedAlignmentScore>setOfGoodCenters[bestAlignment].second*(LogProb)PEGGED_CUTOFF && alignments.count(*BESTPEGGED)==0)
-                                         {
-                                           if (extendCenterList(setOfGoodCenters,BESTPEGGED,peggedAlignmentScore))
-                                           {
-                                             alignments.insert(*BESTPEGGED);
-                                             if (peggedAlignmentScore>1.00001*setOfGoodCenters[bestAlignment].second)
-                                             {
-                                               if (LogPeg)
-                                               {
-                                                 cerr << "found better alignment by pegging " << pair_no << " " << peggedAlignmentScore/setOfGoodCenters[bestAlignment].second << '\n';
-                                                 cerr << "NEW BEST: " << Alignment(*BESTPEGGED);
-                                                 cerr << "OLD     : " << Alignment(*setOfGoodCenters[bestAlignment].first);
-                                               }
-                                               flagBetterByPegging=1;
-                                               bestAlignment=alignments.size()-1;
-                                             }
-                                           }
-                                           assert( differences(*BESTPEGGED, *best)!=0);
-                                           BESTPEGGED=0;       }
-                                         else
-                                           delete BESTPEGGED;
-                                       }
-                                     }
-    } // end of if (Peg)
-    NBetterByPegging+=flagBetterByPegging;
-    for (unsigned int i=0;i<setOfGoodCenters.size();++i)
-      setOfGoodCenters[i].first->check();
-    if (LogPeg>1)
-      cout << "PEGGED: " << setOfGoodCenters.size() << " HILLCLIMBED:" << nHillClimbed << " TOTAL:" << nAlignment << " alignments." << '\n';
-    int alTotal=collectCountsOverNeighborhood(setOfGoodCenters,es, fs, tTable, aCountTable,
-                                              dCountTable, nCountTable, p1_count, p0_count,
-                                              align_total_count, count, collect_counts, dm_out);
-    if (LogPeg>1)
-    {
-      cout << "ALL: " << alTotal << " from " << pow(float(l+1),float(m)) << '\n';
-      MASSERT(alTotal<=pow(double(l+1),double(m)));
-    }
-    NCenter+=setOfGoodCenters.size();NHillClimbed+=nHillClimbed;NAlignment+=nAlignment;NTotal+=alTotal;
-    perp.addFactor(log(double(align_total_count)), count, l, m,0);
-    viterbiPerp.addFactor(log(double(setOfGoodCenters[bestAlignment].second)), count, l, m,0);
-    MASSERT(log(double(setOfGoodCenters[bestAlignment].second)) <= log(double(align_total_count)));
-    if (dump_files||(FEWDUMPS&&sent.sentenceNo<1000)||(final&&(ONLYALDUMPS)))
-      printAlignToFile(es, fs, Elist.getVocabList(), Flist.getVocabList(), of2, (setOfGoodCenters[bestAlignment].first)->getAlignment(), pair_no,
-                       setOfGoodCenters[bestAlignment].second);
-    for (unsigned int i=0;i<setOfGoodCenters.size();++i)
-      setOfGoodCenters[i].first->check();
-    if (of3||(writeNBestErrorsFile&&pair_no<int(ReferenceAlignment.size())))
-    {
-      vector<Als> als;
-      for (unsigned int s=0;s<setOfGoodCenters.size();++s)
+      if (!(align_total_count>0&&align_total_count<HUGE_VAL))
       {
-        const MoveSwapMatrix<MODEL_TYPE>&msc= *setOfGoodCenters[s].first;
-        msc.check();
-        double normalized_ascore=setOfGoodCenters[s].second;
-        if (!msc.isCenterDeleted())
-          als.push_back( Als(s,0,0,normalized_ascore));
-
-        for (WordIndex j=1;j<=m;j++)
-          for (WordIndex i=0;i<=l;i++)
-            if (i!=msc(j)&& !msc.isDelMove(i,j))
-              als.push_back( Als(s,i,j,msc.cmove(i,j)*normalized_ascore));
-        for (PositionIndex j1=1;j1<=m;j1++)
-          for (PositionIndex j2=j1+1;j2<=m;j2++)
-            if (msc(j1)!=msc(j2) && !msc.isDelSwap(j1,j2))
-              als.push_back( Als(s,-j1,-j2,msc.cswap(j1,j2)*normalized_ascore));
+        if (PrintZeroScoreWarning++<100)
+          cerr << "WARNING: score of sentence pair " << pair_no << " is out of range (" << l << "x" << m
+               << "), it is skipped.\n";
+        continue;
       }
-      sort(als.begin(),als.end());
-      double sum=0,sum2=0;
-      for (unsigned int i=0;i<als.size();++i)
-        sum+=als[i].v;
-      for (unsigned int i=0;i<min((unsigned int)als.size(),(unsigned int)PrintN);++i)
+      if (deferCounts && collect_counts)
       {
-        Alignment x=*setOfGoodCenters[als[i].s].first;
-        if (!(als[i].a==0 && als[i].b==0))
+        addNeighborhoodCounts(s.counts,es,fs,count,tTable,aCountTable,dCountTable,nCountTable,p1_count,p0_count);
+        s.counts.distortion.addTo(dm_out);
+      }
+      NCenter+=s.centers();NHillClimbed+=s.nHillClimbed;NAlignment+=s.nAlignment;NTotal+=alTotal;
+      perp.addFactor(log(double(align_total_count)), count, l, m,0);
+      viterbiPerp.addFactor(log(double(bestScore)), count, l, m,0);
+      MASSERT(log(double(bestScore)) <= log(double(align_total_count)));
+      if (dump_files||(FEWDUMPS&&s.sent.sentenceNo<1000)||(final&&(ONLYALDUMPS)))
+        printAlignToFile(es, fs, Elist.getVocabList(), Flist.getVocabList(), of2, best.getAlignment(), pair_no,
+                         bestScore);
+      for (unsigned int i=0;i<setOfGoodCenters.size();++i)
+        setOfGoodCenters[i].first->check();
+      if (of3||(writeNBestErrorsFile&&pair_no<int(ReferenceAlignment.size())))
+      {
+        const MODEL_TYPE& ef=*s.ef;
+        vector<Als> als;
+        for (unsigned int s=0;s<setOfGoodCenters.size();++s)
         {
-          if (als[i].a<=0&&als[i].b<=0)
-            x.doSwap(-als[i].a,-als[i].b);
-          else
-            x.doMove(als[i].a,als[i].b);
+          const MoveSwapMatrix<MODEL_TYPE>&msc= *setOfGoodCenters[s].first;
+          msc.check();
+          double normalized_ascore=setOfGoodCenters[s].second;
+          if (!msc.isCenterDeleted())
+            als.push_back( Als(s,0,0,normalized_ascore));
+
+          for (WordIndex j=1;j<=m;j++)
+            for (WordIndex i=0;i<=l;i++)
+              if (i!=msc(j)&& !msc.isDelMove(i,j))
+                als.push_back( Als(s,i,j,msc.cmove(i,j)*normalized_ascore));
+          for (PositionIndex j1=1;j1<=m;j1++)
+            for (PositionIndex j2=j1+1;j2<=m;j2++)
+              if (msc(j1)!=msc(j2) && !msc.isDelSwap(j1,j2))
+                als.push_back( Als(s,-j1,-j2,msc.cswap(j1,j2)*normalized_ascore));
         }
-        if (of3&&i<PrintN)
-          printAlignToFile(es, fs, Elist.getVocabList(), Flist.getVocabList(),*of3,x.getAlignment(), pair_no,
-                           als[i].v/sum*count);
-        sum2+=als[i].v;
-        if (writeNBestErrorsFile)
+        sort(als.begin(),als.end());
+        double sum=0,sum2=0;
+        for (unsigned int i=0;i<als.size();++i)
+          sum+=als[i].v;
+        for (unsigned int i=0;i<min((unsigned int)als.size(),(unsigned int)PrintN);++i)
         {
-          if (pair_no<int(ReferenceAlignment.size()))
+          Alignment x=*setOfGoodCenters[als[i].s].first;
+          if (!(als[i].a==0 && als[i].b==0))
           {
-            int ALmissing=0,ALtoomuch=0,ALeventsMissing=0,ALeventsToomuch=0;
-            vector<double> scores;
-            ErrorsInAlignment(ReferenceAlignment[pair_no-1],x.getAlignment(),l,ALmissing,ALtoomuch,ALeventsMissing,ALeventsToomuch,pair_no);
-            ef.computeScores(x,scores);
-            *writeNBestErrorsFile << ALmissing+ALtoomuch << ' ';
-            for (unsigned int i=0;i<scores.size();++i)
-              *writeNBestErrorsFile << ((scores[i]>0.0)?(-log(scores[i])):1.0e6) << ' ';
-            *writeNBestErrorsFile << '\n';
+            if (als[i].a<=0&&als[i].b<=0)
+              x.doSwap(-als[i].a,-als[i].b);
+            else
+              x.doMove(als[i].a,als[i].b);
+          }
+          if (of3&&i<(unsigned int)PrintN)
+            printAlignToFile(es, fs, Elist.getVocabList(), Flist.getVocabList(),*of3,x.getAlignment(), pair_no,
+                             als[i].v/sum*count);
+          sum2+=als[i].v;
+          if (writeNBestErrorsFile)
+          {
+            if (pair_no<int(ReferenceAlignment.size()))
+            {
+              int ALmissing=0,ALtoomuch=0,ALeventsMissing=0,ALeventsToomuch=0;
+              vector<double> scores;
+              ErrorsInAlignment(ReferenceAlignment[pair_no-1],x.getAlignment(),l,ALmissing,ALtoomuch,ALeventsMissing,ALeventsToomuch,pair_no);
+              ef.computeScores(x,scores);
+              *writeNBestErrorsFile << ALmissing+ALtoomuch << ' ';
+              for (unsigned int i=0;i<scores.size();++i)
+                *writeNBestErrorsFile << ((scores[i]>0.0)?(-log(scores[i])):1.0e6) << ' ';
+              *writeNBestErrorsFile << '\n';
+            }
           }
         }
+        if (writeNBestErrorsFile)
+          *writeNBestErrorsFile << '\n';
+      }
+      addAL(best.getAlignment(),s.sent.sentenceNo,l);
+      if (g_enable_logging) {
+        util::Logging::GetLogger() << "processing this sentence pair (" << l + 1
+                                   << "x" << m << ") : " << (l+1) * m
+                                   << " prob : " << align_total_count << " "
+                                   << (setOfGoodCenters[bestAlignment].second)
+                                   << Alignment(*setOfGoodCenters[bestAlignment].first) << " \n";
+      }
+      if (g_is_verbose) {
+        cerr << "processing this sentence pair took : " << s.seconds
+             << " seconds\n";
       }
-      if (writeNBestErrorsFile)
-        *writeNBestErrorsFile << '\n';
-    }
-    addAL((setOfGoodCenters[bestAlignment].first)->getAlignment(),sent.sentenceNo,l);
-    if (g_enable_logging) {
-      util::Logging::GetLogger() << "processing this sentence pair (" << l + 1
-                                 << "x" << m << ") : " << (l+1) * m
-                                 << " prob : " << align_total_count << " "
-                                 << (setOfGoodCenters[bestAlignment].second)
-                                 << Alignment(*setOfGoodCenters[bestAlignment].first) << " \n";
-    }
-    for (unsigned int i=0;i<setOfGoodCenters.size();i++)
-      delete setOfGoodCenters[i].first;
-    double period = difftime(time(NULL), sent_s);
-    if (g_is_verbose) {
-      cerr << "processing this sentence pair took : " << period
-           << " seconds\n";
     }
-
+    for (unsigned int b=0;b<batch.size();++b)
+      delete batch[b];
   } /* of sentence pair E, F */
+  shards.finish();
   sHandler1.rewind();
   perp.record(model);
   errorReportAL(cerr,model);
@@ -679,8 +905,10 @@ void IBMModel3::viterbi_loop_with_tricks(Perplexity& perp, Perplexity& viterbiPe
   delete of3;
   delete writeNBestErrorsFile;
   double FSent=pair_no;
-  cout << "#centers(pre/hillclimbed/real): " << NAlignment/FSent << " " << NHillClimbed/FSent << " " << NCenter/FSent << "  #al: " << NTotal/FSent << " #alsophisticatedcountcollection: " <<   NumberOfAlignmentsInSophisticatedCountCollection/FSent << " #hcsteps: " << HillClimbingSteps/FSent << '\n';
+  cout << "#centers(pre/hillclimbed/real): " << NAlignment/FSent << " " << NHillClimbed/FSent << " " << NCenter/FSent << "  #al: " << NTotal/FSent << " #alsophisticatedcountcollection: " << NNeighbourhood/FSent << " #hcsteps: " << NSteps/FSent << '\n';
   cout << "#peggingImprovements: " << NBetterByPegging/FSent << '\n';
+  telemetryCount(kTelemetryHillClimbingSteps, NSteps);
+  telemetryCount(kTelemetryNeighbourhood, NNeighbourhood);
 }
 
 
@@ -700,3 +928,11 @@ INSTANTIATE(transpair_model3, void,d5model);
 INSTANTIATE(transpair_model4, d4model,d4model);
 INSTANTIATE(transpair_model4, d4model,d5model);
 INSTANTIATE(transpair_model5, d5model,d5model);
+
+template LogProb IBMModel3::align_pair<transpair_model3, void>(const Vector<WordIndex>&, const Vector<WordIndex>&, void*, Alignment&);
+template LogProb IBMModel3::align_pair<transpair_model4, d4model>(const Vector<WordIndex>&, const Vector<WordIndex>&, d4model*, Alignment&);
+template LogProb IBMModel3::align_pair<transpair_model5, d5model>(const Vector<WordIndex>&, const Vector<WordIndex>&, d5model*, Alignment&);
+
+template LogProb hillClimb_std(MoveSwapMatrix<transpair_model3>&, int, int);
+template LogProb hillClimb_std(MoveSwapMatrix<transpair_model4>&, int, int);
+template LogProb hillClimb_std(MoveSwapMatrix<transpair_model5>&, int, int);
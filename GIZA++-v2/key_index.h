@@ -0,0 +1,133 @@
+/*
+  This file is part of GIZA++.
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307,
+  USA.
+*/
+
+#ifndef GIZAPP_KEY_INDEX_H_
+#define GIZAPP_KEY_INDEX_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <iostream>
+#include "util/assert.h"
+#include "util/binary_file.h"
+#include "util/vector.h"
+
+// packed keys hash as themselves
+inline uint64_t hashOf(uint64_t k) { return k; }
+
+/*
+  Numbers keys in the order they are added and finds them through an
+  open-addressing hash, for tables stored back to back in one vector
+  (m4_tables, m5_tables, DistortionCounts). KEY needs operator== and a
+  function uint64_t hashOf(const KEY&). A key goes to the slot given by the
+  top bits of hashOf(k)*2^64/phi; as many bits are taken as the number of
+  slots has, so the slots may grow up to 2^30.
+*/
+template<class KEY>
+class KeyIndex {
+ public:
+  KeyIndex() { clear(); }
+
+  // number of key k, -1 if it has none; numbers stay valid when keys are
+  // added
+  int find(const KEY& k) const { return slots_[slotOf(k)]-1; }
+
+  // number of key k, which has none yet
+  int add(const KEY& k) {
+    MASSERT(find(k)<0);
+    keys_.push_back(k);
+    slots_[slotOf(k)]=int(keys_.size());
+    if (keys_.size()*2>slots_.size())
+      rehash(bits_+1);
+    return int(keys_.size())-1;
+  }
+
+  unsigned int size() const { return (unsigned int)keys_.size(); }
+  const KEY& key(int n) const { return keys_[n]; }
+
+  // numbers in the order of their keys (KEY needs operator<)
+  Vector<int> byKey() const {
+    Vector<int> order(keys_.size());
+    for (unsigned int n=0;n<order.size();++n)
+      order[n]=n;
+    sort(order.begin(),order.end(),KeyOrder(keys_));
+    return order;
+  }
+
+  void clear() {
+    keys_.clear();
+    rehash(kMinBits);
+  }
+
+  // bytes used by the keys and the hash
+  size_t memoryBytes() const {
+    return keys_.size()*sizeof(KEY)+slots_.size()*sizeof(int);
+  }
+
+  // the keys only; the hash is built again when they are read
+  void writeBinary(util::BinaryWriter& out) const { out.PutArray(keys_); }
+  bool readBinary(util::BinaryReader& in) {
+    if (!in.GetArray(keys_))
+      return false;
+    int bits=kMinBits;
+    while (keys_.size()*2>(size_t(1)<<bits)&&bits<kMaxBits)
+      ++bits;
+    rehash(bits);
+    // a key read twice would lose its number
+    for (unsigned int n=0;n<keys_.size();++n)
+      if (find(keys_[n])!=int(n))
+        return false;
+    return true;
+  }
+
+ private:
+  static const int kMinBits = 6;
+  static const int kMaxBits = 30;
+
+  struct KeyOrder {
+    const Vector<KEY>& keys;
+    KeyOrder(const Vector<KEY>& _keys) : keys(_keys) {}
+    bool operator()(int a, int b) const { return keys[a]<keys[b]; }
+  };
+
+  unsigned int slotOf(const KEY& k) const {
+    const unsigned int mask=(unsigned int)slots_.size()-1;
+    unsigned int s=(unsigned int)((hashOf(k)*0x9e3779b97f4a7c15ULL)>>(64-bits_));
+    while (slots_[s]&&!(keys_[slots_[s]-1]==k))
+      s=(s+1)&mask;
+    return s;
+  }
+
+  void rehash(int bits) {
+    if (bits>kMaxBits) {
+      cerr << "ERROR: more than " << (1<<(kMaxBits-1)) << " keys in one table\n";
+      exit(1);
+    }
+    bits_=bits;
+    slots_=Vector<int>(1<<bits, 0);
+    for (unsigned int n=0;n<keys_.size();++n)
+      slots_[slotOf(keys_[n])]=int(n+1);
+  }
+
+  Vector<KEY> keys_;   // key of each number
+  Vector<int> slots_;  // number+1 at the hash position, 0 if free
+  int bits_;           // slots_ has 2^bits_ entries
+};
+
+#endif  // GIZAPP_KEY_INDEX_H_
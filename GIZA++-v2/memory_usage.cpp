@@ -0,0 +1,76 @@
+/*
+  This file is part of GIZA++.
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307,
+  USA.
+*/
+
+#include "memory_usage.h"
+
+#include <cstring>
+#include <iomanip>
+#include "globals.h"
+#include "parameter.h"
+#include "telemetry.h"
+
+GLOBAL_PARAMETER(int,MemoryBudget,"memoryBudget",
+                 "memory budget of the tables and the corpus in MB (0: none); over it, the tables are compacted, the corpus is read from disk in every iteration and the t table is pruned",kParLevOptheur,0);
+
+void MemoryUsage::add(const char* name, size_t bytes) {
+  tables_.push_back(std::make_pair(name, bytes));
+}
+
+void MemoryUsage::set(const char* name, size_t bytes) {
+  for (size_t i = 0; i < tables_.size(); ++i)
+    if (strcmp(tables_[i].first, name) == 0) {
+      tables_[i].second = bytes;
+      return;
+    }
+  add(name, bytes);
+}
+
+size_t MemoryUsage::total() const {
+  size_t bytes = 0;
+  for (size_t i = 0; i < tables_.size(); ++i)
+    bytes += tables_[i].second;
+  return bytes;
+}
+
+bool MemoryUsage::overBudget() const {
+  return memoryBudgetBytes() && total() > memoryBudgetBytes();
+}
+
+void MemoryUsage::print(std::ostream& out, const std::string& stage) const {
+  const std::ios::fmtflags flags = out.flags();
+  const std::streamsize precision = out.precision();
+  out << "Memory after " << stage << ':' << std::fixed << std::setprecision(1);
+  for (size_t i = 0; i < tables_.size(); ++i)
+    out << ' ' << tables_[i].first << ' ' << tables_[i].second / 1048576.0 << " MB,";
+  out << " total " << total() / 1048576.0 << " MB";
+  if (memoryBudgetBytes())
+    out << " of a budget of " << MemoryBudget << " MB";
+  out << '\n';
+  out.flags(flags);
+  out.precision(precision);
+}
+
+void MemoryUsage::record(IterationTelemetry& telemetry) const {
+  for (size_t i = 0; i < tables_.size(); ++i)
+    telemetry.table(tables_[i].first, tables_[i].second);
+}
+
+size_t memoryBudgetBytes() {
+  return MemoryBudget > 0 ? size_t(MemoryBudget) * 1048576 : 0;
+}
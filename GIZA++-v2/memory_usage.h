@@ -0,0 +1,61 @@
+/*
+  This file is part of GIZA++.
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307,
+  USA.
+*/
+
+#ifndef GIZAPP_MEMORY_USAGE_H_
+#define GIZAPP_MEMORY_USAGE_H_
+
+#include <cstddef>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+class IterationTelemetry;
+
+/*
+  The live bytes of the tables and of the corpus buffers, by name ("t",
+  "a", "d4", "corpus", ...). The models fill it after every iteration
+  (see IBMModel1::memoryUsage); it goes to the telemetry, is checked
+  against -memoryBudget and is printed at the end of every stage.
+*/
+class MemoryUsage {
+ public:
+  void add(const char* name, size_t bytes);
+
+  // replaces the bytes of 'name', e.g. after the table was pruned
+  void set(const char* name, size_t bytes);
+
+  size_t total() const;
+
+  // true with -memoryBudget if total() is over the budget
+  bool overBudget() const;
+
+  // one line, e.g. "Memory after Model1: t 12.5 MB, corpus 3.1 MB, total 15.6 MB"
+  void print(std::ostream& out, const std::string& stage) const;
+
+  void record(IterationTelemetry& telemetry) const;
+
+ private:
+  std::vector<std::pair<const char*, size_t> > tables_;
+};
+
+// -memoryBudget in bytes, 0 without a budget
+size_t memoryBudgetBytes();
+
+#endif  // GIZAPP_MEMORY_USAGE_H_
@@ -26,7 +26,7 @@ template<class TRANSPAIR>
 MoveSwapMatrix<TRANSPAIR>::MoveSwapMatrix(const TRANSPAIR&_ef, const Alignment&_a)
     : Alignment(_a), ef(_ef), l(ef.get_l()), m(ef.get_m()), _cmove(l+1, m+1), _cswap(m+1, m+1),
       delmove(l+1, m+1,0),delswap(m+1, m+1,0),changed(l+2, 0), changedCounter(1),
-      modelnr(_ef.modelnr()),lazyEvaluation(0),centerDeleted(0)
+      modelnr(_ef.modelnr()),lazyEvaluation(0),centerDeleted(0),tree(0)
 {
   double thisValue=ef.scoreOfAlignmentForChange((*this));
   if (lazyEvaluation==0)
@@ -36,36 +36,72 @@ MoveSwapMatrix<TRANSPAIR>::MoveSwapMatrix(const TRANSPAIR&_ef, const Alignment&_
 template <class TRANSPAIR>
 MoveSwapMatrix<TRANSPAIR>::~MoveSwapMatrix() {}
 
+template<class T>
+static void copyArray2(Array2<T,Vector<T> >&to, const Array2<T,Vector<T> >&from)
+{
+  for (unsigned int i=0;i<from.getLen1();i++)
+    for (unsigned int j=0;j<from.getLen2();j++)
+      to(i, j)=from(i, j);
+}
+
+template<class TRANSPAIR>
+void MoveSwapMatrix<TRANSPAIR>::assign(const MoveSwapMatrix&x)
+{
+  MASSERT(&ef==&x.ef&&tree==0);
+  Alignment::assign(x);
+  copyArray2(_cmove, x._cmove);
+  copyArray2(_cswap, x._cswap);
+  copyArray2(delmove, x.delmove);
+  copyArray2(delswap, x.delswap);
+  for (unsigned int i=0;i<l+2;i++)
+    changed[i]=x.changed[i];
+  changedCounter=x.changedCounter;
+  lazyEvaluation=x.lazyEvaluation;
+  centerDeleted=x.centerDeleted;
+}
+
 template<class TRANSPAIR>
 void MoveSwapMatrix<TRANSPAIR>::updateJ(WordIndex j, bool useChanged,double thisValue)
 {
   MASSERT(lazyEvaluation==0);
   for (WordIndex i=0;i<=l;i++)
     if ((useChanged==0||changed[i]!=changedCounter))
+    {
       if (get_al(j)!=i)
         _cmove(i, j)=ef.scoreOfMove((*this), i, j,thisValue);
       else
         _cmove(i, j)=1.0;
+      touchMove(i, j);
+    }
   for (WordIndex j2=j+1;j2<=m;j2++)
+  {
     if (get_al(j)!=get_al(j2))
       _cswap(j, j2)=ef.scoreOfSwap((*this), j, j2,thisValue);
     else
       _cswap(j, j2)=1.0;
+    touchSwap(j, j2);
+  }
   for (WordIndex j2=1;j2<j;j2++)
+  {
     if (get_al(j)!=get_al(j2))
       _cswap(j2, j)=ef.scoreOfSwap((*this), j2, j,thisValue);
     else
       _cswap(j2, j)=1.0;
+    touchSwap(j2, j);
+  }
 }
 template<class TRANSPAIR>
 void MoveSwapMatrix<TRANSPAIR>::updateI(WordIndex i,double thisValue)
 {
   MASSERT( lazyEvaluation==0);
   for (WordIndex j=1;j<=m;j++)
+  {
     if (get_al(j)!=i)
       _cmove(i, j)=ef.scoreOfMove((*this), i, j,thisValue);
     else
       _cmove(i, j)=1.0;
+    touchMove(i, j);
+  }
 }
 
 template<class TRANSPAIR>
@@ -224,6 +260,77 @@ void MoveSwapMatrix<TRANSPAIR>::doSwap(WordIndex _j1, WordIndex _j2)
   }
 }
 
+template<class TRANSPAIR>
+MoveSwapTree<TRANSPAIR>::MoveSwapTree(MoveSwapMatrix<TRANSPAIR>&_msc, int _j_peg)
+    : msc(_msc), l(_msc.l), m(_msc.m), j_peg(_j_peg), winner(_msc.m,-1), winnerGain(_msc.m,0.0)
+{
+  MASSERT(msc.lazyEvaluation==0&&msc.tree==0);
+  msc.tree=this;
+}
+
+template<class TRANSPAIR>
+LogProb MoveSwapTree<TRANSPAIR>::gain(WordIndex j, WordIndex k) const
+{
+  if (int(j)==j_peg)
+    return 0.0;
+  const WordIndex aj=msc(j);
+  if (k<m)
+  {
+    const WordIndex j1=k+1;
+    if (j1<=j||int(j1)==j_peg||aj==msc(j1))
+      return 0.0;
+    return msc._cswap(j, j1);
+  }
+  const WordIndex i=k-m;
+  if (i != aj &&(i != 0 || (m >= 2 * (msc.fert(0)+1))) && msc.fert(i)+1<g_max_fertility)
+    return msc._cmove(i, j);
+  return 0.0;
+}
+
+template<class TRANSPAIR>
+void MoveSwapTree<TRANSPAIR>::rescan(WordIndex j)
+{
+  int w=0;
+  LogProb best=gain(j,0);
+  for (WordIndex k=j;k<m+l+1;++k)
+  {
+    const LogProb g=gain(j,k);
+    if (g>best)
+    {
+      best=g;
+      w=k;
+    }
+  }
+  winner[j-1]=w;
+  winnerGain[j-1]=best;
+}
+
+template<class TRANSPAIR>
+LogProb MoveSwapTree<TRANSPAIR>::best(int&type, WordIndex&v1, WordIndex&v2)
+{
+  WordIndex j_best=1;
+  for (WordIndex j=1;j<=m;j++)
+  {
+    if (winner[j-1]<0)
+      rescan(j);
+    if (winnerGain[j-1]>winnerGain[j_best-1])
+      j_best=j;
+  }
+  const WordIndex k=winner[j_best-1];
+  v1=j_best;
+  if (k<m)
+  {
+    type=1;
+    v2=k+1;
+  }
+  else
+  {
+    type=2;
+    v2=k-m;
+  }
+  return winnerGain[j_best-1];
+}
+
 #include "transpair_model3.h"
 #include "transpair_model4.h"
 #include "transpair_model5.h"
@@ -233,3 +340,8 @@ template class MoveSwapMatrix<transpair_model3>;
 template class MoveSwapMatrix<transpair_model4>;
 template class MoveSwapMatrix<transpair_model5>;
 template class MoveSwapMatrix<TransPairModelHMM>;
+
+template class MoveSwapTree<transpair_model3>;
+template class MoveSwapTree<transpair_model4>;
+template class MoveSwapTree<transpair_model5>;
+template class MoveSwapTree<TransPairModelHMM>;
@@ -33,6 +33,8 @@
 
 extern short DoViterbiTraining;
 
+template<class TRANSPAIR> class MoveSwapTree;
+
 template<class TRANSPAIR>
 class MoveSwapMatrix : public Alignment {
  private:
@@ -45,11 +47,20 @@ class MoveSwapMatrix : public Alignment {
   const int modelnr;
   bool lazyEvaluation;
   bool centerDeleted;
+  // attached while hill climbing; told about every entry updateJ/updateI set
+  MoveSwapTree<TRANSPAIR>*tree;
+  friend class MoveSwapTree<TRANSPAIR>;
+
+  void touchMove(WordIndex i, WordIndex j) { if (tree) tree->update(j,m+i); }
+  void touchSwap(WordIndex j1, WordIndex j2) { if (tree) tree->update(j1,j2-1); }
 
  public:
   MoveSwapMatrix(const TRANSPAIR&_ef, const Alignment&_a);
   ~MoveSwapMatrix();
 
+  // copies x (of the same sentence pair) into this matrix's storage
+  void assign(const MoveSwapMatrix&x);
+
   bool check() const { return 1; }
 
   const TRANSPAIR& get_ef() const { return ef; }
@@ -110,4 +121,53 @@ class MoveSwapMatrix : public Alignment {
   }
 };
 
+/*
+  MoveSwapTree: two-level tournament tree over the move and swap gains of a
+  MoveSwapMatrix, so that hill climbing finds the best change without
+  sweeping all l*m moves and m*m/2 swaps after every step. Each position j
+  keeps the winner of its leaves (the swaps (j,j1>j), then the moves (i,j),
+  in the order of that sweep); only the entries updateJ/updateI recompute
+  are replayed, and a position is rescanned only when its winner got worse.
+  Ties go to the lower leaf, so the change selected is the one the sweep
+  selected.
+*/
+template<class TRANSPAIR>
+class MoveSwapTree {
+ private:
+  MoveSwapMatrix<TRANSPAIR>&msc;
+  const WordIndex l, m;
+  const int j_peg;
+  Vector<int> winner;  // best leaf k of each position, -1 if to be rescanned
+  Vector<LogProb> winnerGain;
+
+  LogProb gain(WordIndex j, WordIndex k) const;
+  void rescan(WordIndex j);
+
+ public:
+  // leaves of position j: swap slots k<m for (j,k+1), then moves k=m+i
+  MoveSwapTree(MoveSwapMatrix<TRANSPAIR>&_msc, int _j_peg);
+  ~MoveSwapTree() { msc.tree = 0; }
+
+  // leaf k of position j has been recomputed
+  void update(WordIndex j, WordIndex k) {
+    int&w=winner[j-1];
+    if (w<0)
+      return;
+    const LogProb g=gain(j,k);
+    if (int(k)==w) {
+      if (g<winnerGain[j-1])
+        w=-1;
+      else
+        winnerGain[j-1]=g;
+    } else if (g>winnerGain[j-1] || (g==winnerGain[j-1] && int(k)<w)) {
+      w=k;
+      winnerGain[j-1]=g;
+    }
+  }
+
+  // best admissible change, as hillClimb_std names it: type 1 swaps j=v1 and
+  // j1=v2, type 2 aligns j=v1 to i=v2. Returns its gain, 0 if there is none.
+  LogProb best(int&type, WordIndex&v1, WordIndex&v2);
+};
+
 #endif  // GIZAPP_MOVE_SWAP_MATRIX_H_
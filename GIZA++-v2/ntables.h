@@ -27,6 +27,7 @@
 #include "defs.h"
 #include "util/assert.h"
 #include "util/array2.h"
+#include "util/binary_file.h"
 #include "util/vector.h"
 #include "vocab.h"
 #include "globals.h"
@@ -51,6 +52,11 @@ class nmodel
       return max(ntab(w, n), VALTYPE(g_smooth_prob));
   }
 
+  // bytes allocated by the table
+  size_t memoryBytes() const {
+    return size_t(ntab.getLen1())*ntab.getLen2()*sizeof(VALTYPE);
+  }
+
   VALTYPE&getRef(int w, int n)
   {
     //massert(w!=0);
@@ -149,6 +155,22 @@ class nmodel
   // NAS, 7/11/99
   void readNTable(const char *filename);
 
+  // the table in the binary format of the training checkpoints
+  void writeBinary(util::BinaryWriter&out) const {
+    out.Put(ntab.getLen1());
+    out.Put(ntab.getLen2());
+    out.PutRange(&ntab(0,0),ntab.getLen1()*ntab.getLen2());
+  }
+
+  bool readBinary(util::BinaryReader&in) {
+    unsigned int h1=0,h2=0;
+    in.Get(h1);
+    in.Get(h2);
+    if (h1!=ntab.getLen1()||h2!=ntab.getLen2())
+      return false;
+    return in.GetRangeInto(&ntab(0,0),h1*h2);
+  }
+
 };
 
 #endif  // GIZAPP_NTABLES_H_
@@ -25,6 +25,9 @@ using namespace _STL;
 #elsif __GNUC__==3
 #include <ext/hash_map>
 using __gnu_cxx::hash_map;
+#elif __cplusplus >= 201103L
+#include <unordered_map>
+#define hash_map unordered_map
 #else
 #include <tr1/unordered_map>
 #define hash_map unordered_map
@@ -31,13 +31,15 @@
 
 #include "sentence_handler.h"
 
+#include <atomic>
 #include <cmath>
 #include <iostream>
 #include <sstream>
 #include "parameter.h"
 #include "errno.h"
+#include "telemetry.h"
 
-int PrintedTooLong=0;
+std::atomic<int> PrintedTooLong(0);
 
 /* -------------- Method Defnitions for Class SentenceHandler ---------------*/
 
@@ -46,13 +48,14 @@ GLOBAL_PARAMETER(double,Manlexfactor1,"manlexfactor1","",kParLevEM,0.0);
 GLOBAL_PARAMETER(double,Manlexfactor2,"manlexfactor2","",kParLevEM,0.0);
 
 SentenceHandler::SentenceHandler(const char*  filename, VocabList* elist,
-                                 VocabList*  flist) : realCount(0)
+                                 VocabList*  flist) : realCount(0), sharedPairs(0), reversed(false)
                                                       // This method is the constructor of the class, it also intitializes the
                                                       // sentence pair sequential number (count) to zero.
 
 {
   readflag = false;
   allInMemory = false;
+  streaming = false;
   inputFilename = filename;
   inputFile = new ifstream(filename);
   pair_no = 0;
@@ -90,14 +93,32 @@ SentenceHandler::SentenceHandler(const char*  filename, VocabList* elist,
     realCount=0;
 }
 
+SentenceHandler::SentenceHandler(const Vector<SentencePair>& pairs, VocabList* elist,
+                                 VocabList* flist, bool _reversed)
+    : inputFilename(0), inputFile(0), noSentInBuffer(int(pairs.size())), currentSentence(0),
+      totalPairs1(0), totalPairs2(0), readflag(false), allInMemory(true),
+      streaming(false), pair_no(0), realCount(0), sharedPairs(&pairs), reversed(_reversed)
+{
+  SentencePair s;
+  for (unsigned int n = 0; n < pairs.size(); ++n) {
+    s = pairs[n];
+    if (reversed)
+      swap(s.eSent, s.fSent);
+    shorten(s, true);
+    countWords(s, elist, flist);
+    totalPairs1++;
+    totalPairs2 += s.realCount;
+  }
+}
+
 SentenceHandler::~SentenceHandler() {}
 
 void SentenceHandler::rewind()
 {
   currentSentence = 0;
   readflag = false;
-  if (!allInMemory ||
-      !(Buffer.size() >= 1 && Buffer[currentSentence].sentenceNo == 1)) {
+  if (!sharedPairs && (!allInMemory ||
+                       !(Buffer.size() >= 1 && Buffer[currentSentence].sentenceNo == 1))) {
     // check if the buffer doe not already has the first chunk of pairs
     if (Buffer.size() > 0)
       cerr << ' ' <<  Buffer[currentSentence].sentenceNo << '\n';
@@ -107,6 +128,7 @@ void SentenceHandler::rewind()
     Buffer.clear();
   }
   if (!allInMemory) {
+    TelemetryPhaseTimer io(kTelemetryCorpusIO);
     delete inputFile;
     inputFile = new ifstream(inputFilename);
     if (!(*inputFile)) {
@@ -116,6 +138,83 @@ void SentenceHandler::rewind()
 }
 
 
+size_t SentenceHandler::memoryBytes() const
+{
+  size_t bytes = (Buffer.size() + oldPairs.size()) * sizeof(SentencePair) +
+      oldProbs.size() * sizeof(double);
+  for (unsigned int i = 0; i < Buffer.size(); ++i)
+    bytes += (Buffer[i].eSent.size() + Buffer[i].fSent.size()) * sizeof(WordIndex);
+  for (unsigned int i = 0; i < oldPairs.size(); ++i)
+    bytes += (oldPairs[i].eSent.size() + oldPairs[i].fSent.size()) * sizeof(WordIndex);
+  if (sharedPairs) {
+    bytes += sharedPairs->size() * sizeof(SentencePair);
+    for (unsigned int i = 0; i < sharedPairs->size(); ++i)
+      bytes += ((*sharedPairs)[i].eSent.size() + (*sharedPairs)[i].fSent.size()) * sizeof(WordIndex);
+  }
+  if (realCount)
+    bytes += realCount->size() * sizeof(double);
+  return bytes;
+}
+
+bool SentenceHandler::stream()
+{
+  if (!inputFilename)
+    return false;
+  streaming = true;
+  allInMemory = false;
+  Vector<SentencePair>().swap(Buffer);
+  noSentInBuffer = 0;
+  rewind();
+  return true;
+}
+
+void SentenceHandler::shorten(SentencePair& s, bool warn)
+{
+  if ((s.fSent.size()-1) > (g_max_fertility-1) * (s.eSent.size()-1)) {
+    if (warn) {
+      cerr << "WARNING: The following sentence pair has source/target sentence length ration more than\n"<<
+          "the maximum allowed limit for a source word fertility\n"<<
+          " source length = " << s.eSent.size()-1 << " target length = " << s.fSent.size()-1 <<
+          " ratio " << double(s.fSent.size()-1)/  (s.eSent.size()-1) << " ferility limit : " <<
+          g_max_fertility-1 << '\n';
+      cerr << "Shortening sentence \n";
+      cerr << s;
+    }
+    s.eSent.resize(min(s.eSent.size(),s.fSent.size()));
+    s.fSent.resize(min(s.eSent.size(),s.fSent.size()));
+  }
+}
+
+void SentenceHandler::countWords(const SentencePair& s, VocabList* elist, VocabList* flist)
+{
+  if (elist && flist) {
+    if ((*elist).size() > 0)
+      for (WordIndex i= 0; i < s.eSent.size(); i++) {
+        if (s.eSent[i] >= (*elist).uniqTokens()) {
+          if (PrintedTooLong++<100)
+            cerr << "ERROR: source word " << s.eSent[i] << " is not in the vocabulary list \n";
+          exit(-1);
+        }
+        (*elist).incFreq(s.eSent[i], s.realCount);
+      }
+    if ((*flist).size() > 0)
+      for (WordIndex j= 1; j < s.fSent.size(); j++) {
+        if (s.fSent[j] >= (*flist).uniqTokens()) {
+          cerr << "ERROR: target word " << s.fSent[j] << " is not in the vocabulary list \n";
+          exit(-1);
+        }
+        (*flist).incFreq(s.fSent[j], s.realCount);
+      }
+  }
+}
+
+void SentenceHandler::addToBuffer(SentencePair& s, VocabList* elist, VocabList* flist)
+{
+  shorten(s, true);
+  Buffer.push_back(s);
+  countWords(s, elist, flist);
+}
+
 bool SentenceHandler::getNextSentence(SentencePair& sent, VocabList* elist, VocabList* flist)
 {
   SentencePair s;
@@ -128,45 +227,16 @@ bool SentenceHandler::getNextSentence(SentencePair& sent, VocabList* elist, Voca
     if (allInMemory)
       return(false);
     /* no more sentences in buffer */
+    TelemetryPhaseTimer io(kTelemetryCorpusIO);
     noSentInBuffer = 0;
     currentSentence = 0;
     Buffer.clear();
     cout << "Reading more sentence pairs into memory ... \n";
     while ((noSentInBuffer < kTrainBufSize) && readNextSentence(s)) {
-      if ((s.fSent.size()-1) > (g_max_fertility-1) * (s.eSent.size()-1)) {
-        cerr << "WARNING: The following sentence pair has source/target sentence length ration more than\n"<<
-            "the maximum allowed limit for a source word fertility\n"<<
-            " source length = " << s.eSent.size()-1 << " target length = " << s.fSent.size()-1 <<
-            " ratio " << double(s.fSent.size()-1)/  (s.eSent.size()-1) << " ferility limit : " <<
-            g_max_fertility-1 << '\n';
-        cerr << "Shortening sentence \n";
-        cerr << s;
-        s.eSent.resize(min(s.eSent.size(),s.fSent.size()));
-        s.fSent.resize(min(s.eSent.size(),s.fSent.size()));
-      }
-      Buffer.push_back(s);
-      if (elist && flist) {
-        if ((*elist).size() > 0)
-          for (WordIndex i= 0; i < s.eSent.size(); i++) {
-            if (s.eSent[i] >= (*elist).uniqTokens()) {
-              if (PrintedTooLong++<100)
-                cerr << "ERROR: source word " << s.eSent[i] << " is not in the vocabulary list \n";
-              exit(-1);
-            }
-            (*elist).incFreq(s.eSent[i], s.realCount);
-          }
-        if ((*flist).size() > 0)
-          for (WordIndex j= 1; j < s.fSent.size(); j++) {
-            if (s.fSent[j] >= (*flist).uniqTokens()) {
-              cerr << "ERROR: target word " << s.fSent[j] << " is not in the vocabulary list \n";
-              exit(-1);
-            }
-            (*flist).incFreq(s.fSent[j], s.realCount);
-          }
-      }
+      addToBuffer(s, elist, flist);
       noSentInBuffer++;
     }
-    if (inputFile->eof()) {
+    if (inputFile->eof() && !streaming) {
       allInMemory = (Buffer.size() >= 1 &&
                      Buffer[currentSentence].sentenceNo == 1);
       if (allInMemory)
@@ -179,7 +249,16 @@ bool SentenceHandler::getNextSentence(SentencePair& sent, VocabList* elist, Voca
     readflag = true;
     return(false);
   }
-  sent = Buffer[currentSentence++];
+  if (sharedPairs) {
+    sent = (*sharedPairs)[currentSentence++];
+    if (reversed)
+      swap(sent.eSent, sent.fSent);
+    shorten(sent, false);
+  } else {
+    sent = Buffer[currentSentence++];
+  }
+  telemetryCount(kTelemetryPairs, 1);
+  telemetryCount(kTelemetryTokens, sent.eSent.size() + sent.fSent.size() - 2);
   if (sent.noOcc<0 && realCount)
   {
     if (Manlexfactor1 && sent.noOcc==-1.0)
@@ -334,4 +413,33 @@ void SentenceHandler::setProbOfSentence(const SentencePair&s,double d)
   }
 }
 
+void SentenceHandler::writeBinary(util::BinaryWriter& out) const
+{
+  out.Put<char>(realCount!=0);
+  if (realCount)
+    out.PutArray(*realCount);
+}
+
+bool SentenceHandler::readBinary(util::BinaryReader& in)
+{
+  char weighted=0;
+  in.Get(weighted);
+  if ((weighted!=0)!=(realCount!=0))
+    return false;
+  if (realCount&&(!in.GetArray(*realCount)||realCount->size()!=size_t(totalPairs1)))
+    return false;
+  return in.IsOK();
+}
+
+bool SentenceHandler::skipBinary(util::BinaryReader& in)
+{
+  char weighted=0;
+  in.Get(weighted);
+  if (weighted) {
+    size_t n;
+    in.GetRange<double>(n);
+  }
+  return in.IsOK();
+}
+
 /* ------------- End of Method Definition of Class SentenceHandler ----------*/
@@ -40,6 +40,7 @@
 #include "defs.h"
 #include "vocab.h"
 #include "globals.h"
+#include "util/binary_file.h"
 
 /*----------------------- Class Prototype Definition ------------------------*
   Class Name: sentenceHandleer
@@ -106,12 +107,20 @@ class SentenceHandler {
   double totalPairs2;
   bool readflag; // true if you reach the end of file
   bool allInMemory;
+  bool streaming;  // never keeps the whole corpus in memory, see stream()
   int pair_no;
   Vector<double> *realCount;
   Vector<SentencePair> oldPairs;
   Vector<double> oldProbs;
 
   SentenceHandler(const char* filename, VocabList* elist = 0, VocabList* flist = 0);
+  // the sentence pairs 'pairs' (numbered from 1, with positive counts)
+  // in memory, without a file; they are not copied and have to outlive
+  // the handler. With 'reversed' the source and target sentences are
+  // swapped, so that the trainings of both directions read the same pairs.
+  // The word frequencies are added to elist and flist.
+  SentenceHandler(const Vector<SentencePair>& pairs, VocabList* elist, VocabList* flist,
+                  bool reversed = false);
   ~SentenceHandler();
 
   void rewind();
@@ -121,6 +130,30 @@ class SentenceHandler {
   // method will read the next pair of sentence from memory buffer
   bool readNextSentence(SentencePair&);  // will be defined in the definition file, this
   void setProbOfSentence(const SentencePair&s,double d);
+
+  // bytes of the sentence pairs in memory
+  size_t memoryBytes() const;
+  // drops the sentence pairs in memory and rewinds; from now on the
+  // corpus is read from the file in chunks of kTrainBufSize pairs. False
+  // for a corpus without a file.
+  bool stream();
+
+  // the weights of the dictionary entries in the binary format of the
+  // training checkpoints
+  void writeBinary(util::BinaryWriter& out) const;
+  bool readBinary(util::BinaryReader& in);
+  // passes over the weights of another corpus
+  static bool skipBinary(util::BinaryReader& in);
+
+ private:
+  // adds a pair read from the corpus to the buffer
+  void addToBuffer(SentencePair& s, VocabList* elist, VocabList* flist);
+  // shortens a pair over the fertility limit
+  static void shorten(SentencePair& s, bool warn);
+  static void countWords(const SentencePair& s, VocabList* elist, VocabList* flist);
+
+  const Vector<SentencePair>* sharedPairs;  // the pairs in memory, or 0
+  bool reversed;
 };
 
 #endif  // GIZAPP_SENTENCE_HANDLER_H_
@@ -0,0 +1,142 @@
+/*
+  This file is part of GIZA++.
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307,
+  USA.
+*/
+
+#include "sentence_scheduler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include "parameter.h"
+#include "telemetry.h"
+#include "thread_pool.h"
+
+GLOBAL_PARAMETER(int,Threads,"threads","number of threads aligning sentence pairs in the E-steps of all models "
+                 "(1: sequential; -log forces 1)",kParLevSpecial,1);
+
+namespace {
+
+// a window holds up to kWindowPairs pairs per thread, fewer if they reach
+// kWindowCost per thread, which keeps the results of a window small
+const unsigned int kWindowPairs = 64;
+const double kWindowCost = 1 << 20;
+// the share of a thread in a window is cut into about kChunksPerThread chunks
+const int kChunksPerThread = 8;
+
+bool moreExpensive(const std::pair<double, unsigned int>& a, const std::pair<double, unsigned int>& b) {
+  return a.first > b.first;
+}
+
+} // namespace
+
+double SentenceScheduler::cost(Model model, unsigned int l, unsigned int m) {
+  const double I = l + 1.0, J = m;
+  switch (model) {
+    case kModel1:
+      // the t table entries of the pair
+      return I * J;
+    case kHMM:
+      // forward-backward over 2l states
+      return 4.0 * l * l * J + I * J;
+    case kModel345:
+    default:
+      // hill climbing: neighbourhoods of l*m moves and m*m/2 swaps, about
+      // m steps
+      return J * (I * J + J * J / 2) + I * J;
+  }
+}
+
+SentenceScheduler::SentenceScheduler(Model model, int nThreads)
+    : model_(model), nThreads_(std::max(1, nThreads)), windowCost_(0.0), queues_(nThreads_) {}
+
+bool SentenceScheduler::full() const {
+  if (nThreads_ == 1)
+    return costs_.size() >= 1;
+  return costs_.size() >= kWindowPairs * nThreads_ || windowCost_ >= kWindowCost * nThreads_;
+}
+
+void SentenceScheduler::add(unsigned int l, unsigned int m) {
+  costs_.push_back(cost(model_, l, m));
+  windowCost_ += costs_.back();
+}
+
+void SentenceScheduler::run(const std::function<void(unsigned int)>& compute) {
+  if (nThreads_ == 1 || costs_.size() < 2) {
+    for (unsigned int k = 0; k < costs_.size(); ++k)
+      compute(k);
+  } else {
+    // consecutive pairs up to the cost of a chunk; a long pair is a chunk
+    // of its own
+    const double chunkCost = windowCost_ / (kChunksPerThread * nThreads_);
+    std::vector<Chunk> chunks;
+    Chunk chunk = { 0, 0, 0.0 };
+    for (unsigned int k = 0; k < costs_.size(); ++k) {
+      chunk.cost += costs_[k];
+      chunk.end = k + 1;
+      if (chunk.cost >= chunkCost || chunk.end == costs_.size()) {
+        chunks.push_back(chunk);
+        chunk.begin = chunk.end;
+        chunk.cost = 0.0;
+      }
+    }
+    std::vector<std::pair<double, unsigned int> > order;
+    for (unsigned int c = 0; c < chunks.size(); ++c)
+      order.push_back(std::make_pair(chunks[c].cost, c));
+    std::stable_sort(order.begin(), order.end(), moreExpensive);
+    for (int t = 0; t < nThreads_; ++t)
+      queues_[t].chunks.clear();
+    for (unsigned int c = 0; c < order.size(); ++c)
+      queues_[c % nThreads_].chunks.push_back(chunks[order[c].second]);
+
+    std::atomic<int> next(0);
+    const std::thread::id caller = std::this_thread::get_id();
+    sharedThreadPool().run(std::min(nThreads_, int(chunks.size())), [&]() {
+        const int thread = next++;
+        Chunk chunk;
+        while (take(thread, chunk))
+          for (unsigned int k = chunk.begin; k < chunk.end; ++k)
+            compute(k);
+        if (std::this_thread::get_id() != caller)
+          telemetryFlushThread();
+      });
+  }
+  costs_.clear();
+  windowCost_ = 0.0;
+}
+
+bool SentenceScheduler::take(int thread, Chunk& chunk) {
+  {
+    Queue& own = queues_[thread];
+    std::lock_guard<std::mutex> lock(own.mutex);
+    if (!own.chunks.empty()) {
+      chunk = own.chunks.front();
+      own.chunks.pop_front();
+      return true;
+    }
+  }
+  for (int t = 1; t < nThreads_; ++t) {
+    Queue& other = queues_[(thread + t) % nThreads_];
+    std::lock_guard<std::mutex> lock(other.mutex);
+    if (!other.chunks.empty()) {
+      chunk = other.chunks.back();
+      other.chunks.pop_back();
+      return true;
+    }
+  }
+  return false;
+}
@@ -0,0 +1,97 @@
+/*
+  This file is part of GIZA++.
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307,
+  USA.
+*/
+
+#ifndef GIZAPP_SENTENCE_SCHEDULER_H_
+#define GIZAPP_SENTENCE_SCHEDULER_H_
+
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+// the threads of the E-steps (-threads)
+extern int Threads;
+
+/*
+  Aligns the sentence pairs of an E-step on the threads of
+  sharedThreadPool(). The time a pair takes grows with its length, by
+  l*m in Model 1 and 2, l*l*m in the HMM and about the cube of the length in
+  Model 3/4/5, so a few long pairs can keep one thread busy while the
+  others wait. The loop of an E-step reads a window of pairs and adds
+  their lengths; run() cuts the window into chunks of consecutive pairs
+  of about the same estimated cost and deals them to the threads, the
+  most expensive first. A thread whose chunks are done takes the
+  cheapest chunk left of another thread. The tables are only read while
+  run() works; the loop then adds the results of the window in corpus
+  order, so the counts do not depend on the number of threads.
+
+    SentenceScheduler scheduler(SentenceScheduler::kHMM, nThreads);
+    while (pairs are left) {
+      while (!scheduler.full()) { read pair k; scheduler.add(l, m); }
+      scheduler.run(compute the result of pair k);
+      add the results of the pairs 0, 1, ... to the tables
+    }
+
+  With one thread a window is one pair, computed on the calling thread.
+*/
+class SentenceScheduler {
+ public:
+  // kModel1 is Model 1 and 2
+  enum Model { kModel1, kHMM, kModel345 };
+
+  // the estimated time of a pair of l source and m target words
+  static double cost(Model model, unsigned int l, unsigned int m);
+
+  SentenceScheduler(Model model, int nThreads);
+
+  int threads() const { return nThreads_; }
+  // the pairs added since the last run()
+  unsigned int size() const { return (unsigned int)costs_.size(); }
+  bool full() const;
+
+  void add(unsigned int l, unsigned int m);
+  // compute(k) for the pairs k of the window, on any thread; returns when
+  // they are all done and starts the next window
+  void run(const std::function<void(unsigned int)>& compute);
+
+ private:
+  struct Chunk {
+    unsigned int begin, end;  // pairs
+    double cost;
+  };
+  // the chunks of a thread, the most expensive first
+  struct Queue {
+    std::mutex mutex;
+    std::deque<Chunk> chunks;
+  };
+
+  SentenceScheduler(const SentenceScheduler&);
+  SentenceScheduler& operator=(const SentenceScheduler&);
+
+  // the next chunk of a thread: its own or one of another thread
+  bool take(int thread, Chunk& chunk);
+
+  Model model_;
+  int nThreads_;
+  std::vector<double> costs_;
+  double windowCost_;
+  std::vector<Queue> queues_;
+};
+
+#endif  // GIZAPP_SENTENCE_SCHEDULER_H_
@@ -0,0 +1,165 @@
+/*
+  This file is part of GIZA++.
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307,
+  USA.
+*/
+
+#include "telemetry.h"
+
+#include <sys/resource.h>
+#include <atomic>
+#include <chrono>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include "globals.h"
+#include "parameter.h"
+
+GLOBAL_PARAMETER(bool,Telemetry,"telemetry",
+                 "1: append one JSON line with timings and counters per training iteration to prefix.telemetry",kParLevOutput,0);
+
+extern bool ResumeTraining;
+
+thread_local unsigned long long g_ttable_lookups = 0;
+
+namespace {
+
+const char* const kPhaseNames[kTelemetryPhases + 1] = {
+  "corpus_io", "e_step", "normalize", "dump", "other"
+};
+
+struct Times {
+  double wall, cpu;
+};
+
+Times now() {
+  Times t;
+  t.wall = std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+  t.cpu = double(std::clock()) / CLOCKS_PER_SEC;
+  return t;
+}
+
+// the iteration being measured; phase kTelemetryPhases is the time
+// outside of all phases
+bool active = false;
+int currentPhase = kTelemetryPhases;
+Times start, mark, phases[kTelemetryPhases + 1];
+unsigned long long counters[kTelemetryCounters];
+std::atomic<unsigned long long> workerLookups(0);
+bool fileStarted = false;
+
+// charges the time since the last call to the current phase
+void advance() {
+  const Times t = now();
+  phases[currentPhase].wall += t.wall - mark.wall;
+  phases[currentPhase].cpu += t.cpu - mark.cpu;
+  mark = t;
+}
+
+void writeTimes(ostream& out, const Times& t) {
+  out << "{\"wall_seconds\":" << t.wall << ",\"cpu_seconds\":" << t.cpu << '}';
+}
+
+} // namespace
+
+IterationTelemetry::IterationTelemetry(const string& stage, int it)
+    : stage_(stage), iteration_(it), finished_(false) {
+  if (!Telemetry)
+    return;
+  active = true;
+  currentPhase = kTelemetryPhases;
+  for (int i = 0; i <= kTelemetryPhases; ++i)
+    phases[i].wall = phases[i].cpu = 0;
+  for (int i = 0; i < kTelemetryCounters; ++i)
+    counters[i] = 0;
+  g_ttable_lookups = 0;
+  workerLookups = 0;
+  start = mark = now();
+}
+
+IterationTelemetry::~IterationTelemetry() {
+  if (!finished_)
+    active = false;
+}
+
+void IterationTelemetry::table(const char* name, size_t bytes) {
+  tables_.push_back(make_pair(name, bytes));
+}
+
+void IterationTelemetry::finish() {
+  finished_ = true;
+  if (!active)
+    return;
+  advance();
+  active = false;
+  const Times total = { mark.wall - start.wall, mark.cpu - start.cpu };
+  const double readSeconds = phases[kTelemetryCorpusIO].wall + phases[kTelemetryEStep].wall;
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+
+  const string filename = g_prefix + ".telemetry";
+  ofstream out(filename.c_str(), (fileStarted || ResumeTraining) ? ios::app : ios::trunc);
+  fileStarted = true;
+  out << "{\"stage\":\"" << stage_ << "\",\"iteration\":" << iteration_ << ",\"total\":";
+  writeTimes(out, total);
+  for (int i = 0; i <= kTelemetryPhases; ++i) {
+    out << ",\"" << kPhaseNames[i] << "\":";
+    writeTimes(out, phases[i]);
+  }
+  out << ",\"pairs\":" << counters[kTelemetryPairs]
+      << ",\"tokens\":" << counters[kTelemetryTokens]
+      << ",\"pairs_per_second\":" << (readSeconds > 0 ? double(counters[kTelemetryPairs]) / readSeconds : 0.0)
+      << ",\"tokens_per_second\":" << (readSeconds > 0 ? double(counters[kTelemetryTokens]) / readSeconds : 0.0)
+      << ",\"ttable_lookups\":" << (g_ttable_lookups + workerLookups)
+      << ",\"hill_climbing_steps\":" << counters[kTelemetryHillClimbingSteps]
+      << ",\"neighbourhood_alignments\":" << counters[kTelemetryNeighbourhood]
+      << ",\"peak_rss_bytes\":" << (unsigned long long)(usage.ru_maxrss) * 1024
+      << ",\"table_bytes\":{";
+  for (size_t i = 0; i < tables_.size(); ++i)
+    out << (i ? "," : "") << '"' << tables_[i].first << "\":" << tables_[i].second;
+  out << "}}\n";
+  if (!out)
+    cerr << "WARNING: can not write " << filename << '\n';
+}
+
+TelemetryPhaseTimer::TelemetryPhaseTimer(TelemetryPhase phase)
+    : previous_(-1) {
+  if (!active)
+    return;
+  advance();
+  previous_ = currentPhase;
+  currentPhase = phase;
+}
+
+void TelemetryPhaseTimer::stop() {
+  if (previous_ < 0)
+    return;
+  if (active) {
+    advance();
+    currentPhase = previous_;
+  }
+  previous_ = -1;
+}
+
+void telemetryCount(TelemetryCounter counter, unsigned long long n) {
+  if (active)
+    counters[counter] += n;
+}
+
+void telemetryFlushThread() {
+  workerLookups += g_ttable_lookups;
+  g_ttable_lookups = 0;
+}
@@ -0,0 +1,109 @@
+/*
+  This file is part of GIZA++.
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307,
+  USA.
+*/
+
+#ifndef GIZAPP_TELEMETRY_H_
+#define GIZAPP_TELEMETRY_H_
+
+#include <cstddef>
+#include <string>
+#include <utility>
+#include <vector>
+
+/*
+  With -telemetry 1 every training iteration appends one JSON object
+  (one line) to prefix.telemetry: wall and CPU seconds of the iteration
+  and of its phases, the sentence pairs and tokens read, the t table
+  lookups, the Model 3/4/5 hill climbing and neighbourhood counts, the
+  peak resident set size and the bytes of the tables and of the corpus
+  in memory (see memory_usage.h).
+
+  The phases are measured on the main thread and do not overlap: the
+  corpus I/O during the E-step counts as corpus I/O only. The CPU time
+  of a phase includes the threads it runs. Alignment files are written
+  during the E-step and count there.
+*/
+
+enum TelemetryPhase {
+  kTelemetryCorpusIO,
+  kTelemetryEStep,
+  kTelemetryNormalize,
+  kTelemetryDump,
+  kTelemetryPhases
+};
+
+enum TelemetryCounter {
+  kTelemetryPairs,
+  kTelemetryTokens,
+  kTelemetryHillClimbingSteps,
+  kTelemetryNeighbourhood,
+  kTelemetryCounters
+};
+
+// -telemetry
+extern bool Telemetry;
+
+// t table lookups of this thread; see telemetryFlushThread()
+extern thread_local unsigned long long g_ttable_lookups;
+
+// counts a t table lookup; a test of a flag set once without -telemetry
+inline void countTTableLookup() {
+  if (Telemetry)
+    ++g_ttable_lookups;
+}
+
+// The iteration being measured, from construction to finish(). Does
+// nothing without -telemetry.
+class IterationTelemetry {
+ public:
+  IterationTelemetry(const std::string& stage, int it);
+  ~IterationTelemetry();
+
+  // records the size of a table
+  void table(const char* name, size_t bytes);
+
+  // writes the record
+  void finish();
+
+ private:
+  std::string stage_;
+  int iteration_;
+  std::vector<std::pair<const char*, size_t> > tables_;
+  bool finished_;
+};
+
+// Attributes the time from construction to destruction to 'phase'
+// instead of the enclosing phase.
+class TelemetryPhaseTimer {
+ public:
+  explicit TelemetryPhaseTimer(TelemetryPhase phase);
+  ~TelemetryPhaseTimer() { stop(); }
+
+  // ends the phase before the destruction
+  void stop();
+
+ private:
+  int previous_;
+};
+
+void telemetryCount(TelemetryCounter counter, unsigned long long n);
+
+// adds the t table lookups of a worker thread before it ends
+void telemetryFlushThread();
+
+#endif  // GIZAPP_TELEMETRY_H_
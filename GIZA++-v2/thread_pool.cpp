@@ -0,0 +1,79 @@
+/*
+  This file is part of GIZA++.
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307,
+  USA.
+*/
+
+#include "thread_pool.h"
+
+ThreadPool::ThreadPool() : stopping_(false) {}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  wake_.notify_all();
+  for (size_t t = 0; t < threads_.size(); ++t)
+    threads_[t].join();
+}
+
+void ThreadPool::run(int nThreads, const std::function<void()>& worker) {
+  int running = 0;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    while (int(threads_.size()) < nThreads - 1)
+      threads_.push_back(std::thread(&ThreadPool::work, this));
+    for (int t = 1; t < nThreads; ++t) {
+      Task task = { &worker, &running };
+      tasks_.push_back(task);
+      ++running;
+    }
+  }
+  wake_.notify_all();
+  worker();
+  std::unique_lock<std::mutex> lock(mutex_);
+  // the items are all taken when a worker returns
+  for (std::deque<Task>::iterator i = tasks_.begin(); i != tasks_.end();)
+    if (i->running == &running) {
+      i = tasks_.erase(i);
+      --running;
+    } else {
+      ++i;
+    }
+  done_.wait(lock, [&running] { return running == 0; });
+}
+
+void ThreadPool::work() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  for (;;) {
+    wake_.wait(lock, [this] { return stopping_ || !tasks_.empty(); });
+    if (tasks_.empty())
+      return;
+    const Task task = tasks_.front();
+    tasks_.pop_front();
+    lock.unlock();
+    (*task.worker)();
+    lock.lock();
+    if (--*task.running == 0)
+      done_.notify_all();
+  }
+}
+
+ThreadPool& sharedThreadPool() {
+  static ThreadPool pool;
+  return pool;
+}
@@ -0,0 +1,67 @@
+/*
+  This file is part of GIZA++.
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307,
+  USA.
+*/
+
+#ifndef GIZAPP_THREAD_POOL_H_
+#define GIZAPP_THREAD_POOL_H_
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+  Threads that stay for the parallel loops of the training. A loop runs
+  the same worker function on several threads, and the workers share
+  out its items (see sentence_scheduler.h); run() returns when all
+  workers have returned. The calling thread is one of the workers, so a loop
+  makes progress even while other loops keep the pool busy: trainings
+  that run at the same time (giza::BidirectionalTraining) share the
+  threads of sharedThreadPool().
+*/
+class ThreadPool {
+ public:
+  ThreadPool();
+  ~ThreadPool();
+
+  // runs 'worker' on nThreads threads, the calling one and nThreads-1
+  // of the pool (which grows to that size); workers the pool has not
+  // started when the calling one returns are not run
+  void run(int nThreads, const std::function<void()>& worker);
+
+ private:
+  struct Task {
+    const std::function<void()>* worker;
+    int* running;  // the tasks of the loop not yet done
+  };
+
+  void work();
+
+  std::mutex mutex_;
+  std::condition_variable wake_, done_;
+  std::deque<Task> tasks_;
+  std::vector<std::thread> threads_;
+  bool stopping_;
+};
+
+// the pool of all training loops of the process
+ThreadPool& sharedThreadPool();
+
+#endif  // GIZAPP_THREAD_POOL_H_
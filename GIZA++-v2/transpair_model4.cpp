@@ -24,16 +24,23 @@
 
 GLOBAL_PARAMETER(float,d4modelsmooth_factor,"model4SmoothFactor","smooting parameter for alignment probabilities in Model 4",kParLevSmooth,0.2);
 
+namespace {
+
+// the score of a change that makes an alignment of probability zero possible
+const LogProb kScoreFromZeroProb = 1e20;
+
+} // namespace
+
 LogProb transpair_model4::_scoreOfMove(const Alignment&a, WordIndex new_i, WordIndex j,double) const
 {
   LogProb a_prob=prob_of_target_and_alignment_given_source(a);
   Alignment b(a);
   b.set(j, new_i);
   LogProb b_prob=prob_of_target_and_alignment_given_source(b);
-  if (a_prob)
+  if (a_prob>0)
     return b_prob/a_prob;
-  else if (b_prob)
-    return 1e20;
+  else if (b_prob>0)
+    return kScoreFromZeroProb;
   else
     return 1.0;
 }
@@ -44,56 +51,79 @@ LogProb transpair_model4::_scoreOfSwap(const Alignment&a, WordIndex j1, WordInde
   b.set(j1, a(j2));
   b.set(j2, a(j1));
   LogProb b_prob=prob_of_target_and_alignment_given_source(b);
-  if (a_prob)
+  if (a_prob>0)
     return b_prob/a_prob;
-  else if (b_prob)
-    return 1e20;
+  else if (b_prob>0)
+    return kScoreFromZeroProb;
   else
     return 1.0;
 }
-//increasing efficiency: no copy of alignment (calc. everything incrementally)
-LogProb transpair_model4::scoreOfMove(const Alignment&a, WordIndex new_i, WordIndex j,double thisValue) const
+LogProb transpair_model4::distortionOfCepts(const Alignment&al,const PositionIndex*cepts,int n) const
+{
+  LogProb total=1.0;
+  for (int k=0;k<n;++k)
+  {
+    const PositionIndex i=cepts[k];
+    if (i==0||i>l||al.fert(i)==0||find(cepts,cepts+k,i)!=cepts+k)
+      continue;
+    PositionIndex j=al.get_head(i);
+    int ep=al.prev_cept(i);
+    float x2=probFirst(ep,j,al.get_center(ep));
+    total*=x2;
+    for (j=al.als_j[j].next;j;j=al.als_j[j].next)
+    {
+      x2=probSecond(j,al.prev_in_cept(j));
+      total*=x2;
+    }
+  }
+  return total;
+}
+
+// The distortion of a cept depends on its own tablet and on the center of the
+// previous non-empty cept, so a move or swap only changes the terms of the
+// cepts it touches and of the cepts following them. If these terms underflow
+// for a, the whole alignments are scored.
+LogProb transpair_model4::scoreOfMove(const Alignment&a, WordIndex new_i, WordIndex j,double) const
 {
   if (a(j)==new_i)
     return 1.0;
   LogProb change=transpair_model3::scoreOfMove(a,new_i,j,-1.0,0);
-  LogProb a_prob=thisValue;
-  if (a_prob<0.0)
-    a_prob=prob_of_target_and_alignment_given_source(a,2);
-  MASSERT(a_prob==prob_of_target_and_alignment_given_source(a,2));
   WordIndex old_i=a(j);
+  PositionIndex cepts[6]={old_i,new_i,a.next_cept(old_i),a.next_cept(new_i),0,0};
   //Alignment b(a);
   const_cast<Alignment&>(a).set(j,new_i);
-  LogProb b_prob=prob_of_target_and_alignment_given_source(a,2);
+  cepts[4]=a.next_cept(old_i);
+  cepts[5]=a.next_cept(new_i);
+  LogProb b_prob=distortionOfCepts(a,cepts,6);
   const_cast<Alignment&>(a).set(j,old_i);
-  change*=b_prob/a_prob;
-  return change;
+  LogProb a_prob=distortionOfCepts(a,cepts,6);
+  if (!(a_prob>0))
+    return _scoreOfMove(a,new_i,j);
+  return change*b_prob/a_prob;
 }
-//increasing efficiency: no copy of alignment (calc. everything incrementally)
-LogProb transpair_model4::scoreOfSwap(const Alignment&a, WordIndex j1, WordIndex j2,double thisValue) const
+
+LogProb transpair_model4::scoreOfSwap(const Alignment&a, WordIndex j1, WordIndex j2,double) const
 {
   WordIndex aj1=a(j1),aj2=a(j2);
   if (aj1==aj2)
     return 1.0;
   LogProb change=transpair_model3::scoreOfSwap(a,j1,j2,-1.0,0);
-  LogProb a_prob=thisValue;
-  if (a_prob<0.0)
-    a_prob=prob_of_target_and_alignment_given_source(a,2);
-  MASSERT(a_prob==prob_of_target_and_alignment_given_source(a,2));
+  // fertilities do not change, so neither do the following cepts
+  const PositionIndex cepts[4]={aj1,aj2,a.next_cept(aj1),a.next_cept(aj2)};
+  LogProb a_prob=distortionOfCepts(a,cepts,4);
 
   //Alignment b(a);
   const_cast<Alignment&>(a).set(j1,aj2);
   const_cast<Alignment&>(a).set(j2,aj1);
-  LogProb b_prob=prob_of_target_and_alignment_given_source(a,2);
+  LogProb b_prob=distortionOfCepts(a,cepts,4);
   const_cast<Alignment&>(a).set(j1,aj1);
   const_cast<Alignment&>(a).set(j2,aj2);
 
   if (verboseTP)
     cerr << "scoreOfSwap: " << change << ' ' << a_prob << ' ' << b_prob << ' ' << endl;
-  change*=b_prob/a_prob;
-  if (verboseTP)
-    cerr << "resulting: " << change << " should be " << _scoreOfSwap(a,j1,j2) << endl;
-  return change;
+  if (!(a_prob>0))
+    return _scoreOfSwap(a,j1,j2);
+  return change*b_prob/a_prob;
 }
 
 LogProb transpair_model4::prob_of_target_and_alignment_given_source_1(const Alignment&al,bool verb) const
@@ -132,7 +162,7 @@ LogProb transpair_model4::prob_of_target_and_alignment_given_source(const Alignm
         if (al.get_head(al(j))==j)
         {
           int ep=al.prev_cept(al(j));
-          float x2=probFirst[ep](j,al.get_center(ep));
+          float x2=probFirst(ep,j,al.get_center(ep));
           MASSERT(x2<=1.0);
           total*=x2;
           if (verb) cerr << "IBM-4: d=1 of " << j << ": " << x2  << " -> " << total << endl;
@@ -163,7 +193,7 @@ void transpair_model4::computeScores(const Alignment&al,vector<double>&d) const
       if (al.get_head(al(j))==j)
       {
         int ep=al.prev_cept(al(j));
-        float x2=probFirst[ep](j,al.get_center(ep));
+        float x2=probFirst(ep,j,al.get_center(ep));
         total4*=x2;
       }
       else
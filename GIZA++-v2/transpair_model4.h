@@ -38,38 +38,37 @@ class transpair_model4 : public transpair_model3
 {
  private:
   d4model&d4m;
-  Array2<double> probSecond;
-  Vector<Array2<double> > probFirst;
+  // d4m table numbers for the non-head jumps of each j and the head jumps
+  // of each (i,j), looked up once per sentence pair; the probabilities are
+  // computed when needed instead of tabulating all (l+1)*(m+1)*(m+1)
+  Vector<int> secondTables;
+  Vector<int> firstTables;
+  PROB probFirst(PositionIndex i, PositionIndex j, PositionIndex center) const
+  { return d4m.getProb_first_withiterator(j,center,m,firstTables[i*(m+1)+j]); }
+  PROB probSecond(PositionIndex j, PositionIndex prev) const
+  { return d4m.getProb_bigger_withiterator(j,prev,m,secondTables[j]); }
+  // distortion terms of the non-empty cepts among cepts[0..n-1] (once each)
+  LogProb distortionOfCepts(const Alignment&al,const PositionIndex*cepts,int n) const;
  public:
   typedef transpair_model3 simpler_transpair_model;
   transpair_model4(const Vector<WordIndex>&es, const Vector<WordIndex>&fs, TModel<COUNT, PROB>&tTable, AModel<PROB>&aTable, AModel<PROB>&dTable, nmodel<PROB>&nTable, double _p1, double _p0,d4model*_d4m)
       : transpair_model3(es, fs, tTable, aTable, dTable, nTable, _p1, _p0),
-        d4m(*_d4m),probSecond(m+1,m+1,0.0),probFirst(l+1)
+        d4m(*_d4m),secondTables(m+1,-1),firstTables((l+1)*(m+1),-1)
   {
-    for (unsigned int j1=1;j1<=m;++j1)
-      for (unsigned int j2=1;j2<j1;++j2)
-      {
-        probSecond(j1,j2)=d4m.getProb_bigger(j1,j2,0,d4m.fwordclasses.getClass(get_fs(j1)),l,m);
-      }
-    for (unsigned int i=0;i<=l;++i)
+    for (unsigned int j=1;j<=m;++j)
     {
-      Array2<double> &pf=probFirst[i]=Array2<double>(m+1,m+1,0.0);
-      for (unsigned int j1=1;j1<=m;++j1)
-      {
-        map<m4_key,d4model::Vpff,compare1 >::const_iterator ci=d4m.getProb_first_iterator(d4m.ewordclasses.getClass(get_es(i)),d4m.fwordclasses.getClass(get_fs(j1)),l,m);
-        for (unsigned int j2=0;j2<=m;++j2)
-        {
-          pf(j1,j2)=d4m.getProb_first_withiterator(j1,j2,m,ci);
-          MASSERT(pf(j1,j2)==d4m.getProb_first(j1,j2,d4m.ewordclasses.getClass(get_es(i)),d4m.fwordclasses.getClass(get_fs(j1)),l,m));
-        }
-      }
+      const int F=d4m.fwordclasses.getClass(get_fs(j));
+      secondTables[j]=d4m.getProb_bigger_iterator(0,F,l,m);
+      for (unsigned int i=0;i<=l;++i)
+        firstTables[i*(m+1)+j]=d4m.getProb_first_iterator(d4m.ewordclasses.getClass(get_es(i)),F,l,m);
     }
   }
   LogProb prob_of_target_and_alignment_given_source_1(const Alignment&al,bool verb) const;
-  LogProb scoreOfAlignmentForChange(const Alignment&a) const
-  { return prob_of_target_and_alignment_given_source(a,2); }
-  LogProb scoreOfMove(const Alignment&a, WordIndex new_i, WordIndex j,double thisValue=-1.0) const;
-  LogProb scoreOfSwap(const Alignment&a, WordIndex j1, WordIndex j2,double thisValue=-1.0) const;
+  // scoreOfMove and scoreOfSwap compare the distortion of the changed cepts
+  // only and do not need the probability of the whole alignment
+  LogProb scoreOfAlignmentForChange(const Alignment&) const { return -1.0; }
+  LogProb scoreOfMove(const Alignment&a, WordIndex new_i, WordIndex j,double=-1.0) const;
+  LogProb scoreOfSwap(const Alignment&a, WordIndex j1, WordIndex j2,double=-1.0) const;
   LogProb _scoreOfMove(const Alignment&a, WordIndex new_i, WordIndex j,double thisValue=-1.0) const;
   LogProb _scoreOfSwap(const Alignment&a, WordIndex j1, WordIndex j2,double thisValue=-1.0) const;
   int modelnr() const { return 4; }
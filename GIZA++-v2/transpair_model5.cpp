@@ -24,6 +24,8 @@
 
 int m5scorefound=0,m5scorenotfound=0;
 
+static const LogProb almostZero = 1E-299;
+
 GLOBAL_PARAMETER(float,d5modelsmooth_factor,"model5SmoothFactor","smooting parameter for distortion probabilities in Model 5 (linear interpolation with constant)",kParLevSmooth,0.1);
 float d5modelsmooth_countoffset=0.0;
 
@@ -99,7 +101,7 @@ LogProb transpair_model5::scoreOfMove(const Alignment&a, WordIndex new_i, WordIn
     a_prob=prob_of_target_and_alignment_given_source(a,2);
   MASSERT(a_prob==prob_of_target_and_alignment_given_source(a,2));
 
-  LogProb b_prob=prob_of_target_and_alignment_given_source(b,2);
+  LogProb b_prob=distortionOfNeighbour(a,b,firstChangedCept(old_i,new_i));
   change*=b_prob/a_prob;
   return change;
 }
@@ -115,18 +117,90 @@ LogProb transpair_model5::scoreOfSwap(const Alignment&a, WordIndex j1, WordIndex
   if (a_prob<0.0)
     a_prob=prob_of_target_and_alignment_given_source(a,2);
   MASSERT(a_prob==prob_of_target_and_alignment_given_source(a,2));
-  LogProb b_prob=prob_of_target_and_alignment_given_source(b,2);
+  LogProb b_prob=distortionOfNeighbour(a,b,firstChangedCept(a(j1),a(j2)));
   change*=b_prob/a_prob;
   return change;
 }
 
+LogProb transpair_model5::scoreOfAlignmentForChange(const Alignment&a) const
+{
+  if (doModel4Scoring)
+    return transpair_model4::scoreOfAlignmentForChange(a);
+  prefixOf.assign(a);
+  hasPrefix=1;
+  LogProb total=distortion(a,1,1.0,1,0);
+  return total?total:almostZero;
+}
+
+LogProb transpair_model5::distortionOfNeighbour(const Alignment&a,const Alignment&b,PositionIndex from) const
+{
+  if (!hasPrefix||!(prefixOf==a))
+    return prob_of_target_and_alignment_given_source(b,2);
+  LogProb total=distortion(b,from,prefix[from],0,0);
+  return total?total:almostZero;
+}
+
+LogProb transpair_model5::distortion(const Alignment&al,PositionIndex from,LogProb total,bool keepPrefix,bool verb) const
+{
+  double x2;
+  PositionIndex prev_cept=0;
+  PositionIndex vac_all=m;
+  Vacancies vac(m);
+  for (WordIndex i=1;i<from;i++)
+    if (al.fert(i))
+    {
+      for (PositionIndex j=al.als_i[i];j;j=al.als_j[j].next)
+      {
+        vac.fill(j);
+        vac_all--;
+      }
+      prev_cept=i;
+    }
+  for (WordIndex i=from;i<=l;i++)
+  {
+    if (keepPrefix)
+      prefix[i]=total;
+    PositionIndex cur_j=al.als_i[i];
+    PositionIndex prev_j=0;
+    PositionIndex k=0;
+    if (cur_j) { // process first word of cept
+      k++;
+      // previous position
+      total*= (x2=d5m.getProb_first(vac(cur_j),vac(al.get_center(prev_cept)),d5m.fwordclasses.getClass(get_fs(cur_j)),l,m,vac_all-al.fert(i)+k));
+
+      vac_all--;
+      vac.fill(cur_j);
+
+      if (verb) cerr << "IBM-5: d=1 of " << cur_j << ": " << x2  << " -> " << total << endl;
+      prev_j=cur_j;
+      cur_j=al.als_j[cur_j].next;
+    }
+    while (cur_j) { // process following words of cept
+      k++;
+      // previous position
+      int vprev=vac(prev_j);
+      total*= (x2=d5m.getProb_bigger(vac(cur_j),vprev,d5m.fwordclasses.getClass(get_fs(cur_j)),l,m,vac_all-vprev/*war weg*/-al.fert(i)+k));
+
+      vac_all--;
+      vac.fill(cur_j);
+
+      if (verb) cerr << "IBM-5: d>1 of " << cur_j << ": " << x2  << " -> " << total << endl;
+      prev_j=cur_j;
+      cur_j=al.als_j[cur_j].next;
+    }
+    assert(k==al.fert(i));
+    if (k)
+      prev_cept=i;
+  }
+  assert(vac_all==al.fert(0));
+  return total;
+}
+
 LogProb transpair_model5::prob_of_target_and_alignment_given_source(const Alignment&al, short distortionType,bool verb) const
 {
   if (doModel4Scoring)
     return transpair_model4::prob_of_target_and_alignment_given_source(al,distortionType);
   LogProb total = 1.0;
-  static const LogProb almostZero = 1E-299;
-  double x2;
   if (distortionType&1)
   {
     total *= pow(double(1-p1), m-2.0 * al.fert(0)) * pow(double(p1), double(al.fert(0)));
@@ -146,49 +220,7 @@ LogProb transpair_model5::prob_of_target_and_alignment_given_source(const Alignm
     }
   }
   if (distortionType&2)
-  {
-    PositionIndex prev_cept=0;
-    PositionIndex vac_all=m;
-    Vector<char> vac(m+1,0);
-    for (WordIndex i=1;i<=l;i++)
-    {
-      PositionIndex cur_j=al.als_i[i];
-      PositionIndex prev_j=0;
-      PositionIndex k=0;
-      if (cur_j) { // process first word of cept
-        k++;
-        // previous position
-        total*= (x2=d5m.getProb_first(vacancies(vac,cur_j),vacancies(vac,al.get_center(prev_cept)),d5m.fwordclasses.getClass(get_fs(cur_j)),l,m,vac_all-al.fert(i)+k));
-
-        vac_all--;
-        assert(vac[cur_j]==0);
-        vac[cur_j]=1;
-
-        if (verb) cerr << "IBM-5: d=1 of " << cur_j << ": " << x2  << " -> " << total << endl;
-        prev_j=cur_j;
-        cur_j=al.als_j[cur_j].next;
-      }
-      while (cur_j) { // process following words of cept
-        k++;
-        // previous position
-        int vprev=vacancies(vac,prev_j);
-        total*= (x2=d5m.getProb_bigger(vacancies(vac,cur_j),vprev,d5m.fwordclasses.getClass(get_fs(cur_j)),l,m,vac_all-vprev/*war weg*/-al.fert(i)+k));
-
-
-        vac_all--;
-        vac[cur_j]=1;
-
-
-        if (verb) cerr << "IBM-5: d>1 of " << cur_j << ": " << x2  << " -> " << total << endl;
-        prev_j=cur_j;
-        cur_j=al.als_j[cur_j].next;
-      }
-      assert(k==al.fert(i));
-      if (k)
-        prev_cept=i;
-    }
-    assert(vac_all==al.fert(0));
-  }
+    total=distortion(al,1,total,0,verb);
   total = total?total:almostZero;
   return total;
 }
@@ -204,37 +236,7 @@ void transpair_model5::computeScores(const Alignment&al,vector<double>&d) const
     total2 *= get_fertility(i, al.fert(i));
   for (WordIndex j = 1; j <= m; j++)
     total3*= get_t(al(j), j);
-  PositionIndex prev_cept=0;
-  PositionIndex vac_all=m;
-  Vector<char> vac(m+1,0);
-  for (WordIndex i=1;i<=l;i++)
-  {
-    PositionIndex cur_j=al.als_i[i];
-    PositionIndex prev_j=0;
-    PositionIndex k=0;
-    if (cur_j) { // process first word of cept
-      k++;
-      total4*=d5m.getProb_first(vacancies(vac,cur_j),vacancies(vac,al.get_center(prev_cept)),d5m.fwordclasses.getClass(get_fs(cur_j)),l,m,vac_all-al.fert(i)+k);
-      vac_all--;
-      assert(vac[cur_j]==0);
-      vac[cur_j]=1;
-      prev_j=cur_j;
-      cur_j=al.als_j[cur_j].next;
-    }
-    while (cur_j) { // process following words of cept
-      k++;
-      int vprev=vacancies(vac,prev_j);
-      total4*=d5m.getProb_bigger(vacancies(vac,cur_j),vprev,d5m.fwordclasses.getClass(get_fs(cur_j)),l,m,vac_all-vprev/*war weg*/-al.fert(i)+k);
-      vac_all--;
-      vac[cur_j]=1;
-      prev_j=cur_j;
-      cur_j=al.als_j[cur_j].next;
-    }
-    assert(k==al.fert(i));
-    if (k)
-      prev_cept=i;
-  }
-  assert(vac_all==al.fert(0));
+  total4=distortion(al,1,total4,0,0);
   d.push_back(total1);//13
   d.push_back(total2);//14
   d.push_back(total3);//15
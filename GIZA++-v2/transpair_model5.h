@@ -34,35 +34,66 @@
 
 extern double factorial(int n);
 
-inline int vacancies(const Vector<char>&vac,int u)
+// first cept whose Model 5 distortion probabilities change with cepts i1
+// and i2
+inline PositionIndex firstChangedCept(PositionIndex i1,PositionIndex i2)
 {
-  int n=0;
-  const char *i=&(vac[0])+1;
-  const char *end=&(vac[0])+u+1;
-  while (i<end)
-    n+= ((*i++)==0);
-  return n;
+  if (i1==0)
+    return i2?i2:1;
+  if (i2==0)
+    return i1;
+  return min(i1,i2);
 }
 
+// Vacant positions of a target sentence while an alignment fills them
+// cept by cept: a Fenwick tree over the filled positions, so filling a
+// position and counting the vacancies up to a position are O(log m).
+class Vacancies
+{
+ private:
+  Vector<int> filled;
+ public:
+  explicit Vacancies(int m) : filled(m+1,0) {}
+  void fill(int j)
+  {
+    for (;j<int(filled.size());j+=j&-j)
+      filled[j]++;
+  }
+  // vacant positions among 1..u
+  int operator()(int u) const
+  {
+    int n=u;
+    for (;u>0;u-=u&-u)
+      n-=filled[u];
+    return n;
+  }
+};
+
 class transpair_model5 : public transpair_model4
 {
  private:
   const d5model&d5m;
   bool doModel4Scoring;
+  // the distortion product of the cepts before each i of the alignment
+  // last scored for change; its moves and swaps only recompute the cepts
+  // from the first one they change on
+  mutable bool hasPrefix;
+  mutable Alignment prefixOf;
+  mutable Vector<LogProb> prefix;
+  // multiplies the distortion probabilities of the cepts from..l of al into total
+  LogProb distortion(const Alignment&al,PositionIndex from,LogProb total,bool keepPrefix,bool verb) const;
+  // distortion part of the score of b, an alignment differing from a in
+  // the cepts from and later only
+  LogProb distortionOfNeighbour(const Alignment&a,const Alignment&b,PositionIndex from) const;
  public:
   typedef transpair_model3 simpler_transpair_model;
   mutable map<Vector<PositionIndex>,LogProb> scores[4];
   transpair_model5(const Vector<WordIndex>&es, const Vector<WordIndex>&fs, TModel<COUNT, PROB>&tTable,
                    AModel<PROB>&aTable, AModel<PROB>&dTable, nmodel<PROB>&nTable, double _p1, double _p0,
                    const d5model*_d5m)
-      : transpair_model4(es, fs, tTable, aTable, dTable, nTable, _p1, _p0,&_d5m->d4m),d5m(*_d5m),doModel4Scoring(0) {}
-  LogProb scoreOfAlignmentForChange(const Alignment& a) const
-  {
-    if (doModel4Scoring)
-      return transpair_model4::prob_of_target_and_alignment_given_source(a,2);
-    else
-      return prob_of_target_and_alignment_given_source(a,2);
-  }
+      : transpair_model4(es, fs, tTable, aTable, dTable, nTable, _p1, _p0,&_d5m->d4m),d5m(*_d5m),doModel4Scoring(0),
+        hasPrefix(0),prefixOf(l,m),prefix(l+2) {}
+  LogProb scoreOfAlignmentForChange(const Alignment& a) const;
   LogProb scoreOfMove(const Alignment&a, WordIndex new_i, WordIndex j,double thisValue=-1.0) const;
   LogProb scoreOfSwap(const Alignment&a, WordIndex j1, WordIndex j2,double thisValue=-1.0) const;
   LogProb _scoreOfMove(const Alignment&a, WordIndex new_i, WordIndex j,double thisValue=-1.0) const;
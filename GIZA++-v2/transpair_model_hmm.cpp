@@ -8,9 +8,19 @@ TransPairModelHMM::TransPairModelHMM(const Vector<WordIndex>& es,
                                      const AModel<PROB>&,const nmodel<PROB>&,
                                      double, double, const HMM* h)
     : transpair_model2(es,fs,tTable,aTable),
-      network_(h->makeHMMNetwork(es,fs,0)) { }
+      network_(h->makeHMMNetwork(es,fs,0)),
+      pegged_viterbi_(0) { }
 
-TransPairModelHMM::~TransPairModelHMM() { delete network_; }
+TransPairModelHMM::~TransPairModelHMM() {
+  delete pegged_viterbi_;
+  delete network_;
+}
+
+const HMMPeggedViterbi& TransPairModelHMM::GetPeggedViterbi() const {
+  if (pegged_viterbi_ == 0)
+    pegged_viterbi_ = new HMMPeggedViterbi(*network_);
+  return *pegged_viterbi_;
+}
 
 LogProb TransPairModelHMM::scoreOfMove(const Alignment&a,
                                        WordIndex _new_i,
@@ -34,11 +34,13 @@
 #include "hmm.h"
 
 class HMMNetwork;
+class HMMPeggedViterbi;
 
 class TransPairModelHMM : public transpair_model2
 {
  private:
   HMMNetwork* network_;
+  mutable HMMPeggedViterbi* pegged_viterbi_;
 
  public:
   // TODO: make sure this.
@@ -55,6 +57,9 @@ class TransPairModelHMM : public transpair_model2
   const HMMNetwork* GetHMMNetwork() const { return network_; }
   HMMNetwork* mutable_HMMNetwork() { return network_; }
 
+  // Computed on first use; answers all pegged Viterbi queries of the pair.
+  const HMMPeggedViterbi& GetPeggedViterbi() const;
+
   int modelnr() const { return 6; }
 
   LogProb scoreOfMove(const Alignment&a, WordIndex _new_i, WordIndex j,double f=-1.0) const;
@@ -99,7 +99,58 @@ void TModel<COUNT, PROB>::normalizeTable(const VocabList&, const VocabList&, int
 }
 
 template <class COUNT, class PROB>
-void TModel<COUNT, PROB>::readProbTable(const char *) {
+void TModel<COUNT, PROB>::readProbTable(const char *filename) {
+  ifstream inf(filename);
+  cerr << "Reading t prob. table from " << filename << "\n";
+  if (!inf) {
+    cerr << "\nERROR: Cannot open " << filename << "\n";
+    return;
+  }
+  WordIndex src_id, trg_id;
+  PROB prob;
+  int nEntry=0,nSkipped=0;
+  while (inf >> src_id  >> trg_id  >> prob) {
+    CPPair *p=(src_id<lexmat.size()&&lexmat[src_id])?find(src_id,trg_id):0;
+    if (p) {
+      *p=CPPair(0.0,prob);
+      nEntry++;
+    } else {
+      nSkipped++;
+    }
+  }
+  cerr << "Read " << nEntry << " entries in prob. table.\n";
+  if (nSkipped)
+    cerr << "WARNING: skipped " << nSkipped << " entries that are not in the coocurrence file.\n";
+}
+
+template <class COUNT, class PROB>
+void TModel<COUNT, PROB>::writeBinary(util::BinaryWriter& out) const {
+  out.Put<uint64_t>(lexmat.size());
+  for (unsigned int i=0;i<lexmat.size();++i) {
+    out.Put<char>(lexmat[i]!=0);
+    if (lexmat[i])
+      out.PutArray(*lexmat[i]);
+  }
+}
+
+template <class COUNT, class PROB>
+bool TModel<COUNT, PROB>::readBinary(util::BinaryReader& in) {
+  uint64_t n=0;
+  in.Get(n);
+  if (!in.IsOK()||n>(uint64_t(1)<<32))
+    return false;
+  for (unsigned int i=0;i<lexmat.size();++i)
+    delete lexmat[i];
+  lexmat.assign(n,0);
+  for (unsigned int i=0;i<n&&in.IsOK();++i) {
+    char used=0;
+    in.Get(used);
+    if (used) {
+      lexmat[i]=new vector<pair<unsigned int,CPPair> >;
+      in.GetArray(*lexmat[i]);
+    }
+  }
+  return in.IsOK();
 }
 
 template class TModel<COUNT,PROB>;
@@ -309,6 +360,31 @@ void TModel<COUNT, PROB>::readProbTable(const char *filename) {
   cerr << "Read " << nEntry << " entries in prob. table.\n";
 }
 
+template <class COUNT, class PROB>
+void TModel<COUNT, PROB>::writeBinary(util::BinaryWriter& out) const {
+  out.Put<uint64_t>(ef.size());
+  typename hash_map<WordIDPair, CPPair, HashPair, equal_to<WordIDPair> >::const_iterator i;
+  for (i = ef.begin(); i != ef.end(); ++i) {
+    out.Put(i->first);
+    out.Put(i->second);
+  }
+}
+
+template <class COUNT, class PROB>
+bool TModel<COUNT, PROB>::readBinary(util::BinaryReader& in) {
+  uint64_t n=0;
+  in.Get(n);
+  ef.clear();
+  WordIDPair key;
+  CPPair value;
+  for (uint64_t i=0;i<n&&in.IsOK();++i) {
+    in.Get(key);
+    in.Get(value);
+    ef[key]=value;
+  }
+  return in.IsOK();
+}
+
 template class TModel<COUNT,PROB>;
 
 /* ---------------- End of Method Definitions of class TModel ---------------*/
@@ -48,6 +48,8 @@
 #include <fstream>
 
 #include "globals.h"
+#include "util/binary_file.h"
+#include "telemetry.h"
 
 
 /* The tables defined in the following classes are defined as hash tables. For
@@ -148,6 +150,9 @@ class TModel {
   };
   CPPair*find(int e,int f)
   {
+    countTTableLookup();
+    if (e>=int(lexmat.size())||!lexmat[e])
+      return 0;
     //pair<unsigned int,CPPair> *be=&(fs[0])+es[e];
     //pair<unsigned int,CPPair> *en=&(fs[0])+es[e+1];
     pair<unsigned int,CPPair> *be=&(*lexmat[e])[0];
@@ -163,6 +168,9 @@ class TModel {
   }
   const CPPair*find(int e,int f) const
   {
+    countTTableLookup();
+    if (e>=int(lexmat.size())||!lexmat[e])
+      return 0;
     const pair<unsigned int,CPPair> *be=&(*lexmat[e])[0];
     const pair<unsigned int,CPPair> *en=&(*lexmat[e])[0]+(*lexmat[e]).size();
     //const pair<unsigned int,CPPair> *be=&(fs[0])+es[e];
@@ -183,6 +191,9 @@ class TModel {
   }
   CPPair*getPtr(int e,int f) { return find(e,f); }
 
+  // an empty table, for readBinary
+  TModel() {}
+
   TModel(const string& fn) {
     int count=0,count2=0;
     ifstream infile2(fn.c_str());
@@ -218,7 +229,21 @@ class TModel {
     cout << "There are " << count << " " << count2 << " entries in table" << '\n';
   }
 
-  ~TModel() {}
+  // the entries of the word pairs in memory: cooc[e] are the target words
+  // that occur with source word e, in increasing order
+  explicit TModel(const vector<vector<WordIndex> >& cooc) : lexmat(cooc.size(),0) {
+    for (size_t e=0;e<cooc.size();++e)
+      if (cooc[e].size()) {
+        lexmat[e]=new vector<pair<unsigned int,CPPair> >(cooc[e].size());
+        for (size_t k=0;k<cooc[e].size();++k)
+          (*lexmat[e])[k].first=cooc[e][k];
+      }
+  }
+
+  ~TModel() {
+    for (size_t i=0;i<lexmat.size();++i)
+      delete lexmat[i];
+  }
 
   /*  TModel(const string&fn)
       {
@@ -304,7 +329,39 @@ class TModel {
   // Each line is of the format:  source_word_id target_word_id p(target_word|source_word)
   // This is the inverse operation of the printTable function.
   // NAS, 7/11/99
+  // Only pairs of the coocurrence file can be set; others are skipped.
   void readProbTable(const char *filename);
+
+  // the table in the binary format of the training checkpoints
+  void writeBinary(util::BinaryWriter& out) const;
+  bool readBinary(util::BinaryReader& in);
+
+  // bytes allocated by the table
+  size_t memoryBytes() const {
+    size_t bytes=lexmat.capacity()*sizeof(lexmat[0]);
+    for (size_t i=0;i<lexmat.size();++i)
+      if (lexmat[i])
+        bytes+=sizeof(*lexmat[i])+lexmat[i]->capacity()*sizeof(pair<unsigned int,CPPair>);
+    return bytes;
+  }
+
+  // removes the entries with a probability below 'threshold' (they get
+  // the smoothing probability); returns the number of removed entries
+  size_t prune(PROB threshold) {
+    size_t removed=0;
+    for (size_t i=0;i<lexmat.size();++i)
+      if (lexmat[i]) {
+        vector<pair<unsigned int,CPPair> >&fs=*lexmat[i];
+        size_t n=0;
+        for (size_t k=0;k<fs.size();++k)
+          if (!(fs[k].second.prob<threshold))
+            fs[n++]=fs[k];
+        removed+=fs.size()-n;
+        fs.resize(n);
+        vector<pair<unsigned int,CPPair> >(fs).swap(fs);
+      }
+    return removed;
+  }
 };
 
 #else  // BINARY_SEARCH_FOR_TTABLE
@@ -316,6 +373,11 @@ class TModel {
   int noEnglishWords;  // total number of unique source words
   int noFrenchWords;   // total number of unique target words
   hash_map<WordIDPair, CPPair, HashPair, equal_to<WordIDPair> > ef;
+
+  TModel() {}
+  // the entries are added by the training; the coocurrences are not needed
+  explicit TModel(const vector<vector<WordIndex> >&) {}
+
   void erase(WordIndex e, WordIndex f)
   // In: a source and a target token ids.
   // removes the entry with that pair from table
@@ -346,6 +408,7 @@ class TModel {
 
   CPPair*getPtr(WordIndex e, WordIndex f)
   {
+    countTTableLookup();
     // look up this pair and return its position
     typename hash_map<WordIDPair, CPPair, HashPair, equal_to<WordIDPair> >::iterator i = ef.find(WordIDPair(e, f));
     if (i != ef.end())  // if it exists, return a pointer to it.
@@ -357,14 +420,17 @@ class TModel {
   // increments the count of the given word pair. if the pair does not exist,
   // it creates it with the given value.
   {
-    if (inc)
+    if (inc) {
+      countTTableLookup();
       ef[WordIDPair(e, f)].count += inc;
+    }
   }
 
   PROB getProb(WordIndex e, WordIndex f) const
       // read probability value for P(fj/ei) from the hash table
       // if pair does not exist, return floor value g_smooth_prob
   {
+    countTTableLookup();
     typename hash_map<WordIDPair, CPPair, HashPair, equal_to<WordIDPair> >::const_iterator i= ef.find(WordIDPair(e, f));
     if (i == ef.end())
       return g_smooth_prob;
@@ -375,6 +441,7 @@ class TModel {
   COUNT getCount(WordIndex e, WordIndex f) const
       /* read count value for entry pair (fj/ei) from the hash table */
   {
+    countTTableLookup();
     typename hash_map<WordIDPair, CPPair, HashPair, equal_to<WordIDPair> >::const_iterator i= ef.find(WordIDPair(e, f));
     if (i == ef.end())
       return 0;
@@ -406,6 +473,28 @@ class TModel {
 
   void readProbTable(const char *filename);
   //  void readAsFertilityTable(const char *filename);
+
+  // the table in the binary format of the training checkpoints
+  void writeBinary(util::BinaryWriter& out) const;
+  bool readBinary(util::BinaryReader& in);
+
+  // bytes allocated by the table, estimated for the nodes of the hash map
+  size_t memoryBytes() const {
+    return ef.size()*(sizeof(pair<WordIDPair,CPPair>)+2*sizeof(void*))+ef.bucket_count()*sizeof(void*);
+  }
+
+  // removes the entries with a probability below 'threshold'; returns
+  // their number
+  size_t prune(PROB threshold) {
+    size_t removed=0;
+    for (typename hash_map<WordIDPair, CPPair, HashPair, equal_to<WordIDPair> >::iterator i=ef.begin();i!=ef.end();)
+      if (i->second.prob<threshold) {
+        ef.erase(i++);
+        ++removed;
+      } else
+        ++i;
+    return removed;
+  }
 };
 /*--------------- End of Class Definition for TModel -----------------------*/
 
@@ -0,0 +1,100 @@
+/*
+  This file is part of GIZA++.
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307,
+  USA.
+*/
+
+#include "util/binary_file.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace util {
+
+BinaryWriter::BinaryWriter(const std::string& filename)
+    : file_(0), filename_(filename), tmp_filename_(filename + ".tmp"), ok_(true) {
+  file_ = std::fopen(tmp_filename_.c_str(), "wb");
+}
+
+BinaryWriter::~BinaryWriter() {
+  if (file_) {
+    std::fclose(file_);
+    std::remove(tmp_filename_.c_str());
+  }
+}
+
+void BinaryWriter::Write(const void* data, size_t n) {
+  if (file_ && ok_ && std::fwrite(data, 1, n, file_) != n)
+    ok_ = false;
+}
+
+bool BinaryWriter::Commit() {
+  if (!file_)
+    return false;
+  if (std::fflush(file_) != 0 || fsync(fileno(file_)) != 0)
+    ok_ = false;
+  if (std::fclose(file_) != 0)
+    ok_ = false;
+  file_ = 0;
+  if (ok_ && std::rename(tmp_filename_.c_str(), filename_.c_str()) != 0)
+    ok_ = false;
+  if (!ok_)
+    std::remove(tmp_filename_.c_str());
+  return ok_;
+}
+
+bool BinaryReader::Open(const std::string& filename) {
+  Close();
+  const int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0) {
+    close(fd);
+    return false;
+  }
+  void* p = mmap(0, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED)
+    return false;
+  data_ = static_cast<const char*>(p);
+  size_ = size_t(st.st_size);
+  pos_ = 0;
+  ok_ = true;
+  return true;
+}
+
+void BinaryReader::Close() {
+  if (data_)
+    munmap(const_cast<char*>(data_), size_);
+  data_ = 0;
+  size_ = pos_ = 0;
+  ok_ = false;
+}
+
+const char* BinaryReader::Take(size_t n) {
+  if (!ok_ || n > size_ - pos_) {
+    ok_ = false;
+    return 0;
+  }
+  const char* p = data_ + pos_;
+  pos_ += n;
+  return p;
+}
+
+} // namespace util
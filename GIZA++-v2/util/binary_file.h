@@ -0,0 +1,155 @@
+/*
+  This file is part of GIZA++.
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307,
+  USA.
+*/
+
+/*
+  Raw binary files for the training checkpoints. Values are written in the
+  byte order and layout of the machine, so a file can only be read back by
+  a binary built the same way. An array is its element count followed by
+  its elements.
+*/
+
+#ifndef GIZAPP_UTIL_BINARY_FILE_H_
+#define GIZAPP_UTIL_BINARY_FILE_H_
+
+#include <stdint.h>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+namespace util {
+
+// Writes to filename.tmp; Commit() renames it to filename, so an
+// interrupted write never replaces an older complete file.
+class BinaryWriter {
+ public:
+  explicit BinaryWriter(const std::string& filename);
+  ~BinaryWriter();
+
+  bool IsOK() const { return file_ != 0 && ok_; }
+
+  void Write(const void* data, size_t n);
+
+  template<class T>
+  void Put(const T& x) { Write(&x, sizeof(T)); }
+
+  template<class T>
+  void PutRange(const T* x, size_t n) {
+    Put<uint64_t>(n);
+    if (n)
+      Write(x, n * sizeof(T));
+  }
+
+  template<class V>
+  void PutArray(const V& v) {
+    PutRange(v.size() ? &v[0] : 0, v.size());
+  }
+
+  void PutString(const std::string& s) { PutRange(s.data(), s.size()); }
+
+  bool Commit();
+
+ private:
+  std::FILE* file_;
+  std::string filename_, tmp_filename_;
+  bool ok_;
+};
+
+// Maps a file written by BinaryWriter into memory and reads it front to
+// back. Reading past the end makes IsOK() false and yields zeros.
+class BinaryReader {
+ public:
+  BinaryReader() : data_(0), size_(0), pos_(0), ok_(false) {}
+  ~BinaryReader() { Close(); }
+
+  bool Open(const std::string& filename);
+  void Close();
+
+  bool IsOK() const { return ok_; }
+
+  // the next n bytes, 0 if there are fewer left
+  const char* Take(size_t n);
+
+  template<class T>
+  bool Get(T& x) {
+    const char* p = Take(sizeof(T));
+    if (p)
+      std::memcpy(static_cast<void*>(&x), p, sizeof(T));
+    return p != 0;
+  }
+
+  // an array written by PutRange of at most 'limit' elements
+  template<class T>
+  const T* GetRange(size_t& n, size_t limit = size_t(-1)) {
+    uint64_t count = 0;
+    Get(count);
+    if (count > limit || count > size_ / sizeof(T)) {
+      ok_ = false;
+      n = 0;
+      return 0;
+    }
+    n = size_t(count);
+    const char* p = Take(n * sizeof(T));
+    if (!p)
+      n = 0;
+    return reinterpret_cast<const T*>(p);
+  }
+
+  template<class T>
+  bool GetRangeInto(T* x, size_t n) {
+    size_t count;
+    const T* p = GetRange<T>(count, n);
+    if (count != n) {
+      ok_ = false;
+      return false;
+    }
+    if (n)
+      std::memcpy(static_cast<void*>(x), p, n * sizeof(T));
+    return ok_;
+  }
+
+  template<class V>
+  bool GetArray(V& v) {
+    size_t n;
+    const typename V::value_type* p = GetRange<typename V::value_type>(n);
+    v.resize(n);
+    if (n)
+      std::memcpy(static_cast<void*>(&v[0]), p, n * sizeof(typename V::value_type));
+    return ok_;
+  }
+
+  bool GetString(std::string& s) {
+    size_t n;
+    const char* p = GetRange<char>(n);
+    if (n)
+      s.assign(p, n);
+    else
+      s.clear();
+    return ok_;
+  }
+
+ private:
+  const char* data_;
+  size_t size_;
+  size_t pos_;
+  bool ok_;
+};
+
+} // namespace util
+
+#endif  // GIZAPP_UTIL_BINARY_FILE_H_
@@ -32,11 +32,13 @@
  */
 
 #include "util/perplexity.h"
+#include "util/binary_file.h"
 #include "globals.h"
 
 Perplexity::Perplexity()
     : sum_(0.0),
       wc_(0.0),
+      lambda_(g_lambda),
       E_M_L_(new Array2<double, Vector<double> >(MAX_SENTENCE_LENGTH,MAX_SENTENCE_LENGTH)) {
   Init();
 }
@@ -45,17 +47,32 @@ Perplexity::~Perplexity() { delete E_M_L_; }
 
 void Perplexity::Init() {
   unsigned int l, m;
-  Vector<double> fact(MAX_SENTENCE_LENGTH, 1.0);
-  for (m = 2; m < MAX_SENTENCE_LENGTH; m++)
-    fact[m] = fact[m-1] * m;
-  for (m = 1; m < MAX_SENTENCE_LENGTH; m++) {
-    for (l = 1; l < MAX_SENTENCE_LENGTH; l++) {
-      (*E_M_L_)(l, m) = std::log(
-          std::pow((g_lambda * l), double(m)) * std::exp(-g_lambda * double(l)) /
-          (fact[m]));
+  for (m = 1; m < E_M_L_->getLen2(); m++) {
+    for (l = 1; l < E_M_L_->getLen1(); l++) {
+      (*E_M_L_)(l, m) = LogPoisson(l, m);
     }
   }
   perp_.clear();
   ce_.clear();
   name_.clear();
 }
+
+void Perplexity::writeBinary(util::BinaryWriter& out) const {
+  out.Put<uint64_t>(model_id_.size());
+  for (size_t i = 0; i < model_id_.size(); ++i)
+    out.PutString(model_id_[i]);
+  out.PutArray(perp_);
+  out.PutArray(ce_);
+}
+
+bool Perplexity::readBinary(util::BinaryReader& in) {
+  uint64_t n = 0;
+  in.Get(n);
+  model_id_.clear();
+  for (uint64_t i = 0; i < n && in.IsOK(); ++i) {
+    std::string s;
+    in.GetString(s);
+    model_id_.push_back(s);
+  }
+  return in.GetArray(perp_) && in.GetArray(ce_);
+}
@@ -41,12 +41,18 @@
 #include "util/vector.h"
 #include "util/array2.h"
 
+namespace util {
+class BinaryWriter;
+class BinaryReader;
+} // namespace util
+
 const double kCrossEntropyBase = 2.0;
 
 class Perplexity {
  private:
   double sum_;
   double wc_;
+  double lambda_;
   Array2<double, Vector<double> > *E_M_L_;
   Vector<string> model_id_;
   Vector<double> perp_;
@@ -55,6 +61,11 @@ class Perplexity {
 
   void Init();
 
+  // log of the Poisson probability of m French words given l English ones
+  double LogPoisson(int l, int m) const {
+    return m * std::log(lambda_ * l) - lambda_ * l - std::lgamma(m + 1.0);
+  }
+
  public:
   Perplexity();
   ~Perplexity();
@@ -78,7 +89,14 @@ class Perplexity {
   void addFactor(const double p, const double count, const int l,
                  const int m, bool withPoisson) {
     wc_ += count * m; // number of french words
-    sum_ += count * ((withPoisson ? ((*E_M_L_)(l, m)) : 0.0) + p);
+    double poisson = 0.0;
+    if (withPoisson) {
+      if (unsigned(l) < E_M_L_->getLen1() && unsigned(m) < E_M_L_->getLen2())
+        poisson = (*E_M_L_)(l, m);
+      else
+        poisson = LogPoisson(l, m);
+    }
+    sum_ += count * (poisson + p);
   }
 
   void record(const std::string& model) {
@@ -87,6 +105,10 @@ class Perplexity {
     ce_.push_back(cross_entropy());
   }
 
+  // the recorded history in the binary format of the training checkpoints
+  void writeBinary(util::BinaryWriter& out) const;
+  bool readBinary(util::BinaryReader& in);
+
  private:
   friend void generatePerplexityReport(const Perplexity&, const Perplexity&,
                                        const Perplexity&, const Perplexity&,
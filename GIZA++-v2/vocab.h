@@ -69,6 +69,19 @@ class VocabList {
   inline const Vector<WordEntry>& getVocabList() const { return list; }
   void readVocabList();
 
+  // appends a word with the next id, after the empty word NULL with id
+  // 0; returns the id of the word
+  WordIndex addWord(const string& word) {
+    if (list.size()==0) {
+      list.push_back(WordEntry("NULL",0));
+      s2i["NULL"]=0;
+    }
+    list.push_back(WordEntry(word,0));
+    noUniqueTokens=WordIndex(list.size());
+    s2i[word]=int(noUniqueTokens)-1;
+    return noUniqueTokens-1;
+  }
+
   void incFreq(WordIndex id , double f) {
     if (id < list.size()) {
       if (list[id].freq < kEPS)